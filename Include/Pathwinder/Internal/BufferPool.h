@@ -12,24 +12,69 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
-
-#include <Infra/Core/Mutex.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 
 namespace Pathwinder
 {
+  /// Controls how many idle buffers a buffer pool retains once they are freed.
+  struct SBufferPoolPolicy
+  {
+    /// Whether or not idle buffers beyond those needed to satisfy recent demand are deallocated
+    /// automatically whenever buffers are freed to the pool.
+    bool trimIdleBuffers = true;
+
+    /// Amount of time over which the excess of the high-water mark of demand over the current
+    /// demand is halved. Idle buffers are retained up to the high-water mark, so this controls how
+    /// quickly the pool shrinks after a spike in demand.
+    std::chrono::milliseconds highWaterMarkHalfLife = std::chrono::milliseconds(1000);
+  };
+
+  /// Describes the behavior of a buffer pool since it was created.
+  struct SBufferPoolStatistics
+  {
+    /// Number of allocations satisfied by buffers that were already allocated.
+    uint64_t numHits;
+
+    /// Number of allocations that required new buffers to be allocated.
+    uint64_t numMisses;
+
+    /// Number of buffers currently allocated, whether in use or held by the pool.
+    unsigned int numBuffersCurrent;
+
+    /// Maximum number of buffers that were allocated at the same time.
+    unsigned int numBuffersPeak;
+  };
+
   /// Manages a pool of fixed-size dynamically-allocated buffers.
   /// Allocates as many as needed but only holds up to a specified number of buffers once they are
   /// returned. Objects of this class are intended to be long-lived, ideally right up until
   /// program termination. They do not deallocate free buffers in the pool on destruction, nor do
   /// they ever attempt to reclaim buffers that have been allocated but not yet freed.
+  /// Allocation and deallocation are lock-free. Each thread keeps a small magazine of buffers from
+  /// which it allocates and to which it frees, and only exchanges buffers with the shared pool in
+  /// batches when its magazine runs empty or full. A magazine holds buffers for one pool at a time,
+  /// and it returns them to that pool whenever its thread exits or switches to another pool with
+  /// identical template parameters, which are the only times a lock is acquired.
+  /// The shared pool is a pair of Treiber stacks of slot indices, one for slots holding buffers
+  /// and one for empty slots, each with a tag that is advanced on every modification to protect
+  /// against the ABA problem.
+  /// The pool tracks a high-water mark of demand for buffers, which decays over time toward the
+  /// current demand, and idle buffers beyond those needed to meet the high-water mark again are
+  /// deallocated. This way the number of buffers retained follows the workload rather than its
+  /// worst-case spike.
   /// @tparam kBytesPerBuffer Size of each buffer, in bytes.
   /// @tparam kAllocationGranularity Number of buffers to allocate initially and each time the
   /// pool is exhausted and more are needed.
-  /// @tparam kPoolSize Maximum number of buffers to hold in the pool. If more buffers are needed
-  /// beyond this number, then they will be deallocated when freed instead of returned to the
-  /// pool.
+  /// @tparam kPoolSize Maximum number of buffers to hold in the shared pool. If more buffers are
+  /// needed beyond this number and the number held in per-thread magazines, then they will be
+  /// deallocated when freed instead of returned to the pool.
   template <
       unsigned int kBytesPerBuffer,
       unsigned int kAllocationGranularity,
@@ -38,9 +83,49 @@ namespace Pathwinder
   {
   public:
 
-    inline BufferPool(void) : availableBuffers(), numAvailableBuffers(0), allocationMutex()
+    /// Maximum number of buffers held in each thread's magazine.
+    static constexpr unsigned int kMagazineCapacity = std::min(4u, kPoolSize);
+
+    /// Number of buffers exchanged between a magazine and the shared pool at a time.
+    static constexpr unsigned int kMagazineBatchSize = std::max(1u, (kMagazineCapacity / 2));
+
+    static_assert(kAllocationGranularity > 0, "Allocation granularity must be positive.");
+    static_assert(kPoolSize > 0, "Pool size must be positive.");
+
+    inline BufferPool(SBufferPoolPolicy policy = SBufferPoolPolicy())
+        : slots(),
+          filledSlotsHead(kEmptyStack),
+          emptySlotsHead(kEmptyStack),
+          policy(policy),
+          numBuffersIdle(0),
+          numBuffersCurrent(0),
+          numBuffersPeak(0),
+          numBuffersRetainedMinimum(0),
+          demandHighWaterMark(0),
+          numAllocations(0),
+          numMisses(0),
+          lastDecayTime(std::chrono::steady_clock::now().time_since_epoch().count()),
+          ownerLink(std::make_shared<SOwnerLink>(this))
+    {
+      for (unsigned int i = 0; i < kPoolSize; ++i)
+      {
+        slots[i].buffer = nullptr;
+        slots[i].next.store(((i + 1 < kPoolSize) ? (i + 1) : kNullIndex));
+      }
+      emptySlotsHead.store(PackHead(0, 0));
+
+      std::array<uint8_t*, kAllocationGranularity> initialBuffers;
+      for (unsigned int i = 0; i < kAllocationGranularity; ++i)
+        initialBuffers[i] = NewBuffer();
+      PushBuffersToSharedPool(initialBuffers.data(), kAllocationGranularity);
+    }
+
+    /// Detaches this pool from any per-thread magazines that still hold its buffers, which then
+    /// deallocate those buffers instead of returning them.
+    inline ~BufferPool(void)
     {
-      AllocateMoreBuffers();
+      std::scoped_lock lock(ownerLink->mutex);
+      ownerLink->pool = nullptr;
     }
 
     BufferPool(const BufferPool& other) = delete;
@@ -51,56 +136,505 @@ namespace Pathwinder
     /// @return Buffer that the caller can use.
     void* Allocate(void)
     {
-      std::scoped_lock lock(allocationMutex);
+      SMagazine& magazine = ThisThreadMagazine();
+      magazine.numPendingAllocations += 1;
 
-      if (0 == numAvailableBuffers) AllocateMoreBuffers();
+      if (0 == magazine.numBuffers)
+      {
+        PublishPendingAllocations(magazine);
+
+        magazine.numBuffers = PopBuffersFromSharedPool(magazine.buffers.data(), kMagazineBatchSize);
+        if (0 == magazine.numBuffers)
+        {
+          numMisses.fetch_add(1, std::memory_order_relaxed);
+          AllocateMoreBuffers(magazine);
+        }
 
-      numAvailableBuffers -= 1;
-      uint8_t* nextFreeBuffer = availableBuffers[numAvailableBuffers];
+        UpdateHighWaterMark();
+      }
 
-      return nextFreeBuffer;
+      magazine.numBuffers -= 1;
+      return magazine.buffers[magazine.numBuffers];
     }
 
     /// Deallocates a buffer once the caller is finished with it.
     /// @param [in] Previously-allocated buffer that the caller is returning.
     void Free(void* buffer)
     {
-      std::scoped_lock lock(allocationMutex);
+      SMagazine& magazine = ThisThreadMagazine();
 
-      if (numAvailableBuffers == kPoolSize)
+      if (kMagazineCapacity == magazine.numBuffers)
       {
-        delete[] buffer;
+        PublishPendingAllocations(magazine);
+
+        magazine.numBuffers -= kMagazineBatchSize;
+        PushBuffersToSharedPool(&magazine.buffers[magazine.numBuffers], kMagazineBatchSize);
+        if (true == policy.trimIdleBuffers) Trim();
       }
-      else
+
+      magazine.buffers[magazine.numBuffers] = reinterpret_cast<uint8_t*>(buffer);
+      magazine.numBuffers += 1;
+    }
+
+    /// Retrieves statistics that describe the behavior of this pool. Allocations counted by the
+    /// magazines of threads other than the calling thread are published in batches, so they might
+    /// not yet be reflected.
+    /// @return Statistics for this pool.
+    SBufferPoolStatistics GetStatistics(void)
+    {
+      PublishPendingAllocations(ThisThreadMagazine());
+
+      const uint64_t numMissesSnapshot = numMisses.load(std::memory_order_acquire);
+      const uint64_t numAllocationsSnapshot = numAllocations.load(std::memory_order_acquire);
+
+      return {
+          .numHits = ((numAllocationsSnapshot > numMissesSnapshot)
+                          ? (numAllocationsSnapshot - numMissesSnapshot)
+                          : 0),
+          .numMisses = numMissesSnapshot,
+          .numBuffersCurrent = numBuffersCurrent.load(std::memory_order_relaxed),
+          .numBuffersPeak = numBuffersPeak.load(std::memory_order_relaxed)};
+    }
+
+    /// Allocates buffers ahead of time so that the pool holds at least the specified number of
+    /// idle buffers, and ensures that trimming never reduces the pool below that number. Intended
+    /// for latency-sensitive deployments that would rather not allocate buffers on demand.
+    /// @param [in] numBuffers Number of buffers to hold, which is capped at the pool size.
+    void Prewarm(unsigned int numBuffers)
+    {
+      numBuffers = std::min(numBuffers, kPoolSize);
+      AtomicStoreMaximum(numBuffersRetainedMinimum, numBuffers);
+
+      for (unsigned int i = numBuffersIdle.load(std::memory_order_relaxed); i < numBuffers; ++i)
       {
-        availableBuffers[numAvailableBuffers] = reinterpret_cast<uint8_t*>(buffer);
-        numAvailableBuffers += 1;
+        uint8_t* const newBuffer = NewBuffer();
+        PushBuffersToSharedPool(&newBuffer, 1);
+      }
+    }
+
+    /// Decays the high-water mark of demand according to the time elapsed since it last decayed
+    /// and deallocates idle buffers beyond those needed to meet the high-water mark again. Invoked
+    /// whenever buffers are freed to the pool if the policy enables trimming, and can also be
+    /// invoked periodically, such as on a timer, to shrink pools that are no longer being used.
+    void Trim(void)
+    {
+      const unsigned int currentDemand = CurrentDemand();
+      DecayHighWaterMark(currentDemand);
+
+      const unsigned int numBuffersToRetain = std::max(
+          demandHighWaterMark.load(std::memory_order_relaxed),
+          numBuffersRetainedMinimum.load(std::memory_order_relaxed));
+      const unsigned int numIdleBuffersToRetain =
+          ((numBuffersToRetain > currentDemand) ? (numBuffersToRetain - currentDemand) : 0);
+
+      while (numBuffersIdle.load(std::memory_order_relaxed) > numIdleBuffersToRetain)
+      {
+        uint8_t* idleBuffer = nullptr;
+        if (0 == PopBuffersFromSharedPool(&idleBuffer, 1)) break;
+        DeleteBuffer(idleBuffer);
       }
     }
 
   private:
 
-    /// Allocates more buffers and places them into the available buffers data structure.
-    /// Not concurrency-safe. Intended to be invoked as part of an otherwise-guarded operation.
-    void AllocateMoreBuffers(void)
+    /// Slot index value used to indicate the absence of a slot.
+    static constexpr uint32_t kNullIndex = UINT32_MAX;
+
+    /// Stack head value that represents an empty stack with a tag of 0.
+    static constexpr uint64_t kEmptyStack = static_cast<uint64_t>(kNullIndex);
+
+    /// Single slot in the shared pool, which can hold one buffer.
+    struct SSlot
     {
-      for (unsigned int i = 0; i < kAllocationGranularity; ++i)
+      /// Buffer held in the slot. Only accessed by the thread that most recently popped the slot
+      /// from either stack.
+      uint8_t* buffer;
+
+      /// Index of the next slot in whichever stack this slot is in. Atomic because a thread trying
+      /// to pop this slot can read it concurrently with the owning thread writing it, in which case
+      /// the tag check causes the stale value to be discarded.
+      std::atomic<uint32_t> next;
+    };
+
+    /// Connects a pool to the per-thread magazines holding its buffers, which can outlive it.
+    struct SOwnerLink
+    {
+      inline SOwnerLink(BufferPool* pool) : mutex(), pool(pool) {}
+
+      /// Ensures that buffers are not returned to the pool while it is being destroyed.
+      std::mutex mutex;
+
+      /// Pool that owns the buffers, or `nullptr` if it no longer exists.
+      BufferPool* pool;
+    };
+
+    /// Per-thread cache of buffers. Shared among all buffer pools with identical template
+    /// parameters but only holds buffers for one of them at a time, which it returns to that pool
+    /// before holding buffers for another.
+    struct SMagazine
+    {
+      /// Buffers currently held.
+      std::array<uint8_t*, kMagazineCapacity> buffers = {};
+
+      /// Number of buffers currently held.
+      unsigned int numBuffers = 0;
+
+      /// Number of allocations made from this magazine that are not yet counted by a pool.
+      uint64_t numPendingAllocations = 0;
+
+      /// Link to the pool that owns the buffers held and the allocations pending.
+      std::shared_ptr<SOwnerLink> ownerLink;
+
+      inline ~SMagazine(void)
+      {
+        ReleaseToOwner();
+      }
+
+      /// Returns all of the buffers held, along with the allocations pending, to the pool that owns
+      /// them. If that pool no longer exists then the buffers are deallocated instead.
+      void ReleaseToOwner(void)
+      {
+        if (nullptr == ownerLink) return;
+
+        do
+        {
+          std::scoped_lock lock(ownerLink->mutex);
+
+          if (nullptr != ownerLink->pool)
+          {
+            ownerLink->pool->ReclaimMagazine(*this);
+          }
+          else
+          {
+            for (unsigned int i = 0; i < numBuffers; ++i)
+              delete[] buffers[i];
+          }
+        }
+        while (false);
+
+        numBuffers = 0;
+        numPendingAllocations = 0;
+        ownerLink.reset();
+      }
+    };
+
+    /// Stores the specified value into an atomic variable if it is greater than the value already
+    /// there.
+    /// @param [in, out] variable Atomic variable to update.
+    /// @param [in] value Candidate value.
+    static inline void AtomicStoreMaximum(std::atomic<unsigned int>& variable, unsigned int value)
+    {
+      unsigned int oldValue = variable.load(std::memory_order_relaxed);
+      while ((oldValue < value) &&
+             (false == variable.compare_exchange_weak(oldValue, value, std::memory_order_relaxed)))
+        ;
+    }
+
+    /// Allocates a new buffer from the heap.
+    /// @return Newly-allocated buffer.
+    inline uint8_t* NewBuffer(void)
+    {
+      const unsigned int newNumBuffersCurrent =
+          numBuffersCurrent.fetch_add(1, std::memory_order_relaxed) + 1;
+      AtomicStoreMaximum(numBuffersPeak, newNumBuffersCurrent);
+      return new uint8_t[kBytesPerBuffer];
+    }
+
+    /// Deallocates a buffer back to the heap.
+    /// @param [in] buffer Buffer to deallocate.
+    inline void DeleteBuffer(uint8_t* buffer)
+    {
+      numBuffersCurrent.fetch_sub(1, std::memory_order_relaxed);
+      delete[] buffer;
+    }
+
+    /// Determines the current demand for buffers, which is the number of buffers allocated but not
+    /// idle in the shared pool. Buffers held in per-thread magazines count towards demand.
+    /// @return Current demand for buffers.
+    inline unsigned int CurrentDemand(void) const
+    {
+      const unsigned int numBuffersIdleSnapshot = numBuffersIdle.load(std::memory_order_relaxed);
+      const unsigned int numBuffersCurrentSnapshot =
+          numBuffersCurrent.load(std::memory_order_relaxed);
+
+      return (
+          (numBuffersCurrentSnapshot > numBuffersIdleSnapshot)
+              ? (numBuffersCurrentSnapshot - numBuffersIdleSnapshot)
+              : 0);
+    }
+
+    /// Moves the decayed part of the high-water mark of demand toward the current demand, halving
+    /// the excess once for each half-life that elapsed since the last time it decayed.
+    /// @param [in] currentDemand Current demand for buffers.
+    void DecayHighWaterMark(unsigned int currentDemand)
+    {
+      using TTicks = std::chrono::steady_clock::rep;
+
+      const TTicks now = std::chrono::steady_clock::now().time_since_epoch().count();
+      const TTicks halfLifeTicks =
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              policy.highWaterMarkHalfLife)
+              .count();
+
+      TTicks lastDecay = lastDecayTime.load(std::memory_order_relaxed);
+      if ((now - lastDecay) < halfLifeTicks) return;
+      if (false == lastDecayTime.compare_exchange_strong(lastDecay, now)) return;
+
+      constexpr TTicks kMaxHalvings = 31;
+      const TTicks numHalvings =
+          ((halfLifeTicks > 0) ? std::min(((now - lastDecay) / halfLifeTicks), kMaxHalvings)
+                               : kMaxHalvings);
+
+      unsigned int oldHighWaterMark = demandHighWaterMark.load(std::memory_order_relaxed);
+      const unsigned int newHighWaterMark =
+          ((oldHighWaterMark > currentDemand)
+               ? (currentDemand + ((oldHighWaterMark - currentDemand) >> numHalvings))
+               : currentDemand);
+
+      // If this fails then another thread raised the high-water mark concurrently, in which case
+      // the decay is skipped until the next half-life elapses.
+      demandHighWaterMark.compare_exchange_strong(
+          oldHighWaterMark, newHighWaterMark, std::memory_order_relaxed);
+    }
+
+    /// Adds the allocations counted by the specified magazine to this pool's statistics.
+    /// @param [in, out] magazine Magazine whose allocations are to be added.
+    inline void PublishPendingAllocations(SMagazine& magazine)
+    {
+      if (0 == magazine.numPendingAllocations) return;
+
+      numAllocations.fetch_add(magazine.numPendingAllocations, std::memory_order_release);
+      magazine.numPendingAllocations = 0;
+    }
+
+    /// Raises the high-water mark of demand to the current demand, if the latter is higher.
+    inline void UpdateHighWaterMark(void)
+    {
+      AtomicStoreMaximum(demandHighWaterMark, CurrentDemand());
+    }
+
+    /// Combines a slot index and a tag into a stack head value.
+    /// @param [in] index Index of the slot at the top of the stack.
+    /// @param [in] tag Tag value, which is advanced on every modification.
+    /// @return Stack head value.
+    static constexpr uint64_t PackHead(uint32_t index, uint32_t tag)
+    {
+      return ((static_cast<uint64_t>(tag) << 32) | static_cast<uint64_t>(index));
+    }
+
+    /// Extracts the slot index from a stack head value.
+    /// @param [in] head Stack head value.
+    /// @return Index of the slot at the top of the stack.
+    static constexpr uint32_t HeadIndex(uint64_t head)
+    {
+      return static_cast<uint32_t>(head);
+    }
+
+    /// Extracts the tag from a stack head value.
+    /// @param [in] head Stack head value.
+    /// @return Tag value.
+    static constexpr uint32_t HeadTag(uint64_t head)
+    {
+      return static_cast<uint32_t>(head >> 32);
+    }
+
+    /// Retrieves the magazine for the calling thread, first making this pool its owner if it
+    /// currently holds buffers for another pool.
+    /// @return Reference to the calling thread's magazine.
+    inline SMagazine& ThisThreadMagazine(void)
+    {
+      static thread_local SMagazine magazine;
+
+      if (ownerLink != magazine.ownerLink)
       {
-        if (numAvailableBuffers == kPoolSize) break;
+        magazine.ReleaseToOwner();
+        magazine.ownerLink = ownerLink;
+      }
+
+      return magazine;
+    }
+
+    /// Takes back all of the buffers held by a magazine that this pool owns, along with the
+    /// allocations pending, so that the magazine can be released.
+    /// @param [in, out] magazine Magazine whose buffers are to be taken back.
+    void ReclaimMagazine(SMagazine& magazine)
+    {
+      PublishPendingAllocations(magazine);
+
+      PushBuffersToSharedPool(magazine.buffers.data(), magazine.numBuffers);
+      magazine.numBuffers = 0;
+
+      if (true == policy.trimIdleBuffers) Trim();
+    }
 
-        availableBuffers[numAvailableBuffers] = new uint8_t[kBytesPerBuffer];
-        numAvailableBuffers += 1;
+    /// Pops a single slot from the specified stack.
+    /// @param [in] stackHead Head of the stack from which to pop.
+    /// @return Index of the popped slot, or #kNullIndex if the stack is empty.
+    uint32_t PopSlot(std::atomic<uint64_t>& stackHead)
+    {
+      uint64_t oldHead = stackHead.load(std::memory_order_acquire);
+
+      while (kNullIndex != HeadIndex(oldHead))
+      {
+        const uint32_t nextIndex = slots[HeadIndex(oldHead)].next.load(std::memory_order_relaxed);
+        if (true ==
+            stackHead.compare_exchange_weak(
+                oldHead,
+                PackHead(nextIndex, HeadTag(oldHead) + 1),
+                std::memory_order_acq_rel,
+                std::memory_order_acquire))
+          return HeadIndex(oldHead);
       }
+
+      return kNullIndex;
+    }
+
+    /// Pushes a chain of slots, already linked to one another, onto the specified stack.
+    /// @param [in] stackHead Head of the stack onto which to push.
+    /// @param [in] firstIndex Index of the first slot in the chain.
+    /// @param [in] lastIndex Index of the last slot in the chain.
+    void PushSlotChain(std::atomic<uint64_t>& stackHead, uint32_t firstIndex, uint32_t lastIndex)
+    {
+      uint64_t oldHead = stackHead.load(std::memory_order_relaxed);
+
+      do
+      {
+        slots[lastIndex].next.store(HeadIndex(oldHead), std::memory_order_relaxed);
+      } while (false ==
+               stackHead.compare_exchange_weak(
+                   oldHead,
+                   PackHead(firstIndex, HeadTag(oldHead) + 1),
+                   std::memory_order_release,
+                   std::memory_order_relaxed));
     }
 
-    /// Holds available buffers that are already allocated and can be distributed as needed.
-    std::array<uint8_t*, kPoolSize> availableBuffers;
+    /// Moves up to the specified number of buffers out of the shared pool.
+    /// @param [out] buffers Array to receive the buffers.
+    /// @param [in] maxBuffers Maximum number of buffers to move.
+    /// @return Number of buffers actually moved.
+    unsigned int PopBuffersFromSharedPool(uint8_t** buffers, unsigned int maxBuffers)
+    {
+      uint32_t chainFirstIndex = kNullIndex;
+      uint32_t chainLastIndex = kNullIndex;
+      unsigned int numBuffers = 0;
+
+      while (numBuffers < maxBuffers)
+      {
+        const uint32_t slotIndex = PopSlot(filledSlotsHead);
+        if (kNullIndex == slotIndex) break;
+
+        buffers[numBuffers] = slots[slotIndex].buffer;
+        numBuffers += 1;
+
+        slots[slotIndex].buffer = nullptr;
+        slots[slotIndex].next.store(chainFirstIndex, std::memory_order_relaxed);
+        chainFirstIndex = slotIndex;
+        if (kNullIndex == chainLastIndex) chainLastIndex = slotIndex;
+      }
+
+      if (kNullIndex != chainFirstIndex)
+      {
+        numBuffersIdle.fetch_sub(numBuffers, std::memory_order_relaxed);
+        PushSlotChain(emptySlotsHead, chainFirstIndex, chainLastIndex);
+      }
+
+      return numBuffers;
+    }
+
+    /// Moves the specified buffers into the shared pool, deallocating any that do not fit.
+    /// @param [in] buffers Array of buffers to move.
+    /// @param [in] numBuffers Number of buffers to move.
+    void PushBuffersToSharedPool(uint8_t* const* buffers, unsigned int numBuffers)
+    {
+      uint32_t chainFirstIndex = kNullIndex;
+      uint32_t chainLastIndex = kNullIndex;
+      unsigned int numPushedBuffers = 0;
+
+      while (numPushedBuffers < numBuffers)
+      {
+        const uint32_t slotIndex = PopSlot(emptySlotsHead);
+        if (kNullIndex == slotIndex) break;
+
+        slots[slotIndex].buffer = buffers[numPushedBuffers];
+        numPushedBuffers += 1;
+
+        slots[slotIndex].next.store(chainFirstIndex, std::memory_order_relaxed);
+        chainFirstIndex = slotIndex;
+        if (kNullIndex == chainLastIndex) chainLastIndex = slotIndex;
+      }
+
+      // Buffers are counted as idle before they become available so that the count never falls
+      // below the number of buffers actually in the shared pool.
+      if (kNullIndex != chainFirstIndex)
+      {
+        numBuffersIdle.fetch_add(numPushedBuffers, std::memory_order_relaxed);
+        PushSlotChain(filledSlotsHead, chainFirstIndex, chainLastIndex);
+      }
+
+      for (unsigned int i = numPushedBuffers; i < numBuffers; ++i)
+        DeleteBuffer(buffers[i]);
+    }
+
+    /// Allocates more buffers and places them into the specified magazine, which must be empty.
+    /// Any allocated buffers that do not fit into the magazine are placed into the shared pool.
+    /// @param [in, out] magazine Magazine to receive the newly-allocated buffers.
+    void AllocateMoreBuffers(SMagazine& magazine)
+    {
+      constexpr unsigned int kNumBuffersForMagazine =
+          std::min(kAllocationGranularity, kMagazineCapacity);
+      constexpr unsigned int kNumBuffersForSharedPool =
+          kAllocationGranularity - kNumBuffersForMagazine;
+
+      for (unsigned int i = 0; i < kNumBuffersForMagazine; ++i)
+        magazine.buffers[i] = NewBuffer();
+      magazine.numBuffers = kNumBuffersForMagazine;
+
+      if constexpr (kNumBuffersForSharedPool > 0)
+      {
+        std::array<uint8_t*, kNumBuffersForSharedPool> sharedPoolBuffers;
+        for (unsigned int i = 0; i < kNumBuffersForSharedPool; ++i)
+          sharedPoolBuffers[i] = NewBuffer();
+        PushBuffersToSharedPool(sharedPoolBuffers.data(), kNumBuffersForSharedPool);
+      }
+    }
+
+    /// Slots that make up the shared pool.
+    std::array<SSlot, kPoolSize> slots;
+
+    /// Head of the stack of slots that hold buffers available for allocation.
+    std::atomic<uint64_t> filledSlotsHead;
+
+    /// Head of the stack of slots that do not hold buffers.
+    std::atomic<uint64_t> emptySlotsHead;
+
+    /// Policy that controls how many idle buffers are retained.
+    const SBufferPoolPolicy policy;
+
+    /// Number of buffers idle in the shared pool.
+    std::atomic<unsigned int> numBuffersIdle;
+
+    /// Number of buffers currently allocated, whether in use or held by the pool.
+    std::atomic<unsigned int> numBuffersCurrent;
+
+    /// Maximum number of buffers that were allocated at the same time.
+    std::atomic<unsigned int> numBuffersPeak;
+
+    /// Minimum number of buffers to retain regardless of demand, as requested by pre-warming.
+    std::atomic<unsigned int> numBuffersRetainedMinimum;
+
+    /// Decaying high-water mark of the demand for buffers.
+    std::atomic<unsigned int> demandHighWaterMark;
+
+    /// Number of allocations published by per-thread magazines.
+    std::atomic<uint64_t> numAllocations;
+
+    /// Number of allocations that required new buffers to be allocated.
+    std::atomic<uint64_t> numMisses;
 
-    /// Number of available buffers.
-    unsigned int numAvailableBuffers;
+    /// Time, in steady clock ticks, at which the high-water mark of demand last decayed.
+    std::atomic<std::chrono::steady_clock::rep> lastDecayTime;
 
-    /// Mutex used to ensure concurrency control over temporary buffer allocation and
-    /// deallocation.
-    Infra::Mutex allocationMutex;
+    /// Link to this pool shared with the per-thread magazines that hold its buffers.
+    const std::shared_ptr<SOwnerLink> ownerLink;
   };
 } // namespace Pathwinder
@@ -11,10 +11,19 @@
  **************************************************************************************************/
 
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <future>
 #include <memory>
 #include <optional>
+#include <semaphore>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include <Infra/Core/Mutex.h>
+#include <Infra/Core/Strings.h>
 #include <Infra/Core/TemporaryBuffer.h>
 
 #include "ApiWindows.h"
@@ -61,7 +70,9 @@ namespace Pathwinder
 
     /// Causes the enumeration to be restarted from the beginning.
     /// @param [in] filePattern Optional query file pattern to use for filtering enumerated
-    /// entities. Not all subclasses support query file patterns.
+    /// entities. Not all subclasses support query file patterns. If not supplied, the query file
+    /// pattern used previously is retained, just as the system does when an application restarts
+    /// a directory enumeration without supplying a file pattern.
     virtual void Restart(std::wstring_view queryFilePattern = std::wstring_view()) = 0;
 
     /// Determines the size, in bytes, of the first file information structure in the queue.
@@ -72,23 +83,423 @@ namespace Pathwinder
     virtual unsigned int SizeOfFront(void) const = 0;
   };
 
+  /// Holds file information structures and offers them back in case-insensitive sorted order by
+  /// filename, except that the special "." and ".." entries are always offered first. File
+  /// information structures can be appended in any order. They are packed into compact runs of
+  /// bounded size, each of which is sorted once it is full, and the runs are merged together as the
+  /// file information structures are read back out. This avoids needing a single contiguous
+  /// allocation that is large enough to hold the entire contents of a very large directory. The
+  /// total amount of memory held is also bounded, and once it is reached the object reports itself
+  /// as full so that its owner can stop appending. Not concurrency-safe. Methods should be invoked
+  /// under external concurrency control, if needed.
+  class SortedFileInformationRuns
+  {
+  public:
+
+    /// Maximum number of bytes of file information structures that can be held in a single run.
+    /// Once a run reaches this size it is sorted and a new run is started.
+    static constexpr unsigned int kMaxBytesPerRun = 256 * 1024;
+
+    /// Default maximum number of bytes of file information structures that can be held across all
+    /// runs before being reported as full.
+    static constexpr unsigned int kMaxBytesTotal = 4 * 1024 * 1024;
+
+    /// Alignment, in bytes, of each file information structure held in a run.
+    static constexpr unsigned int kStructAlignmentBytes = 8;
+
+    SortedFileInformationRuns(
+        FileInformationStructLayout fileInformationStructLayout,
+        unsigned int maxBytesTotal = kMaxBytesTotal);
+
+    SortedFileInformationRuns(const SortedFileInformationRuns& other) = delete;
+
+    SortedFileInformationRuns(SortedFileInformationRuns&& other) = default;
+
+    SortedFileInformationRuns& operator=(SortedFileInformationRuns&& other) = default;
+
+    /// Appends a copy of the specified file information structure. Only valid before #Finish is
+    /// invoked.
+    /// @param [in] fileInformationStruct File information structure to be copied.
+    void Append(const void* fileInformationStruct);
+
+    /// Sorts any file information structures that have not already been sorted and prepares to
+    /// offer them back in sorted order.
+    void Finish(void);
+
+    /// Retrieves a pointer to the file information structure that sorts first among those not
+    /// already popped. Only valid after #Finish is invoked.
+    /// @return Pointer to the first file information structure, or `nullptr` if there are none
+    /// left.
+    const void* Front(void) const;
+
+    /// Determines if the maximum number of bytes of file information structures has been reached,
+    /// in which case no more should be appended.
+    /// @return `true` if full, `false` otherwise.
+    inline bool IsFull(void) const
+    {
+      return (numBytesTotal >= maxBytesTotal);
+    }
+
+    /// Retrieves the number of runs into which file information structures have been packed.
+    /// Primarily intended for tests.
+    /// @return Number of runs.
+    inline unsigned int GetRunCount(void) const
+    {
+      return static_cast<unsigned int>(runs.size());
+    }
+
+    /// Removes the first file information structure. Only valid after #Finish is invoked and if
+    /// there is at least one file information structure left.
+    void PopFront(void);
+
+  private:
+
+    /// Holds a single run of file information structures.
+    struct SRun
+    {
+      /// Packed file information structures, each aligned to #kStructAlignmentBytes.
+      std::vector<uint8_t> structBytes;
+
+      /// Byte offsets of each of the file information structures in the run. Sorted
+      /// case-insensitively by filename once the run is complete.
+      std::vector<unsigned int> structOffsets;
+
+      /// Position within the sorted byte offsets of the next file information structure to be
+      /// offered back.
+      size_t position;
+    };
+
+    /// Sorts the file information structures in the specified run and releases any excess
+    /// capacity that the run is holding.
+    /// @param [in, out] run Run to be sorted.
+    void SortRunInternal(SRun& run) const;
+
+    /// Selects which of the runs will provide the next file information structure.
+    void SelectFrontRunInternal(void);
+
+    /// File information structure layout information. Used to determine the sizes and filenames
+    /// of the file information structures being sorted.
+    FileInformationStructLayout fileInformationStructLayout;
+
+    /// Maximum number of bytes of file information structures to hold across all runs.
+    unsigned int maxBytesTotal;
+
+    /// Number of bytes of file information structures held across all runs, including alignment.
+    size_t numBytesTotal;
+
+    /// All runs. The last one is still accepting new file information structures until #Finish is
+    /// invoked.
+    std::vector<SRun> runs;
+
+    /// Run which will provide the next file information structure, or `nullptr` if there is none.
+    SRun* frontRun;
+  };
+
+  /// Holds the complete contents of recently-enumerated directories, exactly as they were received
+  /// from the system, so that enumerating the same directory again can be serviced from memory.
+  /// Listings are identified by directory, file information class, and the file pattern supplied
+  /// to the system. Each listing expires after a configurable amount of time, which bounds how long
+  /// changes made outside of Pathwinder's view can go unnoticed, and listings are discarded early
+  /// whenever a change is observed inside their directory. Concurrent requests for the same listing
+  /// are coalesced so that only one of them reads the directory contents from the system and the
+  /// rest share the result. Concurrency-safe.
+  class DirectoryListingCache
+  {
+  public:
+
+    /// Type used to hold a complete directory listing. There is one element per batch received
+    /// from the system, each of which holds one or more file information structures chained
+    /// together by their next entry offset fields.
+    using TListing = std::vector<std::vector<uint8_t>>;
+
+    /// Maximum number of directories whose listings can be held at any given time.
+    static constexpr unsigned int kMaxCachedDirectories = 256;
+
+    /// Outcome of looking up a listing with concurrent requests coalesced.
+    struct SLookupResult
+    {
+      /// Listing that was found, or `nullptr` if there is no such listing.
+      std::shared_ptr<const TListing> listing;
+
+      /// Whether or not the caller is responsible for reading the listing from the system and
+      /// concluding by invoking #CompleteFill.
+      bool isResponsibleForFill;
+
+      /// Value to be supplied to #CompleteFill by the caller responsible for reading the listing.
+      uint64_t invalidationCountAtStart;
+    };
+
+    /// Creates an empty cache.
+    /// @param [in] timeToLive Amount of time for which a listing remains valid after it is stored.
+    DirectoryListingCache(std::chrono::milliseconds timeToLive);
+
+    DirectoryListingCache(const DirectoryListingCache& other) = delete;
+
+    /// Retrieves the number of invalidations that have occurred so far. Callers that intend to
+    /// store a listing should obtain this value before they start reading directory contents from
+    /// the system and supply it when storing the listing.
+    /// @return Number of invalidations that have occurred.
+    uint64_t InvalidationCount(void) const;
+
+    /// Discards all listings for the specified directory, regardless of file information class or
+    /// file pattern.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory whose contents changed.
+    void InvalidateDirectory(std::wstring_view absoluteDirectoryPath);
+
+    /// Attempts to locate an unexpired listing.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory that was enumerated.
+    /// @param [in] fileInformationClass Type of information that was requested from the system.
+    /// @param [in] filePattern File pattern that was supplied to the system.
+    /// @return Listing that was found, or `nullptr` if there is no such listing.
+    std::shared_ptr<const TListing> Lookup(
+        std::wstring_view absoluteDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern);
+
+    /// Attempts to locate an unexpired listing, coalescing concurrent requests for a listing that
+    /// is not yet available. If another caller is already reading the same listing from the system,
+    /// and no invalidations have occurred since it started, then this call waits for that caller to
+    /// finish and shares its result. Otherwise the caller is made responsible for reading the
+    /// listing from the system.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory to be enumerated.
+    /// @param [in] fileInformationClass Type of information to be requested from the system.
+    /// @param [in] filePattern File pattern to be supplied to the system.
+    /// @return Outcome of the lookup, including the listing that was found, if any.
+    SLookupResult LookupOrBeginFill(
+        std::wstring_view absoluteDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern);
+
+    /// Makes the caller responsible for reading a listing from the system, but only if that listing
+    /// is neither already stored nor already being read by another caller. Unlike
+    /// #LookupOrBeginFill this call never waits, which makes it suitable for reading a listing
+    /// before any caller needs it.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory to be enumerated.
+    /// @param [in] fileInformationClass Type of information to be requested from the system.
+    /// @param [in] filePattern File pattern to be supplied to the system.
+    /// @return Value to be supplied to #CompleteFill if the caller is now responsible for reading
+    /// the listing, or nothing otherwise.
+    std::optional<uint64_t> TryBeginFill(
+        std::wstring_view absoluteDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern);
+
+    /// Concludes reading a listing from the system, which must be done exactly once by each caller
+    /// that #LookupOrBeginFill or #TryBeginFill made responsible for doing so. The listing is
+    /// stored, subject to the same conditions as #Insert, and shared with any callers waiting for
+    /// it. If the listing was not stored then waiting callers do not receive it and instead read
+    /// the directory contents from the system themselves.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory that was enumerated.
+    /// @param [in] fileInformationClass Type of information that was requested from the system.
+    /// @param [in] filePattern File pattern that was supplied to the system.
+    /// @param [in] listing Complete directory listing that was read, or nothing if reading failed.
+    /// @param [in] invalidationCountAtStart Value supplied by #LookupOrBeginFill or #TryBeginFill.
+    /// @return Listing that was read, held in a form that can be shared, or `nullptr` if reading
+    /// failed.
+    std::shared_ptr<const TListing> CompleteFill(
+        std::wstring_view absoluteDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern,
+        std::optional<TListing>&& listing,
+        uint64_t invalidationCountAtStart);
+
+    /// Stores a listing, replacing any existing listing with the same identity. The listing is
+    /// not stored if any invalidations occurred after it started being read from the system,
+    /// because its contents may not reflect the change that caused the invalidation.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory that was enumerated.
+    /// @param [in] fileInformationClass Type of information that was requested from the system.
+    /// @param [in] filePattern File pattern that was supplied to the system.
+    /// @param [in] listing Complete directory listing to store.
+    /// @param [in] invalidationCountAtStart Result of #InvalidationCount obtained before the
+    /// listing started being read from the system.
+    void Insert(
+        std::wstring_view absoluteDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern,
+        TListing&& listing,
+        uint64_t invalidationCountAtStart);
+
+  private:
+
+    /// Holds a single listing along with its identity and creation time.
+    struct SCachedListing
+    {
+      /// Type of information that was requested from the system.
+      FILE_INFORMATION_CLASS fileInformationClass;
+
+      /// File pattern that was supplied to the system.
+      std::wstring filePattern;
+
+      /// Time at which the listing was stored.
+      std::chrono::steady_clock::time_point creationTime;
+
+      /// Listing contents, shared with any queues that are reading from it.
+      std::shared_ptr<const TListing> listing;
+    };
+
+    /// Holds the state of a listing that is being read from the system by one caller while any
+    /// number of other callers wait for it.
+    struct SInFlightFill
+    {
+      /// Type of information being requested from the system.
+      FILE_INFORMATION_CLASS fileInformationClass;
+
+      /// File pattern being supplied to the system.
+      std::wstring filePattern;
+
+      /// Number of invalidations that had occurred when the listing started being read.
+      uint64_t invalidationCountAtStart;
+
+      /// Fulfilled once the listing has been read, with `nullptr` if it is not to be shared.
+      std::promise<std::shared_ptr<const TListing>> completion;
+
+      /// Result of the read, which waiting callers obtain once the completion is fulfilled.
+      std::shared_future<std::shared_ptr<const TListing>> sharedResult;
+    };
+
+    /// Registers a new listing as being read from the system by the caller. Requires that the cache
+    /// mutex already be held.
+    /// @param [in, out] inFlightFills Listings being read for the same directory, to which the new
+    /// listing is added.
+    /// @param [in] fileInformationClass Type of information to be requested from the system.
+    /// @param [in] filePattern File pattern to be supplied to the system.
+    /// @return Number of invalidations that have occurred so far.
+    uint64_t BeginFillInternal(
+        std::vector<SInFlightFill>& inFlightFills,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern);
+
+    /// Locates a listing being read from the system that can be shared with a caller arriving now.
+    /// Requires that the cache mutex already be held.
+    /// @param [in] inFlightFills Listings being read for the same directory.
+    /// @param [in] fileInformationClass Type of information to be requested from the system.
+    /// @param [in] filePattern File pattern to be supplied to the system.
+    /// @return Pointer to the matching listing being read, or `nullptr` if there is none.
+    const SInFlightFill* FindInFlightFillInternal(
+        const std::vector<SInFlightFill>& inFlightFills,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern) const;
+
+    /// Internal implementation of #Lookup, which requires that the cache mutex already be held.
+    std::shared_ptr<const TListing> LookupInternal(
+        const std::wstring& normalizedDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern);
+
+    /// Internal implementation of #Insert, which requires that the cache mutex already be held.
+    /// @return `true` if the listing was stored, `false` otherwise.
+    bool InsertInternal(
+        std::wstring&& normalizedDirectoryPath,
+        FILE_INFORMATION_CLASS fileInformationClass,
+        std::wstring_view filePattern,
+        std::shared_ptr<const TListing> listing,
+        uint64_t invalidationCountAtStart);
+
+    /// Converts an absolute directory path to the form used for identifying listings, which omits
+    /// any Windows namespace prefix and trailing backslash.
+    /// @param [in] absoluteDirectoryPath Absolute path of a directory.
+    /// @return Normalized form of the absolute directory path.
+    static std::wstring_view NormalizeDirectoryPath(std::wstring_view absoluteDirectoryPath);
+
+    /// Converts a file pattern to the form used for identifying listings, in which a file pattern
+    /// that matches everything is empty.
+    /// @param [in] filePattern File pattern supplied to the system.
+    /// @return Normalized form of the file pattern.
+    static std::wstring_view NormalizeFilePattern(std::wstring_view filePattern);
+
+    /// Amount of time for which a listing remains valid after it is stored.
+    const std::chrono::milliseconds timeToLive;
+
+    /// Mutex for ensuring concurrency-safe access to the cached listings.
+    mutable Infra::Mutex cacheMutex;
+
+    /// Number of invalidations that have occurred so far.
+    uint64_t invalidationCount;
+
+    /// Cached listings, grouped by normalized absolute directory path.
+    std::unordered_map<
+        std::wstring,
+        std::vector<SCachedListing>,
+        Infra::Strings::CaseInsensitiveHasher<wchar_t>,
+        Infra::Strings::CaseInsensitiveEqualityComparator<wchar_t>>
+        cachedListingsByDirectory;
+
+    /// Listings currently being read from the system, grouped by normalized absolute directory
+    /// path.
+    std::unordered_map<
+        std::wstring,
+        std::vector<SInFlightFill>,
+        Infra::Strings::CaseInsensitiveHasher<wchar_t>,
+        Infra::Strings::CaseInsensitiveEqualityComparator<wchar_t>>
+        inFlightFillsByDirectory;
+  };
+
   /// Holds state and supports enumeration of a single directory within the context of a larger
-  /// directory enumeration operation. Provides a queue-like interface whereby the entire
-  /// enumerated contents of the single directory can be accessed one file information structure
-  /// at a time. Fetches up to a single #FileInformationStructBuffer worth of file information
-  /// structures from the system at any given time, and automatically fetches the next batch once
-  /// the current batch has already been fully popped from the queue. Not concurrency-safe.
-  /// Methods should be invoked under external concurrency control, if needed.
+  /// directory enumeration operation. Provides a queue-like interface whereby the entire enumerated
+  /// contents of the single directory can be accessed one file information structure at a time.
+  /// Fetches up to a single #FileInformationStructBuffer worth of file information structures from
+  /// the system at any given time, and automatically fetches the next batch once the current batch
+  /// has already been fully popped from the queue. Where the match instruction restricts output to
+  /// a single file pattern, that file pattern is supplied to the system along with the query so
+  /// that out-of-scope files are filtered out before they are transferred. Some filesystems, such
+  /// as FAT, exFAT, and many network filesystems, do not produce directory contents in sorted
+  /// order. If this is detected, or if the match instruction requires it, the remaining directory
+  /// contents are read in full and offered back in sorted order instead. Optionally, the next batch
+  /// can be read ahead on a thread pool while the current batch is being consumed, which hides the
+  /// latency of each system call behind the work the application does with the previous batch. If a
+  /// directory listing cache is supplied then the complete directory contents are read up-front and
+  /// stored there and, on subsequent or concurrent enumerations of the same directory, offered from
+  /// memory instead of being read from the system again. Not concurrency-safe. Methods should be
+  /// invoked under external concurrency control, if needed.
   class EnumerationQueue : public IDirectoryOperationQueue
   {
   public:
 
+    /// Describes a directory listing that is being read from the system ahead of time, before any
+    /// queue needs it, so that it can be stored in a directory listing cache.
+    struct SListingPrefetch
+    {
+      /// Directory listing cache that will receive the listing.
+      DirectoryListingCache* directoryListingCache;
+
+      /// Absolute path of the directory whose listing is being read.
+      std::wstring absoluteDirectoryPath;
+
+      /// Type of information being requested from the system.
+      FILE_INFORMATION_CLASS fileInformationClass;
+
+      /// File pattern being supplied to the system.
+      std::wstring filePattern;
+
+      /// Value supplied by the directory listing cache when the listing started being read.
+      uint64_t invalidationCountAtStart;
+    };
+
     /// Attempts to open a handle to be used for directory enumeration.
+    /// @param [in] matchInstruction Instruction that determines which files are included.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory to enumerate.
+    /// @param [in] fileInformationClass Type of information to request from the system.
+    /// @param [in] filePattern Optional file pattern to supply to the system.
+    /// @param [in] enableReadAhead Whether or not to fetch the next batch of file information
+    /// structures in the background while the current batch is being consumed. Defaults to
+    /// disabled.
+    /// @param [in] existingDirectoryHandle Optional handle, already open to the directory to
+    /// enumerate, that should be duplicated instead of opening the directory by path. If the
+    /// handle cannot be duplicated for enumeration then the directory is opened by path instead.
+    /// @param [in] directoryListingCache Optional cache of directory listings to consult and fill.
+    /// The directory is still opened even if its listing is cached, so that the application sees
+    /// the same result as it otherwise would if the directory is inaccessible. Listings are read
+    /// from the system using the richest file information class that can be converted into the
+    /// requested file information class, so that one listing can serve all of them. Must outlive
+    /// this object.
     EnumerationQueue(
         DirectoryEnumerationInstruction::SingleDirectoryEnumeration matchInstruction,
         std::wstring_view absoluteDirectoryPath,
         FILE_INFORMATION_CLASS fileInformationClass,
-        std::wstring_view filePattern = std::wstring_view());
+        std::wstring_view filePattern = std::wstring_view(),
+        bool enableReadAhead = false,
+        HANDLE existingDirectoryHandle = NULL,
+        DirectoryListingCache* directoryListingCache = nullptr);
 
     EnumerationQueue(const EnumerationQueue& other) = delete;
 
@@ -96,6 +507,28 @@ namespace Pathwinder
 
     ~EnumerationQueue(void) override;
 
+    /// Begins reading, ahead of time, the listing that a queue would need if it were created with
+    /// the specified match instruction and directory and then used to enumerate everything. The
+    /// listing is registered with the directory listing cache as being read, so queues created in
+    /// the meantime wait for it rather than reading the same listing themselves. Does not access
+    /// the filesystem and never waits.
+    /// @param [in] matchInstruction Instruction that determines which files are included.
+    /// @param [in] absoluteDirectoryPath Absolute path of the directory to enumerate.
+    /// @param [in] directoryListingCache Directory listing cache that will receive the listing.
+    /// Must outlive the prefetch operation.
+    /// @return Prefetch operation to be concluded by passing it to #CompleteListingPrefetch, or
+    /// nothing if the listing is already stored or already being read.
+    static std::optional<SListingPrefetch> BeginListingPrefetch(
+        const DirectoryEnumerationInstruction::SingleDirectoryEnumeration& matchInstruction,
+        std::wstring_view absoluteDirectoryPath,
+        DirectoryListingCache& directoryListingCache);
+
+    /// Reads the listing described by a prefetch operation from the system and stores it in the
+    /// directory listing cache. Must be invoked exactly once for each prefetch operation, and can
+    /// take some time because it opens and reads the entire directory.
+    /// @param [in] listingPrefetch Prefetch operation returned by #BeginListingPrefetch.
+    static void CompleteListingPrefetch(const SListingPrefetch& listingPrefetch);
+
     /// Retrieves the instruction that this queue object uses to determine which files to include in
     /// the enumeration output. Primarily intended for tests.
     /// @return Single directory enumeration instruction used for determining which files to include
@@ -114,14 +547,58 @@ namespace Pathwinder
       return directoryHandle;
     }
 
+    /// Retrieves the size of the buffer that currently holds file information structures received
+    /// from the system. Primarily intended for tests.
+    /// @return Size of the enumeration buffer, in bytes.
+    inline unsigned int GetEnumerationBufferSize(void) const
+    {
+      return enumerationBuffer.Size();
+    }
+
     /// Retrieves the file information class with which this object was created. Primarily intended
     /// for tests.
-    /// @return File information class used to query the system during directory enumeration.
+    /// @return File information class used to offer file information structures.
     inline FILE_INFORMATION_CLASS GetFileInformationClass(void) const
+    {
+      return applicationFileInformationStructLayout.FileInformationClass();
+    }
+
+    /// Retrieves the file information class that this object uses to query the system, which can
+    /// differ from the file information class with which this object was created if file
+    /// information structures are being converted. Primarily intended for tests.
+    /// @return File information class used to query the system during directory enumeration.
+    inline FILE_INFORMATION_CLASS GetSystemFileInformationClass(void) const
     {
       return fileInformationClass;
     }
 
+    /// Determines whether or not this queue reads ahead in the background. Primarily intended for
+    /// tests.
+    /// @return `true` if read-ahead is enabled, `false` otherwise.
+    inline bool IsReadAheadEnabled(void) const
+    {
+      return (nullptr != readAhead);
+    }
+
+    /// Determines whether or not the directory contents currently being offered by this queue
+    /// come from a directory listing cache, including a listing read concurrently by another queue.
+    /// Primarily intended for tests.
+    /// @return `true` if the directory contents come from a cached listing, `false` otherwise.
+    inline bool IsServingCachedListing(void) const
+    {
+      return (
+          (true == IsOfferingListingFromMemoryInternal()) &&
+          (false == listingCache->isCachedListingReadByThisQueue));
+    }
+
+    /// Retrieves the sorting stage, if it is in use. Primarily intended for tests.
+    /// @return Pointer to the sorting stage, or `nullptr` if file information structures are
+    /// being offered in the order in which the system produces them.
+    inline const SortedFileInformationRuns* GetSortingStage(void) const
+    {
+      return ((true == sortingStage.has_value()) ? &(*sortingStage) : nullptr);
+    }
+
     // IDirectoryOperationQueue
     unsigned int CopyFront(void* dest, unsigned int capacityBytes) const override;
     NTSTATUS EnumerationStatus(void) const override;
@@ -132,6 +609,134 @@ namespace Pathwinder
 
   private:
 
+    /// Holds all of the state needed to fetch a batch of file information structures in the
+    /// background. Allocated separately from the queue object itself so that its address remains
+    /// stable for the thread pool work item even if the queue object is moved.
+    struct SReadAheadState
+    {
+      inline SReadAheadState(HANDLE directoryHandle, FILE_INFORMATION_CLASS fileInformationClass)
+          : directoryHandle(directoryHandle),
+            fileInformationClass(fileInformationClass),
+            buffer(FileInformationStructBuffer::kBytesPerBufferMinimum),
+            result(),
+            isInProgress(false),
+            completionSemaphore(0)
+      {}
+
+      /// Directory handle to be used when querying the system for file information structures.
+      HANDLE directoryHandle;
+
+      /// Type of information to request from the system.
+      FILE_INFORMATION_CLASS fileInformationClass;
+
+      /// Receives the file information structures fetched in the background. Swapped with the
+      /// queue's enumeration buffer once consumed.
+      FileInformationStructBuffer buffer;
+
+      /// Result of the background system call.
+      NTSTATUS result;
+
+      /// Whether or not a background fetch has been submitted but not yet consumed.
+      bool isInProgress;
+
+      /// Released by the thread pool work item once the background fetch is complete.
+      std::binary_semaphore completionSemaphore;
+    };
+
+    /// Holds all of the state needed to consult and fill a directory listing cache.
+    struct SListingCacheState
+    {
+      inline SListingCacheState(
+          DirectoryListingCache& cache, std::wstring_view absoluteDirectoryPath)
+          : cache(cache),
+            absoluteDirectoryPath(absoluteDirectoryPath),
+            cachedListing(),
+            nextCachedBatchIndex(0),
+            isCachedListingReadByThisQueue(false)
+      {}
+
+      /// Directory listing cache to consult and fill.
+      DirectoryListingCache& cache;
+
+      /// Absolute path of the directory being enumerated, which identifies its listings.
+      std::wstring absoluteDirectoryPath;
+
+      /// Cached listing from which directory contents are being offered, if any.
+      std::shared_ptr<const DirectoryListingCache::TListing> cachedListing;
+
+      /// Position, within the cached listing, of the next batch to offer.
+      unsigned int nextCachedBatchIndex;
+
+      /// Whether or not the cached listing was read from the system by this queue, as opposed to
+      /// having been obtained from the directory listing cache.
+      bool isCachedListingReadByThisQueue;
+    };
+
+    /// Thread pool work item callback that fetches the next batch of file information structures.
+    /// @param [in] instance Thread pool callback instance. Not used.
+    /// @param [in] context Pointer to the read-ahead state object.
+    static void CALLBACK ReadAheadWorkCallback(PTP_CALLBACK_INSTANCE instance, PVOID context);
+
+    /// Submits a background fetch of the next batch of file information structures, if read-ahead
+    /// is enabled. If submission fails then the next batch is fetched synchronously when needed.
+    void StartReadAheadInternal(void);
+
+    /// Waits for any in-progress background fetch to complete.
+    /// @return Result of the background fetch, if one was in progress, or nothing otherwise.
+    std::optional<NTSTATUS> WaitForReadAheadInternal(void);
+
+    /// Retrieves a pointer to the first file information structure in the queue, regardless of
+    /// whether it comes from the enumeration buffer or from the sorting stage.
+    /// @return Pointer to the first file information structure.
+    const void* FrontInternal(void) const;
+
+    /// Determines whether or not the first file information structure in the queue should be
+    /// presented to the application. Contents of the sorting stage are filtered before they are
+    /// placed there, and contents of the enumeration buffer are filtered as a batch when they are
+    /// received from the system, so no filename needs to be checked here.
+    /// @return `true` if the first file information structure should be included, `false`
+    /// otherwise.
+    bool IsFrontIncludedInternal(void) const;
+
+    /// Determines whether or not the file information structures in the enumeration buffer, from
+    /// the current position to the end, are in case-insensitive sorted order by filename.
+    /// @param [in] precedingFileName Filename that preceded the current position, if any. Used to
+    /// check that the enumeration buffer contents continue in sorted order from a previous batch.
+    /// @return `true` if the enumeration buffer contents are sorted or if there are no contents,
+    /// `false` otherwise.
+    bool IsEnumerationBufferSortedInternal(
+        std::wstring_view precedingFileName = std::wstring_view()) const;
+
+    /// Reads the remaining directory contents from the system, starting at the current position in
+    /// the enumeration buffer, and places all those that match into the sorting stage. Subsequent
+    /// file information structures are offered from the sorting stage. If the sorting stage becomes
+    /// full before the end of the directory contents is reached then reading stops there, and the
+    /// rest of the directory contents are sorted the same way once the sorting stage is exhausted.
+    /// Memory use is therefore bounded, at the cost of very large directories being offered as a
+    /// sequence of individually-sorted windows rather than in a single sorted order.
+    void SortRemainingContentsInternal(void);
+
+    /// Starts a new pass through the directory contents, serving it from the directory listing
+    /// cache if a matching listing is available. Otherwise, unless another queue is already doing
+    /// so concurrently, the entire listing is read from the system and stored. Has no effect if
+    /// there is no directory listing cache. Listings are identified by the system query file
+    /// pattern this queue retains, so that restarting without a file pattern finds the same
+    /// listing as the pass that preceded it.
+    void BeginListingInternal(void);
+
+    /// Determines whether or not directory contents are being offered from a complete listing held
+    /// in memory, regardless of whether it was obtained from the cache or read by this queue.
+    /// @return `true` if directory contents are being offered from memory, `false` otherwise.
+    inline bool IsOfferingListingFromMemoryInternal(void) const
+    {
+      return ((nullptr != listingCache) && (nullptr != listingCache->cachedListing));
+    }
+
+    /// Copies the next batch of the cached listing into the enumeration buffer.
+    /// @return `STATUS_SUCCESS` if a batch was copied, `STATUS_NO_MORE_FILES` if there are no
+    /// more batches in the cached listing.
+    NTSTATUS ReadCachedListingBatchInternal(void);
+
     /// Queries the system for more file information structures to be placed in the queue.
     /// Sets this object's enumeration status according to the result.
     /// @param [in] queryFlags Optional query flags to supply along with the underlying system
@@ -159,13 +764,19 @@ namespace Pathwinder
     HANDLE directoryHandle;
 
     /// Type of information to request from the system when querying for file information
-    /// structures.
+    /// structures. If a directory listing cache is in use then this can be a richer type than the
+    /// type requested by the application, in which case file information structures are converted
+    /// as they are copied out.
     FILE_INFORMATION_CLASS fileInformationClass;
 
     /// File information structure layout information. Computed based on the file information
     /// class.
     FileInformationStructLayout fileInformationStructLayout;
 
+    /// File information structure layout information for the type of information requested by the
+    /// application, which determines the layout of file information structures as copied out.
+    FileInformationStructLayout applicationFileInformationStructLayout;
+
     /// Holds one or more file information structures received from the system.
     FileInformationStructBuffer enumerationBuffer;
 
@@ -173,6 +784,38 @@ namespace Pathwinder
     /// should be read.
     unsigned int enumerationBufferBytePosition;
 
+    /// Ordinal position, within the enumeration buffer, of the file information structure at the
+    /// current byte position. Used to index into the keep mask.
+    unsigned int enumerationBufferEntryIndex;
+
+    /// Result of filtering all of the file information structures in the enumeration buffer using
+    /// the match instruction, one element per file information structure in order.
+    std::vector<bool> enumerationBufferKeepMask;
+
+    /// Whether or not the most recent batch of file information structures received from the
+    /// system filled its buffer, in which case the next batch is received into a larger buffer.
+    bool shouldGrowEnumerationBuffer;
+
+    /// Sorting stage, present only if the system was found not to produce file information
+    /// structures in sorted order or if the match instruction requires sorting.
+    std::optional<SortedFileInformationRuns> sortingStage;
+
+    /// Whether or not the directory has more contents beyond those held in the sorting stage,
+    /// which happens if the sorting stage became full before the end of the directory contents.
+    bool hasContentsBeyondSortingStage;
+
+    /// Read-ahead state, present only if read-ahead is enabled.
+    std::unique_ptr<SReadAheadState> readAhead;
+
+    /// Directory listing cache state, present only if a directory listing cache is in use.
+    std::unique_ptr<SListingCacheState> listingCache;
+
+    /// File pattern supplied to the system, which combines the application's query file pattern
+    /// with the match instruction's file pattern. Retained across restarts that do not supply a
+    /// new query file pattern, because this queue does not otherwise filter by the application's
+    /// query file pattern.
+    std::wstring systemQueryFilePattern;
+
     /// Overall status of the enumeration.
     NTSTATUS enumerationStatus;
   };
@@ -180,8 +823,9 @@ namespace Pathwinder
   /// Holds state and supports insertion of directory names into the output of a larger directory
   /// enumeration operation. Requires an externally-supplied ordered list of name insertion
   /// instructions, which are offered as file information structures one at a time using a
-  /// queue-like interface. Not concurrency-safe. Methods should be invoked under external
-  /// concurrency control, if needed.
+  /// queue-like interface. Name insertions whose information sources share a parent directory are
+  /// looked up together by enumerating that parent directory once. Not concurrency-safe. Methods
+  /// should be invoked under external concurrency control, if needed.
   class NameInsertionQueue : public IDirectoryOperationQueue
   {
   public:
@@ -196,6 +840,14 @@ namespace Pathwinder
 
     NameInsertionQueue(NameInsertionQueue&& other) = default;
 
+    /// Retrieves the size of the buffer that holds the file information structure at the front of
+    /// the queue. Primarily intended for tests.
+    /// @return Size of the enumeration buffer, in bytes.
+    inline unsigned int GetEnumerationBufferSize(void) const
+    {
+      return enumerationBuffer.Size();
+    }
+
     /// Retrieves the file information class with which this object was created. Primarily intended
     /// for tests.
     /// @return File information class used to query the system during directory enumeration.
@@ -233,10 +885,34 @@ namespace Pathwinder
 
   private:
 
+    /// Holds the result of looking up the file information structure for a single name insertion
+    /// ahead of time, as part of a batch of lookups that share the same parent directory.
+    struct SPrefetchedNameInsertion
+    {
+      /// Result of the lookup, which has the same meaning as the result of querying the system for
+      /// information on just the one file.
+      NTSTATUS lookupResult;
+
+      /// Position, within the prefetched file information buffer, of the file information
+      /// structure that the lookup produced. Valid only if the lookup succeeded.
+      unsigned int byteOffset;
+
+      /// Size, in bytes, of the file information structure that the lookup produced. Valid only if
+      /// the lookup succeeded.
+      unsigned int sizeBytes;
+    };
+
     /// Queries the system for the next file information structure that should be inserted into
     /// the overall enumeration results.
     void AdvanceQueueContentsInternal(void);
 
+    /// Looks up the file information structures for all name insertions whose information source
+    /// shares a parent directory with that of at least one other name insertion. Each such parent
+    /// directory is enumerated once, rather than being opened and queried once per name insertion.
+    /// Name insertions that do not match the query file pattern are skipped because they will not
+    /// be part of the enumeration output.
+    void PrefetchNameInsertionsInternal(void);
+
     /// File pattern against which to match all filenames being enumerated.
     std::wstring filePattern;
 
@@ -255,11 +931,20 @@ namespace Pathwinder
     /// class.
     FileInformationStructLayout fileInformationStructLayout;
 
-    /// Buffer for holding one single file enumeration result at a time.
+    /// Buffer for holding one single file enumeration result at a time. Uses the smallest buffer
+    /// size class, which is large enough for any single file information structure.
     FileInformationStructBuffer enumerationBuffer;
 
     /// Overall status of the enumeration.
     NTSTATUS enumerationStatus;
+
+    /// Results of looking up name insertions ahead of time, one element per name insertion and in
+    /// the same order. Name insertions without a prefetched result need to be looked up
+    /// individually when they are reached.
+    std::vector<std::optional<SPrefetchedNameInsertion>> prefetchedNameInsertions;
+
+    /// Concatenated file information structures produced by successful prefetched lookups.
+    std::vector<uint8_t> prefetchedFileInformation;
   };
 
   /// Maintains multiple directory enumeration queues and merges them into a single stream of file
@@ -14,6 +14,7 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <cstring>
 #include <optional>
@@ -39,43 +40,63 @@ namespace Pathwinder
       std::is_same_v<ULONG, decltype(FileInformationStructType::fileNameLength)> &&
       std::is_same_v<WCHAR[1], decltype(FileInformationStructType::fileName)>;
 
+  // Determines whether or not the specified type has a field for chaining it to the next structure.
+  template <typename FileInformationStructType> concept HasNextEntryOffsetField =
+      std::is_same_v<ULONG, decltype(FileInformationStructType::nextEntryOffset)>;
+
   /// Implements a byte-wise buffer for holding one or more file information structures without
   /// regard for their type or individual size. Directory enumeration system calls often produce
-  /// multiple file information structures, which are placed contiguously in memory. This class
-  /// internally allocates and maintains a pool of fixed-size buffers, which can grow as needed up
-  /// to a pre-determined maximum number of buffers.
+  /// multiple file information structures, which are placed contiguously in memory. Buffers come in
+  /// a small number of size classes, and a buffer can be grown from one size class to the next so
+  /// that its owner only holds as much memory as its workload actually needs. This class internally
+  /// allocates and maintains one pool of fixed-size buffers per size class, each of which can grow
+  /// as needed up to a pre-determined maximum number of buffers.
   class FileInformationStructBuffer
   {
   public:
 
-    /// Size of each file information structure buffer, in bytes.
+    /// Size of each buffer size class, in bytes, from smallest to largest.
     /// Maximum of 64kB can be supported, based on third-party observed behavior of the various
-    /// directory enumeration system calls.
-    static constexpr unsigned int kBytesPerBuffer = 64 * 1024;
+    /// directory enumeration system calls. The minimum is enough to hold any single file
+    /// information structure, regardless of the length of its filename.
+    static constexpr std::array<unsigned int, 3> kBytesPerBufferSizeClass = {
+        4 * 1024, 16 * 1024, 64 * 1024};
+
+    /// Size of the smallest buffer size class, in bytes.
+    static constexpr unsigned int kBytesPerBufferMinimum = kBytesPerBufferSizeClass.front();
 
-    /// Number of buffers to allocate initially and each time the pool is exhausted and more are
+    /// Size of the largest buffer size class, in bytes. This is the size of a buffer whose size
+    /// class is not otherwise specified.
+    static constexpr unsigned int kBytesPerBuffer = kBytesPerBufferSizeClass.back();
+
+    /// Number of buffers to allocate initially and each time a pool is exhausted and more are
     /// needed.
     static constexpr unsigned int kBufferAllocationGranularity = 4;
 
-    /// Maximum number of buffers to hold in the pool.
+    /// Maximum number of buffers to hold in each pool.
     /// If more buffers are needed beyond this number, for example due to a large number of
     /// parallel directory enumeration requests, then they will be deallocated instead of
     /// returned to the pool.
     static constexpr unsigned int kBufferPoolSize = 64;
 
-    inline FileInformationStructBuffer(void)
-        : buffer(reinterpret_cast<uint8_t*>(bufferPool.Allocate()))
-    {}
+    /// Creates a buffer of the smallest size class that can hold the specified number of bytes.
+    /// @param [in] minimumSizeBytes Minimum size of the buffer, in bytes. Defaults to the size of
+    /// the largest size class.
+    inline FileInformationStructBuffer(unsigned int minimumSizeBytes = kBytesPerBuffer)
+        : buffer(nullptr), sizeClass(SizeClassForBytes(minimumSizeBytes))
+    {
+      buffer = AllocateFromPool(sizeClass);
+    }
 
     inline ~FileInformationStructBuffer(void)
     {
-      if (nullptr != buffer) bufferPool.Free(buffer);
+      if (nullptr != buffer) FreeToPool(sizeClass, buffer);
     }
 
     FileInformationStructBuffer(const FileInformationStructBuffer& other) = delete;
 
     inline FileInformationStructBuffer(FileInformationStructBuffer&& other) noexcept
-        : buffer(nullptr)
+        : buffer(nullptr), sizeClass(0)
     {
       *this = std::move(other);
     }
@@ -83,6 +104,7 @@ namespace Pathwinder
     inline FileInformationStructBuffer& operator=(FileInformationStructBuffer&& other) noexcept
     {
       std::swap(buffer, other.buffer);
+      std::swap(sizeClass, other.sizeClass);
       return *this;
     }
 
@@ -98,6 +120,14 @@ namespace Pathwinder
       return Data()[index];
     }
 
+    /// Determines whether or not this buffer can be grown, which is the case unless it is already
+    /// of the largest size class.
+    /// @return `true` if this buffer can be grown, `false` otherwise.
+    inline bool CanGrow(void) const
+    {
+      return ((sizeClass + 1) < kBytesPerBufferSizeClass.size());
+    }
+
     /// Retrieves a pointer to the buffer itself, constant version.
     /// @return Pointer to the buffer.
     inline const uint8_t* Data(void) const
@@ -112,21 +142,133 @@ namespace Pathwinder
       return buffer;
     }
 
+    /// Replaces the buffer with one of the next-larger size class, if there is one.
+    /// Contents of the buffer are not preserved.
+    /// @return `true` if the buffer was grown, `false` if it is already of the largest size class.
+    inline bool Grow(void)
+    {
+      if (false == CanGrow()) return false;
+
+      ReplaceWithSizeClass(sizeClass + 1);
+      return true;
+    }
+
+    /// Replaces the buffer with one of the smallest size class that can hold the specified number
+    /// of bytes, unless the buffer can already hold them. Contents of the buffer are not
+    /// preserved if it is replaced.
+    /// @param [in] sizeBytes Number of bytes the buffer needs to be able to hold.
+    inline void GrowToFit(unsigned int sizeBytes)
+    {
+      DebugAssert(sizeBytes <= kBytesPerBuffer, "Requested size exceeds the largest size class.");
+      if (sizeBytes > Size()) ReplaceWithSizeClass(SizeClassForBytes(sizeBytes));
+    }
+
     /// Retrieves the size of the buffer, in bytes.
     /// @return Size of the buffer, in bytes.
-    constexpr unsigned int Size(void) const
+    inline unsigned int Size(void) const
     {
-      return kBytesPerBuffer;
+      return kBytesPerBufferSizeClass[sizeClass];
+    }
+
+    /// Allocates buffers of every size class ahead of time so that directory enumeration does not
+    /// need to allocate them on demand. Pre-warmed buffers are retained even when idle.
+    /// @param [in] numBuffers Number of buffers of each size class to hold, which is capped at the
+    /// pool size.
+    static inline void PrewarmBufferPools(unsigned int numBuffers)
+    {
+      bufferPoolSmall.Prewarm(numBuffers);
+      bufferPoolMedium.Prewarm(numBuffers);
+      bufferPoolLarge.Prewarm(numBuffers);
     }
 
   private:
 
-    /// Manages the pool of backing buffers.
-    static inline BufferPool<kBytesPerBuffer, kBufferAllocationGranularity, kBufferPoolSize>
-        bufferPool;
+    /// Determines the smallest size class whose buffers can hold the specified number of bytes.
+    /// @param [in] sizeBytes Number of bytes to be held.
+    /// @return Index of the size class, or the index of the largest size class if none of them
+    /// can hold the specified number of bytes.
+    static constexpr unsigned int SizeClassForBytes(unsigned int sizeBytes)
+    {
+      for (unsigned int i = 0; i < kBytesPerBufferSizeClass.size(); ++i)
+      {
+        if (sizeBytes <= kBytesPerBufferSizeClass[i]) return i;
+      }
+
+      return static_cast<unsigned int>(kBytesPerBufferSizeClass.size() - 1);
+    }
+
+    /// Allocates a buffer of the specified size class from the corresponding pool.
+    /// @param [in] sizeClass Index of the size class.
+    /// @return Newly-allocated buffer.
+    static inline uint8_t* AllocateFromPool(unsigned int sizeClass)
+    {
+      switch (sizeClass)
+      {
+        case 0:
+          return reinterpret_cast<uint8_t*>(bufferPoolSmall.Allocate());
+        case 1:
+          return reinterpret_cast<uint8_t*>(bufferPoolMedium.Allocate());
+        default:
+          return reinterpret_cast<uint8_t*>(bufferPoolLarge.Allocate());
+      }
+    }
+
+    /// Returns a buffer of the specified size class to the corresponding pool.
+    /// @param [in] sizeClass Index of the size class.
+    /// @param [in] buffer Previously-allocated buffer being returned.
+    static inline void FreeToPool(unsigned int sizeClass, uint8_t* buffer)
+    {
+      switch (sizeClass)
+      {
+        case 0:
+          bufferPoolSmall.Free(buffer);
+          break;
+        case 1:
+          bufferPoolMedium.Free(buffer);
+          break;
+        default:
+          bufferPoolLarge.Free(buffer);
+          break;
+      }
+    }
+
+    /// Returns the current buffer to its pool and replaces it with a buffer of the specified size
+    /// class.
+    /// @param [in] newSizeClass Index of the size class of the replacement buffer.
+    inline void ReplaceWithSizeClass(unsigned int newSizeClass)
+    {
+      if (nullptr != buffer) FreeToPool(sizeClass, buffer);
+
+      sizeClass = newSizeClass;
+      buffer = AllocateFromPool(sizeClass);
+    }
+
+    /// Manages the pool of backing buffers of the smallest size class.
+    static inline BufferPool<
+        kBytesPerBufferSizeClass[0],
+        kBufferAllocationGranularity,
+        kBufferPoolSize>
+        bufferPoolSmall;
+
+    /// Manages the pool of backing buffers of the middle size class.
+    static inline BufferPool<
+        kBytesPerBufferSizeClass[1],
+        kBufferAllocationGranularity,
+        kBufferPoolSize>
+        bufferPoolMedium;
+
+    /// Manages the pool of backing buffers of the largest size class.
+    static inline BufferPool<
+        kBytesPerBufferSizeClass[2],
+        kBufferAllocationGranularity,
+        kBufferPoolSize>
+        bufferPoolLarge;
 
     /// Pointer to the buffer space.
     uint8_t* buffer;
+
+    /// Index of the size class of the buffer space.
+    unsigned int sizeClass;
   };
 
   /// Holds a single file information structure, including the variably-sized filename, in a
@@ -323,6 +465,17 @@ namespace Pathwinder
     static std::optional<FileInformationStructLayout> LayoutForFileInformationClass(
         FILE_INFORMATION_CLASS fileInformationClass);
 
+    /// Determines which file information class should be used to query the system for directory
+    /// contents that are to be offered to the application using the specified file information
+    /// class. Several file information classes carry a strict subset of the information carried by
+    /// a richer class, in which case the richer class is returned so that one set of directory
+    /// contents can be converted into any of them using #ConvertFileInformationStruct.
+    /// @param [in] fileInformationClass File information class to be offered to the application.
+    /// @return File information class to use when querying the system, which is the same as the
+    /// input file information class if no richer class can be converted into it.
+    static FILE_INFORMATION_CLASS ConvertibleSourceFileInformationClass(
+        FILE_INFORMATION_CLASS fileInformationClass);
+
     /// Retrieves the stored filename from within one of the many structures that uses a dangling
     /// filename field, whose type must be known at compile-time.
     /// @tparam FileInformationStructType Windows internal structure type that uses a wide-character
@@ -389,6 +542,18 @@ namespace Pathwinder
           offsetof(FileInformationStructType, fileNameLength));
     }
 
+    /// Invokes the specified function with an object that describes the same layout as this object
+    /// but whose offsets and sizes are all compile-time constants. Loops that process many file
+    /// information structures can be written once, as a generic function, and specialized for each
+    /// file information class so that the file information class is checked once for the whole
+    /// loop rather than once per file information structure. If there is no compile-time layout
+    /// for this object's file information class then the function is invoked with this object
+    /// instead, so the function must accept either.
+    /// @tparam FuncType Type of function to invoke, typically a generic lambda.
+    /// @param [in] func Function to invoke.
+    /// @return Result of invoking the function.
+    template <typename FuncType> decltype(auto) InvokeWithStaticLayout(FuncType&& func) const;
+
     /// Returns the base size of the file information structure whose layout is represented by
     /// this object.
     /// @return Base structure size in bytes.
@@ -494,6 +659,25 @@ namespace Pathwinder
           static_cast<unsigned int>(ReadFileNameLength(fileInformationStruct)));
     }
 
+    /// Writes a file information structure of the type described by this layout using the contents
+    /// of a file information structure whose type is described by another layout. Fields present in
+    /// both structures are copied, including the trailing filename, and any other fields are set to
+    /// 0. The `nextEntryOffset` field is set to the size of the written structure. Supported source
+    /// types are the type described by this layout and the type identified by
+    /// #ConvertibleSourceFileInformationClass. Performs no verification on the input pointers or
+    /// data structures, and the destination must have space for the entire written structure.
+    /// @param [in] sourceLayout Layout of the source file information structure.
+    /// @param [in] sourceFileInformationStruct Address of the first byte of the source file
+    /// information structure.
+    /// @param [out] fileInformationStruct Address of the first byte of the file information
+    /// structure to be written.
+    /// @return Size, in bytes, of the written file information structure, or 0 if the conversion
+    /// is not supported.
+    unsigned int ConvertFileInformationStruct(
+        const FileInformationStructLayout& sourceLayout,
+        const void* sourceFileInformationStruct,
+        void* fileInformationStruct) const;
+
     /// Updates the `nextEntryOffset` field for the specified file information structure using
     /// the known size of that structure. Performs no verification on the input pointer or data
     /// structure.
@@ -1033,4 +1217,153 @@ namespace Pathwinder
     ULONG fileNameLength;
     WCHAR fileName[1];
   };
+
+  /// Describes the layout of a file information structure whose type is known at compile time.
+  /// Offers the same reading and writing functionality as #FileInformationStructLayout, with the
+  /// same semantics, but all offsets and sizes are compile-time constants rather than values
+  /// loaded from memory. Typically obtained by way of
+  /// #FileInformationStructLayout::InvokeWithStaticLayout.
+  /// @tparam FileInformationStructType Windows internal structure type that uses a wide-character
+  /// dangling filename field and can be chained to other structures of the same type.
+  template <typename FileInformationStructType>
+    requires IsFileInformationStruct<FileInformationStructType> &&
+      HasDanglingFilenameField<FileInformationStructType> &&
+      HasNextEntryOffsetField<FileInformationStructType>
+  class StaticFileInformationStructLayout
+  {
+  public:
+
+    using TNextEntryOffset = FileInformationStructLayout::TNextEntryOffset;
+    using TFileNameLength = FileInformationStructLayout::TFileNameLength;
+    using TFileNameChar = FileInformationStructLayout::TFileNameChar;
+
+    /// Retrieves the equivalent layout object whose offsets and sizes are held at runtime.
+    /// @return Equivalent runtime layout object.
+    static constexpr FileInformationStructLayout Layout(void)
+    {
+      return FileInformationStructLayout(
+          FileInformationStructType::kFileInformationClass,
+          sizeof(FileInformationStructType),
+          offsetof(FileInformationStructType, nextEntryOffset),
+          offsetof(FileInformationStructType, fileNameLength),
+          offsetof(FileInformationStructType, fileName));
+    }
+
+    static constexpr unsigned int BaseStructureSize(void)
+    {
+      return sizeof(FileInformationStructType);
+    }
+
+    static inline void ClearNextEntryOffset(void* fileInformationStruct)
+    {
+      AsStruct(fileInformationStruct).nextEntryOffset = 0;
+    }
+
+    static constexpr FILE_INFORMATION_CLASS FileInformationClass(void)
+    {
+      return FileInformationStructType::kFileInformationClass;
+    }
+
+    static inline TFileNameChar* FileNamePointer(const void* fileInformationStruct)
+    {
+      return const_cast<TFileNameChar*>(AsStruct(fileInformationStruct).fileName);
+    }
+
+    static constexpr unsigned int HypotheticalSizeForFileNameLength(
+        unsigned int fileNameLengthBytes)
+    {
+      return std::max(
+          static_cast<unsigned int>(sizeof(FileInformationStructType)),
+          static_cast<unsigned int>(offsetof(FileInformationStructType, fileName)) +
+              fileNameLengthBytes);
+    }
+
+    static inline TNextEntryOffset ReadNextEntryOffset(const void* fileInformationStruct)
+    {
+      return AsStruct(fileInformationStruct).nextEntryOffset;
+    }
+
+    static inline TFileNameLength ReadFileNameLength(const void* fileInformationStruct)
+    {
+      return AsStruct(fileInformationStruct).fileNameLength;
+    }
+
+    static inline std::basic_string_view<TFileNameChar> ReadFileName(
+        const void* fileInformationStruct)
+    {
+      const FileInformationStructType& typedStruct = AsStruct(fileInformationStruct);
+      return std::basic_string_view<TFileNameChar>(
+          typedStruct.fileName, typedStruct.fileNameLength / sizeof(TFileNameChar));
+    }
+
+    static inline unsigned int SizeOfStruct(const void* fileInformationStruct)
+    {
+      return HypotheticalSizeForFileNameLength(
+          static_cast<unsigned int>(ReadFileNameLength(fileInformationStruct)));
+    }
+
+    static inline void UpdateNextEntryOffset(void* fileInformationStruct)
+    {
+      AsStruct(fileInformationStruct).nextEntryOffset = SizeOfStruct(fileInformationStruct);
+    }
+
+    static inline void WriteFileNameLength(
+        void* fileInformationStruct, TFileNameLength newFileNameLength)
+    {
+      AsStruct(fileInformationStruct).fileNameLength = newFileNameLength;
+      UpdateNextEntryOffset(fileInformationStruct);
+    }
+
+    static inline void WriteFileName(
+        void* fileInformationStruct,
+        std::basic_string_view<TFileNameChar> newFileName,
+        unsigned int bufferCapacityBytes)
+    {
+      FileInformationStructLayout::WriteFileNameByType(
+          AsStruct(fileInformationStruct), bufferCapacityBytes, newFileName);
+      UpdateNextEntryOffset(fileInformationStruct);
+    }
+
+  private:
+
+    /// Interprets the specified address as a file information structure of this layout's type.
+    /// Performs no verification on the input pointer or data structure.
+    /// @param [in] fileInformationStruct Address of the first byte of the file information
+    /// structure of interest.
+    /// @return Typed reference to the file information structure.
+    static inline FileInformationStructType& AsStruct(const void* fileInformationStruct)
+    {
+      return *reinterpret_cast<FileInformationStructType*>(
+          const_cast<void*>(fileInformationStruct));
+    }
+  };
+
+  template <typename FuncType>
+  decltype(auto) FileInformationStructLayout::InvokeWithStaticLayout(FuncType&& func) const
+  {
+    switch (fileInformationClass)
+    {
+      case SFileDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileDirectoryInformation>());
+      case SFileFullDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileFullDirectoryInformation>());
+      case SFileBothDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileBothDirectoryInformation>());
+      case SFileNamesInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileNamesInformation>());
+      case SFileIdBothDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileIdBothDirectoryInformation>());
+      case SFileIdFullDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileIdFullDirectoryInformation>());
+      case SFileIdGlobalTxDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileIdGlobalTxDirectoryInformation>());
+      case SFileIdExtdDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileIdExtdDirectoryInformation>());
+      case SFileIdExtdBothDirectoryInformation::kFileInformationClass:
+        return func(StaticFileInformationStructLayout<SFileIdExtdBothDirectoryInformation>());
+
+      default:
+        return func(*this);
+    }
+  }
 } // namespace Pathwinder
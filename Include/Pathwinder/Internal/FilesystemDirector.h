@@ -45,6 +45,26 @@ namespace Pathwinder
       Infra::Strings::CaseInsensitiveHasher<wchar_t>,
       Infra::Strings::CaseInsensitiveEqualityComparator<wchar_t>>;
 
+  /// Point from which a lookup in the filesystem rule prefix tree can resume, for paths inside a
+  /// directory whose own path was already looked up. Supplied by the caller with just the length of
+  /// the directory path filled in, then resolved by the filesystem director on first use, after
+  /// which it can be retained and supplied again for other paths inside the same directory.
+  /// Remains valid for as long as the filesystem director that resolved it is neither modified nor
+  /// moved.
+  struct SPathLookupResumePoint
+  {
+    /// Number of characters at the beginning of the queried path that make up the directory path.
+    /// Must end at a path separator boundary in the queried path.
+    unsigned int directoryPathLength;
+
+    /// Whether or not the directory path was already looked up, in which case the walk position
+    /// below is valid.
+    bool isResolved;
+
+    /// Position in the filesystem rule prefix tree reached by looking up the directory path.
+    TFilesystemRulePrefixTree::SWalkPosition walkPosition;
+  };
+
   /// Type alias for holding a map from filesystem rule name to filesystem rule object. All
   /// filesystem rules are uniquely identified by name, and the names are considered case
   /// sensitive.
@@ -289,10 +309,16 @@ namespace Pathwinder
     /// @param [in] associatedPath Path associated internally with the open directory handle.
     /// @param [in] realOpenedPath Path actually submitted to the system when the directory
     /// handle was opened.
+    /// @param [in] redirectingRuleIndex Position index of the filesystem rule that redirected the
+    /// directory handle when it was opened, as identified by the file operation instruction used to
+    /// open it. If not known, the rule is identified by comparing paths.
     /// @return Instruction that provides information on how to execute the directory
     /// enumeration.
     DirectoryEnumerationInstruction GetInstructionForDirectoryEnumeration(
-        std::wstring_view associatedPath, std::wstring_view realOpenedPath) const;
+        std::wstring_view associatedPath,
+        std::wstring_view realOpenedPath,
+        RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex =
+            FileOperationInstruction::kUnknownRedirectingRuleIndex) const;
 
     /// Generates an instruction for how to execute a file operation, such as opening, creating,
     /// or querying information about an individual file.
@@ -301,12 +327,16 @@ namespace Pathwinder
     /// @param [in] fileAccessMode Type of access or accesses to be performed on the file.
     /// @param [in] createDisposition Create disposition for the requsted file operation, which
     /// specifies whether a new file should be created, an existing file opened, or either.
+    /// @param [in, out] rootDirectoryResumePoint Optional resume point for the directory that
+    /// contains the file, used to avoid looking up the directory part of the path again. Resolved
+    /// by this method if not already resolved.
     /// @return Instruction that provides information on how to execute the file operation
     /// redirection.
     FileOperationInstruction GetInstructionForFileOperation(
         std::wstring_view absoluteFilePath,
         FileAccessMode fileAccessMode,
-        CreateDisposition createDisposition) const;
+        CreateDisposition createDisposition,
+        SPathLookupResumePoint* rootDirectoryResumePoint = nullptr) const;
 
     /// Determines if any rule contained inside this object uses the specified directory as its
     /// origin directory.
@@ -340,6 +370,21 @@ namespace Pathwinder
 
   private:
 
+    /// Looks up the specified path in the filesystem rule prefix tree, resuming from the position
+    /// reached by a previous lookup of its containing directory if possible.
+    /// @param [in] absoluteFilePath Path being queried, exactly as supplied by the caller.
+    /// @param [in] windowsNamespacePrefix Windows namespace prefix at the start of the path.
+    /// @param [in] absoluteFilePathTrimmedForQuery Path being queried without its Windows
+    /// namespace prefix or any trailing backslash characters.
+    /// @param [in, out] rootDirectoryResumePoint Optional resume point for the directory that
+    /// contains the file. Resolved by this method if not already resolved.
+    /// @return Position in the filesystem rule prefix tree reached by looking up the path.
+    TFilesystemRulePrefixTree::SWalkPosition LookupPath(
+        std::wstring_view absoluteFilePath,
+        std::wstring_view windowsNamespacePrefix,
+        std::wstring_view absoluteFilePathTrimmedForQuery,
+        SPathLookupResumePoint* rootDirectoryResumePoint) const;
+
     /// Stores all absolute paths to origin directories used by filesystem rules.
     TCaseInsensitiveStringSet originDirectories;
 
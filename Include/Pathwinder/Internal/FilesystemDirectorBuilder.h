@@ -87,13 +87,17 @@ namespace Pathwinder
     /// @param [in] redirectMode Redirection mode enumerator for the new rule. Determines how
     /// redirections are presented to the application and which files are tried. Default
     /// behavior is to use simple redirection mode.
+    /// @param [in] sortDirectoryEnumerationOutput Whether or not directory enumeration output
+    /// should always be sorted for directories within the scope of the new rule. Default behavior
+    /// is to sort only if the filesystem is detected not to produce sorted output.
     /// @return Pointer to the new rule on success, error message on failure.
     Infra::ValueOrError<const FilesystemRule*, Infra::TemporaryString> AddRule(
         std::wstring&& ruleName,
         std::wstring_view originDirectory,
         std::wstring_view targetDirectory,
         std::vector<std::wstring>&& filePatterns = std::vector<std::wstring>(),
-        ERedirectMode redirectMode = ERedirectMode::Simple);
+        ERedirectMode redirectMode = ERedirectMode::Simple,
+        bool sortDirectoryEnumerationOutput = false);
 
     /// Attempts to create a new rule and insert it into the candidate filesystem director,
     /// reading settings from a configuration data section. The same constraints are imposed as
@@ -101,7 +101,8 @@ namespace Pathwinder
     /// @param [in] openHandleStore Instance of an open handle store object that holds all of the
     /// file handles known to be open. Sets the context for this call.
     /// @param [in] instructionSourceFunc Function to be invoked that will retrieve a directory
-    /// enumeration instruction, given a source path, file access mode, and create disposition.
+    /// enumeration instruction, given the associated path, real opened path, and redirecting rule
+    /// position index of the handle.
     /// @return Nothing if the request should be passed to the underlying system call without
     /// modification, a status code other than 0 (success) if that code should immediately be
     /// returned without further processing, or 0 (success) to indicate that the preparations were
@@ -116,7 +117,38 @@ namespace Pathwinder
         FILE_INFORMATION_CLASS fileInformationClass,
         PUNICODE_STRING fileName,
         std::function<DirectoryEnumerationInstruction(
-            std::wstring_view associatedPath, std::wstring_view realOpenedPath)>
+            std::wstring_view associatedPath,
+            std::wstring_view realOpenedPath,
+            RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)>
+            instructionSourceFunc);
+
+    /// Starts reading, in the background, the directory listings that a subsequent directory
+    /// enumeration using a newly-opened file handle would need, so that they are already cached,
+    /// or at least partially read, by the time the application enumerates the directory. Has no
+    /// effect unless both directory enumeration prefetching and directory listing caching are
+    /// enabled, the handle was opened as a directory, and the handle is cached in the open handle
+    /// store.
+    /// @param [in] functionName Name of the API function whose hook function is invoking this
+    /// function. Used only for logging.
+    /// @param [in] functionRequestIdentifier Request identifier associated with the invocation of
+    /// the named function. Used only for logging.
+    /// @param [in] openHandleStore Instance of an open handle store object that holds all of the
+    /// file handles known to be open. Sets the context for this call.
+    /// @param [in] fileHandle Newly-opened file handle.
+    /// @param [in] createOptions File creation or opening options received from the application.
+    /// @param [in] instructionSourceFunc Function to be invoked that will retrieve a directory
+    /// enumeration instruction, given the associated path, real opened path, and redirecting rule
+    /// position index of the handle.
+    void DirectoryEnumerationPrefetch(
+        const wchar_t* functionName,
+        unsigned int functionRequestIdentifier,
+        OpenHandleStore& openHandleStore,
+        HANDLE fileHandle,
+        ULONG createOptions,
+        std::function<DirectoryEnumerationInstruction(
+            std::wstring_view associatedPath,
+            std::wstring_view realOpenedPath,
+            RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)>
             instructionSourceFunc);
 
     /// Common internal entry point for intercepting attempts to create or open files, resulting in
@@ -137,7 +169,8 @@ namespace Pathwinder
     /// whether a new file should be created, existing file should be opened, and so on.
     /// @param [in] createOptions File creation or opening options received from the application.
     /// @param [in] instructionSourceFunc Function to be invoked that will retrieve a file operation
-    /// instruction, given a source path, file access mode, and create disposition.
+    /// instruction, given a source path, file access mode, create disposition, and resume point for
+    /// looking up paths relative to a root directory.
     /// @param [in] underlyingSystemCallInvoker Invokable function object that performs the actual
     /// operation, with the variable parameters being destination file handle address, object
     /// attributes of the file to attempt, and a create disposition. Other parameters known to the
@@ -157,7 +190,8 @@ namespace Pathwinder
         std::function<FileOperationInstruction(
             std::wstring_view absolutePath,
             FileAccessMode fileAccessMode,
-            CreateDisposition createDisposition)> instructionSourceFunc,
+            CreateDisposition createDisposition,
+            SPathLookupResumePoint* rootDirectoryResumePoint)> instructionSourceFunc,
         std::function<NTSTATUS(PHANDLE, POBJECT_ATTRIBUTES, ULONG)> underlyingSystemCallInvoker);
 
     /// Common internal entry point for intercepting attempts to rename a file or directory that has
@@ -174,7 +208,8 @@ namespace Pathwinder
     /// @param [in] renameInformationLength Size of the rename information structure, in bytes, as
     /// supplied by the application.
     /// @param [in] instructionSourceFunc Function to be invoked that will retrieve a file operation
-    /// instruction, given a target path for the rename, file access mode, and create disposition.
+    /// instruction, given a target path for the rename, file access mode, create disposition, and
+    /// resume point for looking up paths relative to a root directory.
     /// @param [in] underlyingSystemCallInvoker Invokable function object that performs the actual
     /// operation, with the only variable parameters being open file handle, rename information
     /// structure, and rename information structure length in bytes. Any and all other information
@@ -191,7 +226,8 @@ namespace Pathwinder
         std::function<FileOperationInstruction(
             std::wstring_view absoluteRenameTargetPath,
             FileAccessMode fileAccessMode,
-            CreateDisposition createDisposition)> instructionSourceFunc,
+            CreateDisposition createDisposition,
+            SPathLookupResumePoint* rootDirectoryResumePoint)> instructionSourceFunc,
         std::function<NTSTATUS(HANDLE, SFileRenameInformation&, ULONG)>
             underlyingSystemCallInvoker);
 
@@ -248,7 +284,8 @@ namespace Pathwinder
     /// @param [in] desiredAccess Access type requested for the query operation in question.
     /// Typically this would be read-only for information requests.
     /// @param [in] instructionSourceFunc Function to be invoked that will retrieve a file operation
-    /// instruction, given an absolute path, file access mode, and create disposition.
+    /// instruction, given an absolute path, file access mode, create disposition, and resume point
+    /// for looking up paths relative to a root directory.
     /// @param [in] underlyingSystemCallInvoker Invokable function object that performs the actual
     /// operation, with the only variable parameter being object attributes. Any and all other
     /// information is expected to be captured within the object itself, including other
@@ -263,7 +300,8 @@ namespace Pathwinder
         std::function<FileOperationInstruction(
             std::wstring_view absolutePath,
             FileAccessMode fileAccessMode,
-            CreateDisposition createDisposition)> instructionSourceFunc,
+            CreateDisposition createDisposition,
+            SPathLookupResumePoint* rootDirectoryResumePoint)> instructionSourceFunc,
         std::function<NTSTATUS(POBJECT_ATTRIBUTES)> underlyingSystemCallInvoker);
   } // namespace FilesystemExecutor
 } // namespace Pathwinder
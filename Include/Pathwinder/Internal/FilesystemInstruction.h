@@ -13,6 +13,7 @@
 #pragma once
 
 #include <cstdint>
+#include <limits>
 #include <optional>
 #include <string_view>
 #include <vector>
@@ -20,6 +21,7 @@
 #include <Infra/Core/TemporaryBuffer.h>
 
 #include "ApiBitSet.h"
+#include "FileInformationStruct.h"
 #include "FilesystemRule.h"
 
 namespace Pathwinder
@@ -296,6 +298,15 @@ namespace Pathwinder
         return directoryPathSource;
       }
 
+      /// Determines if the filenames that this instruction includes are restricted to those that
+      /// match a single file pattern, which can then be supplied directly to the system so that it
+      /// filters the directory contents before they are returned. Filenames must still be checked
+      /// individually using #ShouldIncludeInDirectoryEnumeration because the system file pattern
+      /// is only a necessary condition for inclusion, not necessarily a sufficient one.
+      /// @return Single uppercase file pattern that all included filenames must match, or an empty
+      /// string if there is no such file pattern.
+      std::wstring_view GetSystemQueryFilePattern(void) const;
+
       /// Selects a directory path from among those provided as input, using the directory
       /// path source enumerator to make the decision.
       /// @param [in] associatedPath Absolute path internally associated with the handle to
@@ -307,6 +318,24 @@ namespace Pathwinder
       std::wstring_view SelectDirectoryPath(
           std::wstring_view associatedPath, std::wstring_view realOpenedPath) const;
 
+      /// Determines whether or not the enumeration output for this directory should always be
+      /// sorted, regardless of the order in which the system produces the directory contents.
+      /// @return `true` if the enumeration output should always be sorted, `false` otherwise.
+      inline bool ShouldSortEnumerationOutput(void) const
+      {
+        return sortEnumerationOutput;
+      }
+
+      /// Creates a copy of this object that additionally requires the enumeration output for this
+      /// directory always be sorted.
+      /// @return Copy of this object with sorted enumeration output required.
+      inline SingleDirectoryEnumeration WithSortedEnumerationOutput(void) const
+      {
+        SingleDirectoryEnumeration copy = *this;
+        copy.sortEnumerationOutput = true;
+        return copy;
+      }
+
       /// Determines whether or not the specified filename should be included in a directory
       /// enumeration. If a filesystem rule is present then it is checked for a file pattern
       /// match and the result is either inverted or not, as appropriate. Otherwise it is
@@ -317,8 +346,61 @@ namespace Pathwinder
       /// otherwise.
       bool ShouldIncludeInDirectoryEnumeration(std::wstring_view filename) const;
 
+      /// Determines, for every file information structure in a buffer, whether or not it should be
+      /// included in a directory enumeration. Produces the same results as invoking
+      /// #ShouldIncludeInDirectoryEnumeration with each filename in turn, but dispatches only
+      /// once for the whole buffer and skips reading filenames if all of them are included.
+      /// @param [in] fileInformationStructLayout Layout of the file information structures in the
+      /// buffer.
+      /// @param [in] enumerationBuffer Buffer holding one or more file information structures,
+      /// chained together by their next entry offset fields.
+      /// @param [out] keepMask Receives one element per file information structure in the buffer,
+      /// in order, set to `true` if it should be included and `false` otherwise.
+      /// @return Number of file information structures that should be included.
+      unsigned int FilterDirectoryEnumerationBuffer(
+          const FileInformationStructLayout& fileInformationStructLayout,
+          const void* enumerationBuffer,
+          std::vector<bool>& keepMask) const;
+
     private:
 
+      /// Function type for filter kernels. Each filter kernel implements the file pattern match
+      /// check for one combination of file pattern source, match condition, and match inversion.
+      using TFilterKernel = bool (*)(const SingleDirectoryEnumeration&, std::wstring_view);
+
+      /// Filter kernel for instructions without a file pattern source, which include all files.
+      /// @param [in] instruction Instruction on whose behalf the filename is being checked.
+      /// @param [in] filename Filename to check for inclusion.
+      /// @return `true` unconditionally.
+      static bool FilterKernelIncludeAll(
+          const SingleDirectoryEnumeration& instruction, std::wstring_view filename);
+
+      /// Filter kernel for instructions with a file pattern source, specialized by match condition
+      /// and match inversion so that neither needs to be checked per filename.
+      /// @tparam kFilePatternMatchCondition Condition for querying the file pattern source.
+      /// @tparam kInvertMatches Whether or not final match output should be inverted.
+      /// @param [in] instruction Instruction on whose behalf the filename is being checked.
+      /// @param [in] filename Filename to check for inclusion.
+      /// @return `true` if the filename should be included in the enumeration, `false` otherwise.
+      template <EFilePatternMatchCondition kFilePatternMatchCondition, bool kInvertMatches>
+      static bool FilterKernel(
+          const SingleDirectoryEnumeration& instruction, std::wstring_view filename);
+
+      /// Selects the filter kernel that implements the specified file pattern match behavior.
+      /// Invoked once at construction time.
+      /// @param [in] hasFilePatternSource Whether or not a file pattern source is present.
+      /// @param [in] filePatternMatchCondition Condition for querying the file pattern source.
+      /// @param [in] invertMatches Whether or not final match output should be inverted.
+      /// @return Index of the selected filter kernel within the filter kernel table.
+      static uint8_t SelectFilterKernelIndex(
+          bool hasFilePatternSource,
+          EFilePatternMatchCondition filePatternMatchCondition,
+          bool invertMatches);
+
+      /// All available filter kernels. Index 0 is the kernel that includes all files, and the
+      /// remainder are ordered by match condition and then by match inversion.
+      static const TFilterKernel kFilterKernels[];
+
       /// Holds a pointer to the object used to check for a match with file patterns when
       /// enumerating directory contents. Used to determine if a particular filename should be
       /// included or excluded.
@@ -350,7 +432,11 @@ namespace Pathwinder
 
         /// How to search through the file pattern source for a match. Refer to the enumeration
         /// documentation for more information on the meaning of specific values.
-        EFilePatternMatchCondition filePatternMatchCondition : 7;
+        EFilePatternMatchCondition filePatternMatchCondition : 3;
+
+        /// Position within the filter kernel table of the filter kernel that implements the
+        /// combination of file pattern source, match condition, and match inversion.
+        uint8_t filterKernelIndex : 4;
 
         /// Which specific rule within the file pattern source is selected. This acts as an operand
         /// for file pattern match conditions that involve querying multiple rules where one is
@@ -387,6 +473,9 @@ namespace Pathwinder
 
       /// Enumerator to specify how to obtain the path of the directory to be enumerated.
       EDirectoryPathSource directoryPathSource;
+
+      /// Whether or not the enumeration output for this directory should always be sorted.
+      bool sortEnumerationOutput;
     };
 
     /// Holds the information needed to describe how to insert a single directory name into the
@@ -594,6 +683,16 @@ namespace Pathwinder
   {
   public:
 
+    /// Sentinel position index indicating that the filesystem rule that produced the redirected
+    /// filename is not known.
+    static constexpr RelatedFilesystemRuleContainer::TFilesystemRulesIndex
+        kUnknownRedirectingRuleIndex =
+            std::numeric_limits<RelatedFilesystemRuleContainer::TFilesystemRulesIndex>::max();
+
+    static_assert(
+        kUnknownRedirectingRuleIndex >= RelatedFilesystemRuleContainer::kMaximumFilesystemRuleCount,
+        "Sentinel rule position index must not be a valid position index.");
+
     /// Not intended to be invoked externally. Objects should generally be created using factory
     /// methods.
     inline FileOperationInstruction(
@@ -607,6 +706,7 @@ namespace Pathwinder
           filenamesToTry(filenamesToTry),
           createDispositionPreference(createDispositionPreference),
           filenameHandleAssociation(filenameHandleAssociation),
+          redirectingRuleIndex(kUnknownRedirectingRuleIndex),
           extraPreOperations(std::move(extraPreOperations)),
           extraPreOperationOperand(extraPreOperationOperand)
     {}
@@ -753,6 +853,16 @@ namespace Pathwinder
       return filenameHandleAssociation;
     }
 
+    /// Retrieves and returns the position index, within the container of filesystem rules that
+    /// share its origin directory, of the filesystem rule that produced the redirected filename.
+    /// @return Position index of the redirecting rule, or #kUnknownRedirectingRuleIndex if it is
+    /// not known.
+    inline RelatedFilesystemRuleContainer::TFilesystemRulesIndex GetRedirectingRuleIndex(
+        void) const
+    {
+      return redirectingRuleIndex;
+    }
+
     /// Retrieves and returns the redirected filename. Does not verify that such a name exists.
     /// @return Redirected filename.
     inline std::wstring_view GetRedirectedFilename(void) const
@@ -767,6 +877,19 @@ namespace Pathwinder
       return redirectedFilename.has_value();
     }
 
+    /// Creates a copy of this object that additionally identifies the filesystem rule that
+    /// produced the redirected filename, so that it need not be identified again later, such as
+    /// when enumerating a redirected directory.
+    /// @param [in] ruleIndex Position index of the redirecting rule within the container of
+    /// filesystem rules that share its origin directory.
+    /// @return Copy of this object with the redirecting rule identified.
+    inline FileOperationInstruction WithRedirectingRuleIndex(
+        RelatedFilesystemRuleContainer::TFilesystemRulesIndex ruleIndex) &&
+    {
+      redirectingRuleIndex = ruleIndex;
+      return std::move(*this);
+    }
+
   private:
 
     /// Redirected filename. This would result from a file operation redirection query that
@@ -785,6 +908,11 @@ namespace Pathwinder
     /// execution of the file operation.
     EAssociateNameWithHandle filenameHandleAssociation;
 
+    /// Position index of the filesystem rule that produced the redirected filename, within the
+    /// container of filesystem rules that share its origin directory. Occupies space that would
+    /// otherwise be padding.
+    RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex;
+
     /// Extra operations to perform before submitting the filesystem operation to the underlying
     /// system call.
     BitSetEnum<EExtraPreOperation> extraPreOperations;
@@ -42,6 +42,17 @@ namespace Pathwinder
     /// @return System call return code for the deletion operation.
     NTSTATUS Delete(std::wstring_view absolutePath);
 
+    /// Duplicates an existing directory handle so that the duplicate can be used for synchronous
+    /// enumeration. This is much cheaper than opening the same directory again by path, but the
+    /// duplicate shares the original handle's underlying file object, including its enumeration
+    /// cursor, so it is only suitable for handles whose enumerations are entirely under internal
+    /// control. Fails if the existing handle is not open for synchronous non-alertable I/O.
+    /// @param [in] directoryHandle Open handle for the directory to be enumerated.
+    /// @return Duplicated handle for the directory file on success, Windows error code on
+    /// failure.
+    Infra::ValueOrError<HANDLE, NTSTATUS> DuplicateDirectoryHandleForEnumeration(
+        HANDLE directoryHandle);
+
     /// Checks if the specified filesystem entity (file, directory, or otherwise) exists.
     /// @param [in] absolutePath Absolute path of the entity to check.
     /// @return `true` if the entity exists, `false` otherwise.
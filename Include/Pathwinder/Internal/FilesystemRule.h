@@ -89,7 +89,8 @@ namespace Pathwinder
         std::wstring_view originDirectoryFullPath,
         std::wstring_view targetDirectoryFullPath,
         std::vector<std::wstring>&& filePatterns = std::vector<std::wstring>(),
-        ERedirectMode redirectMode = ERedirectMode::Simple);
+        ERedirectMode redirectMode = ERedirectMode::Simple,
+        bool sortDirectoryEnumerationOutput = false);
 
     bool operator==(const FilesystemRule& other) const = default;
 
@@ -206,6 +207,16 @@ namespace Pathwinder
       return (false == filePatterns.empty());
     }
 
+    /// Determines whether or not directory enumeration output for directories within the scope of
+    /// this rule should always be sorted, even if the underlying filesystem appears to produce
+    /// directory contents in sorted order already. Useful for target directories located on
+    /// filesystems that do not guarantee any particular enumeration order.
+    /// @return `true` if directory enumeration output should always be sorted, `false` otherwise.
+    inline bool ShouldSortDirectoryEnumerationOutput(void) const
+    {
+      return sortDirectoryEnumerationOutput;
+    }
+
     /// Computes and returns the result of redirecting from the specified candidate path to the
     /// target directory associated with this rule. Input candidate path is split into two
     /// parts: the directory part, which identifies the absolute directory in which the file is
@@ -259,6 +270,10 @@ namespace Pathwinder
     /// Redirection mode for this filesystem rule.
     ERedirectMode redirectMode;
 
+    /// Whether or not directory enumeration output should always be sorted for directories within
+    /// the scope of this filesystem rule.
+    bool sortDirectoryEnumerationOutput;
+
     /// Position within the origin directory absolute path of the final separator between name
     /// and parent path. Initialized using the contents of the origin directory path string and
     /// must be declared before it.
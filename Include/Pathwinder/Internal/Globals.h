@@ -25,8 +25,45 @@
 
 namespace Pathwinder
 {
+  class ThreadPool;
+
   namespace Globals
   {
+    /// Holds settings that enable or tune optional performance-related behavior. Unless otherwise
+    /// configured, all optional behavior is disabled.
+    struct SPerformanceSettings
+    {
+      /// Whether or not directory enumeration queues fetch the next batch of directory contents in
+      /// the background while the current batch is being consumed.
+      bool directoryEnumerationReadAhead;
+
+      /// Whether or not all of the directory operation queues needed for a directory enumeration
+      /// are created concurrently, such that their directories are opened and their first batches
+      /// of directory contents are fetched in parallel.
+      bool directoryEnumerationConcurrentInitialFill;
+
+      /// Amount of time, in milliseconds, for which complete directory listings are cached and used
+      /// to service subsequent enumerations of the same directory. A value of 0 disables caching.
+      unsigned int directoryEnumerationListingCacheTimeToLiveMilliseconds;
+
+      /// Whether or not opening a directory handle that is subject to redirection starts reading
+      /// the listings that enumerating it would need in the background, so that they are already
+      /// cached by the time the application enumerates the directory. Only effective if directory
+      /// listing caching is enabled.
+      bool directoryEnumerationPrefetch;
+
+      /// Number of directory enumeration buffers of each size to allocate during initialization and
+      /// retain even when idle, which avoids allocating them on demand. A value of 0 disables
+      /// pre-warming, in which case buffers are allocated and trimmed according to demand.
+      unsigned int directoryEnumerationBufferPrewarmCount;
+
+      /// Number of worker threads in the thread pool used for background and asynchronous work. A
+      /// value of 0 uses the Windows thread pool, which manages the number of threads
+      /// automatically. Any other value uses a portable work-stealing thread pool that starts up to
+      /// this many worker threads on demand.
+      unsigned int threadPoolWorkerCount;
+    };
+
     /// Performs run-time initialization. This function only performs operations that are safe to
     /// perform within a DLL entry point.
     void Initialize(void);
@@ -40,5 +77,16 @@ namespace Pathwinder
     /// clean up when Pathwinder is unloaded.
     std::unordered_set<std::wstring>& TemporaryPathsToClean(void);
 
+    /// Retrieves a reference to a global data structure that holds performance-related settings.
+    /// These are read from the configuration file during initialization.
+    /// @return Mutable reference to the global performance settings.
+    SPerformanceSettings& PerformanceSettings(void);
+
+    /// Retrieves the thread pool shared by all background and asynchronous work. It is created the
+    /// first time it is needed, using the configured number of worker threads, and is never
+    /// destroyed.
+    /// @return Pointer to the shared thread pool, or `nullptr` if it could not be created.
+    ThreadPool* SharedThreadPool(void);
+
   } // namespace Globals
 } // namespace Pathwinder
@@ -12,7 +12,13 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <string_view>
@@ -24,15 +30,48 @@
 #include "ApiWindows.h"
 #include "DirectoryOperationQueue.h"
 #include "FileInformationStruct.h"
+#include "FilesystemDirector.h"
+#include "FilesystemInstruction.h"
+#include "PathInternPool.h"
 
 namespace Pathwinder
 {
   /// Implements a concurrency-safe storage data structure for open filesystem handles and
-  /// metadata associated with each.
+  /// metadata associated with each. Handles are distributed by value across multiple independently
+  /// locked segments so that concurrent operations on different handles rarely contend.
   class OpenHandleStore
   {
   public:
 
+    /// Number of independently locked segments across which handles are distributed.
+    static constexpr unsigned int kNumSegments = 64;
+
+    /// Number of counters in the membership filter that can rule out handles without locking.
+    /// Handle values are dense, so this many counters cover the first several thousand handles a
+    /// process opens without any two of them sharing a counter.
+    static constexpr unsigned int kNumFilterSlots = 16384;
+
+    // Every filter slot must map to exactly one segment, so that each counter is only ever modified
+    // while holding the lock of that segment.
+    static_assert(0 == (kNumFilterSlots % kNumSegments), "Filter slots must map to one segment.");
+
+    /// Number of generation counters used to detect changes to stored handle data without locking.
+    /// Handles that share a counter are invalidated together, which costs only a cache miss.
+    static constexpr unsigned int kNumGenerationSlots = 1024;
+
+    // Generation counters are modified while holding segment locks, so likewise every generation
+    // slot must map to exactly one segment.
+    static_assert(
+        0 == (kNumGenerationSlots % kNumSegments), "Generation slots must map to one segment.");
+
+    /// Type for functions that produce the directory enumeration instruction for a handle, given
+    /// the path internally associated with it, the path that was actually opened, and the position
+    /// index of the filesystem rule that redirected it.
+    using TDirectoryEnumerationInstructionSource = std::function<DirectoryEnumerationInstruction(
+        std::wstring_view associatedPath,
+        std::wstring_view realOpenedPath,
+        RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)>;
+
     /// Record type for storing an in-progress directory enumeration operation.
     struct SInProgressDirectoryEnumeration
     {
@@ -45,13 +84,41 @@ namespace Pathwinder
       /// enumeration.
       FileInformationStructLayout fileInformationStructLayout;
 
-      /// Set of already-enumerated files. Used for deduplication in the output.
-      std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
-          enumeratedFilenames;
+      /// Source of the directory enumeration instruction from which the queue was created, retained
+      /// so that the queue can be created again if it is released once the directory enumeration
+      /// is drained. If empty then the queue cannot be created again, so it is never released.
+      TDirectoryEnumerationInstructionSource instructionSource;
+
+      /// File pattern most recently supplied by the application to filter the directory
+      /// enumeration, or empty if none was supplied. Retained because the application need not
+      /// supply it again when restarting the directory enumeration.
+      std::wstring queryFilePattern;
+
+      /// Most recently enumerated filename. Directory operation queues produce filenames in
+      /// case-insensitive sorted order, so any duplicates appear adjacent to one another and only
+      /// the last filename needs to be retained for deduplication.
+      std::wstring lastEnumeratedFilename;
+
+      /// Number of unique filenames enumerated since the enumeration was started or restarted.
+      /// Used to rebuild deduplication state if the queue turns out not to be sorted.
+      unsigned int numEnumeratedFilenames;
+
+      /// Set of already-enumerated files. Only used for deduplication in the output if the queue
+      /// was observed to produce filenames out of sorted order, in which case adjacent duplicate
+      /// suppression is insufficient.
+      std::optional<
+          std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>>
+          unsortedEnumeratedFilenames;
 
       /// Whether or not to enable special behavior for the first invocation of a directory
       /// enumeration function, as specified by `NtQueryDirectoryFileEx` documentation.
       bool isFirstInvocation;
+
+      /// Whether or not the directory enumeration is drained, meaning that every source of file
+      /// information structures reported that there are no more files and so the queue and
+      /// deduplication state were released. A drained directory enumeration offers no more files
+      /// unless it is restarted, which creates the queue again.
+      bool isDrained;
     };
 
     /// By-reference view of data stored about an open handle.
@@ -67,28 +134,55 @@ namespace Pathwinder
       /// In-progress directory enumeration state. Not owned by this structure.
       std::optional<SInProgressDirectoryEnumeration*> directoryEnumeration;
 
+      /// Resolved resume point for looking up paths relative to the open handle, or `nullptr` if
+      /// none is available yet. Not owned by this structure.
+      const SPathLookupResumePoint* pathLookupResumePoint;
+
+      /// Position index of the filesystem rule that redirected the open handle, within the
+      /// container of filesystem rules that share its origin directory.
+      RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex =
+          FileOperationInstruction::kUnknownRedirectingRuleIndex;
+
       inline bool operator==(const SHandleDataView& other) const = default;
     };
 
-    /// Data stored about an open handle.
+    /// Data stored about an open handle. Paths are interned, so handles with identical paths,
+    /// including handles whose associated path and real opened path are the same, share a single
+    /// copy. Directory enumeration state is stored out-of-line, so that handles not used for
+    /// directory enumeration take up only a few words.
     struct SHandleData
     {
       /// Path associated internally with the open handle.
-      std::wstring associatedPath;
+      PathInternPool::InternedPath associatedPath;
 
       /// Actual path that was opened for the handle. This could be different from the
       /// associated path based on instructions from a filesystem director.
-      std::wstring realOpenedPath;
+      PathInternPool::InternedPath realOpenedPath;
+
+      /// In-progress directory enumeration state, or `nullptr` if there is none.
+      std::unique_ptr<SInProgressDirectoryEnumeration> directoryEnumeration;
 
-      /// In-progress directory enumeration state.
-      std::optional<SInProgressDirectoryEnumeration> directoryEnumeration;
+      /// Resolved resume point for looking up paths relative to the open handle, or `nullptr` if
+      /// none is available yet. Only created for handles used as root directories.
+      std::unique_ptr<SPathLookupResumePoint> pathLookupResumePoint;
+
+      /// Position index of the filesystem rule that redirected the open handle, within the
+      /// container of filesystem rules that share its origin directory. Recorded when the handle
+      /// is opened so that the rule need not be identified again for directory enumeration.
+      RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex =
+          FileOperationInstruction::kUnknownRedirectingRuleIndex;
 
       SHandleData(void) = default;
 
-      inline SHandleData(std::wstring&& associatedPath, std::wstring&& realOpenedPath)
+      inline SHandleData(
+          PathInternPool::InternedPath&& associatedPath,
+          PathInternPool::InternedPath&& realOpenedPath,
+          RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)
           : associatedPath(std::move(associatedPath)),
             realOpenedPath(std::move(realOpenedPath)),
-            directoryEnumeration()
+            directoryEnumeration(),
+            pathLookupResumePoint(),
+            redirectingRuleIndex(redirectingRuleIndex)
       {}
 
       SHandleData(SHandleData&& other) = default;
@@ -101,9 +195,11 @@ namespace Pathwinder
             .associatedPath = associatedPath,
             .realOpenedPath = realOpenedPath,
             .directoryEnumeration =
-                ((true == directoryEnumeration.has_value())
-                     ? std::optional<SInProgressDirectoryEnumeration*>(&(*directoryEnumeration))
-                     : std::nullopt)};
+                ((nullptr != directoryEnumeration)
+                     ? std::optional<SInProgressDirectoryEnumeration*>(directoryEnumeration.get())
+                     : std::nullopt),
+            .pathLookupResumePoint = pathLookupResumePoint.get(),
+            .redirectingRuleIndex = redirectingRuleIndex};
       }
     };
 
@@ -114,10 +210,18 @@ namespace Pathwinder
     /// handle. This object takes over ownership of the provided directory enumeration queue.
     /// @param [in] fileInformationStructLayout Layout description for the file information
     /// structures that will be produced by the directory enumeration query.
+    /// @param [in] instructionSource Source of the directory enumeration instruction from which
+    /// the directory enumeration queue was created. Optional, but if not supplied then the
+    /// directory enumeration queue is retained until the handle is closed.
+    /// @param [in] queryFilePattern File pattern supplied by the application to filter the
+    /// directory enumeration. Optional, defaults to no file pattern.
     void AssociateDirectoryEnumerationState(
         HANDLE handleToAssociate,
         std::unique_ptr<IDirectoryOperationQueue>&& directoryEnumerationQueue,
-        FileInformationStructLayout fileInformationStructLayout);
+        FileInformationStructLayout fileInformationStructLayout,
+        TDirectoryEnumerationInstructionSource instructionSource =
+            TDirectoryEnumerationInstructionSource(),
+        std::wstring_view queryFilePattern = std::wstring_view());
 
     /// Determines if the open handle store contains any handles at all. Primarily useful for
     /// testing.
@@ -126,29 +230,55 @@ namespace Pathwinder
     bool Empty(void);
 
     /// Queries the open handle store for the specified handle and retrieves a read-only view of
-    /// the associated data, if the handle is found in the store.
+    /// the associated data, if the handle is found in the store. The most recently retrieved view
+    /// is cached per thread and returned without locking for as long as the handle's generation
+    /// counter is unchanged, which speeds up repeated queries for the same handle, such as those
+    /// made for each call in a directory enumeration loop.
     /// @param [in] handleToQuery Handle for which to query.
     /// @return Read-only view of the data associated with the handle, if the handle exists in
     /// the store.
     std::optional<SHandleDataView> GetDataForHandle(HANDLE handleToQuery);
 
+    /// Determines, without locking, whether or not the specified handle might be stored in the open
+    /// handle store. A result of `false` is definitive, but a result of `true` could be a false
+    /// positive if another stored handle shares the same filter counter. Intended to allow the
+    /// vast majority of handles, which are never stored, to be ruled out cheaply.
+    /// @param [in] handleToQuery Handle for which to query.
+    /// @return `true` if the handle might be stored, `false` if it is definitely not stored.
+    inline bool MightContainHandle(HANDLE handleToQuery) const
+    {
+      const unsigned int filterSlot = FilterSlotForHandle(handleToQuery);
+      return (0 != filterCounters[filterSlot].load(std::memory_order_acquire));
+    }
+
     /// Inserts a new handle and corresponding metadata into the open handle store.
     /// @param [in] handleToInsert Handle to be inserted.
     /// @param [in] associatedPath Path to associate internally with the handle.
     /// @param [in] realOpenedPath Path that was actually opened when producing the handle.
+    /// @param [in] redirectingRuleIndex Position index of the filesystem rule that redirected the
+    /// handle, if known.
     void InsertHandle(
-        HANDLE handleToInsert, std::wstring&& associatedPath, std::wstring&& realOpenedPath);
+        HANDLE handleToInsert,
+        std::wstring&& associatedPath,
+        std::wstring&& realOpenedPath,
+        RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex =
+            FileOperationInstruction::kUnknownRedirectingRuleIndex);
 
     /// Inserts a new handle and corresponding path into the open handle store or, if the handle
     /// already exists, updates its stored data. Does not affect the directory enumeration
-    /// queue, only the path metadata.
+    /// queue, only the path metadata. Any path lookup resume point is discarded because it no
+    /// longer matches the path.
     /// @param [in] handleToInsert Handle to be inserted.
     /// @param [in] associatedPath Path to associate internally with the handle.
     /// @param [in] realOpenedPath Path that was actually opened when producing the handle.
+    /// @param [in] redirectingRuleIndex Position index of the filesystem rule that redirected the
+    /// handle, if known.
     void InsertOrUpdateHandle(
         HANDLE handleToInsertOrUpdate,
         std::wstring&& associatedPath,
-        std::wstring&& realOpenedPath);
+        std::wstring&& realOpenedPath,
+        RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex =
+            FileOperationInstruction::kUnknownRedirectingRuleIndex);
 
     /// Attempts to remove an existing handle and corresponding path from the open handle store.
     /// @param [in] handleToRemove Handle to be removed.
@@ -170,18 +300,131 @@ namespace Pathwinder
     /// @return Result of the underlying system call to `NtClose` to close the handle.
     NTSTATUS RemoveAndCloseHandle(HANDLE handleToRemove, SHandleData* handleData);
 
+    /// Determines the index of the segment responsible for storing the specified handle.
+    /// Primarily intended for tests.
+    /// @param [in] handle Handle for which the segment index is desired.
+    /// @return Index of the segment that stores the handle.
+    static constexpr unsigned int SegmentIndexForHandle(HANDLE handle)
+    {
+      // Handle values are multiples of 4, so the low-order bits carry no information. Handles are
+      // generally allocated close together, so the next bits are enough to spread them out.
+      return static_cast<unsigned int>((reinterpret_cast<size_t>(handle) >> 2) % kNumSegments);
+    }
+
+    /// Stores a resolved resume point for looking up paths relative to the specified handle. Has no
+    /// effect if the handle is not in the store or already has a resume point, since all resume
+    /// points resolved for the same path are identical.
+    /// @param [in] handleToUpdate Handle with which to associate the resume point.
+    /// @param [in] pathLookupResumePoint Resolved resume point for the handle's associated path.
+    void SetPathLookupResumePoint(
+        HANDLE handleToUpdate, const SPathLookupResumePoint& pathLookupResumePoint);
+
     /// Retrieves the number of handles stored in the open handle store. Primarily useful for
     /// testing
     /// @return Number of handles in the data structure.
     unsigned int Size(void);
 
+    /// Retrieves the number of distinct paths held by the open handle store across all of its
+    /// handles. Primarily intended for tests.
+    /// @return Number of distinct paths held.
+    inline unsigned int NumDistinctPaths(void)
+    {
+      return pathInternPool.Size();
+    }
+
   private:
 
-    /// Open handle data structure itself.
-    /// Maps from a handle to the filesystem path that was used to open it.
-    std::unordered_map<HANDLE, SHandleData> openHandles;
+    /// Produces a new identifier that distinguishes an open handle store instance from all others,
+    /// including instances that previously existed at the same address.
+    /// @return New open handle store identifier.
+    static uint64_t NewStoreIdentifier(void);
+
+    /// Determines the index of the generation counter for the specified handle.
+    /// @param [in] handle Handle for which the generation counter index is desired.
+    /// @return Index of the generation counter for the handle.
+    static constexpr unsigned int GenerationSlotForHandle(HANDLE handle)
+    {
+      return static_cast<unsigned int>(
+          (reinterpret_cast<size_t>(handle) >> 2) % kNumGenerationSlots);
+    }
+
+    /// Retrieves the current value of the generation counter for the specified handle.
+    /// @param [in] handle Handle for which the generation counter value is desired.
+    /// @return Current generation counter value.
+    inline uint32_t GenerationForHandle(HANDLE handle) const
+    {
+      return generationCounters[GenerationSlotForHandle(handle)].load(std::memory_order_acquire);
+    }
+
+    /// Records that the data stored for the specified handle was modified or removed, so that any
+    /// views of it cached by other threads are no longer used. Must be invoked while holding the
+    /// lock of the segment that stores the handle.
+    /// @param [in] handle Handle whose data was modified or removed.
+    inline void InvalidateCachedHandleData(HANDLE handle)
+    {
+      generationCounters[GenerationSlotForHandle(handle)].fetch_add(1, std::memory_order_release);
+    }
+
+    /// Determines the index of the membership filter counter for the specified handle.
+    /// @param [in] handle Handle for which the filter counter index is desired.
+    /// @return Index of the filter counter for the handle.
+    static constexpr unsigned int FilterSlotForHandle(HANDLE handle)
+    {
+      return static_cast<unsigned int>((reinterpret_cast<size_t>(handle) >> 2) % kNumFilterSlots);
+    }
+
+    /// Records that the specified handle was added to the open handle store. Must be invoked while
+    /// holding the lock of the segment that stores the handle.
+    /// @param [in] handle Handle that was added.
+    inline void FilterAddHandle(HANDLE handle)
+    {
+      filterCounters[FilterSlotForHandle(handle)].fetch_add(1, std::memory_order_release);
+    }
+
+    /// Records that the specified handle was removed from the open handle store. Must be invoked
+    /// while holding the lock of the segment that stored the handle.
+    /// @param [in] handle Handle that was removed.
+    inline void FilterRemoveHandle(HANDLE handle)
+    {
+      filterCounters[FilterSlotForHandle(handle)].fetch_sub(1, std::memory_order_release);
+    }
+
+    /// One independently locked segment of the open handle store. Aligned to a cache line so that
+    /// locking one segment does not disturb threads working with neighbouring segments.
+    struct alignas(64) SSegment
+    {
+      /// Open handle data structure itself.
+      /// Maps from a handle to the filesystem path that was used to open it.
+      std::unordered_map<HANDLE, SHandleData> openHandles;
+
+      /// Mutex for ensuring concurrency-safe access to the open handles data structure.
+      Infra::SharedMutex openHandlesMutex;
+    };
+
+    /// Retrieves the segment responsible for storing the specified handle.
+    /// @param [in] handle Handle for which the segment is desired.
+    /// @return Reference to the segment that stores the handle.
+    inline SSegment& SegmentForHandle(HANDLE handle)
+    {
+      return segments[SegmentIndexForHandle(handle)];
+    }
+
+    /// Pool of paths associated with stored handles. Must be declared before the segments so that
+    /// it is destroyed after them.
+    PathInternPool pathInternPool;
+
+    /// All segments of the open handle store.
+    std::array<SSegment, kNumSegments> segments;
+
+    /// Counting membership filter, holding the number of stored handles that map to each counter.
+    std::array<std::atomic<uint16_t>, kNumFilterSlots> filterCounters = {};
+
+    /// Generation counters, each advanced whenever data is modified or removed for any stored
+    /// handle that maps to it. Used to validate per-thread cached views of handle data.
+    std::array<std::atomic<uint32_t>, kNumGenerationSlots> generationCounters = {};
 
-    /// Mutex for ensuring concurrency-safe access to the open handles data structure.
-    Infra::SharedMutex openHandlesMutex;
+    /// Identifier of this open handle store instance, used to associate per-thread cached views
+    /// of handle data with the store from which they were retrieved.
+    uint64_t storeIdentifier = NewStoreIdentifier();
   };
 } // namespace Pathwinder
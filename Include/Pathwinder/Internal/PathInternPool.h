@@ -0,0 +1,164 @@
+/***************************************************************************************************
+ * Pathwinder
+ *   Path redirection for files, directories, and registry entries.
+ ***************************************************************************************************
+ * Authored by Samuel Grossman
+ * Copyright (c) 2022-2025
+ ***********************************************************************************************//**
+ * @file PathInternPool.h
+ *   Declaration of a concurrency-safe pool that stores a single reference-counted copy of each
+ *   distinct path.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <Infra/Core/Mutex.h>
+
+namespace Pathwinder
+{
+  /// Stores a single copy of each distinct path and hands out references to it, so that all
+  /// holders of identical paths share one allocation. Paths are compared exactly, including case.
+  /// A path is freed as soon as its last reference is destroyed. The pool must outlive all of the
+  /// references it hands out. Obtaining a reference to a path already in the pool only needs shared
+  /// access to the shard holding it, and destroying a reference other than the last does not lock
+  /// anything, so references to frequently-used identical paths do not serialize with one another.
+  class PathInternPool
+  {
+  private:
+
+    /// Record type for storing a single distinct path held by the pool.
+    struct SEntry
+    {
+      /// Pool that holds this entry.
+      PathInternPool* pool;
+
+      /// Index of the shard of the pool that holds this entry.
+      unsigned int shardIndex;
+
+      /// Number of references to this entry that currently exist. Only incremented while holding
+      /// the lock of the shard that holds this entry, in either mode, and only decremented to 0
+      /// while holding it exclusively, so an entry found in its shard always has references.
+      std::atomic<unsigned int> numReferences;
+
+      /// Path itself.
+      std::wstring path;
+    };
+
+  public:
+
+    /// Number of independently locked shards across which paths are distributed.
+    static constexpr unsigned int kNumShards = 16;
+
+    /// Move-only reference to a path held by a path intern pool. The path remains available for
+    /// as long as the reference exists. A default-constructed reference refers to an empty path.
+    class InternedPath
+    {
+    public:
+
+      inline InternedPath(void) : entry(nullptr) {}
+
+      InternedPath(const InternedPath& other) = delete;
+
+      inline InternedPath(InternedPath&& other) noexcept : entry(other.entry)
+      {
+        other.entry = nullptr;
+      }
+
+      inline ~InternedPath(void)
+      {
+        if (nullptr != entry) entry->pool->Release(entry);
+      }
+
+      InternedPath& operator=(const InternedPath& other) = delete;
+
+      inline InternedPath& operator=(InternedPath&& other) noexcept
+      {
+        if (this != &other)
+        {
+          if (nullptr != entry) entry->pool->Release(entry);
+          entry = other.entry;
+          other.entry = nullptr;
+        }
+
+        return *this;
+      }
+
+      inline bool operator==(const InternedPath& other) const
+      {
+        return (AsStringView() == other.AsStringView());
+      }
+
+      inline operator std::wstring_view(void) const
+      {
+        return AsStringView();
+      }
+
+      /// Retrieves the referenced path as a null-terminated string.
+      /// @return Pointer to the referenced path.
+      inline const wchar_t* AsCString(void) const
+      {
+        return ((nullptr == entry) ? L"" : entry->path.c_str());
+      }
+
+      /// Retrieves a read-only view of the referenced path.
+      /// @return View of the referenced path.
+      inline std::wstring_view AsStringView(void) const
+      {
+        return ((nullptr == entry) ? std::wstring_view() : std::wstring_view(entry->path));
+      }
+
+    private:
+
+      friend class PathInternPool;
+
+      inline explicit InternedPath(SEntry* entry) : entry(entry) {}
+
+      /// Entry in the pool that holds the referenced path, or `nullptr` for an empty path.
+      SEntry* entry;
+    };
+
+    PathInternPool(void) = default;
+
+    PathInternPool(const PathInternPool& other) = delete;
+
+    PathInternPool(PathInternPool&& other) = delete;
+
+    ~PathInternPool(void);
+
+    /// Obtains a reference to the specified path, adding it to the pool if it is not already
+    /// present. Empty paths are never added to the pool.
+    /// @param [in] path Path to be interned. Its contents are moved into the pool if the path is
+    /// not already present.
+    /// @return Reference to the interned path.
+    InternedPath Intern(std::wstring&& path);
+
+    /// Retrieves the number of distinct paths held in the pool. Primarily intended for tests.
+    /// @return Number of distinct paths in the pool.
+    unsigned int Size(void);
+
+  private:
+
+    /// One independently locked shard of the pool.
+    struct SShard
+    {
+      /// Distinct paths held in this shard, keyed by views of the paths owned by the entries.
+      std::unordered_map<std::wstring_view, SEntry*> entries;
+
+      /// Mutex for ensuring concurrency-safe access to this shard.
+      Infra::SharedMutex entriesMutex;
+    };
+
+    /// Removes a reference to the specified entry, freeing it if no references remain.
+    /// @param [in] entry Entry for which a reference is being removed.
+    void Release(SEntry* entry);
+
+    /// All shards of the pool.
+    std::array<SShard, kNumShards> shards;
+  };
+} // namespace Pathwinder
@@ -246,6 +246,24 @@ namespace Pathwinder
       TChildrenContainer children;
     };
 
+    /// Position reached by walking down the tree one delimited string component at a time. A walk
+    /// can later be resumed from this position to match a longer string that begins with the
+    /// string already walked, without walking the common part again.
+    struct SWalkPosition
+    {
+      /// Deepest node reached by the walk. If the walk stopped early because a component had no
+      /// corresponding child node, then this is the last node that did have one.
+      const Node* node;
+
+      /// Deepest node encountered during the walk that contains data, or `nullptr` if none of the
+      /// nodes encountered contain data.
+      const Node* longestMatchingPrefixNode;
+
+      /// Whether or not every component walked so far had a corresponding node. If not, then no
+      /// longer string can reach any deeper nodes and resuming the walk has no effect.
+      bool isOnPath;
+    };
+
     /// Maximum number of path delimiter strings allowed in a path prefix tree.
     static constexpr unsigned int kMaxDelimiters = 4;
 
@@ -386,30 +404,7 @@ namespace Pathwinder
     /// @return Pointer to the node if it exists and contains data, `nullptr` otherwise.
     const Node* LongestMatchingPrefix(TStringView stringToMatch) const
     {
-      size_t tokenizeState = 0;
-
-      const Node* currentNode = &rootNode;
-      const Node* longestMatchingPrefixNode = nullptr;
-
-      for (std::optional<TStringView> maybeNextPathComponent = Infra::Strings::Tokenize<TChar>(
-               tokenizeState, stringToMatch, pathDelimiters.Data(), pathDelimiters.Size());
-           true == maybeNextPathComponent.has_value();
-           maybeNextPathComponent = Infra::Strings::Tokenize<TChar>(
-               tokenizeState, stringToMatch, pathDelimiters.Data(), pathDelimiters.Size()))
-      {
-        if (0 == maybeNextPathComponent->length()) continue;
-
-        if (true == currentNode->HasData()) longestMatchingPrefixNode = currentNode;
-
-        const Node* nextPathChildNode = currentNode->FindChild(*maybeNextPathComponent);
-        if (nullptr == nextPathChildNode) break;
-
-        currentNode = nextPathChildNode;
-      }
-
-      if (true == currentNode->HasData()) longestMatchingPrefixNode = currentNode;
-
-      return longestMatchingPrefixNode;
+      return Walk(stringToMatch).longestMatchingPrefixNode;
     }
 
     /// Attempts to traverse the tree to the node that represents the specified prefix.
@@ -422,20 +417,56 @@ namespace Pathwinder
     /// prefix.
     const Node* TraverseTo(TStringView prefix) const
     {
-      const Node* currentNode = &rootNode;
+      const SWalkPosition walkPosition = Walk(prefix);
+      if (false == walkPosition.isOnPath) return nullptr;
 
-      for (TStringView pathComponent :
-           Infra::Strings::Tokenizer(prefix, pathDelimiters.Data(), pathDelimiters.Size()))
+      return walkPosition.node;
+    }
+
+    /// Walks down the tree from the root node along the components of the specified string.
+    /// @param [in] stringToWalk Delimited string along which to walk.
+    /// @return Position reached by the walk, from which it can later be resumed.
+    inline SWalkPosition Walk(TStringView stringToWalk) const
+    {
+      return WalkFrom(
+          {.node = &rootNode, .longestMatchingPrefixNode = nullptr, .isOnPath = true},
+          stringToWalk);
+    }
+
+    /// Resumes a walk down the tree from a previously-reached position along the components of the
+    /// specified string, which is the remaining part of a longer string whose beginning was already
+    /// walked. The remaining part must begin at a delimiter boundary.
+    /// @param [in] startPosition Position from which to resume the walk.
+    /// @param [in] remainingStringToWalk Remaining part of the delimited string along which to
+    /// walk.
+    /// @return Position reached by the walk, from which it can later be resumed.
+    SWalkPosition WalkFrom(SWalkPosition startPosition, TStringView remainingStringToWalk) const
+    {
+      SWalkPosition walkPosition = startPosition;
+      if (false == walkPosition.isOnPath) return walkPosition;
+
+      for (TStringView pathComponent : Infra::Strings::Tokenizer(
+               remainingStringToWalk, pathDelimiters.Data(), pathDelimiters.Size()))
       {
         if (0 == pathComponent.length()) continue;
 
-        const Node* nextPathChildNode = currentNode->FindChild(pathComponent);
-        if (nullptr == nextPathChildNode) return nullptr;
+        if (true == walkPosition.node->HasData())
+          walkPosition.longestMatchingPrefixNode = walkPosition.node;
 
-        currentNode = nextPathChildNode;
+        const Node* nextPathChildNode = walkPosition.node->FindChild(pathComponent);
+        if (nullptr == nextPathChildNode)
+        {
+          walkPosition.isOnPath = false;
+          return walkPosition;
+        }
+
+        walkPosition.node = nextPathChildNode;
       }
 
-      return currentNode;
+      if (true == walkPosition.node->HasData())
+        walkPosition.longestMatchingPrefixNode = walkPosition.node;
+
+      return walkPosition;
     }
 
     /// Updates the data associated with the specified prefix using copy semantics. If the prefix
@@ -37,6 +37,38 @@ namespace Pathwinder
     /// log file.
     inline constexpr std::wstring_view kStrConfigurationSettingLogLevel = L"LogLevel";
 
+    /// Configuration file setting for enabling background read-ahead during directory enumeration.
+    inline constexpr std::wstring_view kStrConfigurationSettingDirectoryEnumerationReadAhead =
+        L"DirectoryEnumerationReadAhead";
+
+    /// Configuration file setting for enabling concurrent creation of all of the sources of
+    /// directory enumeration output.
+    inline constexpr std::wstring_view
+        kStrConfigurationSettingDirectoryEnumerationConcurrentInitialFill =
+            L"DirectoryEnumerationConcurrentInitialFill";
+
+    /// Configuration file setting for enabling caching of complete directory listings and
+    /// specifying, in milliseconds, how long each listing remains valid.
+    inline constexpr std::wstring_view
+        kStrConfigurationSettingDirectoryEnumerationListingCacheTimeToLive =
+            L"DirectoryEnumerationListingCacheTimeToLive";
+
+    /// Configuration file setting for enabling background reading of directory listings as soon as
+    /// a directory that is subject to redirection is opened.
+    inline constexpr std::wstring_view kStrConfigurationSettingDirectoryEnumerationPrefetch =
+        L"DirectoryEnumerationPrefetch";
+
+    /// Configuration file setting for specifying how many directory enumeration buffers of each
+    /// size to allocate at startup and retain even when idle.
+    inline constexpr std::wstring_view
+        kStrConfigurationSettingDirectoryEnumerationBufferPrewarmCount =
+            L"DirectoryEnumerationBufferPrewarmCount";
+
+    /// Configuration file setting for specifying the number of worker threads in each of the thread
+    /// pools used for background and asynchronous work.
+    inline constexpr std::wstring_view kStrConfigurationSettingThreadPoolWorkerCount =
+        L"ThreadPoolWorkerCount";
+
     /// Configuration file section for defining variables.
     inline constexpr std::wstring_view kStrConfigurationSectionDefinitions = L"Definitions";
 
@@ -60,6 +92,22 @@ namespace Pathwinder
     inline constexpr std::wstring_view kStrConfigurationSettingFilesystemRuleFilePattern =
         L"FilePattern";
 
+    /// Configuration file setting for requiring that directory enumeration output be sorted for
+    /// directories within the scope of a filesystem rule.
+    inline constexpr std::wstring_view
+        kStrConfigurationSettingFilesystemRuleSortDirectoryEnumerationOutput =
+            L"SortDirectoryEnumerationOutput";
+
+    /// Compares two filenames for the purpose of sorting directory contents. Ordering is
+    /// case-insensitive, except that the special "." and ".." entries always sort first, which is
+    /// where filesystems offer them and where applications expect to find them. Plain comparison
+    /// would place them after filenames that begin with characters like '!', '#', or '$'.
+    /// @param [in] fileNameA First filename to compare.
+    /// @param [in] fileNameB Second filename to compare.
+    /// @return Negative value if the first filename sorts first, positive value if the second
+    /// filename sorts first, or 0 if they are equivalent.
+    int CompareFileNamesForSorting(std::wstring_view fileNameA, std::wstring_view fileNameB);
+
     /// Determines if the specified filename matches the specified file pattern. An empty file
     /// pattern is presumed to match everything. Input filename must not contain any backslash
     /// separators, as it is intended to represent a file within a directory rather than a path.
@@ -12,19 +12,49 @@
 
 #pragma once
 
+#include <memory>
 #include <optional>
 
 #include <Infra/Core/Mutex.h>
 
 #include "ApiWindows.h"
+#include "WorkStealingThreadPool.h"
 
 namespace Pathwinder
 {
-  /// Simple wrapper class around the Windows thread pool API.
+  /// Simple wrapper class around the Windows thread pool API. Can alternatively be backed by a
+  /// portable work-stealing thread pool with a bounded number of worker threads.
   class ThreadPool
   {
   public:
 
+    /// Marks a region of code in which the calling thread blocks waiting for another work item to
+    /// complete. If the calling thread is a worker in a work-stealing thread pool, that pool is
+    /// allowed to start another worker to take its place for the duration of the region, so that
+    /// work items waiting on one another cannot exhaust its worker threads. Has no effect on any
+    /// other thread, including those in the Windows thread pool, which manages this automatically.
+    class ScopedBlockingWait
+    {
+    public:
+
+      inline ScopedBlockingWait(void)
+      {
+        TWorkStealingThreadPool::BeginBlockingWait();
+      }
+
+      ScopedBlockingWait(const ScopedBlockingWait& other) = delete;
+
+      inline ~ScopedBlockingWait(void)
+      {
+        TWorkStealingThreadPool::EndBlockingWait();
+      }
+
+      ScopedBlockingWait& operator=(const ScopedBlockingWait& other) = delete;
+    };
+
+    /// Maximum number of worker threads that can be requested for a work-stealing thread pool.
+    static constexpr unsigned int kMaxWorkerThreads = 256;
+
     ~ThreadPool(void);
 
     ThreadPool(const ThreadPool& other) = delete;
@@ -36,8 +66,12 @@ namespace Pathwinder
     ThreadPool& operator=(ThreadPool&& other) = default;
 
     /// Attempts to create a thread pool and, on success, returns the resulting object.
+    /// @param [in] numWorkerThreads Number of worker threads to use. If 0, the thread pool is
+    /// backed by the Windows thread pool, which manages the number of threads automatically.
+    /// Otherwise it is backed by a portable work-stealing thread pool that starts up to this many
+    /// worker threads on demand.
     /// @return Newly-created thread pool object, if successful.
-    static std::optional<ThreadPool> Create(void);
+    static std::optional<ThreadPool> Create(unsigned int numWorkerThreads = 0);
 
     /// Attempts to submit a work item to this thread pool.
     /// @param [in] functionToInvoke Callback function to invoke when processing this work item.
@@ -51,8 +85,13 @@ namespace Pathwinder
 
   private:
 
+    /// Type alias for the portable work-stealing thread pool that can back this object.
+    using TWorkStealingThreadPool = WorkStealingThreadPool<PTP_SIMPLE_CALLBACK>;
+
     ThreadPool(PTP_POOL threadPool, PTP_CLEANUP_GROUP threadPoolCleanupGroup);
 
+    ThreadPool(std::unique_ptr<TWorkStealingThreadPool>&& workStealingThreadPool);
+
     /// Ensures proper concurrency control of the thread pool itself.
     Infra::SharedMutex workItemMutex;
 
@@ -67,5 +106,9 @@ namespace Pathwinder
     /// Underlying thread pool environment object. Refer to the Windows thread pool API
     /// documentation for more information.
     TP_CALLBACK_ENVIRON threadPoolEnvironment;
+
+    /// Portable work-stealing thread pool that executes work items instead of the Windows thread
+    /// pool, if one was requested at creation time.
+    std::unique_ptr<TWorkStealingThreadPool> workStealingThreadPool;
   };
 } // namespace Pathwinder
@@ -0,0 +1,401 @@
+/***************************************************************************************************
+ * Pathwinder
+ *   Path redirection for files, directories, and registry entries.
+ ***************************************************************************************************
+ * Authored by Samuel Grossman
+ * Copyright (c) 2022-2025
+ ***********************************************************************************************//**
+ * @file WorkStealingThreadPool.h
+ *   Implementation of a portable thread pool that uses a fixed set of worker threads, each with
+ *   its own queue of work items, and balances load between them by work stealing.
+ **************************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace Pathwinder
+{
+  /// Thread pool with a bounded number of worker threads, each of which owns a double-ended queue
+  /// of work items. Workers take work from the back of their own queues and, when those are empty,
+  /// steal work from the front of other workers' queues. Work submitted by a worker thread is
+  /// placed into that worker's own queue, and work submitted by any other thread is distributed
+  /// among the workers in round-robin order. Idle workers spin for a short time before parking so
+  /// that bursts of work do not pay the cost of waking them up.
+  /// Worker threads are started on demand, only once there is more work queued than there are idle
+  /// workers to take it. A work item that blocks waiting for another work item to complete can say
+  /// so, in which case an additional worker can be started to take its place, so that work items
+  /// waiting for one another cannot exhaust the worker threads.
+  /// Does not depend on any platform-specific thread pool functionality, so it can be profiled,
+  /// tuned, and tested independently of the operating system.
+  /// @tparam WorkCallbackType Function pointer type for work item callbacks, which are invoked with
+  /// `nullptr` as their first parameter and the work item's context parameter as their second.
+  template <typename WorkCallbackType> class WorkStealingThreadPool
+  {
+  public:
+
+    /// Number of times an idle worker checks for available work before parking.
+    static constexpr unsigned int kSpinIterationsBeforePark = 256;
+
+    /// Maximum number of worker threads that can be started in addition to the requested number to
+    /// take the place of workers that are blocked waiting for other work items to complete.
+    static constexpr unsigned int kMaxReplacementWorkerThreads = 64;
+
+    /// Creates a thread pool. No worker threads are started until work is submitted.
+    /// @param [in] numWorkerThreads Maximum number of worker threads that execute work items at the
+    /// same time, not counting any that are blocked, which must be positive.
+    WorkStealingThreadPool(unsigned int numWorkerThreads)
+        : numWorkerThreads(numWorkerThreads),
+          workers(),
+          workerStartMutex(),
+          numStartedWorkers(0),
+          numIdleWorkers(0),
+          numBlockedWorkers(0),
+          numQueuedWorkItems(0),
+          numOutstandingWorkItems(0),
+          numParkedWorkers(0),
+          wakeSignal(0),
+          nextWorkerIndex(0),
+          isShuttingDown(false)
+    {
+      workers.reserve(numWorkerThreads + kMaxReplacementWorkerThreads);
+      for (unsigned int i = 0; i < (numWorkerThreads + kMaxReplacementWorkerThreads); ++i)
+        workers.push_back(std::make_unique<SWorker>());
+    }
+
+    /// Stops all of the worker threads. No new work items can be submitted once destruction
+    /// begins, but all of the work items already submitted are executed before the worker threads
+    /// stop. This ensures that every submitted work item completes, which in turn releases anything
+    /// waiting for it to do so.
+    ~WorkStealingThreadPool(void)
+    {
+      do
+      {
+        std::scoped_lock lock(workerStartMutex);
+        isShuttingDown.store(true);
+      }
+      while (false);
+
+      WakeWorkers(true);
+
+      const unsigned int numWorkersToJoin = numStartedWorkers.load();
+      for (unsigned int i = 0; i < numWorkersToJoin; ++i)
+        workers[i]->thread.join();
+    }
+
+    WorkStealingThreadPool(const WorkStealingThreadPool& other) = delete;
+
+    WorkStealingThreadPool(WorkStealingThreadPool&& other) = delete;
+
+    WorkStealingThreadPool& operator=(const WorkStealingThreadPool& other) = delete;
+
+    WorkStealingThreadPool& operator=(WorkStealingThreadPool&& other) = delete;
+
+    /// Retrieves the maximum number of worker threads that execute work items at the same time,
+    /// not counting any that are blocked.
+    /// @return Number of worker threads.
+    inline unsigned int NumWorkerThreads(void) const
+    {
+      return numWorkerThreads;
+    }
+
+    /// Retrieves the number of worker threads that have been started so far.
+    /// @return Number of started worker threads.
+    inline unsigned int NumStartedWorkerThreads(void) const
+    {
+      return numStartedWorkers.load();
+    }
+
+    /// Notifies the thread pool to which the calling thread belongs, if any, that the calling
+    /// thread is about to block waiting for another work item to complete. If there is queued work
+    /// and no idle worker to take it then another worker is started. Must be paired with a call to
+    /// #EndBlockingWait once the calling thread stops waiting.
+    static void BeginBlockingWait(void)
+    {
+      WorkStealingThreadPool* const threadPool = ThisThreadWorkerIdentity().threadPool;
+      if (nullptr == threadPool) return;
+
+      threadPool->numBlockedWorkers.fetch_add(1);
+      threadPool->StartWorkerIfNeeded();
+    }
+
+    /// Notifies the thread pool to which the calling thread belongs, if any, that the calling
+    /// thread is no longer blocked. Any worker started to take its place remains available.
+    static void EndBlockingWait(void)
+    {
+      WorkStealingThreadPool* const threadPool = ThisThreadWorkerIdentity().threadPool;
+      if (nullptr == threadPool) return;
+
+      threadPool->numBlockedWorkers.fetch_sub(1);
+    }
+
+    /// Submits a work item to this thread pool.
+    /// @param [in] functionToInvoke Callback function to invoke when processing this work item.
+    /// @param [in] contextParam Context parameter to pass to the work item's callback function.
+    /// @return `true` if successful, `false` otherwise.
+    bool SubmitWork(WorkCallbackType functionToInvoke, void* contextParam)
+    {
+      if ((0 == numWorkerThreads) || (true == isShuttingDown.load())) return false;
+
+      // Work submitted before the first worker is started goes into the first worker's queue,
+      // which is fine because that worker is started immediately afterwards.
+      const SWorkerIdentity& thisThreadWorkerIdentity = ThisThreadWorkerIdentity();
+      const unsigned int workerIndex =
+          ((this == thisThreadWorkerIdentity.threadPool)
+               ? thisThreadWorkerIdentity.workerIndex
+               : (nextWorkerIndex.fetch_add(1, std::memory_order_relaxed) %
+                  std::max(1u, numStartedWorkers.load())));
+      SWorker& worker = *workers[workerIndex];
+
+      // Counters are increased before the work item becomes visible so that they never fall below
+      // the number of work items that workers can actually take.
+      numOutstandingWorkItems.fetch_add(1);
+      numQueuedWorkItems.fetch_add(1);
+
+      do
+      {
+        std::scoped_lock lock(worker.workItemsMutex);
+        worker.workItems.push_back(
+            {.functionToInvoke = functionToInvoke, .contextParam = contextParam});
+      }
+      while (false);
+
+      StartWorkerIfNeeded();
+      WakeWorkers(false);
+      return true;
+    }
+
+    /// Waits for all outstanding work items to be completed. Calling this method does not prevent
+    /// new work items from being submitted.
+    void WaitForOutstandingWork(void)
+    {
+      unsigned int numOutstandingWorkItemsSnapshot = numOutstandingWorkItems.load();
+      while (0 != numOutstandingWorkItemsSnapshot)
+      {
+        numOutstandingWorkItems.wait(numOutstandingWorkItemsSnapshot);
+        numOutstandingWorkItemsSnapshot = numOutstandingWorkItems.load();
+      }
+    }
+
+  private:
+
+    /// Holds all of the information needed to execute a single work item.
+    struct SWorkItem
+    {
+      /// Callback function to invoke.
+      WorkCallbackType functionToInvoke;
+
+      /// Context parameter to pass to the callback function.
+      void* contextParam;
+    };
+
+    /// Holds the state of a single worker thread.
+    struct SWorker
+    {
+      /// Ensures proper concurrency control of the work item queue.
+      std::mutex workItemsMutex;
+
+      /// Queue of work items. The owning worker takes from the back and other workers steal from
+      /// the front.
+      std::deque<SWorkItem> workItems;
+
+      /// Worker thread itself.
+      std::thread thread;
+    };
+
+    /// Identifies the thread pool and worker, if any, that the current thread belongs to.
+    struct SWorkerIdentity
+    {
+      /// Thread pool that owns the current thread, or `nullptr` if the current thread is not a
+      /// worker thread.
+      WorkStealingThreadPool* threadPool;
+
+      /// Index of the worker within its thread pool.
+      unsigned int workerIndex;
+    };
+
+    /// Retrieves the worker identity of the current thread.
+    /// @return Mutable reference to the current thread's worker identity.
+    static inline SWorkerIdentity& ThisThreadWorkerIdentity(void)
+    {
+      static thread_local SWorkerIdentity workerIdentity = {
+          .threadPool = nullptr, .workerIndex = 0};
+      return workerIdentity;
+    }
+
+    /// Attempts to take a work item from the specified worker's own queue and, failing that, to
+    /// steal one from the queues of the other workers.
+    /// @param [in] workerIndex Index of the worker that is looking for work.
+    /// @return Work item to execute, if one was available.
+    std::optional<SWorkItem> TakeWorkItem(unsigned int workerIndex)
+    {
+      do
+      {
+        SWorker& worker = *workers[workerIndex];
+        std::scoped_lock lock(worker.workItemsMutex);
+        if (true == worker.workItems.empty()) break;
+
+        const SWorkItem workItem = worker.workItems.back();
+        worker.workItems.pop_back();
+        numQueuedWorkItems.fetch_sub(1);
+        return workItem;
+      }
+      while (false);
+
+      const unsigned int numWorkersToStealFrom = numStartedWorkers.load();
+      for (unsigned int i = 1; i < numWorkersToStealFrom; ++i)
+      {
+        SWorker& victim = *workers[(workerIndex + i) % numWorkersToStealFrom];
+        std::scoped_lock lock(victim.workItemsMutex);
+        if (true == victim.workItems.empty()) continue;
+
+        const SWorkItem workItem = victim.workItems.front();
+        victim.workItems.pop_front();
+        numQueuedWorkItems.fetch_sub(1);
+        return workItem;
+      }
+
+      return std::nullopt;
+    }
+
+    /// Starts another worker if there is more work queued than there are idle workers to take it,
+    /// provided that doing so would not exceed the maximum number of workers executing work items
+    /// at the same time.
+    void StartWorkerIfNeeded(void)
+    {
+      if (numQueuedWorkItems.load() <= numIdleWorkers.load()) return;
+
+      std::scoped_lock lock(workerStartMutex);
+      if (true == isShuttingDown.load()) return;
+
+      const unsigned int workerIndex = numStartedWorkers.load();
+      if (workerIndex == static_cast<unsigned int>(workers.size())) return;
+      if ((workerIndex - numBlockedWorkers.load()) >= numWorkerThreads) return;
+      if (numQueuedWorkItems.load() <= numIdleWorkers.load()) return;
+
+      // A newly-started worker is idle until it takes its first work item.
+      numIdleWorkers.fetch_add(1);
+      workers[workerIndex]->thread =
+          std::thread(&WorkStealingThreadPool::WorkerMain, this, workerIndex);
+      numStartedWorkers.store(workerIndex + 1);
+    }
+
+    /// Wakes parked workers so that they can look for work.
+    /// @param [in] wakeAll Whether to wake all parked workers or just one of them.
+    inline void WakeWorkers(bool wakeAll)
+    {
+      if ((false == wakeAll) && (0 == numParkedWorkers.load())) return;
+
+      wakeSignal.fetch_add(1);
+      if (true == wakeAll)
+        wakeSignal.notify_all();
+      else
+        wakeSignal.notify_one();
+    }
+
+    /// Entry point for each worker thread. Executes work items until the thread pool is shut down
+    /// and there are no work items left in any of the workers' queues.
+    /// @param [in] workerIndex Index of the worker that the calling thread represents.
+    void WorkerMain(unsigned int workerIndex)
+    {
+      ThisThreadWorkerIdentity() = {.threadPool = this, .workerIndex = workerIndex};
+      bool isIdle = true;
+
+      while (true)
+      {
+        const std::optional<SWorkItem> workItem = TakeWorkItem(workerIndex);
+        if (true == workItem.has_value())
+        {
+          if (true == isIdle)
+          {
+            numIdleWorkers.fetch_sub(1);
+            isIdle = false;
+          }
+
+          workItem->functionToInvoke(nullptr, workItem->contextParam);
+          if (1 == numOutstandingWorkItems.fetch_sub(1)) numOutstandingWorkItems.notify_all();
+          continue;
+        }
+
+        if (false == isIdle)
+        {
+          numIdleWorkers.fetch_add(1);
+          isIdle = true;
+        }
+
+        // Submission is refused during shutdown, so the only work items that can still arrive are
+        // those counted before then, and these keep this worker looking for work until they are
+        // visible in a queue and can be taken.
+        if ((true == isShuttingDown.load()) && (0 == numQueuedWorkItems.load())) break;
+
+        bool workAvailable = false;
+        for (unsigned int i = 0; (i < kSpinIterationsBeforePark) && (false == workAvailable); ++i)
+        {
+          std::this_thread::yield();
+          workAvailable = ((0 != numQueuedWorkItems.load()) || (true == isShuttingDown.load()));
+        }
+        if (true == workAvailable) continue;
+
+        // Registering as parked before checking for work one last time ensures that a submission
+        // either is seen here or sees this worker as parked and changes the wake signal, which
+        // prevents the wait from starting.
+        numParkedWorkers.fetch_add(1);
+        const uint32_t wakeSignalSnapshot = wakeSignal.load();
+        if ((0 == numQueuedWorkItems.load()) && (false == isShuttingDown.load()))
+          wakeSignal.wait(wakeSignalSnapshot);
+        numParkedWorkers.fetch_sub(1);
+      }
+
+      numIdleWorkers.fetch_sub(1);
+      ThisThreadWorkerIdentity() = {.threadPool = nullptr, .workerIndex = 0};
+    }
+
+    /// Maximum number of workers that execute work items at the same time, not counting any that
+    /// are blocked.
+    const unsigned int numWorkerThreads;
+
+    /// Worker threads and their work item queues. Allocated up front for every worker that could
+    /// ever be started so that the set of queues does not change while workers are stealing from
+    /// them, but only the first #numStartedWorkers have been started.
+    std::vector<std::unique_ptr<SWorker>> workers;
+
+    /// Serializes starting workers with one another and with shutdown.
+    std::mutex workerStartMutex;
+
+    /// Number of workers that have been started.
+    std::atomic<unsigned int> numStartedWorkers;
+
+    /// Number of started workers that are looking for work rather than executing a work item.
+    std::atomic<unsigned int> numIdleWorkers;
+
+    /// Number of started workers executing a work item that is blocked waiting for another work
+    /// item to complete.
+    std::atomic<unsigned int> numBlockedWorkers;
+
+    /// Number of work items in all of the workers' queues combined.
+    std::atomic<unsigned int> numQueuedWorkItems;
+
+    /// Number of work items that have been submitted but not yet completed.
+    std::atomic<unsigned int> numOutstandingWorkItems;
+
+    /// Number of workers that are parked or about to park.
+    std::atomic<unsigned int> numParkedWorkers;
+
+    /// Changed whenever parked workers should wake up to look for work.
+    std::atomic<uint32_t> wakeSignal;
+
+    /// Index of the next worker to receive a work item submitted by a thread that is not a worker.
+    std::atomic<unsigned int> nextWorkerIndex;
+
+    /// Whether or not the thread pool is shutting down.
+    std::atomic<bool> isShuttingDown;
+  };
+} // namespace Pathwinder
@@ -106,11 +106,14 @@ namespace PathwinderTest
   /// must exist in the fake filesystem.
   /// @param [in] rootDirectory Optional handle to an open root directory. For use when resolving a
   /// relative path.
+  /// @param [in] additionalCreateOptions Optional create or open options to pass along with the
+  /// request, such as `FILE_DIRECTORY_FILE` or `FILE_NON_DIRECTORY_FILE`.
   /// @return Handle to the newly-opened file.
   HANDLE OpenUsingFilesystemExecutor(
       TIntegrationTestContext& context,
       std::wstring_view pathToOpen,
-      HANDLE rootDirectory = nullptr);
+      HANDLE rootDirectory = nullptr,
+      ULONG additionalCreateOptions = 0);
 
   /// Uses the filesystem executor's query information entry point to verify that a file exists in
   /// the mock filesystem.
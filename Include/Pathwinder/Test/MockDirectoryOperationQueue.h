@@ -15,6 +15,7 @@
 #include <set>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <Infra/Core/Strings.h>
 
@@ -35,6 +36,11 @@ namespace PathwinderTest
     using TFileNamesToEnumerate =
         std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>;
 
+    /// Type alias for the container type used to hold file names to be enumerated in exactly the
+    /// order given, which need not be sorted. Used to simulate filesystems that do not produce
+    /// directory enumeration output in sorted order.
+    using TUnsortedFileNamesToEnumerate = std::vector<std::wstring>;
+
     /// Queues created this way will not enumerate any files but can be used to test enumeration
     /// status reporting. This can also be used as a default constructor for creating objects that
     /// cannot enumerate anything but instead simply report failure.
@@ -44,6 +50,10 @@ namespace PathwinderTest
         Pathwinder::FileInformationStructLayout fileInformationStructLayout,
         TFileNamesToEnumerate&& fileNamesToEnumerate);
 
+    MockDirectoryOperationQueue(
+        Pathwinder::FileInformationStructLayout fileInformationStructLayout,
+        TUnsortedFileNamesToEnumerate&& fileNamesToEnumerate);
+
     /// Retrieves the last query file pattern passed when restarting this queue's enumeration
     /// progress.
     /// @return Last-used query file pattern.
@@ -52,6 +62,12 @@ namespace PathwinderTest
       return lastRestartedQueryFilePattern;
     }
 
+    /// Replaces the filenames to be enumerated the next time this queue's enumeration progress is
+    /// restarted. Used to simulate directory contents changing between enumeration passes.
+    /// @param [in] fileNamesToEnumerate Filenames to enumerate after the next restart, which must
+    /// not be empty.
+    void SetFileNamesToEnumerateAfterRestart(TUnsortedFileNamesToEnumerate&& fileNamesToEnumerate);
+
     // IDirectoryOperationQueue
     unsigned int CopyFront(void* dest, unsigned int capacityBytes) const override;
     NTSTATUS EnumerationStatus(void) const override;
@@ -66,17 +82,21 @@ namespace PathwinderTest
     /// of file information structures to provide as output.
     Pathwinder::FileInformationStructLayout fileInformationStructLayout;
 
-    /// All of the filenames to enumerate, in sorted order.
-    TFileNamesToEnumerate fileNamesToEnumerate;
+    /// All of the filenames to enumerate, in the order in which they are to be enumerated.
+    TUnsortedFileNamesToEnumerate fileNamesToEnumerate;
 
     /// Iterator for the next filename to be enumerated.
-    TFileNamesToEnumerate::const_iterator nextFileNameToEnumerate;
+    TUnsortedFileNamesToEnumerate::const_iterator nextFileNameToEnumerate;
+
+    /// Filenames that replace those to be enumerated the next time enumeration progress is
+    /// restarted, if any.
+    std::optional<TUnsortedFileNamesToEnumerate> fileNamesToEnumerateAfterRestart;
 
     /// Optional override for the enumeration status.
     std::optional<NTSTATUS> enumerationStatusOverride;
 
     /// Holds the last query file pattern passed when attempting to restart this queue's enumeration
     /// progress. Not used for anything internally.
-    std::wstring_view lastRestartedQueryFilePattern;
+    std::wstring lastRestartedQueryFilePattern;
   };
 } // namespace PathwinderTest
@@ -11,10 +11,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 
 #include <Infra/Core/Strings.h>
@@ -65,6 +69,14 @@ namespace PathwinderTest
     {
       std::wstring absolutePath;
       EOpenHandleMode ioMode;
+
+      /// Handle from which this handle was duplicated, or `nullptr` if it was opened directly.
+      HANDLE duplicatedFromHandle;
+
+      /// Handle that was opened directly and from which this handle was ultimately duplicated, or
+      /// this handle itself if it was opened directly. All handles with the same value here refer
+      /// to the same underlying file object and therefore share a directory enumeration cursor.
+      HANDLE fileObjectHandle;
     };
 
     /// Type alias for the contents of an individual directory. Key is a filename and value is
@@ -92,7 +104,8 @@ namespace PathwinderTest
       /// filter filenames that are enumerated.
       std::wstring filePattern;
 
-      /// Iterator for the next item to enumerate.
+      /// Iterator for the next item to enumerate. If enumerating in reverse order, this instead
+      /// refers to the position one past the next item to enumerate.
       TDirectoryContents::const_iterator nextItemIterator;
 
       /// Iterator that represents the first item in the directory contents.
@@ -100,6 +113,9 @@ namespace PathwinderTest
 
       /// Iterator that represents the one-past-the-end item in the directory contents.
       TDirectoryContents::const_iterator endIterator;
+
+      /// Whether or not the directory contents are enumerated in reverse sorted order.
+      bool reverseOrder;
     };
 
     MockFilesystemOperations(void);
@@ -156,6 +172,50 @@ namespace PathwinderTest
     /// @return Full path of the filesystem entity, if it is open.
     std::optional<std::wstring_view> GetPathFromHandle(HANDLE handle) const;
 
+    /// Retrieves the handle from which the specified handle was duplicated.
+    /// @param [in] handle Handle to query for the handle from which it was duplicated.
+    /// @return Handle from which the specified handle was duplicated, or `nullptr` if it was opened
+    /// directly, if the specified handle is open.
+    std::optional<HANDLE> GetDuplicationSourceFromHandle(HANDLE handle) const;
+
+    /// Retrieves the number of times a directory has been opened for enumeration so far.
+    /// @return Number of directories opened for enumeration.
+    inline unsigned int GetNumDirectoriesOpenedForEnumeration(void) const
+    {
+      return numDirectoriesOpenedForEnumeration;
+    }
+
+    /// Retrieves the number of single-file directory information queries made so far.
+    /// @return Number of single-file directory information queries made.
+    inline unsigned int GetNumSingleFileDirectoryInformationQueries(void) const
+    {
+      return numSingleFileDirectoryInformationQueries;
+    }
+
+    /// Retrieves the number of directory enumeration system calls made so far, each of which
+    /// requests the next batch of contents of a directory being enumerated.
+    /// @return Number of directory enumeration system calls made.
+    inline unsigned int GetNumDirectoryEnumerationCalls(void) const
+    {
+      return numDirectoryEnumerationCalls;
+    }
+
+    /// Retrieves the number of directory enumeration system calls made so far from any thread
+    /// other than the one that created this object, such as a thread pool worker thread.
+    /// @return Number of directory enumeration system calls made from other threads.
+    inline unsigned int GetNumDirectoryEnumerationCallsFromOtherThreads(void) const
+    {
+      return numDirectoryEnumerationCallsFromOtherThreads;
+    }
+
+    /// Retrieves the largest number of system calls that would normally need to wait for the
+    /// filesystem that were ever in progress at the same time.
+    /// @return Maximum number of concurrent system calls observed so far.
+    inline unsigned int GetMaxConcurrentSystemCalls(void) const
+    {
+      return maxConcurrentSystemCalls;
+    }
+
     /// Inserts a directory into the fake filesystem if its parent directory exists.
     /// @param [in] absolutePath Absolute path of the directory to insert. Paths are
     /// case-insensitive.
@@ -200,10 +260,41 @@ namespace PathwinderTest
       configAllowOpenNonExistentFile = newConfigAllowOpenNonExistentFile;
     }
 
+    /// Configures this object to enumerate directory contents in reverse sorted order, which
+    /// simulates a filesystem that does not produce directory contents in sorted order. Affects
+    /// only directory enumerations that are started after this setting is changed.
+    /// @param [in] newConfigEnumerateInReverseOrder New value for this configuration setting.
+    inline void SetConfigEnumerateInReverseOrder(bool newConfigEnumerateInReverseOrder)
+    {
+      configEnumerateInReverseOrder = newConfigEnumerateInReverseOrder;
+    }
+
+    /// Configures this object to simulate latency in system calls that would normally need to
+    /// wait for the filesystem, specifically opening a directory for enumeration, enumerating
+    /// directory contents, and querying for single-file directory information. The delay is
+    /// applied before any mock filesystem state is accessed, so concurrent invocations from
+    /// multiple threads experience the delay concurrently.
+    /// @param [in] newConfigSystemCallLatencyMilliseconds New value for this configuration setting.
+    inline void SetConfigSystemCallLatency(unsigned int newConfigSystemCallLatencyMilliseconds)
+    {
+      configSystemCallLatencyMilliseconds = newConfigSystemCallLatencyMilliseconds;
+    }
+
+    /// Configures this object to hold back the next specified number of system calls that would
+    /// normally need to wait for the filesystem until all of them have been made, such that they
+    /// are all in progress at the same time. This only completes if the system calls are made
+    /// concurrently from different threads, so if they are not all made within a generous timeout
+    /// then the ones being held back are released anyway. System calls made afterwards are not
+    /// held back.
+    /// @param [in] newConfigSystemCallRendezvousCount New value for this configuration setting.
+    void SetConfigSystemCallRendezvous(unsigned int newConfigSystemCallRendezvousCount);
+
     // FilesystemOperations
     NTSTATUS CloseHandle(HANDLE handle);
     NTSTATUS CreateDirectoryHierarchy(std::wstring_view absoluteDirectoryPath);
     NTSTATUS Delete(std::wstring_view absolutePath);
+    Infra::ValueOrError<HANDLE, NTSTATUS> DuplicateDirectoryHandleForEnumeration(
+        HANDLE directoryHandle);
     bool Exists(std::wstring_view absolutePath);
     bool IsDirectory(std::wstring_view absolutePath);
     Infra::ValueOrError<HANDLE, NTSTATUS> OpenDirectoryForEnumeration(
@@ -227,6 +318,10 @@ namespace PathwinderTest
 
   private:
 
+    /// Simulates system call latency and holds back system calls for a rendezvous, if so
+    /// configured. Also tracks the number of system calls in progress at the same time.
+    void SimulateSystemCallLatencyInternal(void);
+
     /// Inserts a filesystem entity and all of its parent directories into the fake filesystem.
     /// For internal use only.
     /// @param [in] absolutePath Absolute path of the filesystem entity to insert. Paths are
@@ -240,6 +335,15 @@ namespace PathwinderTest
         unsigned int sizeInBytes,
         bool recursivelyCreateDirectories);
 
+    /// Determines the key under which the directory enumeration state for the specified handle is
+    /// stored. Duplicated handles share the directory enumeration state of the handle from which
+    /// they were ultimately duplicated, just like real handles share an enumeration cursor by way
+    /// of their underlying file object. This remains the case even if the directly-opened handle
+    /// is closed first.
+    /// @param [in] handle Handle for which the directory enumeration state key is desired.
+    /// @return Key for the directory enumeration state of the specified handle.
+    HANDLE DirectoryEnumerationStateKeyInternal(HANDLE handle) const;
+
     /// Attempts to generates a handle and marks a file or directory in the fake filesystem as being
     /// open. This method will fail if the requested filesystem entity does not exist in the fake
     /// filesystem.
@@ -266,6 +370,54 @@ namespace PathwinderTest
     /// triggers `nullptr` being returned.
     bool configAllowOpenNonExistentFile;
 
+    /// Configuration setting that determines whether directory contents are enumerated in sorted
+    /// order, which is the default, or in reverse sorted order.
+    bool configEnumerateInReverseOrder;
+
+    /// Configuration setting that determines the simulated latency, in milliseconds, of system
+    /// calls that would normally need to wait for the filesystem.
+    unsigned int configSystemCallLatencyMilliseconds;
+
+    /// Configuration setting that determines the number of system calls still to be held back
+    /// until all of them have been made, as part of a rendezvous. Guarded by the rendezvous mutex.
+    unsigned int configSystemCallRendezvousCount;
+
+    /// Guards the system call rendezvous state.
+    std::mutex systemCallRendezvousMutex;
+
+    /// Notified when all system calls taking part in a rendezvous have been made.
+    std::condition_variable systemCallRendezvousCondition;
+
+    /// Number of system calls that would normally need to wait for the filesystem that are
+    /// currently in progress.
+    std::atomic<unsigned int> numSystemCallsInProgress;
+
+    /// Largest number of system calls that would normally need to wait for the filesystem that
+    /// were ever in progress at the same time.
+    std::atomic<unsigned int> maxConcurrentSystemCalls;
+
+    /// Identifier of the thread that created this object. Used to distinguish system calls made
+    /// directly by a test case from those made in the background by other threads.
+    std::thread::id creatingThreadId;
+
+    /// Number of times a directory was opened for enumeration.
+    std::atomic<unsigned int> numDirectoriesOpenedForEnumeration;
+
+    /// Number of single-file directory information queries made.
+    std::atomic<unsigned int> numSingleFileDirectoryInformationQueries;
+
+    /// Number of directory enumeration system calls made.
+    std::atomic<unsigned int> numDirectoryEnumerationCalls;
+
+    /// Number of directory enumeration system calls made from threads other than the one that
+    /// created this object.
+    std::atomic<unsigned int> numDirectoryEnumerationCallsFromOtherThreads;
+
+    /// Guards the mock filesystem state so that operations can be invoked from multiple threads,
+    /// for example by thread pool work items. Recursive because some operations are implemented
+    /// in terms of others.
+    std::recursive_mutex mockStateMutex;
+
     /// Contents of the mock filesystem. Top-level map key is an absolute directory name and value
     /// is a set of directory contents.
     TFilesystemContents filesystemContents;
@@ -273,8 +425,8 @@ namespace PathwinderTest
     /// Open filesystem handles for files and directories. Maps from handle to directory full path.
     std::unordered_map<HANDLE, SOpenHandleData> openFilesystemHandles;
 
-    /// In-progress directory enumerations.
-    /// Maps from handle to directory enumeration state.
+    /// In-progress directory enumerations. Maps from the handle that identifies an underlying file
+    /// object to directory enumeration state.
     std::unordered_map<HANDLE, SDirectoryEnumerationState> inProgressDirectoryEnumerations;
 
     /// Next handle value to use when opening a directory handle.
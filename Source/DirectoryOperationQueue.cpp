@@ -12,22 +12,35 @@
 
 #include "DirectoryOperationQueue.h"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <cwctype>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <Infra/Core/ArrayList.h>
 #include <Infra/Core/DebugAssert.h>
 #include <Infra/Core/Strings.h>
+#include <Infra/Core/TemporaryBuffer.h>
 #include <Infra/Core/ValueOrError.h>
 
 #include "ApiWindows.h"
 #include "BufferPool.h"
 #include "FileInformationStruct.h"
 #include "FilesystemOperations.h"
+#include "Globals.h"
 #include "Strings.h"
+#include "ThreadPool.h"
 
 namespace Pathwinder
 {
@@ -36,20 +49,232 @@ namespace Pathwinder
   static constexpr unsigned int kInvalidEnumerationBufferBytePosition =
       static_cast<unsigned int>(-1);
 
+  /// Maximum length, in characters, of a single filename that a file information structure can
+  /// hold.
+  static constexpr unsigned int kMaxFileNameLengthChars = 255;
+
+  /// Obtains a handle that can be used to enumerate the contents of a directory. If a handle to the
+  /// directory is already open then it is duplicated, which avoids the cost of opening the
+  /// directory again by path. Otherwise, or if duplication fails, the directory is opened by path.
+  /// @param [in] existingDirectoryHandle Handle already open to the directory, or `NULL` if none
+  /// is available.
+  /// @param [in] absoluteDirectoryPath Absolute path of the directory to enumerate.
+  /// @return Handle for the directory on success, Windows error code on failure.
+  static Infra::ValueOrError<HANDLE, NTSTATUS> OpenDirectoryHandleForEnumeration(
+      HANDLE existingDirectoryHandle, std::wstring_view absoluteDirectoryPath)
+  {
+    if (NULL != existingDirectoryHandle)
+    {
+      auto maybeDuplicatedDirectoryHandle =
+          FilesystemOperations::DuplicateDirectoryHandleForEnumeration(existingDirectoryHandle);
+      if (true == maybeDuplicatedDirectoryHandle.HasValue()) return maybeDuplicatedDirectoryHandle;
+    }
+
+    return FilesystemOperations::OpenDirectoryForEnumeration(absoluteDirectoryPath);
+  }
+
+  /// Determines if a file pattern contains any wildcard characters, including the special
+  /// DOS-compatible wildcards that the system recognizes.
+  /// @param [in] filePattern File pattern to check.
+  /// @return `true` if the file pattern contains at least one wildcard, `false` otherwise.
+  static inline bool FilePatternContainsWildcards(std::wstring_view filePattern)
+  {
+    return (std::wstring_view::npos != filePattern.find_first_of(L"*?<>\""));
+  }
+
+  /// Selects the file pattern to supply to the system when enumerating a directory, given the file
+  /// pattern that the application supplied and the file pattern, if any, that all filenames
+  /// included by the match instruction must match. The system accepts only a single file pattern,
+  /// so the intersection of the two is used where it can be expressed as one pattern. Otherwise
+  /// the application's file pattern takes precedence because only the match instruction can be
+  /// enforced separately when filtering enumeration output.
+  /// @param [in] queryFilePattern File pattern supplied by the application, if any.
+  /// @param [in] matchInstructionFilePattern Uppercase file pattern that all filenames included
+  /// by the match instruction must match, if any.
+  /// @return File pattern to supply to the system, which is a view of one of the two inputs.
+  static std::wstring_view SelectSystemQueryFilePattern(
+      std::wstring_view queryFilePattern, std::wstring_view matchInstructionFilePattern)
+  {
+    if (true == matchInstructionFilePattern.empty()) return queryFilePattern;
+    if (queryFilePattern.find_first_not_of(L'*') == std::wstring_view::npos)
+      return matchInstructionFilePattern;
+
+    // A match instruction file pattern that is just a filename, and which also matches the
+    // application's file pattern, is by itself the intersection of the two.
+    if (false == FilePatternContainsWildcards(matchInstructionFilePattern))
+    {
+      Infra::TemporaryString queryFilePatternUpperCase;
+      for (wchar_t queryFilePatternChar : queryFilePattern)
+        queryFilePatternUpperCase << static_cast<wchar_t>(std::towupper(queryFilePatternChar));
+
+      if (true ==
+          Strings::FileNameMatchesPattern(
+              matchInstructionFilePattern, queryFilePatternUpperCase.AsStringView()))
+        return matchInstructionFilePattern;
+    }
+
+    return queryFilePattern;
+  }
+
+  /// Determines whether or not the result of a directory enumeration system call indicates that the
+  /// buffer could not hold even a single file information structure, in which case the same query
+  /// can be retried using a larger buffer.
+  /// @param [in] directoryEnumerationResult Result of the directory enumeration system call.
+  /// @return `true` if the buffer was too small for a single file information structure, `false`
+  /// otherwise.
+  static inline bool IsBufferTooSmallForSingleEntry(NTSTATUS directoryEnumerationResult)
+  {
+    return (
+        (NtStatus::kBufferOverflow == directoryEnumerationResult) ||
+        (NtStatus::kBufferTooSmall == directoryEnumerationResult));
+  }
+
+  /// Computes the number of bytes occupied by the file information structures in an enumeration
+  /// buffer, which end with the last structure in the chain.
+  /// @param [in] fileInformationStructLayout Layout of the file information structures in the
+  /// buffer.
+  /// @param [in] enumerationBuffer Buffer holding at least one file information structure.
+  /// @return Number of bytes occupied by file information structures.
+  static unsigned int EnumerationBufferBytesUsed(
+      const FileInformationStructLayout& fileInformationStructLayout,
+      const FileInformationStructBuffer& enumerationBuffer)
+  {
+    return fileInformationStructLayout.InvokeWithStaticLayout(
+        [&enumerationBuffer](const auto& layout) -> unsigned int
+        {
+          unsigned int lastEntryBytePosition = 0;
+          while (true)
+          {
+            const FileInformationStructLayout::TNextEntryOffset bytePositionIncrement =
+                layout.ReadNextEntryOffset(&enumerationBuffer[lastEntryBytePosition]);
+            if (0 == bytePositionIncrement) break;
+
+            lastEntryBytePosition += bytePositionIncrement;
+          }
+
+          return lastEntryBytePosition +
+              layout.SizeOfStruct(&enumerationBuffer[lastEntryBytePosition]);
+        });
+  }
+
+  /// Determines whether or not a batch of file information structures received from the system
+  /// filled its enumeration buffer, meaning there was not enough space left over for one more
+  /// structure with a filename of the maximum possible length. The system would have supplied more
+  /// structures in the same batch if the buffer had been larger.
+  /// @param [in] fileInformationStructLayout Layout of the file information structures in the
+  /// buffer.
+  /// @param [in] enumerationBuffer Buffer holding the batch.
+  /// @param [in] numBytesUsed Number of bytes occupied by file information structures in the
+  /// buffer.
+  /// @return `true` if the batch filled the buffer, `false` otherwise.
+  static inline bool IsEnumerationBufferFull(
+      const FileInformationStructLayout& fileInformationStructLayout,
+      const FileInformationStructBuffer& enumerationBuffer,
+      unsigned int numBytesUsed)
+  {
+    return (
+        (enumerationBuffer.Size() - numBytesUsed) <
+        fileInformationStructLayout.HypotheticalSizeForFileNameLength(
+            kMaxFileNameLengthChars * sizeof(wchar_t)));
+  }
+
+  /// Reads the entire contents of a directory from the system, from the beginning. The enumeration
+  /// buffer is grown as needed so that large directories are read using fewer system calls.
+  /// @param [in] directoryHandle Handle to the directory to enumerate.
+  /// @param [in] fileInformationStructLayout Layout of the type of information to request from the
+  /// system.
+  /// @param [in, out] enumerationBuffer Buffer to be used to receive each batch of directory
+  /// contents from the system.
+  /// @param [in] filePattern File pattern to supply to the system.
+  /// @return Complete directory listing, or nothing if the directory contents could not be read.
+  static std::optional<DirectoryListingCache::TListing> ReadEntireListingFromSystem(
+      HANDLE directoryHandle,
+      const FileInformationStructLayout& fileInformationStructLayout,
+      FileInformationStructBuffer& enumerationBuffer,
+      std::wstring_view filePattern)
+  {
+    DirectoryListingCache::TListing listing;
+    ULONG queryFlags = SL_RESTART_SCAN;
+
+    while (true)
+    {
+      const NTSTATUS directoryEnumerationResult =
+          FilesystemOperations::PartialEnumerateDirectoryContents(
+              directoryHandle,
+              fileInformationStructLayout.FileInformationClass(),
+              enumerationBuffer.Data(),
+              enumerationBuffer.Size(),
+              queryFlags,
+              filePattern);
+
+      if ((true == IsBufferTooSmallForSingleEntry(directoryEnumerationResult)) &&
+          (true == enumerationBuffer.Grow()))
+        continue;
+
+      // Any status other than `STATUS_NO_MORE_FILES` is an error reading the directory contents
+      // from the system, in which case there is no complete listing.
+      if (NtStatus::kNoMoreFiles == directoryEnumerationResult) return listing;
+      if (!(NT_SUCCESS(directoryEnumerationResult))) return std::nullopt;
+
+      // Only the bytes occupied by file information structures need to be kept.
+      const unsigned int numBytesUsed =
+          EnumerationBufferBytesUsed(fileInformationStructLayout, enumerationBuffer);
+      listing.emplace_back(enumerationBuffer.Data(), &enumerationBuffer.Data()[numBytesUsed]);
+
+      if (true ==
+          IsEnumerationBufferFull(fileInformationStructLayout, enumerationBuffer, numBytesUsed))
+        enumerationBuffer.Grow();
+
+      queryFlags = 0;
+    }
+  }
+
+  SortedFileInformationRuns::SortedFileInformationRuns(
+      FileInformationStructLayout fileInformationStructLayout, unsigned int maxBytesTotal)
+      : fileInformationStructLayout(fileInformationStructLayout),
+        maxBytesTotal(maxBytesTotal),
+        numBytesTotal(0),
+        runs(),
+        frontRun(nullptr)
+  {}
+
+  DirectoryListingCache::DirectoryListingCache(std::chrono::milliseconds timeToLive)
+      : timeToLive(timeToLive), cacheMutex(), invalidationCount(0), cachedListingsByDirectory()
+  {}
+
   EnumerationQueue::EnumerationQueue(
       DirectoryEnumerationInstruction::SingleDirectoryEnumeration matchInstruction,
       std::wstring_view absoluteDirectoryPath,
       FILE_INFORMATION_CLASS fileInformationClass,
-      std::wstring_view filePattern)
+      std::wstring_view filePattern,
+      bool enableReadAhead,
+      HANDLE existingDirectoryHandle,
+      DirectoryListingCache* directoryListingCache)
       : IDirectoryOperationQueue(),
         matchInstruction(matchInstruction),
         directoryHandle(NULL),
-        fileInformationClass(fileInformationClass),
+        fileInformationClass(
+            (nullptr == directoryListingCache)
+                ? fileInformationClass
+                : FileInformationStructLayout::ConvertibleSourceFileInformationClass(
+                      fileInformationClass)),
         fileInformationStructLayout(
+            FileInformationStructLayout::LayoutForFileInformationClass(this->fileInformationClass)
+                .value_or(FileInformationStructLayout())),
+        applicationFileInformationStructLayout(
             FileInformationStructLayout::LayoutForFileInformationClass(fileInformationClass)
                 .value_or(FileInformationStructLayout())),
-        enumerationBuffer(),
+        enumerationBuffer(FileInformationStructBuffer::kBytesPerBufferMinimum),
         enumerationBufferBytePosition(),
+        enumerationBufferEntryIndex(),
+        enumerationBufferKeepMask(),
+        shouldGrowEnumerationBuffer(false),
+        sortingStage(),
+        hasContentsBeyondSortingStage(false),
+        readAhead(),
+        listingCache(),
+        systemQueryFilePattern(SelectSystemQueryFilePattern(
+            filePattern, matchInstruction.GetSystemQueryFilePattern())),
         enumerationStatus()
   {
     if (FileInformationStructLayout() == fileInformationStructLayout)
@@ -59,7 +284,7 @@ namespace Pathwinder
     }
 
     auto maybeDirectoryHandle =
-        FilesystemOperations::OpenDirectoryForEnumeration(absoluteDirectoryPath);
+        OpenDirectoryHandleForEnumeration(existingDirectoryHandle, absoluteDirectoryPath);
     if (true == maybeDirectoryHandle.HasError())
     {
       // It is not an error for the directory not to exist.
@@ -84,6 +309,13 @@ namespace Pathwinder
     else
     {
       directoryHandle = maybeDirectoryHandle.Value();
+
+      if (true == enableReadAhead)
+        readAhead = std::make_unique<SReadAheadState>(directoryHandle, this->fileInformationClass);
+
+      if (nullptr != directoryListingCache)
+        listingCache =
+            std::make_unique<SListingCacheState>(*directoryListingCache, absoluteDirectoryPath);
     }
 
     Restart(filePattern);
@@ -95,8 +327,18 @@ namespace Pathwinder
         directoryHandle(std::move(other.directoryHandle)),
         fileInformationClass(std::move(other.fileInformationClass)),
         fileInformationStructLayout(std::move(other.fileInformationStructLayout)),
+        applicationFileInformationStructLayout(
+            std::move(other.applicationFileInformationStructLayout)),
         enumerationBuffer(std::move(other.enumerationBuffer)),
         enumerationBufferBytePosition(std::move(other.enumerationBufferBytePosition)),
+        enumerationBufferEntryIndex(std::move(other.enumerationBufferEntryIndex)),
+        enumerationBufferKeepMask(std::move(other.enumerationBufferKeepMask)),
+        shouldGrowEnumerationBuffer(std::move(other.shouldGrowEnumerationBuffer)),
+        sortingStage(std::move(other.sortingStage)),
+        hasContentsBeyondSortingStage(std::move(other.hasContentsBeyondSortingStage)),
+        readAhead(std::move(other.readAhead)),
+        listingCache(std::move(other.listingCache)),
+        systemQueryFilePattern(std::move(other.systemQueryFilePattern)),
         enumerationStatus(std::move(other.enumerationStatus))
   {
     other.directoryHandle = NULL;
@@ -104,6 +346,10 @@ namespace Pathwinder
 
   EnumerationQueue::~EnumerationQueue(void)
   {
+    // A background fetch still in progress would otherwise be using both the directory handle and
+    // the read-ahead state after they are released.
+    WaitForReadAheadInternal();
+
     if (NULL != directoryHandle) FilesystemOperations::CloseHandle(directoryHandle);
   }
 
@@ -119,9 +365,11 @@ namespace Pathwinder
         fileInformationStructLayout(
             FileInformationStructLayout::LayoutForFileInformationClass(fileInformationClass)
                 .value_or(FileInformationStructLayout())),
-        enumerationBuffer(),
+        enumerationBuffer(FileInformationStructBuffer::kBytesPerBufferMinimum),
         enumerationStatus(),
-        filePattern()
+        filePattern(),
+        prefetchedNameInsertions(),
+        prefetchedFileInformation()
   {
     if (FileInformationStructLayout() == fileInformationStructLayout)
     {
@@ -140,6 +388,407 @@ namespace Pathwinder
     SelectFrontElementSourceQueueInternal();
   }
 
+  void SortedFileInformationRuns::SelectFrontRunInternal(void)
+  {
+    SRun* nextFrontRunCandidate = nullptr;
+
+    for (auto& run : runs)
+    {
+      if (run.position >= run.structOffsets.size()) continue;
+
+      if ((nullptr == nextFrontRunCandidate) ||
+          (Strings::CompareFileNamesForSorting(
+               fileInformationStructLayout.ReadFileName(
+                   &run.structBytes[run.structOffsets[run.position]]),
+               fileInformationStructLayout.ReadFileName(
+                   &nextFrontRunCandidate->structBytes
+                        [nextFrontRunCandidate->structOffsets[nextFrontRunCandidate->position]])) <
+           0))
+        nextFrontRunCandidate = &run;
+    }
+
+    frontRun = nextFrontRunCandidate;
+  }
+
+  void SortedFileInformationRuns::SortRunInternal(SRun& run) const
+  {
+    std::sort(
+        run.structOffsets.begin(),
+        run.structOffsets.end(),
+        [this, &run](unsigned int a, unsigned int b) -> bool
+        {
+          return (
+              Strings::CompareFileNamesForSorting(
+                  fileInformationStructLayout.ReadFileName(&run.structBytes[a]),
+                  fileInformationStructLayout.ReadFileName(&run.structBytes[b])) < 0);
+        });
+
+    run.structBytes.shrink_to_fit();
+    run.structOffsets.shrink_to_fit();
+  }
+
+  void SortedFileInformationRuns::Append(const void* fileInformationStruct)
+  {
+    const unsigned int structSizeBytes =
+        fileInformationStructLayout.SizeOfStruct(fileInformationStruct);
+    const unsigned int structSizeBytesAligned =
+        (structSizeBytes + (kStructAlignmentBytes - 1)) & ~(kStructAlignmentBytes - 1);
+
+    if ((true == runs.empty()) ||
+        ((runs.back().structBytes.size() + structSizeBytesAligned) > kMaxBytesPerRun))
+    {
+      if (false == runs.empty()) SortRunInternal(runs.back());
+      runs.emplace_back();
+    }
+
+    SRun& run = runs.back();
+    const size_t structOffset = run.structBytes.size();
+
+    run.structBytes.resize(structOffset + structSizeBytesAligned);
+    std::memcpy(&run.structBytes[structOffset], fileInformationStruct, structSizeBytes);
+    run.structOffsets.push_back(static_cast<unsigned int>(structOffset));
+    numBytesTotal += structSizeBytesAligned;
+  }
+
+  void SortedFileInformationRuns::Finish(void)
+  {
+    if (false == runs.empty()) SortRunInternal(runs.back());
+
+    for (auto& run : runs)
+      run.position = 0;
+
+    SelectFrontRunInternal();
+  }
+
+  const void* SortedFileInformationRuns::Front(void) const
+  {
+    if (nullptr == frontRun) return nullptr;
+
+    return &frontRun->structBytes[frontRun->structOffsets[frontRun->position]];
+  }
+
+  void SortedFileInformationRuns::PopFront(void)
+  {
+    frontRun->position += 1;
+    SelectFrontRunInternal();
+  }
+
+  std::wstring_view DirectoryListingCache::NormalizeDirectoryPath(
+      std::wstring_view absoluteDirectoryPath)
+  {
+    std::wstring_view normalizedDirectoryPath = absoluteDirectoryPath;
+    normalizedDirectoryPath.remove_prefix(
+        Strings::PathGetWindowsNamespacePrefix(normalizedDirectoryPath).length());
+
+    while ((false == normalizedDirectoryPath.empty()) && (L'\\' == normalizedDirectoryPath.back()))
+      normalizedDirectoryPath.remove_suffix(1);
+
+    return normalizedDirectoryPath;
+  }
+
+  std::wstring_view DirectoryListingCache::NormalizeFilePattern(std::wstring_view filePattern)
+  {
+    // The system treats a file pattern consisting only of asterisks the same as no file pattern at
+    // all, so both identify the same listing.
+    if (std::wstring_view::npos == filePattern.find_first_not_of(L'*')) return std::wstring_view();
+    return filePattern;
+  }
+
+  uint64_t DirectoryListingCache::InvalidationCount(void) const
+  {
+    std::scoped_lock lock(cacheMutex);
+    return invalidationCount;
+  }
+
+  void DirectoryListingCache::InvalidateDirectory(std::wstring_view absoluteDirectoryPath)
+  {
+    std::scoped_lock lock(cacheMutex);
+
+    invalidationCount += 1;
+    cachedListingsByDirectory.erase(std::wstring(NormalizeDirectoryPath(absoluteDirectoryPath)));
+  }
+
+  std::shared_ptr<const DirectoryListingCache::TListing> DirectoryListingCache::Lookup(
+      std::wstring_view absoluteDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern)
+  {
+    filePattern = NormalizeFilePattern(filePattern);
+
+    std::scoped_lock lock(cacheMutex);
+
+    return LookupInternal(
+        std::wstring(NormalizeDirectoryPath(absoluteDirectoryPath)),
+        fileInformationClass,
+        filePattern);
+  }
+
+  DirectoryListingCache::SLookupResult DirectoryListingCache::LookupOrBeginFill(
+      std::wstring_view absoluteDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern)
+  {
+    filePattern = NormalizeFilePattern(filePattern);
+
+    std::shared_future<std::shared_ptr<const TListing>> inFlightFillResult;
+
+    do
+    {
+      std::scoped_lock lock(cacheMutex);
+
+      std::wstring normalizedDirectoryPath(NormalizeDirectoryPath(absoluteDirectoryPath));
+
+      std::shared_ptr<const TListing> cachedListing =
+          LookupInternal(normalizedDirectoryPath, fileInformationClass, filePattern);
+      if (nullptr != cachedListing)
+        return {.listing = std::move(cachedListing), .isResponsibleForFill = false};
+
+      std::vector<SInFlightFill>& inFlightFills =
+          inFlightFillsByDirectory[std::move(normalizedDirectoryPath)];
+
+      const SInFlightFill* const inFlightFill =
+          FindInFlightFillInternal(inFlightFills, fileInformationClass, filePattern);
+      if (nullptr != inFlightFill)
+      {
+        inFlightFillResult = inFlightFill->sharedResult;
+        break;
+      }
+
+      return {
+          .listing = nullptr,
+          .isResponsibleForFill = true,
+          .invalidationCountAtStart =
+              BeginFillInternal(inFlightFills, fileInformationClass, filePattern)};
+    }
+    while (false);
+
+    // Waiting happens without holding the cache mutex so that the caller reading the listing is
+    // able to complete it.
+    ThreadPool::ScopedBlockingWait blockingWait;
+    return {.listing = inFlightFillResult.get(), .isResponsibleForFill = false};
+  }
+
+  std::optional<uint64_t> DirectoryListingCache::TryBeginFill(
+      std::wstring_view absoluteDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern)
+  {
+    filePattern = NormalizeFilePattern(filePattern);
+
+    std::scoped_lock lock(cacheMutex);
+
+    std::wstring normalizedDirectoryPath(NormalizeDirectoryPath(absoluteDirectoryPath));
+
+    if (nullptr != LookupInternal(normalizedDirectoryPath, fileInformationClass, filePattern))
+      return std::nullopt;
+
+    std::vector<SInFlightFill>& inFlightFills =
+        inFlightFillsByDirectory[std::move(normalizedDirectoryPath)];
+
+    if (nullptr != FindInFlightFillInternal(inFlightFills, fileInformationClass, filePattern))
+      return std::nullopt;
+
+    return BeginFillInternal(inFlightFills, fileInformationClass, filePattern);
+  }
+
+  std::shared_ptr<const DirectoryListingCache::TListing> DirectoryListingCache::CompleteFill(
+      std::wstring_view absoluteDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern,
+      std::optional<TListing>&& listing,
+      uint64_t invalidationCountAtStart)
+  {
+    filePattern = NormalizeFilePattern(filePattern);
+
+    std::shared_ptr<const TListing> sharedListing =
+        ((true == listing.has_value()) ? std::make_shared<const TListing>(std::move(*listing))
+                                       : nullptr);
+
+    std::scoped_lock lock(cacheMutex);
+
+    std::wstring normalizedDirectoryPath(NormalizeDirectoryPath(absoluteDirectoryPath));
+
+    auto inFlightFillsIter = inFlightFillsByDirectory.find(normalizedDirectoryPath);
+    DebugAssert(
+        inFlightFillsByDirectory.end() != inFlightFillsIter,
+        "Completing a directory listing fill that was never started.");
+
+    const bool wasStored = ((nullptr != sharedListing) &&
+        (true ==
+         InsertInternal(
+             std::move(normalizedDirectoryPath),
+             fileInformationClass,
+             filePattern,
+             sharedListing,
+             invalidationCountAtStart)));
+
+    if (inFlightFillsByDirectory.end() != inFlightFillsIter)
+    {
+      std::vector<SInFlightFill>& inFlightFills = inFlightFillsIter->second;
+
+      for (auto inFlightFillIter = inFlightFills.begin(); inFlightFillIter != inFlightFills.end();
+           ++inFlightFillIter)
+      {
+        if ((fileInformationClass == inFlightFillIter->fileInformationClass) &&
+            (invalidationCountAtStart == inFlightFillIter->invalidationCountAtStart) &&
+            (0 ==
+             Infra::Strings::CompareCaseInsensitive(inFlightFillIter->filePattern, filePattern)))
+        {
+          inFlightFillIter->completion.set_value(
+              ((true == wasStored) ? sharedListing : nullptr));
+          inFlightFills.erase(inFlightFillIter);
+          break;
+        }
+      }
+
+      if (true == inFlightFills.empty()) inFlightFillsByDirectory.erase(inFlightFillsIter);
+    }
+
+    return sharedListing;
+  }
+
+  void DirectoryListingCache::Insert(
+      std::wstring_view absoluteDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern,
+      TListing&& listing,
+      uint64_t invalidationCountAtStart)
+  {
+    filePattern = NormalizeFilePattern(filePattern);
+
+    std::scoped_lock lock(cacheMutex);
+
+    InsertInternal(
+        std::wstring(NormalizeDirectoryPath(absoluteDirectoryPath)),
+        fileInformationClass,
+        filePattern,
+        std::make_shared<const TListing>(std::move(listing)),
+        invalidationCountAtStart);
+  }
+
+  uint64_t DirectoryListingCache::BeginFillInternal(
+      std::vector<SInFlightFill>& inFlightFills,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern)
+  {
+    SInFlightFill& newInFlightFill = inFlightFills.emplace_back(
+        SInFlightFill{
+            .fileInformationClass = fileInformationClass,
+            .filePattern = std::wstring(filePattern),
+            .invalidationCountAtStart = invalidationCount,
+            .completion = std::promise<std::shared_ptr<const TListing>>(),
+            .sharedResult = std::shared_future<std::shared_ptr<const TListing>>()});
+    newInFlightFill.sharedResult = newInFlightFill.completion.get_future().share();
+
+    return invalidationCount;
+  }
+
+  const DirectoryListingCache::SInFlightFill* DirectoryListingCache::FindInFlightFillInternal(
+      const std::vector<SInFlightFill>& inFlightFills,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern) const
+  {
+    for (const auto& inFlightFill : inFlightFills)
+    {
+      // A read that started before the most recent invalidation might not reflect the change that
+      // caused it, so it cannot be shared with a caller that arrived after the change.
+      if ((fileInformationClass == inFlightFill.fileInformationClass) &&
+          (invalidationCount == inFlightFill.invalidationCountAtStart) &&
+          (0 == Infra::Strings::CompareCaseInsensitive(inFlightFill.filePattern, filePattern)))
+        return &inFlightFill;
+    }
+
+    return nullptr;
+  }
+
+  std::shared_ptr<const DirectoryListingCache::TListing> DirectoryListingCache::LookupInternal(
+      const std::wstring& normalizedDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern)
+  {
+    auto cachedListingsIter = cachedListingsByDirectory.find(normalizedDirectoryPath);
+    if (cachedListingsByDirectory.end() == cachedListingsIter) return nullptr;
+
+    std::vector<SCachedListing>& cachedListings = cachedListingsIter->second;
+
+    const auto currentTime = std::chrono::steady_clock::now();
+    std::erase_if(
+        cachedListings,
+        [this, currentTime](const SCachedListing& cachedListing) -> bool
+        {
+          return ((currentTime - cachedListing.creationTime) >= timeToLive);
+        });
+
+    if (true == cachedListings.empty())
+    {
+      cachedListingsByDirectory.erase(cachedListingsIter);
+      return nullptr;
+    }
+
+    for (const auto& cachedListing : cachedListings)
+    {
+      if ((fileInformationClass == cachedListing.fileInformationClass) &&
+          (0 == Infra::Strings::CompareCaseInsensitive(cachedListing.filePattern, filePattern)))
+        return cachedListing.listing;
+    }
+
+    return nullptr;
+  }
+
+  bool DirectoryListingCache::InsertInternal(
+      std::wstring&& normalizedDirectoryPath,
+      FILE_INFORMATION_CLASS fileInformationClass,
+      std::wstring_view filePattern,
+      std::shared_ptr<const TListing> listing,
+      uint64_t invalidationCountAtStart)
+  {
+    if (invalidationCountAtStart != invalidationCount) return false;
+
+    const auto currentTime = std::chrono::steady_clock::now();
+
+    if ((false == cachedListingsByDirectory.contains(normalizedDirectoryPath)) &&
+        (cachedListingsByDirectory.size() >= kMaxCachedDirectories))
+    {
+      // Making room starts with removing expired listings. If that is not enough then everything
+      // is discarded, which is simple and still correct because a cache miss just means reading
+      // the directory contents from the system.
+      std::erase_if(
+          cachedListingsByDirectory,
+          [this, currentTime](const auto& cachedListingsByDirectoryItem) -> bool
+          {
+            for (const auto& cachedListing : cachedListingsByDirectoryItem.second)
+            {
+              if ((currentTime - cachedListing.creationTime) < timeToLive) return false;
+            }
+            return true;
+          });
+
+      if (cachedListingsByDirectory.size() >= kMaxCachedDirectories)
+        cachedListingsByDirectory.clear();
+    }
+
+    std::vector<SCachedListing>& cachedListings =
+        cachedListingsByDirectory[std::move(normalizedDirectoryPath)];
+
+    std::erase_if(
+        cachedListings,
+        [fileInformationClass, filePattern](const SCachedListing& cachedListing) -> bool
+        {
+          return (
+              (fileInformationClass == cachedListing.fileInformationClass) &&
+              (0 ==
+               Infra::Strings::CompareCaseInsensitive(cachedListing.filePattern, filePattern)));
+        });
+
+    cachedListings.push_back(
+        {.fileInformationClass = fileInformationClass,
+         .filePattern = std::wstring(filePattern),
+         .creationTime = currentTime,
+         .listing = std::move(listing)});
+
+    return true;
+  }
+
   void EnumerationQueue::AdvanceQueueContentsInternal(
       ULONG queryFlags, std::wstring_view filePattern)
   {
@@ -152,13 +801,68 @@ namespace Pathwinder
       return;
     }
 
-    NTSTATUS directoryEnumerationResult = FilesystemOperations::PartialEnumerateDirectoryContents(
-        directoryHandle,
-        fileInformationClass,
-        enumerationBuffer.Data(),
-        enumerationBuffer.Size(),
-        queryFlags,
-        filePattern);
+    NTSTATUS directoryEnumerationResult = NtStatus::kInternalError;
+
+    if (0 != (queryFlags & SL_RESTART_SCAN)) BeginListingInternal();
+
+    if (true == IsOfferingListingFromMemoryInternal())
+    {
+      directoryEnumerationResult = ReadCachedListingBatchInternal();
+    }
+    else
+    {
+      const std::optional<NTSTATUS> readAheadResult = WaitForReadAheadInternal();
+      if ((true == readAheadResult.has_value()) && (0 == queryFlags))
+      {
+        // The next batch was already fetched in the background, so it just needs to be swapped
+        // into place. Any other query flags, such as restarting the scan, mean that the result of
+        // the background fetch is stale and must be discarded.
+        std::swap(enumerationBuffer, readAhead->buffer);
+        directoryEnumerationResult = *readAheadResult;
+      }
+      else
+      {
+        // Continuing on from a batch that filled the enumeration buffer means the directory has
+        // more contents than fit, so they are received into a larger buffer from now on.
+        if ((0 == queryFlags) && (true == shouldGrowEnumerationBuffer)) enumerationBuffer.Grow();
+
+        directoryEnumerationResult = FilesystemOperations::PartialEnumerateDirectoryContents(
+            directoryHandle,
+            fileInformationClass,
+            enumerationBuffer.Data(),
+            enumerationBuffer.Size(),
+            queryFlags,
+            filePattern);
+      }
+
+      while ((true == IsBufferTooSmallForSingleEntry(directoryEnumerationResult)) &&
+             (true == enumerationBuffer.Grow()))
+      {
+        directoryEnumerationResult = FilesystemOperations::PartialEnumerateDirectoryContents(
+            directoryHandle,
+            fileInformationClass,
+            enumerationBuffer.Data(),
+            enumerationBuffer.Size(),
+            queryFlags,
+            filePattern);
+      }
+
+      if ((0 != (queryFlags & SL_RESTART_SCAN)) &&
+          (applicationFileInformationStructLayout != fileInformationStructLayout) &&
+          ((NtStatus::kInvalidInfoClass == directoryEnumerationResult) ||
+           (NtStatus::kInvalidParameter == directoryEnumerationResult)))
+      {
+        // Some filesystems do not support the richer file information class, in which case the
+        // directory contents are read from the system using the requested class instead.
+        fileInformationClass = applicationFileInformationStructLayout.FileInformationClass();
+        fileInformationStructLayout = applicationFileInformationStructLayout;
+        if (nullptr != readAhead) readAhead->fileInformationClass = fileInformationClass;
+
+        AdvanceQueueContentsInternal(queryFlags, filePattern);
+        return;
+      }
+    }
+
     if (!(NT_SUCCESS(directoryEnumerationResult)))
     {
       // This failure block includes `STATUS_NO_MORE_FILES` in which case enumeration is
@@ -168,32 +872,320 @@ namespace Pathwinder
     }
     else
     {
-      // File information structures are available.
+      // File information structures are available. They are all filtered at once, before the
+      // next background fetch is started and before any of them are offered to the application.
       enumerationBufferBytePosition = 0;
+      enumerationBufferEntryIndex = 0;
+      matchInstruction.FilterDirectoryEnumerationBuffer(
+          fileInformationStructLayout, enumerationBuffer.Data(), enumerationBufferKeepMask);
       enumerationStatus = NtStatus::kMoreEntries;
+
+      if (false == IsOfferingListingFromMemoryInternal())
+      {
+        shouldGrowEnumerationBuffer = false;
+        if (true == enumerationBuffer.CanGrow())
+          shouldGrowEnumerationBuffer = IsEnumerationBufferFull(
+              fileInformationStructLayout,
+              enumerationBuffer,
+              EnumerationBufferBytesUsed(fileInformationStructLayout, enumerationBuffer));
+
+        StartReadAheadInternal();
+      }
     }
   }
 
+  void EnumerationQueue::BeginListingInternal(void)
+  {
+    if (nullptr == listingCache) return;
+
+    const std::wstring_view filePattern = systemQueryFilePattern;
+
+    // Any background fetch still in progress belongs to the previous pass through the directory
+    // contents and will not be consumed. It also needs to finish before the directory handle can
+    // be used to read the entire listing.
+    WaitForReadAheadInternal();
+
+    DirectoryListingCache::SLookupResult lookupResult = listingCache->cache.LookupOrBeginFill(
+        listingCache->absoluteDirectoryPath, fileInformationClass, filePattern);
+    listingCache->isCachedListingReadByThisQueue = lookupResult.isResponsibleForFill;
+
+    if (true == lookupResult.isResponsibleForFill)
+    {
+      // Reading the entire listing up-front, rather than as the application consumes it, means
+      // that other queues waiting for the same listing are not held up by this queue's consumer.
+      // If it cannot be read then directory contents are read from the system in the normal way,
+      // which reproduces the error for the application.
+      lookupResult.listing = listingCache->cache.CompleteFill(
+          listingCache->absoluteDirectoryPath,
+          fileInformationClass,
+          filePattern,
+          ReadEntireListingFromSystem(
+              directoryHandle, fileInformationStructLayout, enumerationBuffer, filePattern),
+          lookupResult.invalidationCountAtStart);
+    }
+
+    listingCache->cachedListing = std::move(lookupResult.listing);
+    listingCache->nextCachedBatchIndex = 0;
+  }
+
+  NTSTATUS EnumerationQueue::ReadCachedListingBatchInternal(void)
+  {
+    const DirectoryListingCache::TListing& cachedListing = *listingCache->cachedListing;
+    if (listingCache->nextCachedBatchIndex >= cachedListing.size()) return NtStatus::kNoMoreFiles;
+
+    const std::vector<uint8_t>& cachedBatch = cachedListing[listingCache->nextCachedBatchIndex];
+    listingCache->nextCachedBatchIndex += 1;
+
+    // Batches in the cached listing can be larger than the enumeration buffer, depending on the
+    // size of the buffer that originally received them from the system.
+    enumerationBuffer.GrowToFit(static_cast<unsigned int>(cachedBatch.size()));
+    std::memcpy(enumerationBuffer.Data(), cachedBatch.data(), cachedBatch.size());
+    return NtStatus::kSuccess;
+  }
+
+  std::optional<EnumerationQueue::SListingPrefetch> EnumerationQueue::BeginListingPrefetch(
+      const DirectoryEnumerationInstruction::SingleDirectoryEnumeration& matchInstruction,
+      std::wstring_view absoluteDirectoryPath,
+      DirectoryListingCache& directoryListingCache)
+  {
+    // Which file information class the application will request is not yet known, so the listing
+    // is read using the class from which all of the commonly-requested classes can be produced.
+    // Likewise the application's file pattern is not yet known, so the listing is read the same
+    // way as for an application that enumerates everything.
+    const FILE_INFORMATION_CLASS fileInformationClass =
+        FileInformationStructLayout::ConvertibleSourceFileInformationClass(
+            SFileBothDirectoryInformation::kFileInformationClass);
+    const std::wstring_view filePattern = SelectSystemQueryFilePattern(
+        std::wstring_view(), matchInstruction.GetSystemQueryFilePattern());
+
+    const std::optional<uint64_t> maybeInvalidationCountAtStart =
+        directoryListingCache.TryBeginFill(
+            absoluteDirectoryPath, fileInformationClass, filePattern);
+    if (false == maybeInvalidationCountAtStart.has_value()) return std::nullopt;
+
+    return SListingPrefetch{
+        .directoryListingCache = &directoryListingCache,
+        .absoluteDirectoryPath = std::wstring(absoluteDirectoryPath),
+        .fileInformationClass = fileInformationClass,
+        .filePattern = std::wstring(filePattern),
+        .invalidationCountAtStart = *maybeInvalidationCountAtStart};
+  }
+
+  void EnumerationQueue::CompleteListingPrefetch(const SListingPrefetch& listingPrefetch)
+  {
+    std::optional<DirectoryListingCache::TListing> listing;
+
+    // Any failure, including the directory not existing, means there is no listing to store. Any
+    // queues waiting for it then read the directory contents from the system themselves, which
+    // reproduces the failure for the application.
+    auto maybeDirectoryHandle =
+        FilesystemOperations::OpenDirectoryForEnumeration(listingPrefetch.absoluteDirectoryPath);
+    if (true == maybeDirectoryHandle.HasValue())
+    {
+      const std::optional<FileInformationStructLayout> maybeFileInformationStructLayout =
+          FileInformationStructLayout::LayoutForFileInformationClass(
+              listingPrefetch.fileInformationClass);
+
+      if (true == maybeFileInformationStructLayout.has_value())
+      {
+        FileInformationStructBuffer enumerationBuffer;
+        listing = ReadEntireListingFromSystem(
+            maybeDirectoryHandle.Value(),
+            *maybeFileInformationStructLayout,
+            enumerationBuffer,
+            listingPrefetch.filePattern);
+      }
+
+      FilesystemOperations::CloseHandle(maybeDirectoryHandle.Value());
+    }
+
+    listingPrefetch.directoryListingCache->CompleteFill(
+        listingPrefetch.absoluteDirectoryPath,
+        listingPrefetch.fileInformationClass,
+        listingPrefetch.filePattern,
+        std::move(listing),
+        listingPrefetch.invalidationCountAtStart);
+  }
+
+  void CALLBACK
+      EnumerationQueue::ReadAheadWorkCallback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+  {
+    SReadAheadState* const readAheadState = reinterpret_cast<SReadAheadState*>(context);
+
+    readAheadState->result = FilesystemOperations::PartialEnumerateDirectoryContents(
+        readAheadState->directoryHandle,
+        readAheadState->fileInformationClass,
+        readAheadState->buffer.Data(),
+        readAheadState->buffer.Size());
+    readAheadState->completionSemaphore.release();
+  }
+
+  void EnumerationQueue::StartReadAheadInternal(void)
+  {
+    if (nullptr == readAhead) return;
+
+    ThreadPool* const readAheadThreadPool = Globals::SharedThreadPool();
+    if (nullptr == readAheadThreadPool) return;
+
+    // The background fetch receives its batch into a buffer at least as large as the one that
+    // received the previous batch, and larger still if the previous batch filled its buffer.
+    readAhead->buffer.GrowToFit(enumerationBuffer.Size());
+    if (true == shouldGrowEnumerationBuffer) readAhead->buffer.Grow();
+
+    readAhead->isInProgress = true;
+    if (false == readAheadThreadPool->SubmitWork(ReadAheadWorkCallback, readAhead.get()))
+      readAhead->isInProgress = false;
+  }
+
+  std::optional<NTSTATUS> EnumerationQueue::WaitForReadAheadInternal(void)
+  {
+    if ((nullptr == readAhead) || (false == readAhead->isInProgress)) return std::nullopt;
+
+    do
+    {
+      ThreadPool::ScopedBlockingWait blockingWait;
+      readAhead->completionSemaphore.acquire();
+    }
+    while (false);
+
+    readAhead->isInProgress = false;
+
+    return readAhead->result;
+  }
+
+  const void* EnumerationQueue::FrontInternal(void) const
+  {
+    if (true == sortingStage.has_value()) return sortingStage->Front();
+
+    return &enumerationBuffer[enumerationBufferBytePosition];
+  }
+
+  bool EnumerationQueue::IsFrontIncludedInternal(void) const
+  {
+    if (true == sortingStage.has_value()) return true;
+
+    return enumerationBufferKeepMask[enumerationBufferEntryIndex];
+  }
+
+  bool EnumerationQueue::IsEnumerationBufferSortedInternal(
+      std::wstring_view precedingFileName) const
+  {
+    if (!(NT_SUCCESS(enumerationStatus))) return true;
+
+    return fileInformationStructLayout.InvokeWithStaticLayout(
+        [this, precedingFileName](const auto& layout) -> bool
+        {
+          unsigned int bytePosition = enumerationBufferBytePosition;
+          std::wstring_view previousFileName = precedingFileName;
+
+          while (true)
+          {
+            const void* const enumerationEntry = &enumerationBuffer[bytePosition];
+            const std::wstring_view fileName = layout.ReadFileName(enumerationEntry);
+
+            // The special "." and ".." entries are offered first by some filesystems regardless
+            // of how they sort relative to other filenames, so they do not indicate anything
+            // about whether or not the rest of the directory contents are sorted.
+            if ((L"." != fileName) && (L".." != fileName))
+            {
+              if ((false == previousFileName.empty()) &&
+                  (Infra::Strings::CompareCaseInsensitive(fileName, previousFileName) < 0))
+                return false;
+
+              previousFileName = fileName;
+            }
+
+            const FileInformationStructLayout::TNextEntryOffset bytePositionIncrement =
+                layout.ReadNextEntryOffset(enumerationEntry);
+            if (0 == bytePositionIncrement) return true;
+
+            bytePosition += bytePositionIncrement;
+          }
+        });
+  }
+
   void EnumerationQueue::PopFrontInternal(void)
   {
+    if (true == sortingStage.has_value())
+    {
+      sortingStage->PopFront();
+      if (nullptr != sortingStage->Front()) return;
+
+      if (true == hasContentsBeyondSortingStage)
+        SortRemainingContentsInternal();
+      else
+        enumerationStatus = NtStatus::kNoMoreFiles;
+      return;
+    }
+
     const void* const enumerationEntry = &enumerationBuffer[enumerationBufferBytePosition];
 
     FileInformationStructLayout::TNextEntryOffset bytePositionIncrement =
         fileInformationStructLayout.ReadNextEntryOffset(enumerationEntry);
     if (0 == bytePositionIncrement)
     {
+      // Fetching the next batch overwrites the enumeration buffer, so the last filename of the
+      // current batch needs to be copied in order to check that the next batch continues in
+      // sorted order.
+      const std::wstring lastFileNameOfBatch(
+          fileInformationStructLayout.ReadFileName(enumerationEntry));
+
       AdvanceQueueContentsInternal();
+      if (false == IsEnumerationBufferSortedInternal(lastFileNameOfBatch))
+        SortRemainingContentsInternal();
     }
     else
     {
       enumerationBufferBytePosition += bytePositionIncrement;
+      enumerationBufferEntryIndex += 1;
     }
   }
 
+  void EnumerationQueue::SortRemainingContentsInternal(void)
+  {
+    sortingStage.emplace(fileInformationStructLayout);
+    hasContentsBeyondSortingStage = false;
+
+    while (NT_SUCCESS(enumerationStatus))
+    {
+      if (true == sortingStage->IsFull())
+      {
+        // The enumeration buffer position refers to the first file information structure not yet
+        // placed into the sorting stage, which is where reading resumes once it is exhausted.
+        hasContentsBeyondSortingStage = true;
+        sortingStage->Finish();
+        return;
+      }
+
+      const void* const enumerationEntry = &enumerationBuffer[enumerationBufferBytePosition];
+
+      if (true == enumerationBufferKeepMask[enumerationBufferEntryIndex])
+        sortingStage->Append(enumerationEntry);
+
+      FileInformationStructLayout::TNextEntryOffset bytePositionIncrement =
+          fileInformationStructLayout.ReadNextEntryOffset(enumerationEntry);
+      if (0 == bytePositionIncrement)
+      {
+        AdvanceQueueContentsInternal();
+      }
+      else
+      {
+        enumerationBufferBytePosition += bytePositionIncrement;
+        enumerationBufferEntryIndex += 1;
+      }
+    }
+
+    // Any status other than `STATUS_NO_MORE_FILES` is an error reading the directory contents
+    // from the system, in which case it is preserved and reported to the application.
+    if (NtStatus::kNoMoreFiles != enumerationStatus) return;
+
+    sortingStage->Finish();
+    if (nullptr != sortingStage->Front()) enumerationStatus = NtStatus::kMoreEntries;
+  }
+
   void EnumerationQueue::SkipNonMatchingItemsInternal(void)
   {
-    while ((NT_SUCCESS(enumerationStatus)) &&
-           ((false == matchInstruction.ShouldIncludeInDirectoryEnumeration(FileNameOfFront()))))
+    while ((NT_SUCCESS(enumerationStatus)) && (false == IsFrontIncludedInternal()))
       PopFrontInternal();
   }
 
@@ -220,12 +1212,31 @@ namespace Pathwinder
         continue;
       }
 
-      nameInsertionQueryResult = FilesystemOperations::QuerySingleFileDirectoryInformation(
-          nameInsertion->DirectoryInformationSourceDirectoryPart(),
-          nameInsertion->DirectoryInformationSourceFilePart(),
-          fileInformationClass,
-          enumerationBuffer.Data(),
-          enumerationBuffer.Size());
+      const std::optional<SPrefetchedNameInsertion>& prefetchedNameInsertion =
+          prefetchedNameInsertions[nameInsertionQueuePosition];
+
+      if (true == prefetchedNameInsertion.has_value())
+      {
+        nameInsertionQueryResult = prefetchedNameInsertion->lookupResult;
+
+        if (NT_SUCCESS(nameInsertionQueryResult))
+        {
+          std::memcpy(
+              enumerationBuffer.Data(),
+              &prefetchedFileInformation[prefetchedNameInsertion->byteOffset],
+              static_cast<size_t>(prefetchedNameInsertion->sizeBytes));
+          fileInformationStructLayout.ClearNextEntryOffset(enumerationBuffer.Data());
+        }
+      }
+      else
+      {
+        nameInsertionQueryResult = FilesystemOperations::QuerySingleFileDirectoryInformation(
+            nameInsertion->DirectoryInformationSourceDirectoryPart(),
+            nameInsertion->DirectoryInformationSourceFilePart(),
+            fileInformationClass,
+            enumerationBuffer.Data(),
+            enumerationBuffer.Size());
+      }
 
       // It is not an error for the filesystem entities being queried not to exist and thus be
       // unavailable. They can just be skipped, and the next name insertion tried. Anything
@@ -257,13 +1268,166 @@ namespace Pathwinder
     enumerationStatus = NtStatus::kMoreEntries;
   }
 
+  void NameInsertionQueue::PrefetchNameInsertionsInternal(void)
+  {
+    prefetchedNameInsertions.assign(nameInsertionQueue.Size(), std::nullopt);
+    prefetchedFileInformation.clear();
+
+    // Entire directories are enumerated here, so a full-size buffer is used for the duration of
+    // the lookups rather than the enumeration buffer, which only ever needs to hold one entry.
+    FileInformationStructBuffer directoryContentsBuffer;
+
+    std::unordered_map<
+        std::wstring_view,
+        std::vector<unsigned int>,
+        Infra::Strings::CaseInsensitiveHasher<wchar_t>,
+        Infra::Strings::CaseInsensitiveEqualityComparator<wchar_t>>
+        nameInsertionsByParentDirectory;
+
+    for (unsigned int i = 0; i < nameInsertionQueue.Size(); ++i)
+    {
+      const auto& nameInsertion = nameInsertionQueue[i];
+      if (false == Strings::FileNameMatchesPattern(nameInsertion.FileNameToInsert(), filePattern))
+        continue;
+
+      nameInsertionsByParentDirectory[nameInsertion.DirectoryInformationSourceDirectoryPart()]
+          .push_back(i);
+    }
+
+    auto informationSourceFilePartOf = [this](unsigned int nameInsertionIndex) -> std::wstring_view
+    {
+      return nameInsertionQueue[nameInsertionIndex].DirectoryInformationSourceFilePart();
+    };
+
+    for (auto& [parentDirectory, nameInsertionIndices] : nameInsertionsByParentDirectory)
+    {
+      // Enumerating an entire directory only pays off if it replaces more than one single-file
+      // query, so any name insertion alone in its parent directory is looked up individually.
+      if (nameInsertionIndices.size() < 2) continue;
+
+      std::sort(
+          nameInsertionIndices.begin(),
+          nameInsertionIndices.end(),
+          [&informationSourceFilePartOf](unsigned int lhs, unsigned int rhs) -> bool
+          {
+            return (
+                Infra::Strings::CompareCaseInsensitive(
+                    informationSourceFilePartOf(lhs), informationSourceFilePartOf(rhs)) < 0);
+          });
+
+      // Any name insertion whose information source is not encountered during the enumeration of
+      // its parent directory is treated the same as if the system reported it does not exist.
+      for (unsigned int nameInsertionIndex : nameInsertionIndices)
+        prefetchedNameInsertions[nameInsertionIndex] = SPrefetchedNameInsertion{
+            .lookupResult = NtStatus::kObjectNameNotFound, .byteOffset = 0, .sizeBytes = 0};
+
+      auto maybeDirectoryHandle =
+          FilesystemOperations::OpenDirectoryForEnumeration(parentDirectory);
+      if (true == maybeDirectoryHandle.HasError())
+      {
+        for (unsigned int nameInsertionIndex : nameInsertionIndices)
+          prefetchedNameInsertions[nameInsertionIndex]->lookupResult = maybeDirectoryHandle.Error();
+        continue;
+      }
+
+      NTSTATUS directoryEnumerationResult = FilesystemOperations::PartialEnumerateDirectoryContents(
+          maybeDirectoryHandle.Value(),
+          fileInformationClass,
+          directoryContentsBuffer.Data(),
+          directoryContentsBuffer.Size());
+
+      while (NT_SUCCESS(directoryEnumerationResult))
+      {
+        unsigned int enumerationBufferBytePosition = 0;
+
+        while (true)
+        {
+          const void* const enumerationEntry =
+              &directoryContentsBuffer[enumerationBufferBytePosition];
+          const std::wstring_view enumeratedFileName =
+              fileInformationStructLayout.ReadFileName(enumerationEntry);
+
+          // More than one name insertion can use the same information source, in which case they
+          // are adjacent in the sorted list and can all share the same file information structure.
+          auto matchingNameInsertionIter = std::lower_bound(
+              nameInsertionIndices.cbegin(),
+              nameInsertionIndices.cend(),
+              enumeratedFileName,
+              [&informationSourceFilePartOf](
+                  unsigned int nameInsertionIndex, std::wstring_view fileName) -> bool
+              {
+                return (
+                    Infra::Strings::CompareCaseInsensitive(
+                        informationSourceFilePartOf(nameInsertionIndex), fileName) < 0);
+              });
+
+          if ((nameInsertionIndices.cend() != matchingNameInsertionIter) &&
+              (0 ==
+               Infra::Strings::CompareCaseInsensitive(
+                   informationSourceFilePartOf(*matchingNameInsertionIter), enumeratedFileName)))
+          {
+            const unsigned int byteOffset =
+                static_cast<unsigned int>(prefetchedFileInformation.size());
+            const unsigned int sizeBytes =
+                fileInformationStructLayout.SizeOfStruct(enumerationEntry);
+            const uint8_t* const enumerationEntryBytes =
+                reinterpret_cast<const uint8_t*>(enumerationEntry);
+
+            prefetchedFileInformation.insert(
+                prefetchedFileInformation.end(),
+                enumerationEntryBytes,
+                &enumerationEntryBytes[sizeBytes]);
+
+            for (; (nameInsertionIndices.cend() != matchingNameInsertionIter) &&
+                 (0 ==
+                  Infra::Strings::CompareCaseInsensitive(
+                      informationSourceFilePartOf(*matchingNameInsertionIter),
+                      enumeratedFileName));
+                 ++matchingNameInsertionIter)
+            {
+              prefetchedNameInsertions[*matchingNameInsertionIter] = SPrefetchedNameInsertion{
+                  .lookupResult = NtStatus::kSuccess,
+                  .byteOffset = byteOffset,
+                  .sizeBytes = sizeBytes};
+            }
+          }
+
+          const FileInformationStructLayout::TNextEntryOffset nextEntryOffset =
+              fileInformationStructLayout.ReadNextEntryOffset(enumerationEntry);
+          if (0 == nextEntryOffset) break;
+
+          enumerationBufferBytePosition += nextEntryOffset;
+        }
+
+        directoryEnumerationResult = FilesystemOperations::PartialEnumerateDirectoryContents(
+            maybeDirectoryHandle.Value(),
+            fileInformationClass,
+            directoryContentsBuffer.Data(),
+            directoryContentsBuffer.Size());
+      }
+
+      FilesystemOperations::CloseHandle(maybeDirectoryHandle.Value());
+
+      // Any failure other than reaching the end of the directory contents is a directory
+      // enumeration error for all name insertions that were not already found.
+      if (NtStatus::kNoMoreFiles != directoryEnumerationResult)
+      {
+        for (unsigned int nameInsertionIndex : nameInsertionIndices)
+        {
+          if (!(NT_SUCCESS(prefetchedNameInsertions[nameInsertionIndex]->lookupResult)))
+            prefetchedNameInsertions[nameInsertionIndex]->lookupResult = directoryEnumerationResult;
+        }
+      }
+    }
+  }
+
   void MergedFileInformationQueue::SelectFrontElementSourceQueueInternal(void)
   {
     IDirectoryOperationQueue* nextFrontQueueCandidate = nullptr;
 
     // The next front element will come from whichever queue is present, has more entries, and
-    // sorts lowest using case-insensitive sorting. If all queues are already done then there
-    // will be no next front element.
+    // sorts lowest using the same ordering used to sort directory contents. If all queues are
+    // already done then there will be no next front element.
     for (const auto& underlyingQueue : queuesToMerge)
     {
       if ((nullptr == underlyingQueue) ||
@@ -271,7 +1435,7 @@ namespace Pathwinder
         continue;
 
       if ((nullptr == nextFrontQueueCandidate) ||
-          (Infra::Strings::CompareCaseInsensitive(
+          (Strings::CompareFileNamesForSorting(
                underlyingQueue->FileNameOfFront(), nextFrontQueueCandidate->FileNameOfFront()) < 0))
         nextFrontQueueCandidate = underlyingQueue.get();
     }
@@ -281,7 +1445,25 @@ namespace Pathwinder
 
   unsigned int EnumerationQueue::CopyFront(void* dest, unsigned int capacityBytes) const
   {
-    const void* const enumerationEntry = &enumerationBuffer[enumerationBufferBytePosition];
+    const void* const enumerationEntry = FrontInternal();
+
+    if (applicationFileInformationStructLayout != fileInformationStructLayout)
+    {
+      const unsigned int sizeOfFront = SizeOfFront();
+      if (capacityBytes >= sizeOfFront)
+        return applicationFileInformationStructLayout.ConvertFileInformationStruct(
+            fileInformationStructLayout, enumerationEntry, dest);
+
+      // The converted file information structure does not fit, so it is built elsewhere first and
+      // then only the portion that fits is copied out.
+      Infra::TemporaryVector<uint8_t> convertedEnumerationEntry;
+      convertedEnumerationEntry.UnsafeSetSize(sizeOfFront);
+      applicationFileInformationStructLayout.ConvertFileInformationStruct(
+          fileInformationStructLayout, enumerationEntry, convertedEnumerationEntry.Data());
+      std::memcpy(dest, convertedEnumerationEntry.Data(), static_cast<size_t>(capacityBytes));
+
+      return capacityBytes;
+    }
 
     const unsigned int numBytesToCopy = std::min(SizeOfFront(), capacityBytes);
     std::memcpy(dest, enumerationEntry, static_cast<size_t>(numBytesToCopy));
@@ -296,7 +1478,7 @@ namespace Pathwinder
 
   std::wstring_view EnumerationQueue::FileNameOfFront(void) const
   {
-    const void* const enumerationEntry = &enumerationBuffer[enumerationBufferBytePosition];
+    const void* const enumerationEntry = FrontInternal();
 
     return fileInformationStructLayout.ReadFileName(enumerationEntry);
   }
@@ -309,15 +1491,30 @@ namespace Pathwinder
 
   void EnumerationQueue::Restart(std::wstring_view queryFilePattern)
   {
-    AdvanceQueueContentsInternal(SL_RESTART_SCAN, queryFilePattern);
-    SkipNonMatchingItemsInternal();
+    if (false == queryFilePattern.empty())
+      systemQueryFilePattern = SelectSystemQueryFilePattern(
+          queryFilePattern, matchInstruction.GetSystemQueryFilePattern());
+
+    sortingStage.reset();
+    hasContentsBeyondSortingStage = false;
+    AdvanceQueueContentsInternal(SL_RESTART_SCAN, systemQueryFilePattern);
+
+    // Whether or not the sorting stage is needed is determined fresh each time the enumeration is
+    // restarted so that, for the same directory contents, the same sequence of file information
+    // structures is produced every time.
+    if ((true == matchInstruction.ShouldSortEnumerationOutput()) ||
+        (false == IsEnumerationBufferSortedInternal()))
+      SortRemainingContentsInternal();
+    else
+      SkipNonMatchingItemsInternal();
   }
 
   unsigned int EnumerationQueue::SizeOfFront(void) const
   {
-    const void* const enumerationEntry = &enumerationBuffer[enumerationBufferBytePosition];
+    const void* const enumerationEntry = FrontInternal();
 
-    return fileInformationStructLayout.SizeOfStruct(enumerationEntry);
+    return applicationFileInformationStructLayout.HypotheticalSizeForFileNameLength(
+        fileInformationStructLayout.ReadFileNameLength(enumerationEntry));
   }
 
   unsigned int NameInsertionQueue::CopyFront(void* dest, unsigned int capacityBytes) const
@@ -358,6 +1555,8 @@ namespace Pathwinder
         filePattern[i] = std::towupper(filePattern[i]);
     }
 
+    PrefetchNameInsertionsInternal();
+
     nameInsertionQueuePosition = 0;
     AdvanceQueueContentsInternal();
   }
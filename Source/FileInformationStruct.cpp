@@ -12,6 +12,7 @@
 
 #include "FileInformationStruct.h"
 
+#include <cstring>
 #include <cwchar>
 #include <optional>
 #include <unordered_map>
@@ -30,8 +31,68 @@
             offsetof(structname, fileName))                                                        \
   }
 
+/// Copies the named field from a source file information structure to a destination file
+/// information structure, but only if the destination structure type contains the field.
+#define COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(desttype, dest, source, fieldname)           \
+  if constexpr (requires { &desttype::fieldname; })                                                \
+    std::memcpy(&(dest).fieldname, &(source).fieldname, sizeof((dest).fieldname))
+
 namespace Pathwinder
 {
+  /// Converts a file information structure of the richest convertible type into a file information
+  /// structure of the specified type, whose fields must be a subset of those in the source.
+  /// @tparam FileInformationStructType Type of file information structure to be written.
+  /// @param [in] sourceStruct Source file information structure.
+  /// @param [out] fileInformationStruct Address of the first byte of the file information structure
+  /// to be written.
+  /// @return Size, in bytes, of the written file information structure.
+  template <typename FileInformationStructType>
+    requires IsFileInformationStruct<FileInformationStructType> &&
+      HasDanglingFilenameField<FileInformationStructType>
+  static unsigned int ConvertFromFileIdBothDirectoryInformation(
+      const SFileIdBothDirectoryInformation& sourceStruct, void* fileInformationStruct)
+  {
+    FileInformationStructType& destStruct =
+        *reinterpret_cast<FileInformationStructType*>(fileInformationStruct);
+    std::memset(&destStruct, 0, offsetof(FileInformationStructType, fileName));
+
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, fileIndex);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, creationTime);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, lastAccessTime);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, lastWriteTime);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, changeTime);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, endOfFile);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, allocationSize);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, fileAttributes);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, eaSize);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, shortNameLength);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, shortName);
+    COPY_FILE_INFORMATION_STRUCT_FIELD_IF_PRESENT(
+        FileInformationStructType, destStruct, sourceStruct, fileId);
+
+    destStruct.fileNameLength = sourceStruct.fileNameLength;
+    std::memcpy(
+        destStruct.fileName,
+        sourceStruct.fileName,
+        static_cast<size_t>(sourceStruct.fileNameLength));
+
+    const unsigned int destStructSizeBytes =
+        FileInformationStructLayout::SizeOfStructByType(destStruct);
+    destStruct.nextEntryOffset = static_cast<ULONG>(destStructSizeBytes);
+    return destStructSizeBytes;
+  }
+
   std::optional<FileInformationStructLayout>
       FileInformationStructLayout::LayoutForFileInformationClass(
           FILE_INFORMATION_CLASS fileInformationClass)
@@ -59,6 +120,68 @@ namespace Pathwinder
     return layoutIter->second;
   }
 
+  FILE_INFORMATION_CLASS FileInformationStructLayout::ConvertibleSourceFileInformationClass(
+      FILE_INFORMATION_CLASS fileInformationClass)
+  {
+    switch (fileInformationClass)
+    {
+      case SFileDirectoryInformation::kFileInformationClass:
+      case SFileFullDirectoryInformation::kFileInformationClass:
+      case SFileBothDirectoryInformation::kFileInformationClass:
+      case SFileNamesInformation::kFileInformationClass:
+      case SFileIdBothDirectoryInformation::kFileInformationClass:
+      case SFileIdFullDirectoryInformation::kFileInformationClass:
+        return SFileIdBothDirectoryInformation::kFileInformationClass;
+
+      default:
+        return fileInformationClass;
+    }
+  }
+
+  unsigned int FileInformationStructLayout::ConvertFileInformationStruct(
+      const FileInformationStructLayout& sourceLayout,
+      const void* sourceFileInformationStruct,
+      void* fileInformationStruct) const
+  {
+    if (sourceLayout == *this)
+    {
+      const unsigned int structSizeBytes = SizeOfStruct(sourceFileInformationStruct);
+      std::memcpy(
+          fileInformationStruct, sourceFileInformationStruct, static_cast<size_t>(structSizeBytes));
+      UpdateNextEntryOffset(fileInformationStruct);
+      return structSizeBytes;
+    }
+
+    if (SFileIdBothDirectoryInformation::kFileInformationClass !=
+        sourceLayout.FileInformationClass())
+      return 0;
+
+    const SFileIdBothDirectoryInformation& sourceStruct =
+        *reinterpret_cast<const SFileIdBothDirectoryInformation*>(sourceFileInformationStruct);
+
+    switch (fileInformationClass)
+    {
+      case SFileDirectoryInformation::kFileInformationClass:
+        return ConvertFromFileIdBothDirectoryInformation<SFileDirectoryInformation>(
+            sourceStruct, fileInformationStruct);
+      case SFileFullDirectoryInformation::kFileInformationClass:
+        return ConvertFromFileIdBothDirectoryInformation<SFileFullDirectoryInformation>(
+            sourceStruct, fileInformationStruct);
+      case SFileBothDirectoryInformation::kFileInformationClass:
+        return ConvertFromFileIdBothDirectoryInformation<SFileBothDirectoryInformation>(
+            sourceStruct, fileInformationStruct);
+      case SFileNamesInformation::kFileInformationClass:
+        return ConvertFromFileIdBothDirectoryInformation<SFileNamesInformation>(
+            sourceStruct, fileInformationStruct);
+      case SFileIdFullDirectoryInformation::kFileInformationClass:
+        return ConvertFromFileIdBothDirectoryInformation<SFileIdFullDirectoryInformation>(
+            sourceStruct, fileInformationStruct);
+
+      default:
+        return 0;
+    }
+  }
+
   FileInformationStructLayout::TFileNameChar* FileInformationStructLayout::FileNamePointerInternal(
       const void* fileInformationStruct, unsigned int offsetOfFileName)
   {
@@ -92,8 +92,43 @@ namespace Pathwinder
     return &ruleNode->GetData();
   }
 
+  TFilesystemRulePrefixTree::SWalkPosition FilesystemDirector::LookupPath(
+      std::wstring_view absoluteFilePath,
+      std::wstring_view windowsNamespacePrefix,
+      std::wstring_view absoluteFilePathTrimmedForQuery,
+      SPathLookupResumePoint* rootDirectoryResumePoint) const
+  {
+    if ((nullptr == rootDirectoryResumePoint) ||
+        (rootDirectoryResumePoint->directoryPathLength < windowsNamespacePrefix.length()) ||
+        (rootDirectoryResumePoint->directoryPathLength > absoluteFilePath.length()))
+      return filesystemRulesByOriginDirectory.Walk(absoluteFilePathTrimmedForQuery);
+
+    // The directory part is trimmed the same way as the whole path, so that both agree on where the
+    // directory part ends. Whatever follows it begins at a path separator, possibly one that was
+    // trimmed from the directory part, and this is all that remains to be looked up.
+    const std::wstring_view directoryPathTrimmedForQuery = Infra::Strings::RemoveTrailing(
+        absoluteFilePath.substr(
+            windowsNamespacePrefix.length(),
+            rootDirectoryResumePoint->directoryPathLength - windowsNamespacePrefix.length()),
+        L'\\');
+
+    if (false == rootDirectoryResumePoint->isResolved)
+    {
+      rootDirectoryResumePoint->walkPosition =
+          filesystemRulesByOriginDirectory.Walk(directoryPathTrimmedForQuery);
+      rootDirectoryResumePoint->isResolved = true;
+    }
+
+    return filesystemRulesByOriginDirectory.WalkFrom(
+        rootDirectoryResumePoint->walkPosition,
+        absoluteFilePathTrimmedForQuery.substr(std::min(
+            directoryPathTrimmedForQuery.length(), absoluteFilePathTrimmedForQuery.length())));
+  }
+
   DirectoryEnumerationInstruction FilesystemDirector::GetInstructionForDirectoryEnumeration(
-      std::wstring_view associatedPath, std::wstring_view realOpenedPath) const
+      std::wstring_view associatedPath,
+      std::wstring_view realOpenedPath,
+      RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex) const
   {
     associatedPath = Infra::Strings::RemoveTrailing(associatedPath, L'\\');
     realOpenedPath = Infra::Strings::RemoveTrailing(realOpenedPath, L'\\');
@@ -160,8 +195,14 @@ namespace Pathwinder
         return DirectoryEnumerationInstruction::PassThroughUnmodifiedQuery();
       }
 
-      const FilesystemRule* originalRedirectRule = IdentifyRuleThatPerformedRedirection(
-          *directoryEnumerationRules, redirectedPathTrimmedForQuery);
+      // The rule that performed the redirection is normally already known from when the directory
+      // handle was opened, in which case it does not need to be identified again by comparing the
+      // redirected path with the target directory of each rule.
+      const FilesystemRule* originalRedirectRule =
+          ((redirectingRuleIndex < directoryEnumerationRules->CountOfRules())
+               ? directoryEnumerationRules->GetRuleByIndex(redirectingRuleIndex)
+               : IdentifyRuleThatPerformedRedirection(
+                     *directoryEnumerationRules, redirectedPathTrimmedForQuery));
       if (nullptr == originalRedirectRule)
       {
         Infra::Message::OutputFormatted(
@@ -440,6 +481,20 @@ namespace Pathwinder
               associatedPath.data());
           return DirectoryEnumerationInstruction::PassThroughUnmodifiedQuery();
       }
+
+      // Any of the selected rules can require that directory enumeration output be sorted, for
+      // example if its target directory is on a filesystem that does not guarantee sorted order.
+      // Because all of the individual directory enumerations are merged together, sorting is
+      // applied to all of them so that the merged output is also sorted.
+      for (const FilesystemRule& directoryEnumerationRule : directoryEnumerationRules->AllRules())
+      {
+        if (true == directoryEnumerationRule.ShouldSortDirectoryEnumerationOutput())
+        {
+          for (auto& directoryToEnumerate : directoriesToEnumerate)
+            directoryToEnumerate = directoryToEnumerate.WithSortedEnumerationOutput();
+          break;
+        }
+      }
     }
     else
     {
@@ -537,7 +592,8 @@ namespace Pathwinder
   FileOperationInstruction FilesystemDirector::GetInstructionForFileOperation(
       std::wstring_view absoluteFilePath,
       FileAccessMode fileAccessMode,
-      CreateDisposition createDisposition) const
+      CreateDisposition createDisposition,
+      SPathLookupResumePoint* rootDirectoryResumePoint) const
   {
     const std::wstring_view windowsNamespacePrefix =
         Strings::PathGetWindowsNamespacePrefix(absoluteFilePath);
@@ -567,7 +623,18 @@ namespace Pathwinder
       return FileOperationInstruction::NoRedirectionOrInterception();
     }
 
-    const auto selectedRuleContainer = SelectRulesForPath(absoluteFilePathTrimmedForQuery);
+    // A single walk of the prefix tree both selects the rules to use, which are the ones with the
+    // longest matching origin directory prefix, and determines whether the path is itself a prefix
+    // of any origin directory.
+    const TFilesystemRulePrefixTree::SWalkPosition lookupPosition = LookupPath(
+        absoluteFilePath,
+        windowsNamespacePrefix,
+        absoluteFilePathTrimmedForQuery,
+        rootDirectoryResumePoint);
+    const RelatedFilesystemRuleContainer* const selectedRuleContainer =
+        ((nullptr == lookupPosition.longestMatchingPrefixNode)
+             ? nullptr
+             : &lookupPosition.longestMatchingPrefixNode->GetData());
 
     if (nullptr == selectedRuleContainer)
     {
@@ -577,7 +644,7 @@ namespace Pathwinder
           static_cast<int>(absoluteFilePath.length()),
           absoluteFilePath.data());
 
-      if (true == IsPrefixForAnyRule(absoluteFilePathTrimmedForQuery))
+      if (true == lookupPosition.isOnPath)
       {
         // If the file path could possibly be a directory path that but exists in the
         // hierarchy as an ancestor of filesystem rules, then it is possible this same path
@@ -601,6 +668,7 @@ namespace Pathwinder
     std::wstring_view unredirectedPathFilePart;
     std::optional<Infra::TemporaryString> maybeRedirectedFilePath;
     const FilesystemRule* selectedRule = nullptr;
+    RelatedFilesystemRuleContainer::TFilesystemRulesIndex selectedRuleIndex = 0;
 
     if (EDirectoryCompareResult::Equal ==
         selectedRuleContainer->AnyRule().DirectoryCompareWithOrigin(
@@ -681,6 +749,8 @@ namespace Pathwinder
           selectedRule = &candidateRule;
           break;
         }
+
+        selectedRuleIndex += 1;
       }
 
       if (false == maybeRedirectedFilePath.has_value())
@@ -781,11 +851,12 @@ namespace Pathwinder
                  ? ECreateDispositionPreference::PreferOpenExistingFile
                  : ECreateDispositionPreference::NoPreference);
         return FileOperationInstruction::OverlayRedirectTo(
-            std::move(*maybeRedirectedFilePath),
-            EAssociateNameWithHandle::Unredirected,
-            createDispositionPreference,
-            std::move(extraPreOperations),
-            extraPreOperationOperand);
+                   std::move(*maybeRedirectedFilePath),
+                   EAssociateNameWithHandle::Unredirected,
+                   createDispositionPreference,
+                   std::move(extraPreOperations),
+                   extraPreOperationOperand)
+            .WithRedirectingRuleIndex(selectedRuleIndex);
       }
 
       case ERedirectMode::Simple:
@@ -793,10 +864,11 @@ namespace Pathwinder
         // In simple redirection mode there is nothing further to do. Only one file is
         // attempted, so no preference based on create disposition needs to be set.
         return FileOperationInstruction::SimpleRedirectTo(
-            std::move(*maybeRedirectedFilePath),
-            EAssociateNameWithHandle::Unredirected,
-            std::move(extraPreOperations),
-            extraPreOperationOperand);
+                   std::move(*maybeRedirectedFilePath),
+                   EAssociateNameWithHandle::Unredirected,
+                   std::move(extraPreOperations),
+                   extraPreOperationOperand)
+            .WithRedirectingRuleIndex(selectedRuleIndex);
       }
     }
 
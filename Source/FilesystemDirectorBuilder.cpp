@@ -208,6 +208,13 @@ namespace Pathwinder
           static_cast<int>(indentNumSpaces),
           L"");
     }
+
+    if (true == ruleToLog.ShouldSortDirectoryEnumerationOutput())
+      Infra::Message::OutputFormatted(
+          Infra::Message::ESeverity::Info,
+          L"%*sDirectory enumeration output is always sorted",
+          static_cast<int>(indentNumSpaces),
+          L"");
   }
 
   std::optional<FilesystemDirector> FilesystemDirectorBuilder::BuildFromConfigurationData(
@@ -358,7 +365,8 @@ namespace Pathwinder
           std::wstring_view originDirectory,
           std::wstring_view targetDirectory,
           std::vector<std::wstring>&& filePatterns,
-          ERedirectMode redirectMode)
+          ERedirectMode redirectMode,
+          bool sortDirectoryEnumerationOutput)
   {
     if (true == filesystemRuleNames.contains(ruleName))
       return Infra::Strings::Format(
@@ -484,7 +492,8 @@ namespace Pathwinder
         originDirectoryFullPathOwnedView,
         targetDirectoryFullPathOwnedView,
         std::move(filePatterns),
-        redirectMode);
+        redirectMode,
+        sortDirectoryEnumerationOutput);
     if (nullptr == createResult.first)
     {
       DebugAssert(
@@ -539,12 +548,19 @@ namespace Pathwinder
             .ExtractAllStrings()
             .value_or(std::vector<std::wstring>());
 
+    const bool sortDirectoryEnumerationOutput =
+        configSection
+            .Extract(Strings::kStrConfigurationSettingFilesystemRuleSortDirectoryEnumerationOutput)
+            .value_or(Infra::Configuration::Name())
+            .ValueOr(false);
+
     return AddRule(
         std::move(ruleName),
         (*maybeOriginDirectory)->GetString(),
         (*maybeTargetDirectory)->GetString(),
         std::move(filePatterns),
-        std::move(*maybeRedirectMode));
+        std::move(*maybeRedirectMode),
+        sortDirectoryEnumerationOutput);
   }
 
   Infra::ValueOrError<FilesystemDirector, Infra::TemporaryString> FilesystemDirectorBuilder::Build(
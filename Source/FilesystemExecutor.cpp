@@ -14,13 +14,19 @@
 
 #include "FilesystemExecutor.h"
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <latch>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <vector>
 
 #include <Infra/Core/ArrayList.h>
 #include <Infra/Core/Message.h>
 #include <Infra/Core/Mutex.h>
+#include <Infra/Core/Strings.h>
 #include <Infra/Core/TemporaryBuffer.h>
 #include <Infra/Core/ValueOrError.h>
 
@@ -28,6 +34,7 @@
 #include "BufferPool.h"
 #include "FileInformationStruct.h"
 #include "FilesystemOperations.h"
+#include "Globals.h"
 #include "OpenHandleStore.h"
 #include "Strings.h"
 #include "ThreadPool.h"
@@ -122,7 +129,8 @@ namespace Pathwinder
     public:
 
       inline AsynchronousDirectoryEnumerationImpl(void)
-          : contextBufferPool(), executionThreadPool(ThreadPool::Create())
+          : contextBufferPool(),
+            executionThreadPool(Globals::SharedThreadPool())
       {}
 
       inline bool SubmitOperation(
@@ -130,7 +138,7 @@ namespace Pathwinder
           const SDirectoryEnumerationParams& params,
           const SDirectoryEnumerationCompletionSignal& completionSignal)
       {
-        if (false == executionThreadPool.has_value()) return false;
+        if (nullptr == executionThreadPool) return false;
 
         SDirectoryEnumerationAsyncContext* const asyncContext =
             reinterpret_cast<SDirectoryEnumerationAsyncContext*>(contextBufferPool.Allocate());
@@ -180,7 +188,7 @@ namespace Pathwinder
       TContextBufferPool contextBufferPool;
 
       /// Thread pool used to execute all asynchronous directory enumeration operations.
-      std::optional<ThreadPool> executionThreadPool;
+      ThreadPool* executionThreadPool;
     };
 
     /// Holds all of the information needed to represent a create disposition that should be
@@ -392,11 +400,111 @@ namespace Pathwinder
       }
     }
 
-    /// Internal implementation of advancing an in-progress directory enumeration operation.
+    /// Rebuilds the deduplication state for an in-progress directory enumeration operation whose
+    /// queue was observed to produce filenames out of sorted order. Adjacent duplicate suppression
+    /// is insufficient in this situation, so the queue is restarted and replayed up to its current
+    /// position to produce the complete set of filenames already enumerated. Because the replay
+    /// reads the directory contents again, it supersedes the original pass: enumeration continues
+    /// from wherever the replay stops, and the directory may have changed in the meantime such that
+    /// the replay runs out of filenames, in which case the queue is left with no more files.
+    /// @param [in, out] enumerationState In-progress directory enumeration state to update.
+    static void RebuildEnumeratedFilenamesForUnsortedQueue(
+        OpenHandleStore::SInProgressDirectoryEnumeration& enumerationState)
+    {
+      enumerationState.unsortedEnumeratedFilenames.emplace();
+      enumerationState.queue->Restart(enumerationState.queryFilePattern);
+
+      while ((NT_SUCCESS(enumerationState.queue->EnumerationStatus())) &&
+             (enumerationState.unsortedEnumeratedFilenames->size() <
+              static_cast<size_t>(enumerationState.numEnumeratedFilenames)))
+      {
+        enumerationState.unsortedEnumeratedFilenames->emplace(
+            std::wstring(enumerationState.queue->FileNameOfFront()));
+        enumerationState.queue->PopFront();
+      }
+
+      // The most recently enumerated filename was definitely seen by the application, even if the
+      // replay did not encounter it again.
+      enumerationState.unsortedEnumeratedFilenames->emplace(
+          std::move(enumerationState.lastEnumeratedFilename));
+      enumerationState.lastEnumeratedFilename.clear();
+    }
+
+    /// Determines whether or not the filename at the front of an in-progress directory enumeration
+    /// operation's queue was already enumerated and should therefore be skipped. If the queue is
+    /// found to be producing filenames out of sorted order then its deduplication state is rebuilt
+    /// before the check is performed, after which the check applies to whatever filename is at the
+    /// front of the replayed queue.
+    /// @param [in, out] enumerationState In-progress directory enumeration state to check. Queue
+    /// must have at least one file information structure available, although it may have none
+    /// left after its deduplication state is rebuilt.
+    /// @return `true` if the filename at the front of the queue is a duplicate, `false` otherwise,
+    /// including if the queue has no more file information structures available.
+    static bool IsFrontOfQueueAlreadyEnumerated(
+        OpenHandleStore::SInProgressDirectoryEnumeration& enumerationState)
+    {
+      if (0 == enumerationState.numEnumeratedFilenames) return false;
+
+      if (false == enumerationState.unsortedEnumeratedFilenames.has_value())
+      {
+        const int compareResult = Strings::CompareFileNamesForSorting(
+            enumerationState.queue->FileNameOfFront(), enumerationState.lastEnumeratedFilename);
+        if (compareResult >= 0) return (0 == compareResult);
+
+        RebuildEnumeratedFilenamesForUnsortedQueue(enumerationState);
+        if (!(NT_SUCCESS(enumerationState.queue->EnumerationStatus()))) return false;
+      }
+
+      return enumerationState.unsortedEnumeratedFilenames->contains(
+          enumerationState.queue->FileNameOfFront());
+    }
+
+    /// Records the filename at the front of an in-progress directory enumeration operation's queue
+    /// as having been enumerated.
+    /// @param [in, out] enumerationState In-progress directory enumeration state to update. Queue
+    /// must have at least one file information structure available.
+    static void RecordFrontOfQueueAsEnumerated(
+        OpenHandleStore::SInProgressDirectoryEnumeration& enumerationState)
+    {
+      if (true == enumerationState.unsortedEnumeratedFilenames.has_value())
+        enumerationState.unsortedEnumeratedFilenames->emplace(
+            std::wstring(enumerationState.queue->FileNameOfFront()));
+      else
+        enumerationState.lastEnumeratedFilename.assign(enumerationState.queue->FileNameOfFront());
+
+      enumerationState.numEnumeratedFilenames += 1;
+    }
+
+    /// Releases the queue and deduplication state of an in-progress directory enumeration operation
+    /// whose queue reported that there are no more files, which in turn frees all of the queue's
+    /// buffers and closes any directory handles it opened. Applications often keep directory
+    /// handles open long after enumerating their contents, and none of this state is needed again
+    /// unless the directory enumeration is restarted. Has no effect if the queue could not be
+    /// created again on restart.
+    /// @param [in, out] enumerationState In-progress directory enumeration state to drain.
+    static void DrainDirectoryEnumerationState(
+        OpenHandleStore::SInProgressDirectoryEnumeration& enumerationState)
+    {
+      if (nullptr == enumerationState.instructionSource) return;
+
+      enumerationState.queue.reset();
+      enumerationState.lastEnumeratedFilename.clear();
+      enumerationState.lastEnumeratedFilename.shrink_to_fit();
+      enumerationState.unsortedEnumeratedFilenames.reset();
+      enumerationState.isDrained = true;
+    }
+
+    /// Internal implementation of advancing an in-progress directory enumeration operation,
+    /// specialized for the layout of the file information structures being written.
+    /// @tparam LayoutType Type of object that describes the layout of the file information
+    /// structures being written, either compile-time or runtime.
     /// @param [in] params Parameter record containing information on how to process the request.
+    /// @param [in] fileInformationStructLayout Layout of the file information structures being
+    /// written to the output buffer.
     /// @return Windows error code corresponding to the result of advancing the directory
     /// enumeration operation.
-    static NTSTATUS AdvanceDirectoryEnumerationOperation(const SDirectoryEnumerationParams& params)
+    template <typename LayoutType> static NTSTATUS AdvanceDirectoryEnumerationOperationWithLayout(
+        const SDirectoryEnumerationParams& params, const LayoutType& fileInformationStructLayout)
     {
       OpenHandleStore::SInProgressDirectoryEnumeration& enumerationState =
           *(*params.handleData.directoryEnumeration);
@@ -404,12 +512,21 @@ namespace Pathwinder
       const bool isFirstInvocation = enumerationState.isFirstInvocation;
       enumerationState.isFirstInvocation = false;
 
+      if (true == enumerationState.isDrained)
+      {
+        params.ioStatusBlock->Information = 0;
+        return NtStatus::kNoMoreFiles;
+      }
+
       // This block will cause `STATUS_NO_MORE_FILES` to be returned if the queue is empty and
       // enumeration is complete. Getting past here means the queue is not empty and more files
       // can be enumerated.
       NTSTATUS enumerationStatus = enumerationState.queue->EnumerationStatus();
       if (!(NT_SUCCESS(enumerationStatus)))
       {
+        if (NtStatus::kNoMoreFiles == enumerationStatus)
+          DrainDirectoryEnumerationState(enumerationState);
+
         // If the first invocation has resulted in no files available for enumeration then that
         // should be the result. This would only happen if a query file pattern is specified and
         // it matches no files. Otherwise, a directory enumeration would at very least include
@@ -434,8 +551,8 @@ namespace Pathwinder
         // length of the filename that would be written to the output buffer if there were
         // sufficient space (the actual length of the filename, even though the whole thing could
         // not be copied).
-        enumerationState.fileInformationStructLayout.ClearNextEntryOffset(params.outputBuffer);
-        enumerationState.fileInformationStructLayout.WriteFileNameLength(
+        fileInformationStructLayout.ClearNextEntryOffset(params.outputBuffer);
+        fileInformationStructLayout.WriteFileNameLength(
             params.outputBuffer,
             static_cast<FileInformationStructLayout::TFileNameLength>(
                 enumerationState.queue->FileNameOfFront().length() * sizeof(wchar_t)));
@@ -475,26 +592,29 @@ namespace Pathwinder
         // removed. For these reasons it is necessary to update the next entry offset here and
         // track the last written file information structure so that its next entry offset can
         // be cleared after the loop.
-        enumerationState.fileInformationStructLayout.UpdateNextEntryOffset(bufferPosition);
+        fileInformationStructLayout.UpdateNextEntryOffset(bufferPosition);
         lastBufferPosition = bufferPosition;
 
-        enumerationState.enumeratedFilenames.emplace(
-            std::wstring(enumerationState.queue->FileNameOfFront()));
+        RecordFrontOfQueueAsEnumerated(enumerationState);
         enumerationState.queue->PopFront();
 
         // Enumeration status must be checked first because, if there are no file information
         // structures left in the queue, checking the front element's filename will cause a
         // crash.
         while ((NT_SUCCESS(enumerationState.queue->EnumerationStatus())) &&
-               (enumerationState.enumeratedFilenames.contains(
-                   enumerationState.queue->FileNameOfFront())))
+               (true == IsFrontOfQueueAlreadyEnumerated(enumerationState)))
           enumerationState.queue->PopFront();
 
         enumerationStatus = enumerationState.queue->EnumerationStatus();
       }
 
       if (nullptr != lastBufferPosition)
-        enumerationState.fileInformationStructLayout.ClearNextEntryOffset(lastBufferPosition);
+        fileInformationStructLayout.ClearNextEntryOffset(lastBufferPosition);
+
+      // Nothing more will be offered until a restart, so there is no reason to wait for the
+      // application to observe the end of the enumeration before releasing its resources.
+      if (NtStatus::kNoMoreFiles == enumerationStatus)
+        DrainDirectoryEnumerationState(enumerationState);
 
       // Whether or not the queue still has any file information structures is not relevant.
       // Coming into this function call there was at least one such structure available.
@@ -515,6 +635,23 @@ namespace Pathwinder
       return enumerationStatus;
     }
 
+    /// Internal implementation of advancing an in-progress directory enumeration operation. The
+    /// layout of the file information structures being written is resolved once here, rather than
+    /// once per file information structure written.
+    /// @param [in] params Parameter record containing information on how to process the request.
+    /// @return Windows error code corresponding to the result of advancing the directory
+    /// enumeration operation.
+    static NTSTATUS AdvanceDirectoryEnumerationOperation(const SDirectoryEnumerationParams& params)
+    {
+      return (*params.handleData.directoryEnumeration)
+          ->fileInformationStructLayout.InvokeWithStaticLayout(
+              [&params](const auto& fileInformationStructLayout) -> NTSTATUS
+              {
+                return AdvanceDirectoryEnumerationOperationWithLayout(
+                    params, fileInformationStructLayout);
+              });
+    }
+
     /// Wrapper for submitting a request to advance a directory enumeration operation
     /// asynchronously.
     /// @param [in] params Parameter record containing information on how to process the request.
@@ -558,6 +695,145 @@ namespace Pathwinder
           completionSignal);
     }
 
+    /// Holds all of the information needed to create a single directory operation queue, either
+    /// on the calling thread or as a thread pool work item.
+    struct SDirectoryOperationQueueCreationContext
+    {
+      /// Single directory enumeration instruction for an enumeration queue, or `nullptr` if a name
+      /// insertion queue is to be created instead.
+      const DirectoryEnumerationInstruction::SingleDirectoryEnumeration* singleDirectoryEnumeration;
+
+      /// Absolute path of the directory to enumerate. Used only for enumeration queues.
+      std::wstring_view enumerationPath;
+
+      /// Handle already open to the directory to enumerate, or `NULL` if the directory needs to
+      /// be opened by path. Used only for enumeration queues.
+      HANDLE existingDirectoryHandle;
+
+      /// Directory names to insert. Used only for name insertion queues.
+      std::optional<DirectoryEnumerationInstruction::TDirectoryNamesToInsert>
+          directoryNamesToInsert;
+
+      /// Type of information to request from the system when querying for file information
+      /// structures.
+      FILE_INFORMATION_CLASS fileInformationClass;
+
+      /// File pattern to supply to the queue when it is created.
+      std::wstring_view queryFilePattern;
+
+      /// Whether or not the queue should read ahead in the background. Used only for enumeration
+      /// queues.
+      bool enableReadAhead;
+
+      /// Directory listing cache for the queue to consult and fill, or `nullptr` if directory
+      /// listing caching is disabled. Used only for enumeration queues.
+      DirectoryListingCache* directoryListingCache;
+
+      /// Receives the newly-created queue.
+      std::unique_ptr<IDirectoryOperationQueue> createdQueue;
+
+      /// Counted down once the queue is created, if queues are being created concurrently.
+      std::latch* completionLatch;
+    };
+
+    /// Retrieves the directory listing cache shared by all directory enumeration queues. Its time
+    /// to live is fixed the first time it is retrieved.
+    /// @return Pointer to the directory listing cache, or `nullptr` if directory listing caching is
+    /// disabled.
+    static DirectoryListingCache* GetDirectoryListingCache(void)
+    {
+      const unsigned int timeToLiveMilliseconds =
+          Globals::PerformanceSettings().directoryEnumerationListingCacheTimeToLiveMilliseconds;
+      if (0 == timeToLiveMilliseconds) return nullptr;
+
+      static DirectoryListingCache directoryListingCache(
+          std::chrono::milliseconds(timeToLiveMilliseconds));
+      return &directoryListingCache;
+    }
+
+    /// Discards any cached listings of the directory that contains the specified file, whose
+    /// existence, name, or metadata has just been changed. Has no effect if directory listing
+    /// caching is disabled.
+    /// @param [in] absolutePath Absolute path of the file that was changed.
+    static void InvalidateDirectoryListingOfContainingDirectory(std::wstring_view absolutePath)
+    {
+      DirectoryListingCache* const directoryListingCache = GetDirectoryListingCache();
+      if (nullptr == directoryListingCache) return;
+
+      directoryListingCache->InvalidateDirectory(Strings::PathGetParentDirectory(absolutePath));
+    }
+
+    /// Determines if opening or creating a file using the specified parameters can change the
+    /// contents of the directory that contains it. This is the case for anything that might create,
+    /// replace, or delete the file. Requesting delete access is included because the file can
+    /// subsequently be deleted by handle without any further involvement of Pathwinder.
+    /// @param [in] desiredAccess Access mask requested by the application.
+    /// @param [in] createDisposition Create disposition requested by the application.
+    /// @param [in] createOptions Create or open options requested by the application.
+    /// @return `true` if the containing directory's contents might change, `false` otherwise.
+    static bool NewFileHandleMayChangeContainingDirectory(
+        ACCESS_MASK desiredAccess, ULONG createDisposition, ULONG createOptions)
+    {
+      if (FILE_OPEN != createDisposition) return true;
+      if (0 != (createOptions & FILE_DELETE_ON_CLOSE)) return true;
+      if (0 != (desiredAccess & DELETE)) return true;
+
+      return false;
+    }
+
+    /// Thread pool work item callback for reading a directory listing ahead of time.
+    /// @param [in] instance Thread pool callback instance. Not used.
+    /// @param [in] context Pointer to the listing prefetch object, which this callback owns.
+    static void CALLBACK
+        DirectoryListingPrefetchCallback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+    {
+      std::unique_ptr<EnumerationQueue::SListingPrefetch> listingPrefetch(
+          reinterpret_cast<EnumerationQueue::SListingPrefetch*>(context));
+
+      EnumerationQueue::CompleteListingPrefetch(*listingPrefetch);
+    }
+
+    /// Creates a single directory operation queue using the information in the supplied context.
+    /// Creating a queue opens the directory to be enumerated, if applicable, and fetches the first
+    /// file information structure, so it can take some time.
+    /// @param [in, out] queueCreationContext Context that describes the queue to create and
+    /// receives the newly-created queue.
+    static void CreateDirectoryOperationQueueFromContext(
+        SDirectoryOperationQueueCreationContext& queueCreationContext)
+    {
+      if (nullptr != queueCreationContext.singleDirectoryEnumeration)
+      {
+        queueCreationContext.createdQueue = std::make_unique<EnumerationQueue>(
+            *queueCreationContext.singleDirectoryEnumeration,
+            queueCreationContext.enumerationPath,
+            queueCreationContext.fileInformationClass,
+            queueCreationContext.queryFilePattern,
+            queueCreationContext.enableReadAhead,
+            queueCreationContext.existingDirectoryHandle,
+            queueCreationContext.directoryListingCache);
+      }
+      else
+      {
+        queueCreationContext.createdQueue = std::make_unique<NameInsertionQueue>(
+            std::move(*queueCreationContext.directoryNamesToInsert),
+            queueCreationContext.fileInformationClass,
+            queueCreationContext.queryFilePattern);
+      }
+    }
+
+    /// Thread pool work item callback for concurrently creating a directory operation queue.
+    /// @param [in] instance Thread pool callback instance. Not used.
+    /// @param [in] context Pointer to the queue creation context object.
+    static void CALLBACK
+        DirectoryOperationQueueCreationCallback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+    {
+      SDirectoryOperationQueueCreationContext& queueCreationContext =
+          *reinterpret_cast<SDirectoryOperationQueueCreationContext*>(context);
+
+      CreateDirectoryOperationQueueFromContext(queueCreationContext);
+      queueCreationContext.completionLatch->count_down();
+    }
+
     /// Creates a directory operation queue object based on the supplied directory enumeration
     /// instruction.
     /// @param [in] instruction Instruction that specifies how to implement the directory
@@ -572,6 +848,9 @@ namespace Pathwinder
     /// directory that is open for enumeration.
     /// @param [in] handleRealOpenedPath Absolute path that was actually opened when creating the
     /// handle to the directory that is open for enumeration.
+    /// @param [in] handle Handle to the directory that is open for enumeration. Any queue that
+    /// enumerates the real opened path uses a duplicate of this handle, if possible, rather than
+    /// opening the same directory again.
     /// @return Directory operation queue that will implement the instruction, or `nullptr` if the
     /// instruction is a no-op and the represented enumeration can just be forwarded to the system.
     static std::unique_ptr<IDirectoryOperationQueue> CreateDirectoryOperationQueue(
@@ -579,12 +858,18 @@ namespace Pathwinder
         FILE_INFORMATION_CLASS fileInformationClass,
         std::wstring_view queryFilePattern,
         std::wstring_view handleAssociatedPath,
-        std::wstring_view handleRealOpenedPath)
+        std::wstring_view handleRealOpenedPath,
+        HANDLE handle)
     {
       if (instruction == DirectoryEnumerationInstruction::PassThroughUnmodifiedQuery())
         return nullptr;
 
-      MergedFileInformationQueue::TQueuesToMerge createdQueues;
+      const Globals::SPerformanceSettings& performanceSettings = Globals::PerformanceSettings();
+
+      std::vector<SDirectoryOperationQueueCreationContext> queueCreationContexts;
+      queueCreationContexts.reserve(
+          instruction.GetDirectoriesToEnumerate().size() +
+          ((true == instruction.HasDirectoryNamesToInsert()) ? 1 : 0));
 
       for (const auto& singleDirectoryEnumeration : instruction.GetDirectoriesToEnumerate())
       {
@@ -592,16 +877,81 @@ namespace Pathwinder
             handleAssociatedPath, handleRealOpenedPath);
         DebugAssert(false == enumerationPath.empty(), "Empty directory enumeration path.");
 
-        createdQueues.push_back(std::make_unique<EnumerationQueue>(
-            singleDirectoryEnumeration, enumerationPath, fileInformationClass, queryFilePattern));
+        // The application's handle already refers to the real opened path. All enumeration on that
+        // handle is serviced by the queue being created here, so the application never observes
+        // the position of its cursor, which means it can be shared by way of a duplicated handle.
+        const HANDLE existingDirectoryHandle =
+            ((EDirectoryPathSource::RealOpenedPath ==
+              singleDirectoryEnumeration.GetDirectoryPathSource())
+                 ? handle
+                 : NULL);
+
+        queueCreationContexts.push_back(
+            {.singleDirectoryEnumeration = &singleDirectoryEnumeration,
+             .enumerationPath = enumerationPath,
+             .existingDirectoryHandle = existingDirectoryHandle,
+             .directoryNamesToInsert = std::nullopt,
+             .fileInformationClass = fileInformationClass,
+             .queryFilePattern = queryFilePattern,
+             .enableReadAhead = performanceSettings.directoryEnumerationReadAhead,
+             .directoryListingCache = GetDirectoryListingCache(),
+             .createdQueue = nullptr,
+             .completionLatch = nullptr});
       }
 
       if (true == instruction.HasDirectoryNamesToInsert())
       {
-        createdQueues.push_back(std::make_unique<NameInsertionQueue>(
-            instruction.ExtractDirectoryNamesToInsert(), fileInformationClass, queryFilePattern));
+        queueCreationContexts.push_back(
+            {.singleDirectoryEnumeration = nullptr,
+             .enumerationPath = std::wstring_view(),
+             .existingDirectoryHandle = NULL,
+             .directoryNamesToInsert = instruction.ExtractDirectoryNamesToInsert(),
+             .fileInformationClass = fileInformationClass,
+             .queryFilePattern = queryFilePattern,
+             .enableReadAhead = false,
+             .directoryListingCache = nullptr,
+             .createdQueue = nullptr,
+             .completionLatch = nullptr});
+      }
+
+      ThreadPool* const initialFillThreadPool =
+          ((true == performanceSettings.directoryEnumerationConcurrentInitialFill) &&
+           (queueCreationContexts.size() > 1))
+          ? Globals::SharedThreadPool()
+          : nullptr;
+
+      if (nullptr != initialFillThreadPool)
+      {
+        // Each queue opens its directory and fetches its first batch of file information
+        // structures when it is created, so creating them all concurrently means the application
+        // waits only as long as the slowest of them, rather than the sum of all of them.
+        std::latch completionLatch(static_cast<std::ptrdiff_t>(queueCreationContexts.size()));
+
+        for (auto& queueCreationContext : queueCreationContexts)
+        {
+          queueCreationContext.completionLatch = &completionLatch;
+
+          if (false ==
+              initialFillThreadPool->SubmitWork(
+                  DirectoryOperationQueueCreationCallback, &queueCreationContext))
+            DirectoryOperationQueueCreationCallback(nullptr, &queueCreationContext);
+        }
+
+        ThreadPool::ScopedBlockingWait blockingWait;
+        completionLatch.wait();
+      }
+      else
+      {
+        for (auto& queueCreationContext : queueCreationContexts)
+          CreateDirectoryOperationQueueFromContext(queueCreationContext);
       }
 
+      MergedFileInformationQueue::TQueuesToMerge createdQueues;
+      createdQueues.reserve(queueCreationContexts.size());
+
+      for (auto& queueCreationContext : queueCreationContexts)
+        createdQueues.push_back(std::move(queueCreationContext.createdQueue));
+
       switch (createdQueues.size())
       {
         case 0:
@@ -644,7 +994,8 @@ namespace Pathwinder
         FileAccessMode fileAccessMode,
         CreateDisposition createDisposition,
         std::function<FileOperationInstruction(
-            std::wstring_view, FileAccessMode, CreateDisposition)> instructionSourceFunc)
+            std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)>
+            instructionSourceFunc)
     {
       std::optional<Infra::TemporaryString> maybeRedirectedFilename = std::nullopt;
       std::optional<OpenHandleStore::SHandleDataView> maybeRootDirectoryHandleData =
@@ -662,8 +1013,26 @@ namespace Pathwinder
         Infra::TemporaryString inputFullFilename;
         inputFullFilename << rootDirectoryHandlePath << L'\\' << inputFilename;
 
-        FileOperationInstruction redirectionInstruction =
-            instructionSourceFunc(inputFullFilename, fileAccessMode, createDisposition);
+        // Applications that scan directory trees tend to open many files relative to the same root
+        // directory handle. The part of the lookup that covers the root directory path only needs
+        // to happen once per handle, after which it is resumed for each relative path.
+        const SPathLookupResumePoint* const storedRootDirectoryResumePoint =
+            maybeRootDirectoryHandleData->pathLookupResumePoint;
+        SPathLookupResumePoint rootDirectoryResumePoint =
+            ((nullptr != storedRootDirectoryResumePoint)
+                 ? *storedRootDirectoryResumePoint
+                 : SPathLookupResumePoint{
+                       .directoryPathLength =
+                           static_cast<unsigned int>(rootDirectoryHandlePath.length()),
+                       .isResolved = false,
+                       .walkPosition = {}});
+
+        FileOperationInstruction redirectionInstruction = instructionSourceFunc(
+            inputFullFilename, fileAccessMode, createDisposition, &rootDirectoryResumePoint);
+        if ((nullptr == storedRootDirectoryResumePoint) &&
+            (true == rootDirectoryResumePoint.isResolved))
+          openHandleStore.SetPathLookupResumePoint(rootDirectory, rootDirectoryResumePoint);
+
         if (true == redirectionInstruction.HasRedirectedFilename())
           Infra::Message::OutputFormatted(
               Infra::Message::ESeverity::Debug,
@@ -699,7 +1068,7 @@ namespace Pathwinder
         // root directory. It is sufficient to send the object name directly for redirection.
 
         FileOperationInstruction redirectionInstruction =
-            instructionSourceFunc(inputFilename, fileAccessMode, createDisposition);
+            instructionSourceFunc(inputFilename, fileAccessMode, createDisposition, nullptr);
 
         if (true == redirectionInstruction.HasRedirectedFilename())
         {
@@ -1087,6 +1456,7 @@ namespace Pathwinder
     /// @param [in] instruction Instruction that specifies how to redirect a filesystem operation.
     /// @param [in] successfulPath Path that was used successfully to create the file handle.
     /// @param [in] unredirectedPath Original file name supplied by the application.
+    /// @param [in] createOptions Create or open options supplied by the application.
     static void SelectFilenameAndStoreNewlyOpenedHandle(
         const wchar_t* functionName,
         unsigned int functionRequestIdentifier,
@@ -1094,8 +1464,26 @@ namespace Pathwinder
         HANDLE newlyOpenedHandle,
         const FileOperationInstruction& instruction,
         std::wstring_view successfulPath,
-        std::wstring_view unredirectedPath)
+        std::wstring_view unredirectedPath,
+        ULONG createOptions)
     {
+      // Handles that are intercepted without being redirected only need to be stored so that they
+      // can later be used as root directories or for directory enumeration. Neither is possible for
+      // a handle explicitly opened as a non-directory file. Any other operation that needs the path
+      // of such a handle queries the system for it instead.
+      if ((EAssociateNameWithHandle::Unredirected == instruction.GetFilenameHandleAssociation()) &&
+          (false == instruction.HasRedirectedFilename()) &&
+          (0 != (createOptions & FILE_NON_DIRECTORY_FILE)))
+      {
+        Infra::Message::OutputFormatted(
+            Infra::Message::ESeverity::SuperDebug,
+            L"%s(%u): Handle %zu was opened as a non-directory file and is not being stored.",
+            functionName,
+            functionRequestIdentifier,
+            reinterpret_cast<size_t>(newlyOpenedHandle));
+        return;
+      }
+
       std::wstring_view selectedPath;
 
       switch (instruction.GetFilenameHandleAssociation())
@@ -1131,7 +1519,10 @@ namespace Pathwinder
         selectedPath = Infra::Strings::RemoveTrailing(selectedPath, L'\\');
 
         openHandleStore.InsertHandle(
-            newlyOpenedHandle, std::wstring(selectedPath), std::wstring(successfulPath));
+            newlyOpenedHandle,
+            std::wstring(selectedPath),
+            std::wstring(successfulPath),
+            instruction.GetRedirectingRuleIndex());
         Infra::Message::OutputFormatted(
             Infra::Message::ESeverity::Debug,
             L"%s(%u): Handle %zu was opened for path \"%.*s\" and stored in association with path \"%.*s\".",
@@ -1180,7 +1571,7 @@ namespace Pathwinder
                 functionName,
                 functionRequestIdentifier,
                 reinterpret_cast<size_t>(handleToUpdate),
-                erasedHandleData.associatedPath.c_str());
+                erasedHandleData.associatedPath.AsCString());
           break;
         }
 
@@ -1212,7 +1603,10 @@ namespace Pathwinder
         selectedPath = Infra::Strings::RemoveTrailing(selectedPath, L'\\');
 
         openHandleStore.InsertOrUpdateHandle(
-            handleToUpdate, std::wstring(selectedPath), std::wstring(successfulPath));
+            handleToUpdate,
+            std::wstring(selectedPath),
+            std::wstring(successfulPath),
+            instruction.GetRedirectingRuleIndex());
         Infra::Message::OutputFormatted(
             Infra::Message::ESeverity::Debug,
             L"%s(%u): Handle %zu was updated in storage to be opened with path \"%.*s\" and associated with path \"%.*s\".",
@@ -1233,6 +1627,11 @@ namespace Pathwinder
         HANDLE handle,
         std::function<NTSTATUS(HANDLE)> underlyingSystemCallInvoker)
     {
+      // Most handles closed by the application were never stored, so it is worth ruling them out
+      // without taking any locks.
+      if (false == openHandleStore.MightContainHandle(handle))
+        return underlyingSystemCallInvoker(handle);
+
       std::optional<OpenHandleStore::SHandleDataView> maybeClosedHandleData =
           openHandleStore.GetDataForHandle(handle);
       if (false == maybeClosedHandleData.has_value()) return underlyingSystemCallInvoker(handle);
@@ -1247,7 +1646,7 @@ namespace Pathwinder
             functionName,
             functionRequestIdentifier,
             reinterpret_cast<size_t>(handle),
-            closedHandleData.associatedPath.c_str());
+            closedHandleData.associatedPath.AsCString());
 
       return closeHandleResult;
     }
@@ -1274,18 +1673,71 @@ namespace Pathwinder
       OpenHandleStore::SInProgressDirectoryEnumeration& enumerationState =
           *(*handleData.directoryEnumeration);
       DebugAssert(
-          nullptr != enumerationState.queue,
+          (nullptr != enumerationState.queue) || (true == enumerationState.isDrained),
           "Advancing directory enumeration state without an operation queue.");
-      if (nullptr == enumerationState.queue) return NtStatus::kInternalError;
+      if ((nullptr == enumerationState.queue) && (false == enumerationState.isDrained))
+        return NtStatus::kInternalError;
 
       if (queryFlags & SL_RESTART_SCAN)
       {
         const std::wstring_view queryFilePattern =
             ((nullptr == fileName) ? std::wstring_view()
                                    : Strings::NtConvertUnicodeStringToStringView(*fileName));
+        if (false == queryFilePattern.empty())
+          enumerationState.queryFilePattern = std::wstring(queryFilePattern);
+
+        if (true == enumerationState.isDrained)
+        {
+          // A drained directory enumeration no longer has a queue, so restarting it means creating
+          // the queue again from scratch, exactly as when the enumeration was first requested. The
+          // application need not supply a file pattern on restart, in which case the one it most
+          // recently supplied continues to apply.
+          DirectoryEnumerationInstruction directoryEnumerationInstruction =
+              enumerationState.instructionSource(
+                  handleData.associatedPath,
+                  handleData.realOpenedPath,
+                  handleData.redirectingRuleIndex);
+
+          std::unique_ptr<IDirectoryOperationQueue> rebuiltQueue = CreateDirectoryOperationQueue(
+              directoryEnumerationInstruction,
+              enumerationState.fileInformationStructLayout.FileInformationClass(),
+              enumerationState.queryFilePattern,
+              handleData.associatedPath,
+              handleData.realOpenedPath,
+              fileHandle);
+
+          // If the queue could not be created then the directory enumeration remains drained, so
+          // that it continues to indicate no more files and can be restarted again later.
+          if (nullptr == rebuiltQueue)
+          {
+            Infra::Message::OutputFormatted(
+                Infra::Message::ESeverity::Error,
+                L"%s(%u): Directory enumeration state for handle %zu could not be rebuilt on restart.",
+                functionName,
+                functionRequestIdentifier,
+                reinterpret_cast<size_t>(fileHandle));
+            return NtStatus::kInternalError;
+          }
 
-        enumerationState.queue->Restart(queryFilePattern);
-        enumerationState.enumeratedFilenames.clear();
+          enumerationState.queue = std::move(rebuiltQueue);
+          enumerationState.isDrained = false;
+
+          Infra::Message::OutputFormatted(
+              Infra::Message::ESeverity::Debug,
+              L"%s(%u): Directory enumeration state for handle %zu was rebuilt on restart.",
+              functionName,
+              functionRequestIdentifier,
+              reinterpret_cast<size_t>(fileHandle));
+        }
+        else
+        {
+          enumerationState.queue->Restart(queryFilePattern);
+        }
+
+        enumerationState.lastEnumeratedFilename.clear();
+        enumerationState.numEnumeratedFilenames = 0;
+        if (true == enumerationState.unsortedEnumeratedFilenames.has_value())
+          enumerationState.unsortedEnumeratedFilenames->clear();
         enumerationState.isFirstInvocation = true;
       }
 
@@ -1359,8 +1811,10 @@ namespace Pathwinder
         ULONG length,
         FILE_INFORMATION_CLASS fileInformationClass,
         PUNICODE_STRING fileName,
-        std::function<DirectoryEnumerationInstruction(std::wstring_view, std::wstring_view)>
-            instructionSourceFunc)
+        std::function<DirectoryEnumerationInstruction(
+            std::wstring_view,
+            std::wstring_view,
+            RelatedFilesystemRuleContainer::TFilesystemRulesIndex)> instructionSourceFunc)
     {
       std::optional<FileInformationStructLayout> maybeFileInformationStructLayout =
           FileInformationStructLayout::LayoutForFileInformationClass(fileInformationClass);
@@ -1420,7 +1874,10 @@ namespace Pathwinder
         // is being requested for the first time.
 
         DirectoryEnumerationInstruction directoryEnumerationInstruction =
-            instructionSourceFunc(maybeHandleData->associatedPath, maybeHandleData->realOpenedPath);
+            instructionSourceFunc(
+                maybeHandleData->associatedPath,
+                maybeHandleData->realOpenedPath,
+                maybeHandleData->redirectingRuleIndex);
 
         std::unique_ptr<IDirectoryOperationQueue> directoryOperationQueueUniquePtr =
             CreateDirectoryOperationQueue(
@@ -1428,11 +1885,14 @@ namespace Pathwinder
                 fileInformationClass,
                 queryFilePattern,
                 maybeHandleData->associatedPath,
-                maybeHandleData->realOpenedPath);
+                maybeHandleData->realOpenedPath,
+                fileHandle);
         openHandleStore.AssociateDirectoryEnumerationState(
             fileHandle,
             std::move(directoryOperationQueueUniquePtr),
-            *maybeFileInformationStructLayout);
+            *maybeFileInformationStructLayout,
+            std::move(instructionSourceFunc),
+            queryFilePattern);
 
         // Re-obtain the handle data so that it contains a pointer to the newly-created directory
         // enumeration state object.
@@ -1441,14 +1901,78 @@ namespace Pathwinder
 
       // A `nullptr` queue, either just created or already cached, indicates that the directory
       // enumeration operation should be passed through to the system without interception or
-      // modification.
-      const auto& handleAssociatedEnumerationQueue =
-          (*(*maybeHandleData->directoryEnumeration)).queue;
-      if (nullptr == handleAssociatedEnumerationQueue) return std::nullopt;
+      // modification. The exception is a drained directory enumeration, which released its queue.
+      const OpenHandleStore::SInProgressDirectoryEnumeration& handleAssociatedEnumerationState =
+          *(*maybeHandleData->directoryEnumeration);
+      if ((nullptr == handleAssociatedEnumerationState.queue) &&
+          (false == handleAssociatedEnumerationState.isDrained))
+        return std::nullopt;
 
       return NtStatus::kSuccess;
     }
 
+    void DirectoryEnumerationPrefetch(
+        const wchar_t* functionName,
+        unsigned int functionRequestIdentifier,
+        OpenHandleStore& openHandleStore,
+        HANDLE fileHandle,
+        ULONG createOptions,
+        std::function<DirectoryEnumerationInstruction(
+            std::wstring_view,
+            std::wstring_view,
+            RelatedFilesystemRuleContainer::TFilesystemRulesIndex)> instructionSourceFunc)
+    {
+      if (false == Globals::PerformanceSettings().directoryEnumerationPrefetch) return;
+      if (0 == (createOptions & FILE_DIRECTORY_FILE)) return;
+
+      DirectoryListingCache* const directoryListingCache = GetDirectoryListingCache();
+      if (nullptr == directoryListingCache) return;
+
+      ThreadPool* const prefetchThreadPool = Globals::SharedThreadPool();
+      if (nullptr == prefetchThreadPool) return;
+
+      std::optional<OpenHandleStore::SHandleDataView> maybeHandleData =
+          openHandleStore.GetDataForHandle(fileHandle);
+      if (false == maybeHandleData.has_value()) return;
+
+      const DirectoryEnumerationInstruction directoryEnumerationInstruction =
+          instructionSourceFunc(
+              maybeHandleData->associatedPath,
+              maybeHandleData->realOpenedPath,
+              maybeHandleData->redirectingRuleIndex);
+
+      for (const auto& singleDirectoryEnumeration :
+           directoryEnumerationInstruction.GetDirectoriesToEnumerate())
+      {
+        const std::wstring_view enumerationPath = singleDirectoryEnumeration.SelectDirectoryPath(
+            maybeHandleData->associatedPath, maybeHandleData->realOpenedPath);
+
+        // Beginning the prefetch registers the listing as being read, so an enumeration that
+        // starts before the work item finishes waits for it instead of reading it a second time.
+        std::optional<EnumerationQueue::SListingPrefetch> maybeListingPrefetch =
+            EnumerationQueue::BeginListingPrefetch(
+                singleDirectoryEnumeration, enumerationPath, *directoryListingCache);
+        if (false == maybeListingPrefetch.has_value()) continue;
+
+        Infra::Message::OutputFormatted(
+            Infra::Message::ESeverity::Debug,
+            L"%s(%u): Prefetching directory listing for path \"%.*s\" associated with handle %zu.",
+            functionName,
+            functionRequestIdentifier,
+            static_cast<int>(enumerationPath.length()),
+            enumerationPath.data(),
+            reinterpret_cast<size_t>(fileHandle));
+
+        auto listingPrefetch =
+            std::make_unique<EnumerationQueue::SListingPrefetch>(std::move(*maybeListingPrefetch));
+        if (true ==
+            prefetchThreadPool->SubmitWork(DirectoryListingPrefetchCallback, listingPrefetch.get()))
+          listingPrefetch.release();
+        else
+          EnumerationQueue::CompleteListingPrefetch(*listingPrefetch);
+      }
+    }
+
     NTSTATUS NewFileHandle(
         const wchar_t* functionName,
         unsigned int functionRequestIdentifier,
@@ -1460,7 +1984,8 @@ namespace Pathwinder
         ULONG createDisposition,
         ULONG createOptions,
         std::function<FileOperationInstruction(
-            std::wstring_view, FileAccessMode, CreateDisposition)> instructionSourceFunc,
+            std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)>
+            instructionSourceFunc,
         std::function<NTSTATUS(PHANDLE, POBJECT_ATTRIBUTES, ULONG)> underlyingSystemCallInvoker)
     {
       DumpNewFileHandleParameters(
@@ -1483,13 +2008,25 @@ namespace Pathwinder
           instructionSourceFunc);
       const FileOperationInstruction& redirectionInstruction = operationContext.instruction;
 
+      std::wstring_view unredirectedPath =
+          ((true == operationContext.composedInputPath.has_value())
+               ? operationContext.composedInputPath->AsStringView()
+               : Strings::NtConvertUnicodeStringToStringView(*objectAttributes->ObjectName));
+      const bool mayChangeContainingDirectory = NewFileHandleMayChangeContainingDirectory(
+          desiredAccess, createDisposition, createOptions);
+
       if (FileOperationInstruction::NoRedirectionOrInterception() == redirectionInstruction)
       {
         SObjectNameAndAttributes unredirectedObjectNameAndAttributes = {};
         FillUnredirectedObjectNameAndAttributes(
             unredirectedObjectNameAndAttributes, operationContext, *objectAttributes);
-        return underlyingSystemCallInvoker(
+
+        const NTSTATUS systemCallResult = underlyingSystemCallInvoker(
             fileHandle, &unredirectedObjectNameAndAttributes.objectAttributes, createDisposition);
+        if ((NT_SUCCESS(systemCallResult)) && (true == mayChangeContainingDirectory))
+          InvalidateDirectoryListingOfContainingDirectory(unredirectedPath);
+
+        return systemCallResult;
       }
 
       NTSTATUS preOperationResult = ExecuteExtraPreOperations(
@@ -1502,11 +2039,6 @@ namespace Pathwinder
 
       HANDLE newlyOpenedHandle = nullptr;
       NTSTATUS systemCallResult = NtStatus::kObjectPathNotFound;
-
-      std::wstring_view unredirectedPath =
-          ((true == operationContext.composedInputPath.has_value())
-               ? operationContext.composedInputPath->AsStringView()
-               : Strings::NtConvertUnicodeStringToStringView(*objectAttributes->ObjectName));
       std::wstring_view lastAttemptedPath;
 
       for (const auto& createDispositionToTry : SelectCreateDispositionsToTry(
@@ -1601,7 +2133,17 @@ namespace Pathwinder
       }
 
       if (true == lastAttemptedPath.empty())
-        return underlyingSystemCallInvoker(fileHandle, objectAttributes, createDisposition);
+      {
+        systemCallResult =
+            underlyingSystemCallInvoker(fileHandle, objectAttributes, createDisposition);
+        if ((NT_SUCCESS(systemCallResult)) && (true == mayChangeContainingDirectory))
+          InvalidateDirectoryListingOfContainingDirectory(unredirectedPath);
+
+        return systemCallResult;
+      }
+
+      if ((NT_SUCCESS(systemCallResult)) && (true == mayChangeContainingDirectory))
+        InvalidateDirectoryListingOfContainingDirectory(lastAttemptedPath);
 
       if (NT_SUCCESS(systemCallResult))
         SelectFilenameAndStoreNewlyOpenedHandle(
@@ -1611,7 +2153,8 @@ namespace Pathwinder
             newlyOpenedHandle,
             redirectionInstruction,
             lastAttemptedPath,
-            unredirectedPath);
+            unredirectedPath,
+            createOptions);
 
       *fileHandle = newlyOpenedHandle;
       return systemCallResult;
@@ -1625,7 +2168,8 @@ namespace Pathwinder
         SFileRenameInformation& renameInformation,
         ULONG renameInformationLength,
         std::function<FileOperationInstruction(
-            std::wstring_view, FileAccessMode, CreateDisposition)> instructionSourceFunc,
+            std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)>
+            instructionSourceFunc,
         std::function<NTSTATUS(HANDLE, SFileRenameInformation&, ULONG)> underlyingSystemCallInvoker)
     {
       std::wstring_view unredirectedPath =
@@ -1695,6 +2239,28 @@ namespace Pathwinder
           functionName, functionRequestIdentifier, operationContext.instruction);
       if (!(NT_SUCCESS(preOperationResult))) return preOperationResult;
 
+      // A rename removes the file from the directory that currently contains it, which needs to be
+      // identified before the rename takes place because afterwards the handle refers to the new
+      // location.
+      std::optional<Infra::TemporaryString> maybeRenameSourcePath = std::nullopt;
+      if (nullptr != GetDirectoryListingCache())
+      {
+        std::optional<OpenHandleStore::SHandleDataView> maybeRenameSourceHandleData =
+            openHandleStore.GetDataForHandle(fileHandle);
+
+        if (true == maybeRenameSourceHandleData.has_value())
+        {
+          maybeRenameSourcePath = Infra::TemporaryString();
+          (*maybeRenameSourcePath) << maybeRenameSourceHandleData->realOpenedPath;
+        }
+        else
+        {
+          auto maybeAbsolutePath = FilesystemOperations::QueryAbsolutePathByHandle(fileHandle);
+          if (true == maybeAbsolutePath.HasValue())
+            maybeRenameSourcePath = std::move(maybeAbsolutePath.Value());
+        }
+      }
+
       NTSTATUS systemCallResult = NtStatus::kObjectPathNotFound;
       std::wstring_view lastAttemptedPath;
 
@@ -1751,6 +2317,19 @@ namespace Pathwinder
         systemCallResult =
             underlyingSystemCallInvoker(fileHandle, renameInformation, renameInformationLength);
 
+      if (NT_SUCCESS(systemCallResult))
+      {
+        if (true == maybeRenameSourcePath.has_value())
+          InvalidateDirectoryListingOfContainingDirectory(maybeRenameSourcePath->AsStringView());
+
+        InvalidateDirectoryListingOfContainingDirectory(
+            (true == lastAttemptedPath.empty())
+                ? ((true == operationContext.composedInputPath.has_value())
+                       ? operationContext.composedInputPath->AsStringView()
+                       : unredirectedPath)
+                : lastAttemptedPath);
+      }
+
       if (NT_SUCCESS(systemCallResult))
         SelectFilenameAndUpdateOpenHandle(
             functionName,
@@ -1912,7 +2491,8 @@ namespace Pathwinder
         POBJECT_ATTRIBUTES objectAttributes,
         ACCESS_MASK desiredAccess,
         std::function<FileOperationInstruction(
-            std::wstring_view, FileAccessMode, CreateDisposition)> instructionSourceFunc,
+            std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)>
+            instructionSourceFunc,
         std::function<NTSTATUS(POBJECT_ATTRIBUTES)> underlyingSystemCallInvoker)
     {
       const SFileOperationContext operationContext = CreateFileOperationContext(
@@ -12,21 +12,48 @@
 
 #include "FilesystemInstruction.h"
 
+#include <cstdint>
+#include <iterator>
 #include <string_view>
+#include <vector>
 
 #include <Infra/Core/DebugAssert.h>
 
+#include "FileInformationStruct.h"
+
 namespace Pathwinder
 {
+  const DirectoryEnumerationInstruction::SingleDirectoryEnumeration::TFilterKernel
+      DirectoryEnumerationInstruction::SingleDirectoryEnumeration::kFilterKernels[] = {
+          &FilterKernelIncludeAll,
+          &FilterKernel<EFilePatternMatchCondition::SingleRuleOnly, false>,
+          &FilterKernel<EFilePatternMatchCondition::SingleRuleOnly, true>,
+          &FilterKernel<EFilePatternMatchCondition::MatchAny, false>,
+          &FilterKernel<EFilePatternMatchCondition::MatchAny, true>,
+          &FilterKernel<EFilePatternMatchCondition::MatchByRedirectModeInvertOverlay, false>,
+          &FilterKernel<EFilePatternMatchCondition::MatchByRedirectModeInvertOverlay, true>,
+          &FilterKernel<EFilePatternMatchCondition::MatchByPositionInvertAllPriorToSelected, false>,
+          &FilterKernel<EFilePatternMatchCondition::MatchByPositionInvertAllPriorToSelected, true>,
+  };
+
+  static_assert(
+      std::size(DirectoryEnumerationInstruction::SingleDirectoryEnumeration::kFilterKernels) ==
+          (1 + (2 * static_cast<unsigned int>(EFilePatternMatchCondition::Count))),
+      "Filter kernel table must have one entry per match condition and match inversion.");
+
   DirectoryEnumerationInstruction::SingleDirectoryEnumeration::SingleDirectoryEnumeration(void)
       : filePatternSource(),
         filePatternMatchConfig(),
-        directoryPathSource(EDirectoryPathSource::None)
+        directoryPathSource(EDirectoryPathSource::None),
+        sortEnumerationOutput(false)
   {}
 
   DirectoryEnumerationInstruction::SingleDirectoryEnumeration::SingleDirectoryEnumeration(
       EDirectoryPathSource directoryPathSource)
-      : directoryPathSource(directoryPathSource), filePatternSource(), filePatternMatchConfig()
+      : directoryPathSource(directoryPathSource),
+        filePatternSource(),
+        filePatternMatchConfig(),
+        sortEnumerationOutput(false)
   {}
 
   DirectoryEnumerationInstruction::SingleDirectoryEnumeration::SingleDirectoryEnumeration(
@@ -37,7 +64,10 @@ namespace Pathwinder
         filePatternSource({.singleRule = &filePatternSource}),
         filePatternMatchConfig(
             {.invertMatches = invertFilePatternMatches,
-             .filePatternMatchCondition = EFilePatternMatchCondition::SingleRuleOnly})
+             .filePatternMatchCondition = EFilePatternMatchCondition::SingleRuleOnly,
+             .filterKernelIndex = SelectFilterKernelIndex(
+                 true, EFilePatternMatchCondition::SingleRuleOnly, invertFilePatternMatches)}),
+        sortEnumerationOutput(false)
   {}
 
   DirectoryEnumerationInstruction::SingleDirectoryEnumeration::SingleDirectoryEnumeration(
@@ -51,9 +81,52 @@ namespace Pathwinder
         filePatternMatchConfig(
             {.invertMatches = invertFilePatternMatches,
              .filePatternMatchCondition = filePatternMatchCondition,
-             .filePatternMatchRuleIndex = filePatternMatchRuleIndex})
+             .filterKernelIndex = SelectFilterKernelIndex(
+                 true, filePatternMatchCondition, invertFilePatternMatches),
+             .filePatternMatchRuleIndex = filePatternMatchRuleIndex}),
+        sortEnumerationOutput(false)
   {}
 
+  std::wstring_view
+      DirectoryEnumerationInstruction::SingleDirectoryEnumeration::GetSystemQueryFilePattern(
+          void) const
+  {
+    // If matches are inverted then included filenames are those that do not match a file pattern,
+    // which cannot be expressed as a file pattern.
+    if (true == filePatternMatchConfig.invertMatches) return std::wstring_view();
+
+    const FilesystemRule* filePatternRule = nullptr;
+
+    switch (filePatternMatchConfig.filePatternMatchCondition)
+    {
+      case EFilePatternMatchCondition::SingleRuleOnly:
+        filePatternRule = filePatternSource.singleRule;
+        break;
+
+      case EFilePatternMatchCondition::MatchAny:
+        if ((nullptr != filePatternSource.multipleRules) &&
+            (1 == filePatternSource.multipleRules->CountOfRules()))
+          filePatternRule = filePatternSource.multipleRules->GetRuleByIndex(0);
+        break;
+
+      case EFilePatternMatchCondition::MatchByPositionInvertAllPriorToSelected:
+        // Included filenames must match the selected rule, and any rules before it only serve to
+        // exclude additional filenames.
+        if (nullptr != filePatternSource.multipleRules)
+          filePatternRule = filePatternSource.multipleRules->GetRuleByIndex(
+              filePatternMatchConfig.filePatternMatchRuleIndex);
+        break;
+
+      default:
+        break;
+    }
+
+    if (nullptr == filePatternRule) return std::wstring_view();
+    if (1 != filePatternRule->GetFilePatterns().size()) return std::wstring_view();
+
+    return filePatternRule->GetFilePatterns().front();
+  }
+
   std::wstring_view
       DirectoryEnumerationInstruction::SingleDirectoryEnumeration::SelectDirectoryPath(
           std::wstring_view associatedPath, std::wstring_view realOpenedPath) const
@@ -89,60 +162,128 @@ namespace Pathwinder
     }
   }
 
-  bool DirectoryEnumerationInstruction::SingleDirectoryEnumeration::
-      ShouldIncludeInDirectoryEnumeration(std::wstring_view filename) const
+  bool DirectoryEnumerationInstruction::SingleDirectoryEnumeration::FilterKernelIncludeAll(
+      const SingleDirectoryEnumeration& instruction, std::wstring_view filename)
+  {
+    return true;
+  }
+
+  template <EFilePatternMatchCondition kFilePatternMatchCondition, bool kInvertMatches>
+  bool DirectoryEnumerationInstruction::SingleDirectoryEnumeration::FilterKernel(
+      const SingleDirectoryEnumeration& instruction, std::wstring_view filename)
   {
-    if (EFilePatternMatchCondition::SingleRuleOnly ==
-        filePatternMatchConfig.filePatternMatchCondition)
+    if constexpr (EFilePatternMatchCondition::SingleRuleOnly == kFilePatternMatchCondition)
     {
-      if (nullptr == filePatternSource.singleRule) return true;
       return (
-          filePatternSource.singleRule->FileNameMatchesAnyPattern(filename) !=
-          filePatternMatchConfig.invertMatches);
+          instruction.filePatternSource.singleRule->FileNameMatchesAnyPattern(filename) !=
+          kInvertMatches);
     }
     else
     {
-      if (nullptr == filePatternSource.multipleRules) return true;
-
-      const bool matchFoundReturnValue = !filePatternMatchConfig.invertMatches;
       const auto matchingFilesystemRuleAndPosition =
-          filePatternSource.multipleRules->RuleMatchingFileName(
-              filename, filePatternMatchConfig.filePatternMatchRuleIndex);
+          instruction.filePatternSource.multipleRules->RuleMatchingFileName(
+              filename, instruction.filePatternMatchConfig.filePatternMatchRuleIndex);
 
       const FilesystemRule* matchingFilesystemRule = matchingFilesystemRuleAndPosition.first;
       const RelatedFilesystemRuleContainer::TFilesystemRulesIndex matchingFilesystemRulePosition =
           matchingFilesystemRuleAndPosition.second;
 
-      const bool hasMatchingFilesystemRule = (matchingFilesystemRule != nullptr);
-      if (false == hasMatchingFilesystemRule) return !matchFoundReturnValue;
+      if (nullptr == matchingFilesystemRule) return kInvertMatches;
 
-      switch (filePatternMatchConfig.filePatternMatchCondition)
+      if constexpr (EFilePatternMatchCondition::MatchAny == kFilePatternMatchCondition)
+      {
+        return !kInvertMatches;
+      }
+      else if constexpr (
+          EFilePatternMatchCondition::MatchByRedirectModeInvertOverlay ==
+          kFilePatternMatchCondition)
+      {
+        return (
+            (ERedirectMode::Overlay == matchingFilesystemRule->GetRedirectMode()) ==
+            kInvertMatches);
+      }
+      else if constexpr (
+          EFilePatternMatchCondition::MatchByPositionInvertAllPriorToSelected ==
+          kFilePatternMatchCondition)
       {
-        case EFilePatternMatchCondition::MatchAny:
-          return matchFoundReturnValue;
+        return (
+            (matchingFilesystemRulePosition ==
+             instruction.filePatternMatchConfig.filePatternMatchRuleIndex) != kInvertMatches);
+      }
+      else
+      {
+        DebugAssert(false, "Unrecognized file pattern match condition.");
+        return false;
+      }
+    }
+  }
+
+  uint8_t DirectoryEnumerationInstruction::SingleDirectoryEnumeration::SelectFilterKernelIndex(
+      bool hasFilePatternSource,
+      EFilePatternMatchCondition filePatternMatchCondition,
+      bool invertMatches)
+  {
+    if (false == hasFilePatternSource) return 0;
 
-        case EFilePatternMatchCondition::MatchByRedirectModeInvertOverlay:
-          switch (matchingFilesystemRule->GetRedirectMode())
+    if (filePatternMatchCondition >= EFilePatternMatchCondition::Count)
+    {
+      DebugAssert(false, "Unrecognized file pattern match condition.");
+      return 0;
+    }
+
+    return static_cast<uint8_t>(
+        1 + (2 * static_cast<unsigned int>(filePatternMatchCondition)) +
+        ((true == invertMatches) ? 1 : 0));
+  }
+
+  bool DirectoryEnumerationInstruction::SingleDirectoryEnumeration::
+      ShouldIncludeInDirectoryEnumeration(std::wstring_view filename) const
+  {
+    return kFilterKernels[filePatternMatchConfig.filterKernelIndex](*this, filename);
+  }
+
+  unsigned int
+      DirectoryEnumerationInstruction::SingleDirectoryEnumeration::FilterDirectoryEnumerationBuffer(
+          const FileInformationStructLayout& fileInformationStructLayout,
+          const void* enumerationBuffer,
+          std::vector<bool>& keepMask) const
+  {
+    const uint8_t* const enumerationBufferBytes =
+        reinterpret_cast<const uint8_t*>(enumerationBuffer);
+    const TFilterKernel filterKernel = kFilterKernels[filePatternMatchConfig.filterKernelIndex];
+
+    keepMask.clear();
+
+    return fileInformationStructLayout.InvokeWithStaticLayout(
+        [this, enumerationBufferBytes, filterKernel, &keepMask](
+            const auto& layout) -> unsigned int
+        {
+          unsigned int bytePosition = 0;
+          unsigned int numIncluded = 0;
+
+          while (true)
           {
-            case ERedirectMode::Overlay:
-              return !matchFoundReturnValue;
+            const void* const enumerationEntry = &enumerationBufferBytes[bytePosition];
 
-            default:
-              return matchFoundReturnValue;
-          }
+            if (&FilterKernelIncludeAll == filterKernel)
+            {
+              keepMask.push_back(true);
+            }
+            else
+            {
+              keepMask.push_back(filterKernel(*this, layout.ReadFileName(enumerationEntry)));
+            }
 
-        case EFilePatternMatchCondition::MatchByPositionInvertAllPriorToSelected:
-          return (
-              (matchingFilesystemRulePosition == filePatternMatchConfig.filePatternMatchRuleIndex)
-                  ? matchFoundReturnValue
-                  : !matchFoundReturnValue);
+            if (true == keepMask.back()) numIncluded += 1;
 
-        default:
-          break;
-      }
+            const FileInformationStructLayout::TNextEntryOffset bytePositionIncrement =
+                layout.ReadNextEntryOffset(enumerationEntry);
+            if (0 == bytePositionIncrement) break;
 
-      DebugAssert(false, "Unrecognized file pattern match condition.");
-      return false;
-    }
+            bytePosition += bytePositionIncrement;
+          }
+
+          return numIncluded;
+        });
   }
 } // namespace Pathwinder
@@ -303,6 +303,32 @@ namespace Pathwinder
       return Hooks::ProtectedDependency::NtDeleteFile::SafeInvoke(&absolutePathObjectAttributes);
     }
 
+    Infra::ValueOrError<HANDLE, NTSTATUS> DuplicateDirectoryHandleForEnumeration(
+        HANDLE directoryHandle)
+    {
+      auto maybeHandleMode = QueryFileHandleMode(directoryHandle);
+      if (true == maybeHandleMode.HasError()) return maybeHandleMode.Error();
+
+      // Directory enumeration is always performed synchronously, which requires that system calls
+      // not return before they complete and not be interrupted by alerts.
+      if (0 == (maybeHandleMode.Value() & FILE_SYNCHRONOUS_IO_NONALERT))
+        return NtStatus::kInvalidParameter;
+
+      HANDLE duplicatedDirectoryHandle = nullptr;
+      if (0 ==
+          DuplicateHandle(
+              GetCurrentProcess(),
+              directoryHandle,
+              GetCurrentProcess(),
+              &duplicatedDirectoryHandle,
+              0,
+              FALSE,
+              DUPLICATE_SAME_ACCESS))
+        return NtStatus::kInvalidHandle;
+
+      return duplicatedDirectoryHandle;
+    }
+
     bool Exists(std::wstring_view absolutePath)
     {
       DWORD pathAttributes = 0;
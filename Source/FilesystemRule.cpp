@@ -215,9 +215,11 @@ namespace Pathwinder
       std::wstring_view originDirectoryFullPath,
       std::wstring_view targetDirectoryFullPath,
       std::vector<std::wstring>&& filePatterns,
-      ERedirectMode redirectMode)
+      ERedirectMode redirectMode,
+      bool sortDirectoryEnumerationOutput)
       : name(name),
         redirectMode(redirectMode),
+        sortDirectoryEnumerationOutput(sortDirectoryEnumerationOutput),
         originDirectorySeparator(FinalSeparatorPosition(originDirectoryFullPath)),
         targetDirectorySeparator(FinalSeparatorPosition(targetDirectoryFullPath)),
         originDirectoryFullPath(originDirectoryFullPath),
@@ -12,9 +12,12 @@
 
 #include "Globals.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -24,10 +27,12 @@
 #include <Infra/Core/TemporaryBuffer.h>
 
 #include "Strings.h"
+#include "ThreadPool.h"
 
 #ifndef PATHWINDER_SKIP_CONFIG
 #include <Infra/Core/Configuration.h>
 
+#include "FileInformationStruct.h"
 #include "FilesystemDirector.h"
 #include "FilesystemDirectorBuilder.h"
 #include "Hooks.h"
@@ -150,6 +155,53 @@ namespace Pathwinder
       }
     }
 
+    /// Reads performance-related settings from the specified configuration data object and applies
+    /// them globally.
+    /// @param [in] configData Read-only reference to a configuration data object.
+    static void ApplyPerformanceSettings(const Infra::Configuration::ConfigurationData& configData)
+    {
+      PerformanceSettings().directoryEnumerationReadAhead =
+          configData[Infra::Configuration::kSectionNameGlobal]
+                    [Strings::kStrConfigurationSettingDirectoryEnumerationReadAhead]
+                        .ValueOr(false);
+      PerformanceSettings().directoryEnumerationConcurrentInitialFill =
+          configData[Infra::Configuration::kSectionNameGlobal]
+                    [Strings::kStrConfigurationSettingDirectoryEnumerationConcurrentInitialFill]
+                        .ValueOr(false);
+
+      const int64_t directoryEnumerationListingCacheTimeToLiveMilliseconds =
+          configData[Infra::Configuration::kSectionNameGlobal]
+                    [Strings::kStrConfigurationSettingDirectoryEnumerationListingCacheTimeToLive]
+                        .ValueOr(0);
+      PerformanceSettings().directoryEnumerationListingCacheTimeToLiveMilliseconds =
+          static_cast<unsigned int>(std::clamp<int64_t>(
+              directoryEnumerationListingCacheTimeToLiveMilliseconds,
+              0,
+              std::numeric_limits<unsigned int>::max()));
+
+      PerformanceSettings().directoryEnumerationPrefetch =
+          configData[Infra::Configuration::kSectionNameGlobal]
+                    [Strings::kStrConfigurationSettingDirectoryEnumerationPrefetch]
+                        .ValueOr(false);
+
+      const int64_t directoryEnumerationBufferPrewarmCount =
+          configData[Infra::Configuration::kSectionNameGlobal]
+                    [Strings::kStrConfigurationSettingDirectoryEnumerationBufferPrewarmCount]
+                        .ValueOr(0);
+      PerformanceSettings().directoryEnumerationBufferPrewarmCount =
+          static_cast<unsigned int>(std::clamp<int64_t>(
+              directoryEnumerationBufferPrewarmCount,
+              0,
+              FileInformationStructBuffer::kBufferPoolSize));
+
+      const int64_t threadPoolWorkerCount =
+          configData[Infra::Configuration::kSectionNameGlobal]
+                    [Strings::kStrConfigurationSettingThreadPoolWorkerCount]
+                        .ValueOr(0);
+      PerformanceSettings().threadPoolWorkerCount = static_cast<unsigned int>(
+          std::clamp<int64_t>(threadPoolWorkerCount, 0, ThreadPool::kMaxWorkerThreads));
+    }
+
     /// Reads configuration data from the configuration file and returns the resulting
     /// configuration data object. Enables logging and outputs read errors if any are
     /// encountered.
@@ -198,6 +250,11 @@ namespace Pathwinder
 
       if (false == configReader.HasErrorMessages())
       {
+        ApplyPerformanceSettings(configData);
+        if (0 != PerformanceSettings().directoryEnumerationBufferPrewarmCount)
+          FileInformationStructBuffer::PrewarmBufferPools(
+              PerformanceSettings().directoryEnumerationBufferPrewarmCount);
+
         AddConfiguredDefinitionsToResolver(ResolverWithConfiguredDefinitions(), configData);
         BuildFilesystemRules(configData);
       }
@@ -209,5 +266,33 @@ namespace Pathwinder
       static std::unordered_set<std::wstring> temporaryPathsToClean;
       return temporaryPathsToClean;
     }
+
+    SPerformanceSettings& PerformanceSettings(void)
+    {
+      static SPerformanceSettings performanceSettings{
+          .directoryEnumerationReadAhead = false,
+          .directoryEnumerationConcurrentInitialFill = false,
+          .directoryEnumerationListingCacheTimeToLiveMilliseconds = 0,
+          .directoryEnumerationPrefetch = false,
+          .directoryEnumerationBufferPrewarmCount = 0,
+          .threadPoolWorkerCount = 0};
+      return performanceSettings;
+    }
+
+    ThreadPool* SharedThreadPool(void)
+    {
+      // Maintained on the heap so it is not destroyed automatically by the runtime on program
+      // exit. Destroying it would wait for its worker threads to finish, which is not safe to do
+      // while the loader lock is held during process exit.
+      static ThreadPool* const sharedThreadPool = []() -> ThreadPool*
+      {
+        std::optional<ThreadPool> newThreadPool =
+            ThreadPool::Create(PerformanceSettings().threadPoolWorkerCount);
+        if (false == newThreadPool.has_value()) return nullptr;
+        return new ThreadPool(std::move(*newThreadPool));
+      }();
+
+      return sharedThreadPool;
+    }
   } // namespace Globals
 } // namespace Pathwinder
@@ -62,10 +62,12 @@ static inline Pathwinder::OpenHandleStore& OpenHandleStoreInstance(void)
 /// Instruction source function for obtaining directory enumeration instructions using the singleton
 /// filesystem director object instance.
 static Pathwinder::DirectoryEnumerationInstruction InstructionSourceForDirectoryEnumeration(
-    std::wstring_view associatedPath, std::wstring_view realOpenedPath)
+    std::wstring_view associatedPath,
+    std::wstring_view realOpenedPath,
+    Pathwinder::RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)
 {
   return FilesystemDirectorInstance().GetInstructionForDirectoryEnumeration(
-      associatedPath, realOpenedPath);
+      associatedPath, realOpenedPath, redirectingRuleIndex);
 }
 
 /// Instruction source function for obtaining file operation instructions using the singleton
@@ -73,10 +75,11 @@ static Pathwinder::DirectoryEnumerationInstruction InstructionSourceForDirectory
 static Pathwinder::FileOperationInstruction InstructionSourceForFileOperation(
     std::wstring_view absoluteFilePath,
     Pathwinder::FileAccessMode fileAccessMode,
-    Pathwinder::CreateDisposition createDisposition)
+    Pathwinder::CreateDisposition createDisposition,
+    Pathwinder::SPathLookupResumePoint* rootDirectoryResumePoint)
 {
   return FilesystemDirectorInstance().GetInstructionForFileOperation(
-      absoluteFilePath, fileAccessMode, createDisposition);
+      absoluteFilePath, fileAccessMode, createDisposition, rootDirectoryResumePoint);
 }
 
 void Pathwinder::Hooks::SetFilesystemDirectorInstance(
@@ -165,9 +168,12 @@ NTSTATUS Pathwinder::Hooks::DynamicHook_NtCreateFile::Hook(
     PVOID EaBuffer,
     ULONG EaLength)
 {
-  return Pathwinder::FilesystemExecutor::NewFileHandle(
-      GetFunctionName(),
-      GetRequestIdentifier(),
+  const wchar_t* const functionName = GetFunctionName();
+  const unsigned int requestIdentifier = GetRequestIdentifier();
+
+  const NTSTATUS newFileHandleResult = Pathwinder::FilesystemExecutor::NewFileHandle(
+      functionName,
+      requestIdentifier,
       OpenHandleStoreInstance(),
       FileHandle,
       DesiredAccess,
@@ -199,6 +205,17 @@ NTSTATUS Pathwinder::Hooks::DynamicHook_NtCreateFile::Hook(
             EaBuffer,
             EaLength);
       });
+
+  if (NT_SUCCESS(newFileHandleResult))
+    Pathwinder::FilesystemExecutor::DirectoryEnumerationPrefetch(
+        functionName,
+        requestIdentifier,
+        OpenHandleStoreInstance(),
+        *FileHandle,
+        CreateOptions,
+        InstructionSourceForDirectoryEnumeration);
+
+  return newFileHandleResult;
 }
 
 NTSTATUS Pathwinder::Hooks::DynamicHook_NtDeleteFile::Hook(POBJECT_ATTRIBUTES ObjectAttributes)
@@ -227,7 +244,7 @@ NTSTATUS Pathwinder::Hooks::DynamicHook_NtOpenFile::Hook(
   const wchar_t* const functionName = GetFunctionName();
   const unsigned int requestIdentifier = GetRequestIdentifier();
 
-  return Pathwinder::FilesystemExecutor::NewFileHandle(
+  const NTSTATUS newFileHandleResult = Pathwinder::FilesystemExecutor::NewFileHandle(
       functionName,
       requestIdentifier,
       OpenHandleStoreInstance(),
@@ -263,6 +280,17 @@ NTSTATUS Pathwinder::Hooks::DynamicHook_NtOpenFile::Hook(
         return Original(
             fileHandle, DesiredAccess, objectAttributes, IoStatusBlock, ShareAccess, OpenOptions);
       });
+
+  if (NT_SUCCESS(newFileHandleResult))
+    Pathwinder::FilesystemExecutor::DirectoryEnumerationPrefetch(
+        functionName,
+        requestIdentifier,
+        OpenHandleStoreInstance(),
+        *FileHandle,
+        OpenOptions,
+        InstructionSourceForDirectoryEnumeration);
+
+  return newFileHandleResult;
 }
 
 NTSTATUS Pathwinder::Hooks::DynamicHook_NtQueryDirectoryFile::Hook(
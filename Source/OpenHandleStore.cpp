@@ -12,6 +12,9 @@
 
 #include "OpenHandleStore.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <set>
 #include <string>
@@ -24,125 +27,235 @@
 #include "ApiWindows.h"
 #include "DirectoryOperationQueue.h"
 #include "FileInformationStruct.h"
+#include "FilesystemDirector.h"
 #include "FilesystemOperations.h"
+#include "PathInternPool.h"
 #include "Strings.h"
 
 namespace Pathwinder
 {
+  /// Record type for holding the most recently retrieved view of handle data on a thread.
+  struct SCachedHandleDataView
+  {
+    /// Identifier of the open handle store from which the view was retrieved, or 0 if none.
+    uint64_t storeIdentifier;
+
+    /// Handle for which the view was retrieved.
+    HANDLE handle;
+
+    /// Value of the handle's generation counter at the time the view was retrieved.
+    uint32_t generation;
+
+    /// Cached view itself.
+    OpenHandleStore::SHandleDataView handleData;
+  };
+
+  /// Most recently retrieved view of handle data on the current thread.
+  static thread_local SCachedHandleDataView lastRetrievedHandleData = {};
+
+  uint64_t OpenHandleStore::NewStoreIdentifier(void)
+  {
+    static std::atomic<uint64_t> nextStoreIdentifier = 1;
+    return nextStoreIdentifier.fetch_add(1, std::memory_order_relaxed);
+  }
+
   void OpenHandleStore::AssociateDirectoryEnumerationState(
       HANDLE handleToAssociate,
       std::unique_ptr<IDirectoryOperationQueue>&& directoryEnumerationQueue,
-      FileInformationStructLayout fileInformationStructLayout)
+      FileInformationStructLayout fileInformationStructLayout,
+      TDirectoryEnumerationInstructionSource instructionSource,
+      std::wstring_view queryFilePattern)
   {
-    std::unique_lock lock(openHandlesMutex);
+    SSegment& segment = SegmentForHandle(handleToAssociate);
+    std::unique_lock lock(segment.openHandlesMutex);
 
-    auto openHandleIter = openHandles.find(handleToAssociate);
+    auto openHandleIter = segment.openHandles.find(handleToAssociate);
     DebugAssert(
-        openHandleIter != openHandles.end(),
+        openHandleIter != segment.openHandles.end(),
         "Attempting to associate a directory enumeration queue with a handle that is not in storage.");
-    if (openHandleIter == openHandles.end()) return;
+    if (openHandleIter == segment.openHandles.end()) return;
 
     DebugAssert(
-        false == openHandleIter->second.directoryEnumeration.has_value(),
+        nullptr == openHandleIter->second.directoryEnumeration,
         "Attempting to re-associate a directory enumeration queue with a handle that already has one.");
 
-    openHandleIter->second.directoryEnumeration = SInProgressDirectoryEnumeration{
-        .queue = std::move(directoryEnumerationQueue),
-        .fileInformationStructLayout = fileInformationStructLayout,
-        .isFirstInvocation = true};
+    openHandleIter->second.directoryEnumeration =
+        std::make_unique<SInProgressDirectoryEnumeration>(SInProgressDirectoryEnumeration{
+            .queue = std::move(directoryEnumerationQueue),
+            .fileInformationStructLayout = fileInformationStructLayout,
+            .instructionSource = std::move(instructionSource),
+            .queryFilePattern = std::wstring(queryFilePattern),
+            .lastEnumeratedFilename = std::wstring(),
+            .numEnumeratedFilenames = 0,
+            .unsortedEnumeratedFilenames = std::nullopt,
+            .isFirstInvocation = true,
+            .isDrained = false});
+    InvalidateCachedHandleData(handleToAssociate);
   }
 
   bool OpenHandleStore::Empty(void)
   {
-    std::shared_lock lock(openHandlesMutex);
-    return openHandles.empty();
+    for (SSegment& segment : segments)
+    {
+      std::shared_lock lock(segment.openHandlesMutex);
+      if (false == segment.openHandles.empty()) return false;
+    }
+
+    return true;
   }
 
   std::optional<OpenHandleStore::SHandleDataView> OpenHandleStore::GetDataForHandle(
       HANDLE handleToQuery)
   {
-    std::shared_lock lock(openHandlesMutex);
+    // Data for a handle can only be modified or removed while the generation counter is advanced,
+    // so an unchanged generation means the cached view is still accurate. Closing a handle while
+    // another thread is still using it is an application error, so the view can be used after the
+    // check in the same way as a view retrieved from the map after the lock is released.
+    if ((storeIdentifier == lastRetrievedHandleData.storeIdentifier) &&
+        (handleToQuery == lastRetrievedHandleData.handle) &&
+        (GenerationForHandle(handleToQuery) == lastRetrievedHandleData.generation))
+      return lastRetrievedHandleData.handleData;
+
+    SSegment& segment = SegmentForHandle(handleToQuery);
+    std::shared_lock lock(segment.openHandlesMutex);
 
-    auto openHandleIter = openHandles.find(handleToQuery);
-    if (openHandleIter == openHandles.cend()) return std::nullopt;
+    auto openHandleIter = segment.openHandles.find(handleToQuery);
+    if (openHandleIter == segment.openHandles.cend()) return std::nullopt;
 
-    return openHandleIter->second;
+    lastRetrievedHandleData = {
+        .storeIdentifier = storeIdentifier,
+        .handle = handleToQuery,
+        .generation = GenerationForHandle(handleToQuery),
+        .handleData = openHandleIter->second};
+    return lastRetrievedHandleData.handleData;
   }
 
   void OpenHandleStore::InsertHandle(
-      HANDLE handleToInsert, std::wstring&& associatedPath, std::wstring&& realOpenedPath)
+      HANDLE handleToInsert,
+      std::wstring&& associatedPath,
+      std::wstring&& realOpenedPath,
+      RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)
   {
-    std::unique_lock lock(openHandlesMutex);
+    SHandleData handleData(
+        pathInternPool.Intern(std::move(associatedPath)),
+        pathInternPool.Intern(std::move(realOpenedPath)),
+        redirectingRuleIndex);
+
+    SSegment& segment = SegmentForHandle(handleToInsert);
+    std::unique_lock lock(segment.openHandlesMutex);
 
     const bool insertionWasSuccessful =
-        openHandles
-            .emplace(
-                handleToInsert, SHandleData(std::move(associatedPath), std::move(realOpenedPath)))
-            .second;
+        segment.openHandles.emplace(handleToInsert, std::move(handleData)).second;
     DebugAssert(true == insertionWasSuccessful, "Failed to insert a handle into storage.");
+    if (true == insertionWasSuccessful) FilterAddHandle(handleToInsert);
   }
 
   void OpenHandleStore::InsertOrUpdateHandle(
-      HANDLE handleToInsertOrUpdate, std::wstring&& associatedPath, std::wstring&& realOpenedPath)
+      HANDLE handleToInsertOrUpdate,
+      std::wstring&& associatedPath,
+      std::wstring&& realOpenedPath,
+      RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)
   {
-    std::unique_lock lock(openHandlesMutex);
+    PathInternPool::InternedPath internedAssociatedPath =
+        pathInternPool.Intern(std::move(associatedPath));
+    PathInternPool::InternedPath internedRealOpenedPath =
+        pathInternPool.Intern(std::move(realOpenedPath));
 
-    auto existingHandleIter = openHandles.find(handleToInsertOrUpdate);
-    if (openHandles.end() == existingHandleIter)
+    SSegment& segment = SegmentForHandle(handleToInsertOrUpdate);
+    std::unique_lock lock(segment.openHandlesMutex);
+
+    auto existingHandleIter = segment.openHandles.find(handleToInsertOrUpdate);
+    if (segment.openHandles.end() == existingHandleIter)
     {
       const bool insertionWasSuccessful =
-          openHandles
+          segment.openHandles
               .emplace(
                   handleToInsertOrUpdate,
-                  SHandleData(std::move(associatedPath), std::move(realOpenedPath)))
+                  SHandleData(
+                      std::move(internedAssociatedPath),
+                      std::move(internedRealOpenedPath),
+                      redirectingRuleIndex))
               .second;
       DebugAssert(true == insertionWasSuccessful, "Failed to insert a handle into storage.");
+      if (true == insertionWasSuccessful) FilterAddHandle(handleToInsertOrUpdate);
     }
     else
     {
-      existingHandleIter->second.associatedPath = std::move(associatedPath);
-      existingHandleIter->second.realOpenedPath = std::move(realOpenedPath);
+      existingHandleIter->second.associatedPath = std::move(internedAssociatedPath);
+      existingHandleIter->second.realOpenedPath = std::move(internedRealOpenedPath);
+      existingHandleIter->second.pathLookupResumePoint.reset();
+      existingHandleIter->second.redirectingRuleIndex = redirectingRuleIndex;
+      InvalidateCachedHandleData(handleToInsertOrUpdate);
     }
   }
 
   bool OpenHandleStore::RemoveHandle(HANDLE handleToRemove, SHandleData* handleData)
   {
-    std::unique_lock lock(openHandlesMutex);
+    SSegment& segment = SegmentForHandle(handleToRemove);
+    std::unique_lock lock(segment.openHandlesMutex);
 
-    auto removalIter = openHandles.find(handleToRemove);
-    if (openHandles.end() == removalIter) return false;
+    auto removalIter = segment.openHandles.find(handleToRemove);
+    if (segment.openHandles.end() == removalIter) return false;
 
     if (nullptr == handleData)
-      openHandles.erase(removalIter);
+      segment.openHandles.erase(removalIter);
     else
-      *handleData = std::move(openHandles.extract(removalIter).mapped());
+      *handleData = std::move(segment.openHandles.extract(removalIter).mapped());
 
+    FilterRemoveHandle(handleToRemove);
+    InvalidateCachedHandleData(handleToRemove);
     return true;
   }
 
   NTSTATUS OpenHandleStore::RemoveAndCloseHandle(HANDLE handleToRemove, SHandleData* handleData)
   {
-    std::unique_lock lock(openHandlesMutex);
+    // Closing the handle while holding the lock of the segment that stores it is sufficient, since
+    // a reused handle value would be stored in the same segment.
+    SSegment& segment = SegmentForHandle(handleToRemove);
+    std::unique_lock lock(segment.openHandlesMutex);
 
-    auto removalIter = openHandles.find(handleToRemove);
+    auto removalIter = segment.openHandles.find(handleToRemove);
     DebugAssert(
-        openHandles.end() != removalIter,
+        segment.openHandles.end() != removalIter,
         "Attempting to close and erase a handle that was not previously stored.");
 
     NTSTATUS systemCallResult = FilesystemOperations::CloseHandle(handleToRemove);
     if (!(NT_SUCCESS(systemCallResult))) return systemCallResult;
 
     if (nullptr == handleData)
-      openHandles.erase(removalIter);
+      segment.openHandles.erase(removalIter);
     else
-      *handleData = std::move(openHandles.extract(removalIter).mapped());
+      *handleData = std::move(segment.openHandles.extract(removalIter).mapped());
 
+    FilterRemoveHandle(handleToRemove);
+    InvalidateCachedHandleData(handleToRemove);
     return systemCallResult;
   }
 
+  void OpenHandleStore::SetPathLookupResumePoint(
+      HANDLE handleToUpdate, const SPathLookupResumePoint& pathLookupResumePoint)
+  {
+    SSegment& segment = SegmentForHandle(handleToUpdate);
+    std::unique_lock lock(segment.openHandlesMutex);
+
+    auto existingHandleIter = segment.openHandles.find(handleToUpdate);
+    if (segment.openHandles.end() == existingHandleIter) return;
+    if (nullptr != existingHandleIter->second.pathLookupResumePoint) return;
+
+    existingHandleIter->second.pathLookupResumePoint =
+        std::make_unique<SPathLookupResumePoint>(pathLookupResumePoint);
+    InvalidateCachedHandleData(handleToUpdate);
+  }
+
   unsigned int OpenHandleStore::Size(void)
   {
-    std::shared_lock lock(openHandlesMutex);
-    return static_cast<unsigned int>(openHandles.size());
+    size_t numHandles = 0;
+    for (SSegment& segment : segments)
+    {
+      std::shared_lock lock(segment.openHandlesMutex);
+      numHandles += segment.openHandles.size();
+    }
+
+    return static_cast<unsigned int>(numHandles);
   }
 } // namespace Pathwinder
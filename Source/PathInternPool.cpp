@@ -0,0 +1,110 @@
+/***************************************************************************************************
+ * Pathwinder
+ *   Path redirection for files, directories, and registry entries.
+ ***************************************************************************************************
+ * Authored by Samuel Grossman
+ * Copyright (c) 2022-2025
+ ***********************************************************************************************//**
+ * @file PathInternPool.cpp
+ *   Implementation of a concurrency-safe pool that stores a single reference-counted copy of each
+ *   distinct path.
+ **************************************************************************************************/
+
+#include "PathInternPool.h"
+
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+#include <Infra/Core/DebugAssert.h>
+#include <Infra/Core/Mutex.h>
+
+namespace Pathwinder
+{
+  PathInternPool::~PathInternPool(void)
+  {
+    for (SShard& shard : shards)
+    {
+      DebugAssert(
+          true == shard.entries.empty(),
+          "Path intern pool destroyed while references to its paths still exist.");
+
+      for (auto& entry : shard.entries)
+        delete entry.second;
+    }
+  }
+
+  PathInternPool::InternedPath PathInternPool::Intern(std::wstring&& path)
+  {
+    if (true == path.empty()) return InternedPath();
+
+    const unsigned int shardIndex =
+        static_cast<unsigned int>(std::hash<std::wstring_view>()(path) % kNumShards);
+    SShard& shard = shards[shardIndex];
+
+    do
+    {
+      std::shared_lock lock(shard.entriesMutex);
+
+      auto existingEntryIter = shard.entries.find(path);
+      if (shard.entries.end() != existingEntryIter)
+      {
+        existingEntryIter->second->numReferences.fetch_add(1);
+        return InternedPath(existingEntryIter->second);
+      }
+    }
+    while (false);
+
+    std::unique_lock lock(shard.entriesMutex);
+
+    // Another thread may have added the same path between releasing the shared lock and acquiring
+    // the exclusive lock.
+    auto existingEntryIter = shard.entries.find(path);
+    if (shard.entries.end() != existingEntryIter)
+    {
+      existingEntryIter->second->numReferences.fetch_add(1);
+      return InternedPath(existingEntryIter->second);
+    }
+
+    SEntry* const newEntry = new SEntry{
+        .pool = this, .shardIndex = shardIndex, .numReferences = 1, .path = std::move(path)};
+    shard.entries.emplace(std::wstring_view(newEntry->path), newEntry);
+    return InternedPath(newEntry);
+  }
+
+  unsigned int PathInternPool::Size(void)
+  {
+    size_t numEntries = 0;
+    for (SShard& shard : shards)
+    {
+      std::shared_lock lock(shard.entriesMutex);
+      numEntries += shard.entries.size();
+    }
+
+    return static_cast<unsigned int>(numEntries);
+  }
+
+  void PathInternPool::Release(SEntry* entry)
+  {
+    // Removing a reference other than the last does not need the shard lock. Only the last
+    // reference is removed while holding the lock exclusively, which prevents the entry from being
+    // found and referenced again between its count reaching 0 and its removal from the shard.
+    unsigned int numReferences = entry->numReferences.load();
+    while (numReferences > 1)
+    {
+      if (true == entry->numReferences.compare_exchange_weak(numReferences, numReferences - 1))
+        return;
+    }
+
+    SShard& shard = shards[entry->shardIndex];
+
+    std::unique_lock lock(shard.entriesMutex);
+
+    if (1 != entry->numReferences.fetch_sub(1)) return;
+
+    shard.entries.erase(std::wstring_view(entry->path));
+    delete entry;
+  }
+} // namespace Pathwinder
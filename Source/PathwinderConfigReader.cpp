@@ -36,6 +36,24 @@ namespace Pathwinder
               ConfigurationFileLayoutNameAndValueType(
                   Strings::kStrConfigurationSettingLogLevel,
                   Infra::Configuration::EValueType::Integer),
+              ConfigurationFileLayoutNameAndValueType(
+                  Strings::kStrConfigurationSettingDirectoryEnumerationReadAhead,
+                  Infra::Configuration::EValueType::Boolean),
+              ConfigurationFileLayoutNameAndValueType(
+                  Strings::kStrConfigurationSettingDirectoryEnumerationConcurrentInitialFill,
+                  Infra::Configuration::EValueType::Boolean),
+              ConfigurationFileLayoutNameAndValueType(
+                  Strings::kStrConfigurationSettingDirectoryEnumerationListingCacheTimeToLive,
+                  Infra::Configuration::EValueType::Integer),
+              ConfigurationFileLayoutNameAndValueType(
+                  Strings::kStrConfigurationSettingDirectoryEnumerationPrefetch,
+                  Infra::Configuration::EValueType::Boolean),
+              ConfigurationFileLayoutNameAndValueType(
+                  Strings::kStrConfigurationSettingDirectoryEnumerationBufferPrewarmCount,
+                  Infra::Configuration::EValueType::Integer),
+              ConfigurationFileLayoutNameAndValueType(
+                  Strings::kStrConfigurationSettingThreadPoolWorkerCount,
+                  Infra::Configuration::EValueType::Integer),
           }),
   };
 
@@ -53,6 +71,9 @@ namespace Pathwinder
       ConfigurationFileLayoutNameAndValueType(
           Strings::kStrConfigurationSettingFilesystemRuleFilePattern,
           Infra::Configuration::EValueType::StringMultiValue),
+      ConfigurationFileLayoutNameAndValueType(
+          Strings::kStrConfigurationSettingFilesystemRuleSortDirectoryEnumerationOutput,
+          Infra::Configuration::EValueType::Boolean),
   };
 
   /// Checks if the specified section name could correspond with a section that defines a
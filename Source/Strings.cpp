@@ -35,6 +35,22 @@ namespace Pathwinder
     /// letter, a colon, and a backslash, for a total of three characters.
     static constexpr size_t kPathDriveLetterPrefixLengthChars = 3;
 
+    int CompareFileNamesForSorting(std::wstring_view fileNameA, std::wstring_view fileNameB)
+    {
+      auto dotEntryRank = [](std::wstring_view fileName) -> int
+      {
+        if (L"." == fileName) return 0;
+        if (L".." == fileName) return 1;
+        return 2;
+      };
+
+      const int dotEntryRankA = dotEntryRank(fileNameA);
+      const int dotEntryRankB = dotEntryRank(fileNameB);
+      if (dotEntryRankA != dotEntryRankB) return (dotEntryRankA - dotEntryRankB);
+
+      return Infra::Strings::CompareCaseInsensitive(fileNameA, fileNameB);
+    }
+
     bool FileNameMatchesPattern(std::wstring_view fileName, std::wstring_view filePatternUpperCase)
     {
       if (true == filePatternUpperCase.empty()) return true;
@@ -9,8 +9,10 @@
  *   Integration tests based on situations tested with real applications.
  **************************************************************************************************/
 
+#include <iterator>
 #include <set>
 #include <string_view>
+#include <vector>
 
 #include <Infra/Test/TestCase.h>
 
@@ -272,4 +274,57 @@ namespace PathwinderTest
     TEST_ASSERT(true == mockFilesystem.IsDirectory(L"C:\\DesiredTarget\\Subdir"));
     TEST_ASSERT(true == mockFilesystem.Exists(L"C:\\DesiredTarget\\Subdir\\File.txt"));
   }
+
+  // Exercises a real-world scenario in which an application walks the directory hierarchy that
+  // leads to an origin directory, opening each ancestor both as a directory and as a non-directory
+  // file, and also opens some plain files along the way. Only the handles opened as directories
+  // can be used as root directories or enumerated, so only those should be stored.
+  TEST_CASE(RealWorldScenario_OpenAncestorsOfOriginDirectory_OnlyDirectoryHandlesStored)
+  {
+    constexpr std::wstring_view kConfigurationFileString =
+        L"[FilesystemRule:Test]\n"
+        L"OriginDirectory = C:\\Users\\Player\\Documents\\Game\\Saves\n"
+        L"TargetDirectory = C:\\Redirected\\Saves";
+
+    constexpr std::wstring_view kAncestorDirectories[] = {
+        L"C:\\Users",
+        L"C:\\Users\\Player",
+        L"C:\\Users\\Player\\Documents",
+        L"C:\\Users\\Player\\Documents\\Game"};
+
+    constexpr std::wstring_view kPlainFiles[] = {
+        L"C:\\Users\\Player\\Desktop.ini",
+        L"C:\\Users\\Player\\Documents\\Desktop.ini",
+        L"C:\\Users\\Player\\Documents\\Game\\Readme.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFilesInDirectory(L"C:\\Users\\Player", {L"Desktop.ini"});
+    mockFilesystem.AddFilesInDirectory(L"C:\\Users\\Player\\Documents", {L"Desktop.ini"});
+    mockFilesystem.AddFilesInDirectory(
+        L"C:\\Users\\Player\\Documents\\Game", {L"Readme.txt"});
+
+    TIntegrationTestContext context =
+        CreateIntegrationTestContext(mockFilesystem, kConfigurationFileString);
+
+    std::vector<HANDLE> openedHandles;
+
+    for (const auto& ancestorDirectory : kAncestorDirectories)
+    {
+      openedHandles.push_back(
+          OpenUsingFilesystemExecutor(context, ancestorDirectory, nullptr, FILE_DIRECTORY_FILE));
+      openedHandles.push_back(OpenUsingFilesystemExecutor(
+          context, ancestorDirectory, nullptr, FILE_NON_DIRECTORY_FILE));
+    }
+
+    for (const auto& plainFile : kPlainFiles)
+      openedHandles.push_back(
+          OpenUsingFilesystemExecutor(context, plainFile, nullptr, FILE_NON_DIRECTORY_FILE));
+
+    TEST_ASSERT(std::size(kAncestorDirectories) == context->openHandleStore.Size());
+
+    for (HANDLE openedHandle : openedHandles)
+      CloseHandleUsingFilesystemExecutor(context, openedHandle);
+
+    TEST_ASSERT(true == context->openHandleStore.Empty());
+  }
 } // namespace PathwinderTest
@@ -0,0 +1,484 @@
+/***************************************************************************************************
+ * Pathwinder
+ *   Path redirection for files, directories, and registry entries.
+ ***************************************************************************************************
+ * Authored by Samuel Grossman
+ * Copyright (c) 2022-2025
+ ***********************************************************************************************//**
+ * @file BufferPoolTest.cpp
+ *   Unit tests for the pool of fixed-size dynamically-allocated buffers.
+ **************************************************************************************************/
+
+#include "BufferPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <Infra/Test/TestCase.h>
+
+namespace PathwinderTest
+{
+  using namespace ::Pathwinder;
+
+  /// Fills the entirety of a buffer with the specified stamp value.
+  /// @tparam kBytesPerBuffer Size of the buffer, in bytes.
+  /// @param [in] buffer Buffer to fill.
+  /// @param [in] stamp Value with which to fill the buffer.
+  template <unsigned int kBytesPerBuffer> static void StampBuffer(void* buffer, uint64_t stamp)
+  {
+    uint64_t* const stampBuffer = reinterpret_cast<uint64_t*>(buffer);
+    for (unsigned int i = 0; i < (kBytesPerBuffer / sizeof(uint64_t)); ++i)
+      stampBuffer[i] = stamp;
+  }
+
+  /// Determines whether the entirety of a buffer is filled with the specified stamp value.
+  /// @tparam kBytesPerBuffer Size of the buffer, in bytes.
+  /// @param [in] buffer Buffer to check.
+  /// @param [in] stamp Value with which the buffer is expected to be filled.
+  /// @return `true` if every part of the buffer holds the stamp value, `false` otherwise.
+  template <unsigned int kBytesPerBuffer> static bool BufferHasStamp(
+      const void* buffer, uint64_t stamp)
+  {
+    const uint64_t* const stampBuffer = reinterpret_cast<const uint64_t*>(buffer);
+    for (unsigned int i = 0; i < (kBytesPerBuffer / sizeof(uint64_t)); ++i)
+    {
+      if (stamp != stampBuffer[i]) return false;
+    }
+
+    return true;
+  }
+
+  // Verifies that a buffer freed back to the pool is handed out again by the next allocation on
+  // the same thread.
+  TEST_CASE(BufferPool_AllocateFree_BufferReused)
+  {
+    BufferPool<64, 4, 16> bufferPool;
+
+    void* const firstBuffer = bufferPool.Allocate();
+    TEST_ASSERT(nullptr != firstBuffer);
+    std::memset(firstBuffer, 0xab, 64);
+    bufferPool.Free(firstBuffer);
+
+    void* const secondBuffer = bufferPool.Allocate();
+    TEST_ASSERT(secondBuffer == firstBuffer);
+    bufferPool.Free(secondBuffer);
+  }
+
+  // Verifies that allocating many more buffers than the pool holds produces distinct buffers, both
+  // before and after they are all freed back to the pool, which requires buffers to move between
+  // the per-thread magazine and the shared pool in batches and excess buffers to be deallocated.
+  TEST_CASE(BufferPool_Allocate_DistinctBuffersBeyondPoolSize)
+  {
+    constexpr unsigned int kBytesPerBuffer = 128;
+    constexpr unsigned int kPoolSize = 16;
+    constexpr unsigned int kNumBuffers = kPoolSize * 3;
+
+    BufferPool<kBytesPerBuffer, 4, kPoolSize> bufferPool;
+
+    for (int round = 0; round < 2; ++round)
+    {
+      std::vector<void*> buffers;
+      for (unsigned int i = 0; i < kNumBuffers; ++i)
+      {
+        buffers.push_back(bufferPool.Allocate());
+        StampBuffer<kBytesPerBuffer>(buffers.back(), i);
+      }
+
+      TEST_ASSERT(kNumBuffers == std::set<void*>(buffers.cbegin(), buffers.cend()).size());
+
+      for (unsigned int i = 0; i < kNumBuffers; ++i)
+      {
+        TEST_ASSERT(true == BufferHasStamp<kBytesPerBuffer>(buffers[i], i));
+        bufferPool.Free(buffers[i]);
+      }
+    }
+  }
+
+  // Verifies that statistics count allocations satisfied by existing buffers separately from those
+  // that required new buffers, along with the current and peak numbers of buffers.
+  TEST_CASE(BufferPool_GetStatistics_HitsAndMisses)
+  {
+    constexpr unsigned int kAllocationGranularity = 4;
+
+    using TStatisticsBufferPool = BufferPool<96, kAllocationGranularity, 16>;
+    TStatisticsBufferPool bufferPool;
+
+    // The pool starts with one allocation granularity's worth of buffers, so allocating one more
+    // buffer than that results in exactly one miss.
+    std::vector<void*> buffers;
+    for (unsigned int i = 0; i < (kAllocationGranularity + 1); ++i)
+      buffers.push_back(bufferPool.Allocate());
+
+    const SBufferPoolStatistics statistics = bufferPool.GetStatistics();
+    TEST_ASSERT(kAllocationGranularity == statistics.numHits);
+    TEST_ASSERT(1 == statistics.numMisses);
+    TEST_ASSERT((2 * kAllocationGranularity) == statistics.numBuffersCurrent);
+    TEST_ASSERT((2 * kAllocationGranularity) == statistics.numBuffersPeak);
+
+    for (void* buffer : buffers)
+      bufferPool.Free(buffer);
+  }
+
+  // Verifies that once the high-water mark of demand fully decays, trimming deallocates all of the
+  // idle buffers in the shared pool and leaves only those held by the per-thread magazine.
+  TEST_CASE(BufferPool_Trim_IdleBuffersDeallocated)
+  {
+    constexpr unsigned int kNumBuffers = 16;
+
+    using TTrimBufferPool = BufferPool<160, 4, kNumBuffers>;
+    TTrimBufferPool bufferPool(
+        {.trimIdleBuffers = true, .highWaterMarkHalfLife = std::chrono::milliseconds(0)});
+
+    std::vector<void*> buffers;
+    for (unsigned int i = 0; i < kNumBuffers; ++i)
+      buffers.push_back(bufferPool.Allocate());
+    TEST_ASSERT(bufferPool.GetStatistics().numBuffersPeak >= kNumBuffers);
+
+    for (void* buffer : buffers)
+      bufferPool.Free(buffer);
+
+    bufferPool.Trim();
+    TEST_ASSERT(
+        bufferPool.GetStatistics().numBuffersCurrent <= TTrimBufferPool::kMagazineCapacity);
+    TEST_ASSERT(bufferPool.GetStatistics().numBuffersPeak >= kNumBuffers);
+  }
+
+  // Verifies that idle buffers are retained when trimming is disabled by the policy.
+  TEST_CASE(BufferPool_Trim_DisabledByPolicy)
+  {
+    constexpr unsigned int kNumBuffers = 16;
+
+    using TNoTrimBufferPool = BufferPool<192, 4, kNumBuffers>;
+    TNoTrimBufferPool bufferPool(
+        {.trimIdleBuffers = false, .highWaterMarkHalfLife = std::chrono::milliseconds(0)});
+
+    std::vector<void*> buffers;
+    for (unsigned int i = 0; i < kNumBuffers; ++i)
+      buffers.push_back(bufferPool.Allocate());
+
+    for (void* buffer : buffers)
+      bufferPool.Free(buffer);
+
+    const SBufferPoolStatistics statistics = bufferPool.GetStatistics();
+    TEST_ASSERT(statistics.numBuffersCurrent >= kNumBuffers);
+    TEST_ASSERT(statistics.numBuffersCurrent == statistics.numBuffersPeak);
+  }
+
+  // Verifies that idle buffers needed to meet the high-water mark of demand are retained while the
+  // high-water mark has not yet had time to decay.
+  TEST_CASE(BufferPool_Trim_HighWaterMarkRetained)
+  {
+    constexpr unsigned int kNumBuffers = 16;
+
+    using THighWaterMarkBufferPool = BufferPool<224, 4, kNumBuffers>;
+    THighWaterMarkBufferPool bufferPool(
+        {.trimIdleBuffers = true, .highWaterMarkHalfLife = std::chrono::hours(1)});
+
+    std::vector<void*> buffers;
+    for (unsigned int i = 0; i < kNumBuffers; ++i)
+      buffers.push_back(bufferPool.Allocate());
+
+    for (void* buffer : buffers)
+      bufferPool.Free(buffer);
+
+    bufferPool.Trim();
+
+    const SBufferPoolStatistics statistics = bufferPool.GetStatistics();
+    TEST_ASSERT(statistics.numBuffersCurrent >= kNumBuffers);
+    TEST_ASSERT(statistics.numBuffersCurrent == statistics.numBuffersPeak);
+  }
+
+  // Verifies that pre-warming allocates buffers up front and that trimming never reduces the pool
+  // below the number of pre-warmed buffers, even after the high-water mark fully decays.
+  TEST_CASE(BufferPool_Prewarm_BuffersRetainedAfterTrim)
+  {
+    constexpr unsigned int kNumPrewarmBuffers = 12;
+    constexpr unsigned int kNumBuffers = 16;
+
+    using TPrewarmBufferPool = BufferPool<288, 4, kNumBuffers>;
+    TPrewarmBufferPool bufferPool(
+        {.trimIdleBuffers = true, .highWaterMarkHalfLife = std::chrono::milliseconds(0)});
+
+    bufferPool.Prewarm(kNumPrewarmBuffers);
+    TEST_ASSERT(kNumPrewarmBuffers == bufferPool.GetStatistics().numBuffersCurrent);
+
+    std::vector<void*> buffers;
+    for (unsigned int i = 0; i < kNumBuffers; ++i)
+      buffers.push_back(bufferPool.Allocate());
+
+    for (void* buffer : buffers)
+      bufferPool.Free(buffer);
+
+    bufferPool.Trim();
+    TEST_ASSERT(bufferPool.GetStatistics().numBuffersCurrent >= kNumPrewarmBuffers);
+  }
+
+  // Verifies that buffers held by a thread's magazine are returned to the pool that owns them when
+  // the thread exits, such that they are no longer counted as being in use and can be trimmed.
+  TEST_CASE(BufferPool_Magazine_BuffersReturnedOnThreadExit)
+  {
+    using TThreadExitBufferPool = BufferPool<320, 4, 16>;
+    TThreadExitBufferPool bufferPool(
+        {.trimIdleBuffers = true, .highWaterMarkHalfLife = std::chrono::milliseconds(0)});
+
+    std::thread(
+        [&bufferPool]() -> void
+        {
+          std::array<void*, TThreadExitBufferPool::kMagazineCapacity> buffers = {};
+          for (auto& buffer : buffers)
+            buffer = bufferPool.Allocate();
+
+          for (auto& buffer : buffers)
+            bufferPool.Free(buffer);
+        })
+        .join();
+
+    bufferPool.Trim();
+    TEST_ASSERT(0 == bufferPool.GetStatistics().numBuffersCurrent);
+  }
+
+  // Verifies that a thread alternating between two pools with identical template parameters, and
+  // hence the same per-thread magazine, returns the buffers held by its magazine to the pool that
+  // owns them each time it switches. Neither pool should end up counting, or trimming, buffers
+  // that belong to the other.
+  TEST_CASE(BufferPool_Magazine_BuffersReturnedOnSwitchBetweenPools)
+  {
+    using TSwitchBufferPool = BufferPool<352, 4, 16>;
+    TSwitchBufferPool bufferPoolA(
+        {.trimIdleBuffers = true, .highWaterMarkHalfLife = std::chrono::milliseconds(0)});
+    TSwitchBufferPool bufferPoolB(
+        {.trimIdleBuffers = true, .highWaterMarkHalfLife = std::chrono::milliseconds(0)});
+
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+      void* const bufferA = bufferPoolA.Allocate();
+      void* const bufferB = bufferPoolB.Allocate();
+      bufferPoolA.Free(bufferA);
+      bufferPoolB.Free(bufferB);
+    }
+
+    TEST_ASSERT(bufferPoolA.GetStatistics().numBuffersPeak <= 8);
+    bufferPoolA.Trim();
+    TEST_ASSERT(0 == bufferPoolA.GetStatistics().numBuffersCurrent);
+
+    TEST_ASSERT(bufferPoolB.GetStatistics().numBuffersPeak <= 8);
+    bufferPoolB.Trim();
+    TEST_ASSERT(0 == bufferPoolB.GetStatistics().numBuffersCurrent);
+  }
+
+  // Exercises the buffer pool with many threads concurrently allocating buffers, writing to them,
+  // and freeing them, including buffers handed off to be freed by threads other than the ones that
+  // allocated them. Every buffer is stamped with a value unique to its current owner and checked
+  // before being released, so any buffer handed out to two owners at once causes a failure.
+  TEST_CASE(BufferPool_Concurrency_StressTest)
+  {
+    constexpr unsigned int kBytesPerBuffer = 256;
+    constexpr unsigned int kNumThreads = 16;
+    constexpr unsigned int kNumIterationsPerThread = 20000;
+    constexpr unsigned int kMaxBuffersPerIteration = 12;
+    constexpr unsigned int kNumHandoffSlots = 8;
+
+    using TStressTestBufferPool = BufferPool<kBytesPerBuffer, 4, 32>;
+    TStressTestBufferPool bufferPool;
+
+    std::array<std::atomic<void*>, kNumHandoffSlots> handoffSlots = {};
+    std::atomic<unsigned int> numFailedChecks = 0;
+    std::atomic<bool> startSignal = false;
+
+    std::vector<std::thread> workerThreads;
+    for (unsigned int threadIndex = 0; threadIndex < kNumThreads; ++threadIndex)
+    {
+      workerThreads.emplace_back(
+          [&bufferPool, &handoffSlots, &numFailedChecks, &startSignal, threadIndex]() -> void
+          {
+            while (false == startSignal.load()) std::this_thread::yield();
+
+            std::array<void*, kMaxBuffersPerIteration> buffers = {};
+
+            for (unsigned int iteration = 0; iteration < kNumIterationsPerThread; ++iteration)
+            {
+              const unsigned int numBuffers =
+                  1 + ((iteration + threadIndex) % kMaxBuffersPerIteration);
+              const uint64_t stamp =
+                  (static_cast<uint64_t>(threadIndex) << 32) | static_cast<uint64_t>(iteration);
+
+              for (unsigned int i = 0; i < numBuffers; ++i)
+              {
+                buffers[i] = bufferPool.Allocate();
+                StampBuffer<kBytesPerBuffer>(buffers[i], stamp + i);
+              }
+
+              std::this_thread::yield();
+
+              for (unsigned int i = 0; i < numBuffers; ++i)
+              {
+                if (false == BufferHasStamp<kBytesPerBuffer>(buffers[i], stamp + i))
+                  numFailedChecks += 1;
+              }
+
+              // The first buffer is handed off for some other thread to free, and whatever buffer
+              // was previously in the handoff slot is freed by this thread instead.
+              void* const handedOffBuffer =
+                  handoffSlots[(iteration + threadIndex) % kNumHandoffSlots].exchange(buffers[0]);
+              if (nullptr != handedOffBuffer) bufferPool.Free(handedOffBuffer);
+
+              for (unsigned int i = 1; i < numBuffers; ++i)
+                bufferPool.Free(buffers[i]);
+            }
+          });
+    }
+
+    startSignal = true;
+
+    for (auto& workerThread : workerThreads)
+      workerThread.join();
+
+    for (auto& handoffSlot : handoffSlots)
+    {
+      void* const handedOffBuffer = handoffSlot.exchange(nullptr);
+      if (nullptr != handedOffBuffer) bufferPool.Free(handedOffBuffer);
+    }
+
+    TEST_ASSERT(0 == numFailedChecks);
+  }
+
+  // Verifies that the buffer pool hands out intact, exclusively-owned buffers with between 1 and 32
+  // threads concurrently allocating and freeing bursts of buffers, which mirrors many directory
+  // enumerations happening at the same time. Each burst fills the per-thread magazine, and every
+  // buffer in it is stamped with a value unique to its thread and burst and checked before being
+  // freed, so any buffer handed out twice at once or modified by the pool causes a failure.
+  TEST_CASE(BufferPool_Concurrency_BurstIntegrity)
+  {
+    constexpr std::array<unsigned int, 6> kThreadCounts = {1, 2, 4, 8, 16, 32};
+    constexpr unsigned int kNumBurstsPerThread = 2000;
+
+    constexpr unsigned int kBytesPerBuffer = 512;
+    using TBurstBufferPool = BufferPool<kBytesPerBuffer, 4, 64>;
+    constexpr unsigned int kBurstSize = TBurstBufferPool::kMagazineCapacity;
+
+    for (const unsigned int numThreads : kThreadCounts)
+    {
+      TBurstBufferPool bufferPool;
+      std::atomic<unsigned int> numFailedOperations = 0;
+      std::atomic<bool> startSignal = false;
+
+      std::vector<std::thread> workerThreads;
+      for (unsigned int threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+      {
+        workerThreads.emplace_back(
+            [&bufferPool, &numFailedOperations, &startSignal, threadIndex]() -> void
+            {
+              while (false == startSignal.load()) std::this_thread::yield();
+
+              std::array<void*, kBurstSize> buffers = {};
+              for (unsigned int burst = 0; burst < kNumBurstsPerThread; ++burst)
+              {
+                const uint64_t stamp = (static_cast<uint64_t>(threadIndex) << 32) |
+                    (static_cast<uint64_t>(burst) * kBurstSize);
+
+                for (unsigned int i = 0; i < kBurstSize; ++i)
+                {
+                  buffers[i] = bufferPool.Allocate();
+                  if (nullptr == buffers[i])
+                  {
+                    numFailedOperations += 1;
+                    return;
+                  }
+
+                  StampBuffer<kBytesPerBuffer>(buffers[i], stamp + i);
+                }
+
+                for (unsigned int i = 0; i < kBurstSize; ++i)
+                {
+                  if (false == BufferHasStamp<kBytesPerBuffer>(buffers[i], stamp + i))
+                    numFailedOperations += 1;
+
+                  bufferPool.Free(buffers[i]);
+                }
+              }
+            });
+      }
+
+      startSignal = true;
+
+      for (auto& workerThread : workerThreads)
+        workerThread.join();
+
+      TEST_ASSERT(0 == numFailedOperations);
+    }
+  }
+
+  // Measures the throughput of the buffer pool with between 1 and 32 threads concurrently
+  // allocating and freeing bursts of buffers, which mirrors many directory enumerations happening
+  // at the same time. Because each thread mostly allocates from and frees to its own magazine,
+  // overall throughput should not drop as threads are added, up to the number of available
+  // processors. This is a benchmark, so throughput is reported but not checked, because it depends
+  // on the load on the machine running the test.
+  TEST_CASE(BufferPool_Concurrency_ContentionBenchmark)
+  {
+    constexpr std::array<unsigned int, 6> kThreadCounts = {1, 2, 4, 8, 16, 32};
+    constexpr unsigned int kNumBurstsPerThread = 50000;
+
+    using TBenchmarkBufferPool = BufferPool<512, 4, 64>;
+    constexpr unsigned int kBurstSize = TBenchmarkBufferPool::kMagazineCapacity;
+
+    for (const unsigned int numThreads : kThreadCounts)
+    {
+      TBenchmarkBufferPool bufferPool;
+      std::atomic<unsigned int> numFailedOperations = 0;
+      std::atomic<bool> startSignal = false;
+
+      std::vector<std::thread> workerThreads;
+      for (unsigned int threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+      {
+        workerThreads.emplace_back(
+            [&bufferPool, &numFailedOperations, &startSignal]() -> void
+            {
+              while (false == startSignal.load()) std::this_thread::yield();
+
+              std::array<void*, kBurstSize> buffers = {};
+              for (unsigned int burst = 0; burst < kNumBurstsPerThread; ++burst)
+              {
+                for (auto& buffer : buffers)
+                {
+                  buffer = bufferPool.Allocate();
+                  if (nullptr == buffer)
+                  {
+                    numFailedOperations += 1;
+                    return;
+                  }
+                }
+
+                for (auto& buffer : buffers)
+                  bufferPool.Free(buffer);
+              }
+            });
+      }
+
+      const auto startTime = std::chrono::steady_clock::now();
+      startSignal = true;
+
+      for (auto& workerThread : workerThreads)
+        workerThread.join();
+
+      const std::chrono::duration<double> elapsedTime =
+          std::chrono::steady_clock::now() - startTime;
+
+      TEST_ASSERT(0 == numFailedOperations);
+
+      TEST_PRINT_MESSAGE(
+          L"%2u threads: %.0f allocations per second.",
+          numThreads,
+          (static_cast<double>(numThreads) * static_cast<double>(kNumBurstsPerThread) *
+           static_cast<double>(kBurstSize)) /
+              std::max(elapsedTime.count(), 1e-9));
+    }
+  }
+} // namespace PathwinderTest
@@ -12,16 +12,26 @@
 
 #include "DirectoryOperationQueue.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <latch>
+#include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
+#include <Infra/Core/Strings.h>
 #include <Infra/Core/TemporaryBuffer.h>
 #include <Infra/Test/TestCase.h>
 
 #include "ApiWindows.h"
 #include "FileInformationStruct.h"
 #include "FilesystemInstruction.h"
+#include "FilesystemOperations.h"
 #include "FilesystemRule.h"
 #include "MockDirectoryOperationQueue.h"
 #include "MockFilesystemOperations.h"
@@ -152,6 +162,47 @@ namespace PathwinderTest
     TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
   }
 
+  // Creates a directory with a small number of files and enumerates all of them using a duplicate
+  // of a handle that is already open to the directory, rather than by opening the directory by
+  // path.
+  TEST_CASE(EnumerationQueue_EnumerateAllFilesUsingExistingDirectoryHandle)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L"asdf.txt", L"File1.txt", L"File2.txt", L"File3.txt", L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    const HANDLE existingDirectoryHandle = mockFilesystem.Open(kDirectoryName);
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        existingDirectoryHandle);
+
+    TEST_ASSERT(
+        mockFilesystem.GetDuplicationSourceFromHandle(enumerationQueue.GetDirectoryHandle()) ==
+        existingDirectoryHandle);
+
+    for (auto fileName : kFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
   // Creates a directory with a small number of files, gets part-way through enumerating them all,
   // and then restarts the scan. After the restart all the files should be enumerated.
   TEST_CASE(EnumerationQueue_EnumerateAllFilesWithRestart)
@@ -359,195 +410,1725 @@ namespace PathwinderTest
   TEST_CASE(EnumerationQueue_EnumerateOnlyMultiRuleMatchingFiles)
   {
     constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
-    constexpr std::wstring_view kMatchingFileNames[] = {
-        L"File0.log",
-        L"File1.txt",
-        L"File2.txt",
-        L"File3.txt",
-        L"File4.txt",
-        L"File5.txt",
-    };
-    constexpr std::wstring_view kNonMatchingFileNames[] = {
-        L"asdf.txt",
-        L"SomeOtherFile.bin",
-        L"Program.exe"
-        L"zZz.txt"};
+    constexpr std::wstring_view kMatchingFileNames[] = {
+        L"File0.log",
+        L"File1.txt",
+        L"File2.txt",
+        L"File3.txt",
+        L"File4.txt",
+        L"File5.txt",
+    };
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"asdf.txt",
+        L"SomeOtherFile.bin",
+        L"Program.exe"
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    RelatedFilesystemRuleContainer filePatternSource;
+    for (auto fileName : kMatchingFileNames)
+      filePatternSource.EmplaceRule(CreateFilePatternSourceRule(fileName));
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and expects that only files that match the
+  // file patterns, supplied both via a filesystem rule and via query, are enumerated.
+  TEST_CASE(EnumerationQueue_EnumerateOnlyRuleAndQueryMatchingFiles)
+  {
+    constexpr std::wstring_view kQueryFilePattern = L"*.txt";
+    constexpr std::wstring_view kRuleFilePattern = L"File*";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {
+        L"File1.txt",
+        L"File2.txt",
+        L"File3.txt",
+        L"File4.txt",
+        L"File5.txt",
+    };
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"File0.log",
+        L"asdf.txt",
+        L"SomeOtherFile.bin",
+        L"Program.exe"
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass,
+        kQueryFilePattern);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and enumerates it using a filesystem rule
+  // that has a single file pattern. That file pattern should be supplied to the system so that
+  // non-matching files are filtered out before they are ever returned.
+  TEST_CASE(EnumerationQueue_SingleRuleFilePatternSuppliedToSystem)
+  {
+    constexpr std::wstring_view kRuleFilePattern = L"*.txt";
+    constexpr std::wstring_view kExpectedSystemQueryFilePattern = L"*.TXT";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {
+        L"asdf.txt",
+        L"File1.txt",
+        L"File2.txt",
+        L"zZz.txt"};
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"File0.log",
+        L"Program.exe",
+        L"SomeOtherFile.bin"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass);
+
+    TEST_ASSERT(
+        mockFilesystem.GetFilePatternForDirectoryEnumeration(
+            enumerationQueue.GetDirectoryHandle()) == kExpectedSystemQueryFilePattern);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and enumerates it using a filesystem rule that
+  // has a single file pattern, along with a query file pattern that cannot be combined with it. The
+  // query file pattern should be supplied to the system and the rule file pattern should be applied
+  // to the enumeration output.
+  TEST_CASE(EnumerationQueue_QueryFilePatternSuppliedToSystemInsteadOfRuleFilePattern)
+  {
+    constexpr std::wstring_view kQueryFilePattern = L"File*";
+    constexpr std::wstring_view kRuleFilePattern = L"*.txt";
+    constexpr std::wstring_view kExpectedSystemQueryFilePattern = L"FILE*";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {L"File1.txt", L"File2.txt"};
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"asdf.txt",
+        L"File0.log",
+        L"Program.exe",
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        kQueryFilePattern);
+
+    TEST_ASSERT(
+        mockFilesystem.GetFilePatternForDirectoryEnumeration(
+            enumerationQueue.GetDirectoryHandle()) == kExpectedSystemQueryFilePattern);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and enumerates it using a filesystem rule that
+  // has a single file pattern, along with a query file pattern that cannot be combined with it. The
+  // scan is then restarted without a query file pattern, as happens when an application restarts
+  // the scan without supplying one. The original query file pattern should continue to be supplied
+  // to the system and honored, rather than being replaced by the rule file pattern.
+  TEST_CASE(EnumerationQueue_QueryFilePatternRetainedOnRestartWithoutFilePattern)
+  {
+    constexpr std::wstring_view kQueryFilePattern = L"File*";
+    constexpr std::wstring_view kRuleFilePattern = L"*.txt";
+    constexpr std::wstring_view kExpectedSystemQueryFilePattern = L"FILE*";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {L"File1.txt", L"File2.txt"};
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"asdf.txt",
+        L"File0.log",
+        L"Program.exe",
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        kQueryFilePattern);
+
+    for (int i = 0; i < 2; ++i)
+    {
+      TEST_ASSERT(
+          mockFilesystem.GetFilePatternForDirectoryEnumeration(
+              enumerationQueue.GetDirectoryHandle()) == kExpectedSystemQueryFilePattern);
+
+      for (auto fileName : kMatchingFileNames)
+      {
+        TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+        TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      enumerationQueue.Restart();
+    }
+  }
+
+  // Creates a directory with a small number of files and enumerates it using a filesystem rule
+  // whose single file pattern is just a filename, along with a query file pattern that matches that
+  // filename. The filename alone is the intersection of the two patterns and should be supplied to
+  // the system.
+  TEST_CASE(EnumerationQueue_RuleFileNameIntersectsQueryFilePattern)
+  {
+    constexpr std::wstring_view kQueryFilePattern = L"*.txt";
+    constexpr std::wstring_view kRuleFilePattern = L"File2.txt";
+    constexpr std::wstring_view kExpectedSystemQueryFilePattern = L"FILE2.TXT";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {L"File2.txt"};
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"asdf.txt",
+        L"File0.log",
+        L"File1.txt",
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        kQueryFilePattern);
+
+    TEST_ASSERT(
+        mockFilesystem.GetFilePatternForDirectoryEnumeration(
+            enumerationQueue.GetDirectoryHandle()) == kExpectedSystemQueryFilePattern);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and enumerates it using a filesystem rule
+  // whose file pattern determines which files are excluded. An exclusion cannot be expressed as a
+  // file pattern, so no file pattern should be supplied to the system.
+  TEST_CASE(EnumerationQueue_ExclusiveRuleFilePatternNotSuppliedToSystem)
+  {
+    constexpr std::wstring_view kRuleFilePattern = L"*.txt";
+    constexpr std::wstring_view kExpectedSystemQueryFilePattern = L"";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {
+        L"File0.log",
+        L"Program.exe",
+        L"SomeOtherFile.bin"};
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"asdf.txt",
+        L"File1.txt",
+        L"File2.txt",
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToExcludeMatchingFiles(filePatternSource),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass);
+
+    TEST_ASSERT(
+        mockFilesystem.GetFilePatternForDirectoryEnumeration(
+            enumerationQueue.GetDirectoryHandle()) == kExpectedSystemQueryFilePattern);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and expects that none are enumerated due to
+  // no matches with the file pattern supplied within a filesystem rule. In this case the
+  // instruction specifies to include all matching files, so the file pattern is one that does not
+  // match.
+  TEST_CASE(EnumerationQueue_NothingMatchesInclusiveRuleFilePattern)
+  {
+    constexpr std::wstring_view kRuleFilePattern = L"*.exe";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L"asdf.txt",
+        L"File1.txt",
+        L"File2.txt",
+        L"File3.txt",
+        L"File4.txt",
+        L"File5.txt",
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files and expects that none are enumerated due to
+  // no matches with the file pattern supplied within a filesystem rule. In this case the
+  // instruction specifies to exclude all matching files, so the file pattern is one that does
+  // match.
+  TEST_CASE(EnumerationQueue_EverythingMatchesExclusiveRuleFilePattern)
+  {
+    constexpr std::wstring_view kRuleFilePattern = L"*.txt";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L"asdf.txt",
+        L"File1.txt",
+        L"File2.txt",
+        L"File3.txt",
+        L"File4.txt",
+        L"File5.txt",
+        L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToExcludeMatchingFiles(filePatternSource),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Fills an enumeration buffer with the contents of a directory and filters the whole buffer at
+  // once using instructions that cover every combination of file pattern source, match condition,
+  // and match inversion. The resulting keep mask should agree with filtering one filename at a
+  // time.
+  TEST_CASE(EnumerationQueue_BatchFilterAgreesWithSingleFileFilter)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L"asdf.txt", L"File1.log", L"File2.txt", L"Program.exe", L"Setup.log", L"zZz.bin"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    const FilesystemRule singleFilePatternSource = CreateFilePatternSourceRule(L"*.txt");
+
+    RelatedFilesystemRuleContainer multipleFilePatternSource;
+    multipleFilePatternSource.EmplaceRule(CreateFilePatternSourceRule(L"*.txt"));
+    multipleFilePatternSource.EmplaceRule(
+        CreateFilePatternSourceRule(L"*.log", ERedirectMode::Overlay));
+
+    std::vector<DirectoryEnumerationInstruction::SingleDirectoryEnumeration> instructions = {
+        InstructionToIncludeAllFiles(),
+        InstructionToIncludeMatchingFiles(singleFilePatternSource),
+        InstructionToExcludeMatchingFiles(singleFilePatternSource)};
+
+    for (auto filePatternMatchCondition :
+         {EFilePatternMatchCondition::MatchAny,
+          EFilePatternMatchCondition::MatchByRedirectModeInvertOverlay,
+          EFilePatternMatchCondition::MatchByPositionInvertAllPriorToSelected})
+    {
+      instructions.push_back(
+          DirectoryEnumerationInstruction::SingleDirectoryEnumeration::
+              IncludeOnlyMatchingFilenames(
+                  EDirectoryPathSource::None,
+                  multipleFilePatternSource,
+                  filePatternMatchCondition,
+                  1));
+      instructions.push_back(
+          DirectoryEnumerationInstruction::SingleDirectoryEnumeration::
+              IncludeAllExceptMatchingFilenames(
+                  EDirectoryPathSource::None,
+                  multipleFilePatternSource,
+                  filePatternMatchCondition,
+                  1));
+    }
+
+    const FileInformationStructLayout layout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(
+            SFileNamesInformation::kFileInformationClass);
+
+    auto maybeDirectoryHandle = FilesystemOperations::OpenDirectoryForEnumeration(kDirectoryName);
+    TEST_ASSERT(true == maybeDirectoryHandle.HasValue());
+
+    FileInformationStructBuffer enumerationBuffer;
+    TEST_ASSERT(NT_SUCCESS(FilesystemOperations::PartialEnumerateDirectoryContents(
+        maybeDirectoryHandle.Value(),
+        SFileNamesInformation::kFileInformationClass,
+        enumerationBuffer.Data(),
+        enumerationBuffer.Size())));
+    FilesystemOperations::CloseHandle(maybeDirectoryHandle.Value());
+
+    for (const auto& instruction : instructions)
+    {
+      std::vector<bool> keepMask;
+      const unsigned int numIncluded =
+          instruction.FilterDirectoryEnumerationBuffer(layout, enumerationBuffer.Data(), keepMask);
+
+      TEST_ASSERT(std::size(kFileNames) == keepMask.size());
+
+      unsigned int expectedNumIncluded = 0;
+      unsigned int bytePosition = 0;
+
+      for (size_t i = 0; i < keepMask.size(); ++i)
+      {
+        const bool expectedKeep = instruction.ShouldIncludeInDirectoryEnumeration(
+            layout.ReadFileName(&enumerationBuffer[bytePosition]));
+        TEST_ASSERT(expectedKeep == keepMask[i]);
+
+        if (true == expectedKeep) expectedNumIncluded += 1;
+        bytePosition += layout.ReadNextEntryOffset(&enumerationBuffer[bytePosition]);
+      }
+
+      TEST_ASSERT(expectedNumIncluded == numIncluded);
+    }
+  }
+
+  // Attempts to enumerate an empty directory. This should succeed but return no files.
+  TEST_CASE(EnumerationQueue_EnumerateEmptyDirectory)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kDirectoryName);
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Attempts to enumerate a directory that does not exist. This should result in the enumeration
+  // being reported as completed.
+  TEST_CASE(EnumerationQueue_EnumerateNonExistentDirectory)
+  {
+    MockFilesystemOperations mockFilesystem;
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files on a filesystem that produces them in sorted
+  // order. No sorting stage should be needed.
+  TEST_CASE(EnumerationQueue_SortedFilesystem_NoSortingStage)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L"asdf.txt", L"File1.txt", L"File2.txt", L"File3.txt", L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(nullptr == enumerationQueue.GetSortingStage());
+
+    for (auto fileName : kFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+    TEST_ASSERT(nullptr == enumerationQueue.GetSortingStage());
+  }
+
+  // Creates a directory with a small number of files on a filesystem that does not produce them in
+  // sorted order. The queue should detect this and produce them in sorted order anyway, including
+  // after a restart.
+  TEST_CASE(EnumerationQueue_UnsortedFilesystem_OutputIsSorted)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L"asdf.txt", L"File1.txt", L"File2.txt", L"File3.txt", L"File4.txt", L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.SetConfigEnumerateInReverseOrder(true);
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(nullptr != enumerationQueue.GetSortingStage());
+
+    for (int i = 0; i < 2; ++i)
+    {
+      for (auto fileName : kFileNames)
+      {
+        TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+        TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      enumerationQueue.Restart();
+    }
+  }
+
+  // Creates a directory with the special "." and ".." entries along with files whose names begin
+  // with characters that sort before '.', on a filesystem that does not produce them in sorted
+  // order. The queue should produce them in sorted order except that "." and ".." come first.
+  TEST_CASE(EnumerationQueue_UnsortedFilesystem_DotEntriesFirst)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {
+        L".", L"..", L"!x", L"#foo", L"$Recycle.Bin", L"asdf.txt", L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.SetConfigEnumerateInReverseOrder(true);
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(nullptr != enumerationQueue.GetSortingStage());
+
+    for (int i = 0; i < 2; ++i)
+    {
+      for (auto fileName : kFileNames)
+      {
+        TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+        TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      enumerationQueue.Restart();
+    }
+  }
+
+  // Creates a directory with a small number of files on a filesystem that does not produce them in
+  // sorted order, and enumerates it using a filesystem rule file pattern. Only the matching files
+  // should be enumerated, and they should be in sorted order.
+  TEST_CASE(EnumerationQueue_UnsortedFilesystem_EnumerateOnlySingleRuleMatchingFiles)
+  {
+    constexpr std::wstring_view kRuleFilePattern = L"File*";
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kMatchingFileNames[] = {
+        L"File0.log", L"File1.txt", L"File2.txt", L"File3.txt"};
+    constexpr std::wstring_view kNonMatchingFileNames[] = {
+        L"asdf.txt", L"SomeOtherFile.bin", L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.SetConfigEnumerateInReverseOrder(true);
+    for (auto fileName : kMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    for (auto fileName : kNonMatchingFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeMatchingFiles(filePatternSource),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+
+    for (auto fileName : kMatchingFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a small number of files on a filesystem that produces them in sorted
+  // order but uses a match instruction that requires sorting. The sorting stage should be used
+  // even though it is not strictly necessary.
+  TEST_CASE(EnumerationQueue_SortingRequiredByInstruction)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kFileNames[] = {L"asdf.txt", L"File1.txt", L"zZz.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    for (auto fileName : kFileNames)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles().WithSortedEnumerationOutput(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(nullptr != enumerationQueue.GetSortingStage());
+
+    for (auto fileName : kFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory with a large number of files on a filesystem that does not produce them in
+  // sorted order. The directory is large enough that the sorting stage needs multiple runs, which
+  // must be merged to produce sorted output.
+  TEST_CASE(EnumerationQueue_UnsortedFilesystem_LargeDirectoryUsesMultipleRuns)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr unsigned int kNumFiles = 12000;
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.SetConfigEnumerateInReverseOrder(true);
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(nullptr != enumerationQueue.GetSortingStage());
+    TEST_ASSERT(enumerationQueue.GetSortingStage()->GetRunCount() > 1);
+
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(
+          enumerationQueue.FileNameOfFront() ==
+          Infra::Strings::Format(L"File%05u.txt", i).AsStringView());
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Creates a directory on a filesystem that does not produce files in sorted order, with more
+  // files than the sorting stage is allowed to hold at once. Memory use is expected to stay bounded
+  // by offering the files as a sequence of individually-sorted windows, each holding as many files
+  // as fit in the sorting stage. Every file should still be enumerated exactly once. Because the
+  // filesystem produces files in reverse order and the directory fits in two windows, the output
+  // is expected to be out of sorted order at exactly one position, namely the window boundary.
+  TEST_CASE(EnumerationQueue_UnsortedFilesystem_SortingStageMemoryBounded)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+
+    // Each file information structure is larger than 32 bytes, so this many files cannot all fit
+    // in the sorting stage at once, but they do fit in two windows.
+    constexpr unsigned int kNumFiles = SortedFileInformationRuns::kMaxBytesTotal / 32;
+    constexpr unsigned int kMaxRunsPerWindow =
+        (SortedFileInformationRuns::kMaxBytesTotal / SortedFileInformationRuns::kMaxBytesPerRun) +
+        1;
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.SetConfigEnumerateInReverseOrder(true);
+
+    std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+        expectedFileNames;
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      const auto fileName = Infra::Strings::Format(L"File%06u.txt", i);
+      expectedFileNames.emplace(fileName.AsStringView());
+
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\' << fileName.AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+
+    std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+        actualFileNames;
+    std::wstring previousFileName;
+    unsigned int numOutOfOrderPositions = 0;
+
+    while (NT_SUCCESS(enumerationQueue.EnumerationStatus()))
+    {
+      TEST_ASSERT(nullptr != enumerationQueue.GetSortingStage());
+      TEST_ASSERT(enumerationQueue.GetSortingStage()->GetRunCount() <= kMaxRunsPerWindow);
+
+      const std::wstring_view fileName = enumerationQueue.FileNameOfFront();
+      if ((false == previousFileName.empty()) &&
+          (Infra::Strings::CompareCaseInsensitive(fileName, previousFileName) < 0))
+        numOutOfOrderPositions += 1;
+
+      TEST_ASSERT(true == actualFileNames.emplace(fileName).second);
+      previousFileName.assign(fileName);
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+    TEST_ASSERT(actualFileNames == expectedFileNames);
+    TEST_ASSERT(1 == numOutOfOrderPositions);
+  }
+
+  // Creates a directory with enough files to require multiple batches and enumerates it with
+  // read-ahead enabled, restarting part-way through. All files should be enumerated in order, both
+  // before and after the restart.
+  TEST_CASE(EnumerationQueue_ReadAhead_EnumerateAllFilesWithRestart)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr unsigned int kNumFiles = 6000;
+
+    MockFilesystemOperations mockFilesystem;
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        true);
+    TEST_ASSERT(true == enumerationQueue.IsReadAheadEnabled());
+
+    for (unsigned int i = 0; i < (kNumFiles / 2); ++i)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(
+          enumerationQueue.FileNameOfFront() ==
+          Infra::Strings::Format(L"File%05u.txt", i).AsStringView());
+      enumerationQueue.PopFront();
+    }
+
+    enumerationQueue.Restart();
+
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(
+          enumerationQueue.FileNameOfFront() ==
+          Infra::Strings::Format(L"File%05u.txt", i).AsStringView());
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Enumerates a directory that spans multiple batches, on a filesystem with simulated system call
+  // latency, while the consumer does a fixed amount of work per file. With read-ahead enabled, the
+  // consumer is expected to fetch only the first batch itself and every subsequent batch is
+  // expected to be fetched in the background, which is what allows fetching each batch to overlap
+  // with consuming the previous one. Elapsed times are reported but not checked, because they
+  // depend on the load on the machine running the test.
+  TEST_CASE(EnumerationQueue_ReadAhead_Benchmark)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr unsigned int kNumFiles = 8000;
+    constexpr unsigned int kSystemCallLatencyMilliseconds = 25;
+    constexpr std::chrono::microseconds kConsumerWorkPerFile(20);
+
+    MockFilesystemOperations mockFilesystem;
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+    mockFilesystem.SetConfigSystemCallLatency(kSystemCallLatencyMilliseconds);
+
+    struct SEnumerationResult
+    {
+      std::chrono::steady_clock::duration duration;
+      unsigned int numCallsByConsumer;
+      unsigned int numCallsInBackground;
+    };
+
+    auto measureEnumeration = [&](bool enableReadAhead) -> SEnumerationResult
+    {
+      const unsigned int numCallsBefore = mockFilesystem.GetNumDirectoryEnumerationCalls();
+      const unsigned int numCallsInBackgroundBefore =
+          mockFilesystem.GetNumDirectoryEnumerationCallsFromOtherThreads();
+      const auto startTime = std::chrono::steady_clock::now();
+
+      do
+      {
+        EnumerationQueue enumerationQueue(
+            InstructionToIncludeAllFiles(),
+            L"C:\\Directory",
+            SFileNamesInformation::kFileInformationClass,
+            std::wstring_view(),
+            enableReadAhead);
+
+        unsigned int numFilesEnumerated = 0;
+        while (NT_SUCCESS(enumerationQueue.EnumerationStatus()))
+        {
+          // Simulates the application doing some work with each file information structure.
+          const auto workEndTime = std::chrono::steady_clock::now() + kConsumerWorkPerFile;
+          while (std::chrono::steady_clock::now() < workEndTime);
+
+          numFilesEnumerated += 1;
+          enumerationQueue.PopFront();
+        }
+
+        TEST_ASSERT(kNumFiles == numFilesEnumerated);
+      } while (false);
+
+      const auto duration = (std::chrono::steady_clock::now() - startTime);
+      const unsigned int numCalls =
+          mockFilesystem.GetNumDirectoryEnumerationCalls() - numCallsBefore;
+      const unsigned int numCallsInBackground =
+          mockFilesystem.GetNumDirectoryEnumerationCallsFromOtherThreads() -
+          numCallsInBackgroundBefore;
+
+      return {
+          .duration = duration,
+          .numCallsByConsumer = (numCalls - numCallsInBackground),
+          .numCallsInBackground = numCallsInBackground};
+    };
+
+    const SEnumerationResult resultWithoutReadAhead = measureEnumeration(false);
+    const SEnumerationResult resultWithReadAhead = measureEnumeration(true);
+
+    TEST_PRINT_MESSAGE(
+        L"Enumeration of %u files took %lld ms without read-ahead and %lld ms with read-ahead.",
+        kNumFiles,
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(resultWithoutReadAhead.duration)
+                .count()),
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(resultWithReadAhead.duration)
+                .count()));
+
+    TEST_ASSERT(resultWithoutReadAhead.numCallsByConsumer > 2);
+    TEST_ASSERT(0 == resultWithoutReadAhead.numCallsInBackground);
+
+    TEST_ASSERT(1 == resultWithReadAhead.numCallsByConsumer);
+    TEST_ASSERT(resultWithReadAhead.numCallsInBackground > 1);
+  }
+
+  // Enumerates a small directory. Its entire contents fit in the smallest enumeration buffer, so
+  // the enumeration buffer should never grow.
+  TEST_CASE(EnumerationQueue_AdaptiveBuffer_SmallDirectoryUsesSmallestBuffer)
+  {
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\Directory\\File1.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\File2.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\File3.txt");
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileNamesInformation::kFileInformationClass);
+
+    unsigned int numFilesEnumerated = 0;
+    while (NT_SUCCESS(enumerationQueue.EnumerationStatus()))
+    {
+      TEST_ASSERT(
+          enumerationQueue.GetEnumerationBufferSize() ==
+          FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+      numFilesEnumerated += 1;
+      enumerationQueue.PopFront();
+    }
+
+    TEST_ASSERT(3 == numFilesEnumerated);
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+    TEST_ASSERT(
+        enumerationQueue.GetEnumerationBufferSize() ==
+        FileInformationStructBuffer::kBytesPerBufferMinimum);
+  }
+
+  // Enumerates a directory with enough files to fill several buffers, both with and without
+  // read-ahead. The enumeration buffer should start at the smallest size class and grow each time
+  // a batch fills it, without any files being skipped or repeated along the way.
+  TEST_CASE(EnumerationQueue_AdaptiveBuffer_LargeDirectoryGrowsBuffer)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr unsigned int kNumFiles = 6000;
+
+    MockFilesystemOperations mockFilesystem;
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    for (bool enableReadAhead : {false, true})
+    {
+      EnumerationQueue enumerationQueue(
+          InstructionToIncludeAllFiles(),
+          kDirectoryName,
+          SFileNamesInformation::kFileInformationClass,
+          std::wstring_view(),
+          enableReadAhead);
+      TEST_ASSERT(
+          enumerationQueue.GetEnumerationBufferSize() ==
+          FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+      unsigned int previousEnumerationBufferSize = enumerationQueue.GetEnumerationBufferSize();
+
+      for (unsigned int i = 0; i < kNumFiles; ++i)
+      {
+        TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+        TEST_ASSERT(
+            enumerationQueue.FileNameOfFront() ==
+            Infra::Strings::Format(L"File%05u.txt", i).AsStringView());
+
+        TEST_ASSERT(enumerationQueue.GetEnumerationBufferSize() >= previousEnumerationBufferSize);
+        previousEnumerationBufferSize = enumerationQueue.GetEnumerationBufferSize();
+
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      TEST_ASSERT(
+          enumerationQueue.GetEnumerationBufferSize() ==
+          FileInformationStructBuffer::kBytesPerBuffer);
+    }
+  }
+
+  // Enumerates a directory containing a file whose name is so long that a file information
+  // structure for it does not fit in the smallest enumeration buffer. The system reports that the
+  // buffer is too small, so the enumeration buffer should grow and the query should be retried.
+  TEST_CASE(EnumerationQueue_AdaptiveBuffer_EntryTooLargeForSmallestBuffer)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+
+    const std::wstring longFileName(FileInformationStructBuffer::kBytesPerBufferMinimum, L'X');
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(std::wstring(kDirectoryName) + L'\\' + longFileName);
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass);
+
+    TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+    TEST_ASSERT(enumerationQueue.FileNameOfFront() == longFileName);
+    TEST_ASSERT(
+        enumerationQueue.GetEnumerationBufferSize() >
+        FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+    enumerationQueue.PopFront();
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Measures the enumeration buffer memory held by many simultaneous enumerations, most of which
+  // are of a small directory and some of which are of a large directory, and compares it with the
+  // memory that would be needed if every enumeration used a buffer of the largest size class. This
+  // is a memory measurement expressed as a test, so it checks only that the adaptive total is a
+  // small fraction of the fixed-size total.
+  TEST_CASE(EnumerationQueue_AdaptiveBuffer_MemoryMeasurement)
+  {
+    constexpr std::wstring_view kSmallDirectoryName = L"C:\\SmallDirectory";
+    constexpr std::wstring_view kLargeDirectoryName = L"C:\\LargeDirectory";
+    constexpr unsigned int kNumFilesInLargeDirectory = 6000;
+    constexpr unsigned int kNumSmallDirectoryEnumerations = 240;
+    constexpr unsigned int kNumLargeDirectoryEnumerations = 16;
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\SmallDirectory\\File1.txt");
+    mockFilesystem.AddFile(L"C:\\SmallDirectory\\File2.txt");
+    for (unsigned int i = 0; i < kNumFilesInLargeDirectory; ++i)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kLargeDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    std::vector<std::unique_ptr<EnumerationQueue>> enumerationQueues;
+    for (unsigned int i = 0; i < kNumSmallDirectoryEnumerations; ++i)
+      enumerationQueues.push_back(std::make_unique<EnumerationQueue>(
+          InstructionToIncludeAllFiles(),
+          kSmallDirectoryName,
+          SFileNamesInformation::kFileInformationClass));
+    for (unsigned int i = 0; i < kNumLargeDirectoryEnumerations; ++i)
+      enumerationQueues.push_back(std::make_unique<EnumerationQueue>(
+          InstructionToIncludeAllFiles(),
+          kLargeDirectoryName,
+          SFileNamesInformation::kFileInformationClass));
+
+    // All of the enumerations are driven to completion but kept alive, so that each one holds the
+    // largest buffer it needed at any point.
+    for (auto& enumerationQueue : enumerationQueues)
+    {
+      while (NT_SUCCESS(enumerationQueue->EnumerationStatus()))
+        enumerationQueue->PopFront();
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue->EnumerationStatus());
+    }
+
+    size_t adaptiveTotalBytes = 0;
+    for (const auto& enumerationQueue : enumerationQueues)
+      adaptiveTotalBytes += enumerationQueue->GetEnumerationBufferSize();
+
+    const size_t fixedTotalBytes =
+        enumerationQueues.size() * FileInformationStructBuffer::kBytesPerBuffer;
+    const size_t expectedAdaptiveTotalBytes =
+        (kNumSmallDirectoryEnumerations * FileInformationStructBuffer::kBytesPerBufferMinimum) +
+        (kNumLargeDirectoryEnumerations * FileInformationStructBuffer::kBytesPerBuffer);
+
+    TEST_ASSERT(expectedAdaptiveTotalBytes == adaptiveTotalBytes);
+    TEST_ASSERT((adaptiveTotalBytes * 4) < fixedTotalBytes);
+  }
+
+  // Enumerates a directory twice using a directory listing cache. The first enumeration should read
+  // the directory contents from the system and store them, and the second enumeration, including
+  // after a restart, should be served from the cache even though the directory contents changed in
+  // the meantime. This includes enumerations that use a different but convertible file information
+  // class. Invalidating the directory should cause the new contents to become visible.
+  TEST_CASE(EnumerationQueue_ListingCache_ServesRepeatEnumerationFromCache)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\Directory\\File1.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\File2.txt");
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    auto countEnumeratedFiles = [](EnumerationQueue& enumerationQueue) -> unsigned int
+    {
+      unsigned int numFilesEnumerated = 0;
+      while (NT_SUCCESS(enumerationQueue.EnumerationStatus()))
+      {
+        numFilesEnumerated += 1;
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      return numFilesEnumerated;
+    };
+
+    EnumerationQueue firstEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(false == firstEnumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(2 == countEnumeratedFiles(firstEnumerationQueue));
+
+    mockFilesystem.AddFile(L"C:\\Directory\\File3.txt");
+
+    EnumerationQueue secondEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(true == secondEnumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(2 == countEnumeratedFiles(secondEnumerationQueue));
+
+    secondEnumerationQueue.Restart();
+    TEST_ASSERT(true == secondEnumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(2 == countEnumeratedFiles(secondEnumerationQueue));
+
+    EnumerationQueue differentFilePatternEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        L"*.txt",
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(false == differentFilePatternEnumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(3 == countEnumeratedFiles(differentFilePatternEnumerationQueue));
+
+    EnumerationQueue differentFileInformationClassEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileDirectoryInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(true == differentFileInformationClassEnumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(2 == countEnumeratedFiles(differentFileInformationClassEnumerationQueue));
+
+    directoryListingCache.InvalidateDirectory(L"C:\\Directory\\");
+
+    EnumerationQueue thirdEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(false == thirdEnumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(3 == countEnumeratedFiles(thirdEnumerationQueue));
+  }
+
+  // Verifies that restarting an enumeration queue that uses a directory listing cache, without
+  // supplying a file pattern, serves the listing for the file pattern with which the enumeration
+  // started. A cached listing of the entire directory is available, but serving it would include
+  // files that do not match the application's file pattern.
+  TEST_CASE(EnumerationQueue_ListingCache_RestartWithoutFilePatternUsesOriginalListing)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr std::wstring_view kQueryFilePattern = L"File*";
+    constexpr std::wstring_view kMatchingFileNames[] = {L"File1.txt", L"File2.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\Directory\\asdf.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\File1.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\File2.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\zZz.txt");
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    EnumerationQueue entireDirectoryEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    while (NT_SUCCESS(entireDirectoryEnumerationQueue.EnumerationStatus()))
+      entireDirectoryEnumerationQueue.PopFront();
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        kQueryFilePattern,
+        false,
+        NULL,
+        &directoryListingCache);
+
+    for (int i = 0; i < 2; ++i)
+    {
+      for (auto fileName : kMatchingFileNames)
+      {
+        TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+        TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      enumerationQueue.Restart();
+      TEST_ASSERT(true == enumerationQueue.IsServingCachedListing());
+    }
+  }
+
+  // Verifies that an enumeration queue that uses a directory listing cache queries the system using
+  // a richer file information class and converts file information structures into the requested
+  // file information class as they are copied out, including when the destination is too small to
+  // hold an entire file information structure.
+  TEST_CASE(EnumerationQueue_ListingCache_ConvertsFileInformationClass)
+  {
+    constexpr std::wstring_view kFileName = L"File1.txt";
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\Directory\\File1.txt");
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    EnumerationQueue enumerationQueue(
+        InstructionToIncludeAllFiles(),
+        L"C:\\Directory",
+        SFileDirectoryInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(
+        SFileDirectoryInformation::kFileInformationClass ==
+        enumerationQueue.GetFileInformationClass());
+    TEST_ASSERT(
+        SFileIdBothDirectoryInformation::kFileInformationClass ==
+        enumerationQueue.GetSystemFileInformationClass());
+
+    TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+    TEST_ASSERT(enumerationQueue.FileNameOfFront() == kFileName);
+
+    const unsigned int expectedSizeOfFront = static_cast<unsigned int>(
+        offsetof(SFileDirectoryInformation, fileName) + (kFileName.length() * sizeof(wchar_t)));
+    TEST_ASSERT(expectedSizeOfFront == enumerationQueue.SizeOfFront());
+
+    FileInformationStructBuffer copiedEntryBuffer;
+    std::memset(copiedEntryBuffer.Data(), 0xcd, copiedEntryBuffer.Size());
+    TEST_ASSERT(
+        expectedSizeOfFront ==
+        enumerationQueue.CopyFront(copiedEntryBuffer.Data(), copiedEntryBuffer.Size()));
+
+    const SFileDirectoryInformation& copiedEntry =
+        *reinterpret_cast<const SFileDirectoryInformation*>(copiedEntryBuffer.Data());
+    TEST_ASSERT(expectedSizeOfFront == copiedEntry.nextEntryOffset);
+    TEST_ASSERT(FileInformationStructLayout::ReadFileNameByType(copiedEntry) == kFileName);
+
+    constexpr unsigned int kShortCopyCapacityBytes = 10;
+    std::memset(copiedEntryBuffer.Data(), 0xcd, copiedEntryBuffer.Size());
+    TEST_ASSERT(
+        kShortCopyCapacityBytes ==
+        enumerationQueue.CopyFront(copiedEntryBuffer.Data(), kShortCopyCapacityBytes));
+    TEST_ASSERT(0xcd == copiedEntryBuffer[kShortCopyCapacityBytes]);
+
+    enumerationQueue.PopFront();
+    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+  }
+
+  // Verifies that directory listings are not served from a directory listing cache once their time
+  // to live has elapsed.
+  TEST_CASE(EnumerationQueue_ListingCache_ExpiredListingNotServed)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\Directory\\File1.txt");
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(1));
+
+    EnumerationQueue firstEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    while (NT_SUCCESS(firstEnumerationQueue.EnumerationStatus())) firstEnumerationQueue.PopFront();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EnumerationQueue secondEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(false == secondEnumerationQueue.IsServingCachedListing());
+  }
+
+  // Verifies that a directory listing is stored in full even if only part of it is consumed, but
+  // that a listing is not stored if its directory is invalidated while it is being read from the
+  // system.
+  TEST_CASE(EnumerationQueue_ListingCache_ListingInvalidatedWhileReadingNotStored)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+    constexpr unsigned int kNumFiles = 6000;
+    constexpr unsigned int kSystemCallLatencyMilliseconds = 20;
 
     MockFilesystemOperations mockFilesystem;
-    for (auto fileName : kMatchingFileNames)
+    for (unsigned int i = 0; i < kNumFiles; ++i)
     {
       Infra::TemporaryString fileAbsolutePath;
-      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
       mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
     }
-    for (auto fileName : kNonMatchingFileNames)
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    do
     {
-      Infra::TemporaryString fileAbsolutePath;
-      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
-      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+      EnumerationQueue partialEnumerationQueue(
+          InstructionToIncludeAllFiles(),
+          kDirectoryName,
+          SFileNamesInformation::kFileInformationClass,
+          std::wstring_view(),
+          false,
+          NULL,
+          &directoryListingCache);
+      TEST_ASSERT(false == partialEnumerationQueue.IsServingCachedListing());
+
+      for (unsigned int i = 0; i < (kNumFiles / 2); ++i) partialEnumerationQueue.PopFront();
+      TEST_ASSERT(NT_SUCCESS(partialEnumerationQueue.EnumerationStatus()));
     }
+    while (false);
 
-    RelatedFilesystemRuleContainer filePatternSource;
-    for (auto fileName : kMatchingFileNames)
-      filePatternSource.EmplaceRule(CreateFilePatternSourceRule(fileName));
+    EnumerationQueue cachedEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(true == cachedEnumerationQueue.IsServingCachedListing());
+
+    directoryListingCache.InvalidateDirectory(kDirectoryName);
+
+    // Reading the listing requires several system calls, each of which takes a while, so the
+    // invalidation is expected to occur part-way through.
+    mockFilesystem.SetConfigSystemCallLatency(kSystemCallLatencyMilliseconds);
+    std::thread invalidationThread(
+        [&directoryListingCache, kDirectoryName]() -> void
+        {
+          std::this_thread::sleep_for(
+              std::chrono::milliseconds(kSystemCallLatencyMilliseconds * 3));
+          directoryListingCache.InvalidateDirectory(kDirectoryName);
+        });
+
+    EnumerationQueue invalidatedEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    invalidationThread.join();
+    mockFilesystem.SetConfigSystemCallLatency(0);
 
-    EnumerationQueue enumerationQueue(
-        InstructionToIncludeMatchingFiles(filePatternSource),
-        L"C:\\Directory",
-        SFileNamesInformation::kFileInformationClass);
+    TEST_ASSERT(false == invalidatedEnumerationQueue.IsServingCachedListing());
 
-    for (auto fileName : kMatchingFileNames)
+    unsigned int numFilesEnumerated = 0;
+    while (NT_SUCCESS(invalidatedEnumerationQueue.EnumerationStatus()))
     {
-      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
-      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
-      enumerationQueue.PopFront();
+      numFilesEnumerated += 1;
+      invalidatedEnumerationQueue.PopFront();
     }
+    TEST_ASSERT(kNumFiles == numFilesEnumerated);
 
-    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+    EnumerationQueue finalEnumerationQueue(
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        false,
+        NULL,
+        &directoryListingCache);
+    TEST_ASSERT(false == finalEnumerationQueue.IsServingCachedListing());
   }
 
-  // Creates a directory with a small number of files and expects that only files that match the
-  // file patterns, supplied both via a filesystem rule and via query, are enumerated.
-  TEST_CASE(EnumerationQueue_EnumerateOnlyRuleAndQueryMatchingFiles)
+  // Starts many threads that all enumerate the same directory at the same time using a directory
+  // listing cache, on a filesystem with simulated system call latency. Each thread repeats this
+  // several times, and between rounds the directory is invalidated. Every enumeration should
+  // produce the complete directory contents in order, and within each round at most one thread
+  // should have read the directory contents from the system while the rest shared its listing.
+  TEST_CASE(EnumerationQueue_ListingCache_ConcurrentEnumerationsCoalesced)
   {
-    constexpr std::wstring_view kQueryFilePattern = L"*.txt";
-    constexpr std::wstring_view kRuleFilePattern = L"File*";
     constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
-    constexpr std::wstring_view kMatchingFileNames[] = {
-        L"File1.txt",
-        L"File2.txt",
-        L"File3.txt",
-        L"File4.txt",
-        L"File5.txt",
-    };
-    constexpr std::wstring_view kNonMatchingFileNames[] = {
-        L"File0.log",
-        L"asdf.txt",
-        L"SomeOtherFile.bin",
-        L"Program.exe"
-        L"zZz.txt"};
+    constexpr unsigned int kNumFiles = 3000;
+    constexpr unsigned int kNumThreads = 16;
+    constexpr unsigned int kNumRounds = 8;
+    constexpr unsigned int kSystemCallLatencyMilliseconds = 5;
 
     MockFilesystemOperations mockFilesystem;
-    for (auto fileName : kMatchingFileNames)
+    for (unsigned int i = 0; i < kNumFiles; ++i)
     {
       Infra::TemporaryString fileAbsolutePath;
-      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
       mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
     }
-    for (auto fileName : kNonMatchingFileNames)
+    mockFilesystem.SetConfigSystemCallLatency(kSystemCallLatencyMilliseconds);
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    for (unsigned int round = 0; round < kNumRounds; ++round)
     {
-      Infra::TemporaryString fileAbsolutePath;
-      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
-      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+      directoryListingCache.InvalidateDirectory(kDirectoryName);
+
+      std::atomic<unsigned int> numListingsReadFromSystem = 0;
+      std::atomic<unsigned int> numIncorrectEnumerations = 0;
+      std::latch startLatch(kNumThreads);
+
+      std::vector<std::thread> enumerationThreads;
+      enumerationThreads.reserve(kNumThreads);
+
+      for (unsigned int threadIndex = 0; threadIndex < kNumThreads; ++threadIndex)
+      {
+        enumerationThreads.emplace_back(
+            [&]() -> void
+            {
+              startLatch.arrive_and_wait();
+
+              EnumerationQueue enumerationQueue(
+                  InstructionToIncludeAllFiles(),
+                  kDirectoryName,
+                  SFileDirectoryInformation::kFileInformationClass,
+                  std::wstring_view(),
+                  false,
+                  NULL,
+                  &directoryListingCache);
+              if (false == enumerationQueue.IsServingCachedListing())
+                numListingsReadFromSystem += 1;
+
+              unsigned int numFilesEnumerated = 0;
+              while (NT_SUCCESS(enumerationQueue.EnumerationStatus()))
+              {
+                if (enumerationQueue.FileNameOfFront() !=
+                    Infra::Strings::Format(L"File%05u.txt", numFilesEnumerated).AsStringView())
+                  break;
+
+                numFilesEnumerated += 1;
+                enumerationQueue.PopFront();
+              }
+
+              if ((kNumFiles != numFilesEnumerated) ||
+                  (NtStatus::kNoMoreFiles != enumerationQueue.EnumerationStatus()))
+                numIncorrectEnumerations += 1;
+            });
+      }
+
+      for (auto& enumerationThread : enumerationThreads)
+        enumerationThread.join();
+
+      TEST_ASSERT(0 == numIncorrectEnumerations);
+      TEST_ASSERT(1 == numListingsReadFromSystem);
     }
+  }
+
+  // Prefetches a directory listing and then enumerates the same directory while the prefetch is
+  // being completed concurrently. Only one prefetch of the same listing should be in progress at a
+  // time, and the enumeration should be served the prefetched listing regardless of whether it
+  // arrives before or after the prefetch completes, including when it uses a file pattern that
+  // matches everything.
+  TEST_CASE(EnumerationQueue_ListingCache_ServedFromListingPrefetch)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\Directory\\File1.txt");
+    mockFilesystem.AddFile(L"C:\\Directory\\File2.txt");
+    mockFilesystem.SetConfigSystemCallLatency(20);
+
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    std::optional<EnumerationQueue::SListingPrefetch> maybeListingPrefetch =
+        EnumerationQueue::BeginListingPrefetch(
+            InstructionToIncludeAllFiles(), kDirectoryName, directoryListingCache);
+    TEST_ASSERT(true == maybeListingPrefetch.has_value());
+    TEST_ASSERT(
+        false ==
+        EnumerationQueue::BeginListingPrefetch(
+            InstructionToIncludeAllFiles(), kDirectoryName, directoryListingCache)
+            .has_value());
+
+    std::thread listingPrefetchThread(
+        [&maybeListingPrefetch]() -> void
+        {
+          EnumerationQueue::CompleteListingPrefetch(*maybeListingPrefetch);
+        });
 
-    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
     EnumerationQueue enumerationQueue(
-        InstructionToIncludeMatchingFiles(filePatternSource),
-        L"C:\\Directory",
+        InstructionToIncludeAllFiles(),
+        kDirectoryName,
         SFileNamesInformation::kFileInformationClass,
-        kQueryFilePattern);
+        L"*",
+        false,
+        NULL,
+        &directoryListingCache);
+    listingPrefetchThread.join();
 
-    for (auto fileName : kMatchingFileNames)
+    TEST_ASSERT(true == enumerationQueue.IsServingCachedListing());
+
+    unsigned int numFilesEnumerated = 0;
+    while (NT_SUCCESS(enumerationQueue.EnumerationStatus()))
     {
-      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
-      TEST_ASSERT(enumerationQueue.FileNameOfFront() == fileName);
+      numFilesEnumerated += 1;
       enumerationQueue.PopFront();
     }
+    TEST_ASSERT(2 == numFilesEnumerated);
 
-    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+    TEST_ASSERT(
+        false ==
+        EnumerationQueue::BeginListingPrefetch(
+            InstructionToIncludeAllFiles(), kDirectoryName, directoryListingCache)
+            .has_value());
   }
 
-  // Creates a directory with a small number of files and expects that none are enumerated due to
-  // no matches with the file pattern supplied within a filesystem rule. In this case the
-  // instruction specifies to include all matching files, so the file pattern is one that does not
-  // match.
-  TEST_CASE(EnumerationQueue_NothingMatchesInclusiveRuleFilePattern)
+  // Enumerates a directory with enough files to fill several buffers using a directory listing
+  // cache. The listing is read from the system using progressively larger buffers, so a second
+  // enumeration served from the cache should grow its own enumeration buffer to fit each batch.
+  TEST_CASE(EnumerationQueue_ListingCache_LargeBatchesGrowEnumerationBuffer)
   {
-    constexpr std::wstring_view kRuleFilePattern = L"*.exe";
     constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
-    constexpr std::wstring_view kFileNames[] = {
-        L"asdf.txt",
-        L"File1.txt",
-        L"File2.txt",
-        L"File3.txt",
-        L"File4.txt",
-        L"File5.txt",
-        L"zZz.txt"};
+    constexpr unsigned int kNumFiles = 6000;
 
     MockFilesystemOperations mockFilesystem;
-    for (auto fileName : kFileNames)
+    for (unsigned int i = 0; i < kNumFiles; ++i)
     {
       Infra::TemporaryString fileAbsolutePath;
-      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
       mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
     }
 
-    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
-    EnumerationQueue enumerationQueue(
-        InstructionToIncludeMatchingFiles(filePatternSource),
-        L"C:\\Directory",
-        SFileNamesInformation::kFileInformationClass);
-    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    for (bool expectServedFromCache : {false, true})
+    {
+      EnumerationQueue enumerationQueue(
+          InstructionToIncludeAllFiles(),
+          kDirectoryName,
+          SFileNamesInformation::kFileInformationClass,
+          std::wstring_view(),
+          false,
+          NULL,
+          &directoryListingCache);
+      TEST_ASSERT(expectServedFromCache == enumerationQueue.IsServingCachedListing());
+
+      for (unsigned int i = 0; i < kNumFiles; ++i)
+      {
+        TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+        TEST_ASSERT(
+            enumerationQueue.FileNameOfFront() ==
+            Infra::Strings::Format(L"File%05u.txt", i).AsStringView());
+        enumerationQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
+      TEST_ASSERT(
+          enumerationQueue.GetEnumerationBufferSize() ==
+          FileInformationStructBuffer::kBytesPerBuffer);
+    }
   }
 
-  // Creates a directory with a small number of files and expects that none are enumerated due to
-  // no matches with the file pattern supplied within a filesystem rule. In this case the
-  // instruction specifies to exclude all matching files, so the file pattern is one that does
-  // match.
-  TEST_CASE(EnumerationQueue_EverythingMatchesExclusiveRuleFilePattern)
+  // Enumerates a directory with both a directory listing cache and read-ahead enabled, in a way
+  // that forces the queue to fall back to reading batches from the system because the listing it
+  // waited for was invalidated and therefore not stored. Batches fetched in the background must use
+  // the same richer file information class as the rest of the queue, otherwise their contents
+  // would be misinterpreted. All files should be enumerated in order.
+  TEST_CASE(EnumerationQueue_ListingCache_ReadAheadAfterFallbackUsesSystemFileInformationClass)
   {
-    constexpr std::wstring_view kRuleFilePattern = L"*.txt";
     constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
-    constexpr std::wstring_view kFileNames[] = {
-        L"asdf.txt",
-        L"File1.txt",
-        L"File2.txt",
-        L"File3.txt",
-        L"File4.txt",
-        L"File5.txt",
-        L"zZz.txt"};
+    constexpr unsigned int kNumFiles = 6000;
 
     MockFilesystemOperations mockFilesystem;
-    for (auto fileName : kFileNames)
+    for (unsigned int i = 0; i < kNumFiles; ++i)
     {
       Infra::TemporaryString fileAbsolutePath;
-      fileAbsolutePath << kDirectoryName << L'\\' << fileName;
+      fileAbsolutePath << kDirectoryName << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
       mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
     }
 
-    FilesystemRule filePatternSource = CreateFilePatternSourceRule(kRuleFilePattern);
-    EnumerationQueue enumerationQueue(
-        InstructionToExcludeMatchingFiles(filePatternSource),
-        L"C:\\Directory",
-        SFileNamesInformation::kFileInformationClass);
-    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
-  }
-
-  // Attempts to enumerate an empty directory. This should succeed but return no files.
-  TEST_CASE(EnumerationQueue_EnumerateEmptyDirectory)
-  {
-    constexpr std::wstring_view kDirectoryName = L"C:\\Directory";
-
-    MockFilesystemOperations mockFilesystem;
-    mockFilesystem.AddDirectory(kDirectoryName);
+    DirectoryListingCache directoryListingCache(std::chrono::milliseconds(60000));
+
+    // Invalidating the directory after the prefetch begins means the prefetched listing is not
+    // stored, so the queue waiting for it receives nothing and must read batches itself. Reading
+    // the listing requires several slow system calls, so the queue is expected to start waiting
+    // before the prefetch completes.
+    std::optional<EnumerationQueue::SListingPrefetch> maybeListingPrefetch =
+        EnumerationQueue::BeginListingPrefetch(
+            InstructionToIncludeAllFiles(), kDirectoryName, directoryListingCache);
+    TEST_ASSERT(true == maybeListingPrefetch.has_value());
+    directoryListingCache.InvalidateDirectory(kDirectoryName);
+
+    mockFilesystem.SetConfigSystemCallLatency(20);
+    std::thread listingPrefetchThread(
+        [&maybeListingPrefetch]() -> void
+        {
+          EnumerationQueue::CompleteListingPrefetch(*maybeListingPrefetch);
+        });
 
     EnumerationQueue enumerationQueue(
         InstructionToIncludeAllFiles(),
-        L"C:\\Directory",
-        SFileNamesInformation::kFileInformationClass);
-    TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
-  }
+        kDirectoryName,
+        SFileNamesInformation::kFileInformationClass,
+        std::wstring_view(),
+        true,
+        NULL,
+        &directoryListingCache);
+    listingPrefetchThread.join();
+    mockFilesystem.SetConfigSystemCallLatency(0);
+
+    TEST_ASSERT(true == enumerationQueue.IsReadAheadEnabled());
+    TEST_ASSERT(false == enumerationQueue.IsServingCachedListing());
+    TEST_ASSERT(
+        SFileIdBothDirectoryInformation::kFileInformationClass ==
+        enumerationQueue.GetSystemFileInformationClass());
+
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      TEST_ASSERT(NT_SUCCESS(enumerationQueue.EnumerationStatus()));
+      TEST_ASSERT(
+          enumerationQueue.FileNameOfFront() ==
+          Infra::Strings::Format(L"File%05u.txt", i).AsStringView());
+      enumerationQueue.PopFront();
+    }
 
-  // Attempts to enumerate a directory that does not exist. This should result in the enumeration
-  // being reported as completed.
-  TEST_CASE(EnumerationQueue_EnumerateNonExistentDirectory)
-  {
-    MockFilesystemOperations mockFilesystem;
-    EnumerationQueue enumerationQueue(
-        InstructionToIncludeAllFiles(),
-        L"C:\\Directory",
-        SFileNamesInformation::kFileInformationClass);
     TEST_ASSERT(NtStatus::kNoMoreFiles == enumerationQueue.EnumerationStatus());
   }
 
@@ -694,6 +2275,152 @@ namespace PathwinderTest
     TEST_ASSERT(NtStatus::kNoMoreFiles == nameInsertionQueue.EnumerationStatus());
   }
 
+  // Enumerates the parent directory of several filesystem rules' origin directories, most of which
+  // have target directories that share a parent directory and one of which has a target directory
+  // elsewhere. Target directory existence is resolved in a batch for the shared parent directory
+  // and individually for the other. Only origin directories whose target directories exist should
+  // be enumerated, each with a file information structure that stands alone.
+  TEST_CASE(NameInsertionQueue_MultipleFilesystemRules_BatchedAndIndividualLookups)
+  {
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(L"C:\\DirectoryTarget\\Target1");
+    mockFilesystem.AddDirectory(L"C:\\DirectoryTarget\\Target3");
+    mockFilesystem.AddFile(L"C:\\DirectoryTarget\\Unrelated.txt");
+    mockFilesystem.AddDirectory(L"C:\\OtherTarget\\Target5");
+
+    const FilesystemRule filesystemRules[] = {
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin1", L"C:\\DirectoryTarget\\Target1"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin2", L"C:\\DirectoryTarget\\Target2"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin3", L"C:\\DirectoryTarget\\TARGET3"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin4", L"C:\\DirectoryTarget\\Target4"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin5", L"C:\\OtherTarget\\Target5")};
+
+    Infra::TemporaryVector<DirectoryEnumerationInstruction::SingleDirectoryNameInsertion>
+        nameInsertionInstructions;
+    for (const auto& filesystemRule : filesystemRules)
+      nameInsertionInstructions.EmplaceBack(filesystemRule);
+
+    NameInsertionQueue nameInsertionQueue(
+        std::move(nameInsertionInstructions), SFileDirectoryInformation::kFileInformationClass);
+
+    constexpr std::wstring_view kExpectedEnumeratedItems[] = {L"Origin1", L"Origin3", L"Origin5"};
+
+    for (int i = 0; i < 2; ++i)
+    {
+      for (const auto& expectedEnumeratedItem : kExpectedEnumeratedItems)
+      {
+        TEST_ASSERT(NT_SUCCESS(nameInsertionQueue.EnumerationStatus()));
+        TEST_ASSERT(nameInsertionQueue.FileNameOfFront() == expectedEnumeratedItem);
+
+        FileInformationStructBuffer enumeratedFileInformation;
+        nameInsertionQueue.CopyFront(
+            enumeratedFileInformation.Data(), enumeratedFileInformation.Size());
+        TEST_ASSERT(
+            0 ==
+            reinterpret_cast<const SFileDirectoryInformation*>(enumeratedFileInformation.Data())
+                ->nextEntryOffset);
+
+        nameInsertionQueue.PopFront();
+      }
+
+      TEST_ASSERT(NtStatus::kNoMoreFiles == nameInsertionQueue.EnumerationStatus());
+      nameInsertionQueue.Restart();
+    }
+  }
+
+  // Enumerates the parent directory of many filesystem rules' origin directories, all of which
+  // have target directories in the same parent directory, while every system call is slowed down.
+  // Resolving target directory existence in a single batch is expected to enumerate the shared
+  // parent directory once and not query any target directory individually, whereas resolving them
+  // one at a time would make one system call per filesystem rule. Elapsed time is reported but not
+  // checked, because it depends on the load on the machine running the test.
+  TEST_CASE(NameInsertionQueue_MultipleFilesystemRules_BatchedLookup_Benchmark)
+  {
+    constexpr unsigned int kSystemCallLatencyMilliseconds = 20;
+
+    MockFilesystemOperations mockFilesystem;
+
+    const FilesystemRule filesystemRules[] = {
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin1", L"C:\\DirectoryTarget\\Target1"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin2", L"C:\\DirectoryTarget\\Target2"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin3", L"C:\\DirectoryTarget\\Target3"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin4", L"C:\\DirectoryTarget\\Target4"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin5", L"C:\\DirectoryTarget\\Target5"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin6", L"C:\\DirectoryTarget\\Target6"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin7", L"C:\\DirectoryTarget\\Target7"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin8", L"C:\\DirectoryTarget\\Target8")};
+
+    for (const auto& filesystemRule : filesystemRules)
+      mockFilesystem.AddDirectory(filesystemRule.GetTargetDirectoryFullPath());
+
+    mockFilesystem.SetConfigSystemCallLatency(kSystemCallLatencyMilliseconds);
+
+    Infra::TemporaryVector<DirectoryEnumerationInstruction::SingleDirectoryNameInsertion>
+        nameInsertionInstructions;
+    for (const auto& filesystemRule : filesystemRules)
+      nameInsertionInstructions.EmplaceBack(filesystemRule);
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    NameInsertionQueue nameInsertionQueue(
+        std::move(nameInsertionInstructions), SFileNamesInformation::kFileInformationClass);
+
+    for (const auto& filesystemRule : filesystemRules)
+    {
+      TEST_ASSERT(NT_SUCCESS(nameInsertionQueue.EnumerationStatus()));
+      TEST_ASSERT(nameInsertionQueue.FileNameOfFront() == filesystemRule.GetOriginDirectoryName());
+      nameInsertionQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == nameInsertionQueue.EnumerationStatus());
+
+    const auto elapsedTime = std::chrono::steady_clock::now() - startTime;
+    TEST_PRINT_MESSAGE(
+        L"Name insertion for %u filesystem rules took %lld ms.",
+        static_cast<unsigned int>(std::size(filesystemRules)),
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(elapsedTime).count()));
+
+    TEST_ASSERT(1 == mockFilesystem.GetNumDirectoriesOpenedForEnumeration());
+    TEST_ASSERT(0 == mockFilesystem.GetNumSingleFileDirectoryInformationQueries());
+  }
+
+  // Enumerates name insertions for several filesystem rules, some of which are looked up together
+  // and some individually. Only one file information structure is ever held at a time, so the
+  // enumeration buffer should remain at the smallest size class throughout.
+  TEST_CASE(NameInsertionQueue_UsesSmallestBuffer)
+  {
+    MockFilesystemOperations mockFilesystem;
+
+    const FilesystemRule filesystemRules[] = {
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin1", L"C:\\DirectoryTarget\\Target1"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin2", L"C:\\DirectoryTarget\\Target2"),
+        FilesystemRule(L"", L"C:\\DirectoryOrigin\\Origin3", L"C:\\OtherDirectoryTarget\\Target3")};
+
+    for (const auto& filesystemRule : filesystemRules)
+      mockFilesystem.AddDirectory(filesystemRule.GetTargetDirectoryFullPath());
+
+    Infra::TemporaryVector<DirectoryEnumerationInstruction::SingleDirectoryNameInsertion>
+        nameInsertionInstructions;
+    for (const auto& filesystemRule : filesystemRules)
+      nameInsertionInstructions.EmplaceBack(filesystemRule);
+
+    NameInsertionQueue nameInsertionQueue(
+        std::move(nameInsertionInstructions), SFileNamesInformation::kFileInformationClass);
+
+    for (const auto& filesystemRule : filesystemRules)
+    {
+      TEST_ASSERT(NT_SUCCESS(nameInsertionQueue.EnumerationStatus()));
+      TEST_ASSERT(nameInsertionQueue.FileNameOfFront() == filesystemRule.GetOriginDirectoryName());
+      TEST_ASSERT(
+          nameInsertionQueue.GetEnumerationBufferSize() ==
+          FileInformationStructBuffer::kBytesPerBufferMinimum);
+      nameInsertionQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == nameInsertionQueue.EnumerationStatus());
+  }
+
   // Creates two directory enumeration queues and verifies that they are correctly merged, with
   // output properly being provided in sorted order.
   TEST_CASE(MergedFileInformationQueue_SimpleMergeTwo_Nominal)
@@ -922,6 +2649,39 @@ namespace PathwinderTest
     TEST_ASSERT(NtStatus::kNoMoreFiles == mergedQueue.EnumerationStatus());
   }
 
+  // Creates two directory enumeration queues, one of which offers only the special "." and ".."
+  // entries and the other of which offers filenames that begin with characters that compare lower
+  // than '.', and verifies that the merged output still begins with "." and "..". This is the same
+  // ordering used when sorting the contents of an individual directory.
+  TEST_CASE(MergedFileInformationQueue_SimpleMergeTwo_DotEntriesFirst)
+  {
+    FileInformationStructLayout layout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(
+            SFileNamesInformation::kFileInformationClass);
+
+    auto firstQueue = std::make_unique<MockDirectoryOperationQueue>(
+        layout, MockDirectoryOperationQueue::TFileNamesToEnumerate({L".", L".."}));
+    auto secondQueue = std::make_unique<MockDirectoryOperationQueue>(
+        layout,
+        MockDirectoryOperationQueue::TFileNamesToEnumerate(
+            {L"!Bang.txt", L"#Hash.txt", L"$Dollar.txt", L"File.txt"}));
+
+    constexpr std::wstring_view kExpectedFileNames[] = {
+        L".", L"..", L"!Bang.txt", L"#Hash.txt", L"$Dollar.txt", L"File.txt"};
+
+    MergedFileInformationQueue mergedQueue =
+        MergedFileInformationQueue::Create<2>({std::move(firstQueue), std::move(secondQueue)});
+
+    for (auto fileName : kExpectedFileNames)
+    {
+      TEST_ASSERT(NT_SUCCESS(mergedQueue.EnumerationStatus()));
+      TEST_ASSERT(mergedQueue.FileNameOfFront() == fileName);
+      mergedQueue.PopFront();
+    }
+
+    TEST_ASSERT(NtStatus::kNoMoreFiles == mergedQueue.EnumerationStatus());
+  }
+
   // Verifies that a merged file information queue correctly reports that the enumeration is in
   // progress if at least one underlying queue reports the same. None of the underlying queues
   // report error conditions. They either report "enumeration in progress" or "enumeration done."
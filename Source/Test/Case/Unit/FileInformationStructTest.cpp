@@ -13,7 +13,10 @@
 #include "FileInformationStruct.h"
 
 #include <cstring>
+#include <cwchar>
 #include <string_view>
+#include <type_traits>
+#include <utility>
 
 #include <Infra/Test/TestCase.h>
 
@@ -49,6 +52,85 @@ namespace PathwinderTest
     return (reinterpret_cast<const wchar_t*>(fileInformationStruct))[lastWideCharacterIndex];
   }
 
+  // Verifies that file information structure buffers are created using the smallest size class
+  // that can hold the requested number of bytes, and that a buffer created without a requested size
+  // uses the largest size class.
+  TEST_CASE(FileInformationStructBuffer_SizeClassSelection)
+  {
+    TEST_ASSERT(
+        FileInformationStructBuffer().Size() == FileInformationStructBuffer::kBytesPerBuffer);
+
+    for (unsigned int sizeBytes : FileInformationStructBuffer::kBytesPerBufferSizeClass)
+    {
+      TEST_ASSERT(FileInformationStructBuffer(sizeBytes).Size() == sizeBytes);
+      TEST_ASSERT(FileInformationStructBuffer(sizeBytes - 1).Size() == sizeBytes);
+    }
+
+    TEST_ASSERT(
+        FileInformationStructBuffer(1).Size() ==
+        FileInformationStructBuffer::kBytesPerBufferMinimum);
+  }
+
+  // Verifies that growing a file information structure buffer proceeds through each size class in
+  // order and stops at the largest size class.
+  TEST_CASE(FileInformationStructBuffer_Grow)
+  {
+    FileInformationStructBuffer buffer(FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+    for (size_t i = 1; i < FileInformationStructBuffer::kBytesPerBufferSizeClass.size(); ++i)
+    {
+      TEST_ASSERT(true == buffer.CanGrow());
+      TEST_ASSERT(true == buffer.Grow());
+      TEST_ASSERT(buffer.Size() == FileInformationStructBuffer::kBytesPerBufferSizeClass[i]);
+
+      // The entire buffer should be usable after growing.
+      std::memset(buffer.Data(), 0, static_cast<size_t>(buffer.Size()));
+    }
+
+    TEST_ASSERT(false == buffer.CanGrow());
+    TEST_ASSERT(false == buffer.Grow());
+    TEST_ASSERT(buffer.Size() == FileInformationStructBuffer::kBytesPerBuffer);
+  }
+
+  // Verifies that growing a file information structure buffer to fit a specific number of bytes
+  // selects the smallest sufficient size class and never shrinks the buffer.
+  TEST_CASE(FileInformationStructBuffer_GrowToFit)
+  {
+    FileInformationStructBuffer buffer(FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+    buffer.GrowToFit(FileInformationStructBuffer::kBytesPerBufferMinimum / 2);
+    TEST_ASSERT(buffer.Size() == FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+    buffer.GrowToFit(FileInformationStructBuffer::kBytesPerBufferMinimum + 1);
+    TEST_ASSERT(buffer.Size() == FileInformationStructBuffer::kBytesPerBufferSizeClass[1]);
+
+    buffer.GrowToFit(FileInformationStructBuffer::kBytesPerBuffer);
+    TEST_ASSERT(buffer.Size() == FileInformationStructBuffer::kBytesPerBuffer);
+
+    buffer.GrowToFit(FileInformationStructBuffer::kBytesPerBufferMinimum);
+    TEST_ASSERT(buffer.Size() == FileInformationStructBuffer::kBytesPerBuffer);
+  }
+
+  // Verifies that moving a file information structure buffer carries its size along with it.
+  TEST_CASE(FileInformationStructBuffer_MovePreservesSize)
+  {
+    FileInformationStructBuffer smallBuffer(FileInformationStructBuffer::kBytesPerBufferMinimum);
+    FileInformationStructBuffer largeBuffer(FileInformationStructBuffer::kBytesPerBuffer);
+
+    const uint8_t* const smallBufferData = smallBuffer.Data();
+    const uint8_t* const largeBufferData = largeBuffer.Data();
+
+    std::swap(smallBuffer, largeBuffer);
+    TEST_ASSERT(smallBuffer.Data() == largeBufferData);
+    TEST_ASSERT(smallBuffer.Size() == FileInformationStructBuffer::kBytesPerBuffer);
+    TEST_ASSERT(largeBuffer.Data() == smallBufferData);
+    TEST_ASSERT(largeBuffer.Size() == FileInformationStructBuffer::kBytesPerBufferMinimum);
+
+    FileInformationStructBuffer movedBuffer(std::move(largeBuffer));
+    TEST_ASSERT(movedBuffer.Data() == smallBufferData);
+    TEST_ASSERT(movedBuffer.Size() == FileInformationStructBuffer::kBytesPerBufferMinimum);
+  }
+
   // Verifies correct default-initialization of bytewise-represented file information structures
   // with dangling filename fields.
   TEST_CASE(BytewiseDanglingFilenameStruct_DefaultInitialization)
@@ -595,4 +677,247 @@ namespace PathwinderTest
     TestCaseBodyWriteFileNameShortWrite<SFileIdExtdDirectoryInformation>();
     TestCaseBodyWriteFileNameShortWrite<SFileIdExtdBothDirectoryInformation>();
   }
+
+  // Verifies that the file information classes that can be synthesized by conversion are mapped to
+  // the richer file information class from which they can be converted, and that all others are
+  // mapped to themselves.
+  TEST_CASE(FileInformationStructLayout_ConvertibleSourceFileInformationClass)
+  {
+    constexpr FILE_INFORMATION_CLASS kConvertibleFileInformationClasses[] = {
+        SFileDirectoryInformation::kFileInformationClass,
+        SFileFullDirectoryInformation::kFileInformationClass,
+        SFileBothDirectoryInformation::kFileInformationClass,
+        SFileNamesInformation::kFileInformationClass,
+        SFileIdBothDirectoryInformation::kFileInformationClass,
+        SFileIdFullDirectoryInformation::kFileInformationClass};
+
+    constexpr FILE_INFORMATION_CLASS kNonConvertibleFileInformationClasses[] = {
+        SFileIdGlobalTxDirectoryInformation::kFileInformationClass,
+        SFileIdExtdDirectoryInformation::kFileInformationClass,
+        SFileIdExtdBothDirectoryInformation::kFileInformationClass,
+        SFileBasicInformation::kFileInformationClass};
+
+    for (const auto fileInformationClass : kConvertibleFileInformationClasses)
+      TEST_ASSERT(
+          SFileIdBothDirectoryInformation::kFileInformationClass ==
+          FileInformationStructLayout::ConvertibleSourceFileInformationClass(fileInformationClass));
+
+    for (const auto fileInformationClass : kNonConvertibleFileInformationClasses)
+      TEST_ASSERT(
+          fileInformationClass ==
+          FileInformationStructLayout::ConvertibleSourceFileInformationClass(fileInformationClass));
+  }
+
+  // Verifies that a file information structure of the richer convertible type is correctly
+  // converted into a file information structure of the specified type. All fields common to both
+  // should be copied, and the size and next entry offset of the output structure should reflect
+  // the output type rather than the input type.
+  template <typename FileInformationStructType> static void
+      TestCaseBodyConvertFileInformationStruct(void)
+  {
+    constexpr std::wstring_view testFileName = L"AbCdEfG hIjKlMnOp.txt";
+
+    auto sourceStructBuffer = InitializeFileInformationStructBuffer();
+    auto sourceStruct =
+        reinterpret_cast<SFileIdBothDirectoryInformation*>(sourceStructBuffer.Data());
+    const FileInformationStructLayout sourceStructLayout =
+        FileInformationStructLayout::LayoutForFileInformationClass(
+            SFileIdBothDirectoryInformation::kFileInformationClass)
+            .value();
+
+    sourceStruct->fileIndex = 11;
+    sourceStruct->creationTime.QuadPart = 22;
+    sourceStruct->lastWriteTime.QuadPart = 33;
+    sourceStruct->endOfFile.QuadPart = 44;
+    sourceStruct->fileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+    sourceStruct->eaSize = 55;
+    sourceStruct->shortNameLength = 4;
+    std::wmemcpy(sourceStruct->shortName, L"ABCD", 4);
+    sourceStruct->fileId.QuadPart = 66;
+    sourceStructLayout.WriteFileName(sourceStruct, testFileName, sourceStructBuffer.Size());
+
+    auto testStructBuffer = InitializeFileInformationStructBuffer();
+    std::memset(testStructBuffer.Data(), 0xcd, static_cast<size_t>(testStructBuffer.Size()));
+    auto testStruct = reinterpret_cast<FileInformationStructType*>(testStructBuffer.Data());
+    const FileInformationStructLayout testStructLayout =
+        FileInformationStructLayout::LayoutForFileInformationClass(
+            FileInformationStructType::kFileInformationClass)
+            .value();
+
+    const unsigned int convertedSize =
+        testStructLayout.ConvertFileInformationStruct(sourceStructLayout, sourceStruct, testStruct);
+
+    TEST_ASSERT(testStructLayout.HypotheticalSizeForFileName(testFileName) == convertedSize);
+    TEST_ASSERT(testStructLayout.SizeOfStruct(testStruct) == convertedSize);
+    TEST_ASSERT(convertedSize == testStruct->nextEntryOffset);
+    TEST_ASSERT(testFileName == testStructLayout.ReadFileName(testStruct));
+    TEST_ASSERT(11 == testStruct->fileIndex);
+
+    if constexpr (requires { &FileInformationStructType::fileAttributes; })
+    {
+      TEST_ASSERT(22 == testStruct->creationTime.QuadPart);
+      TEST_ASSERT(0 == testStruct->lastAccessTime.QuadPart);
+      TEST_ASSERT(33 == testStruct->lastWriteTime.QuadPart);
+      TEST_ASSERT(44 == testStruct->endOfFile.QuadPart);
+      TEST_ASSERT(FILE_ATTRIBUTE_DIRECTORY == testStruct->fileAttributes);
+    }
+
+    if constexpr (requires { &FileInformationStructType::eaSize; })
+      TEST_ASSERT(55 == testStruct->eaSize);
+
+    if constexpr (requires { &FileInformationStructType::shortName; })
+    {
+      TEST_ASSERT(4 == testStruct->shortNameLength);
+      TEST_ASSERT(0 == std::wmemcmp(L"ABCD", testStruct->shortName, 4));
+    }
+
+    if constexpr (requires { &FileInformationStructType::fileId; })
+      TEST_ASSERT(66 == testStruct->fileId.QuadPart);
+  }
+
+  TEST_CASE(FileInformationStructLayout_ConvertFileInformationStruct)
+  {
+    TestCaseBodyConvertFileInformationStruct<SFileDirectoryInformation>();
+    TestCaseBodyConvertFileInformationStruct<SFileFullDirectoryInformation>();
+    TestCaseBodyConvertFileInformationStruct<SFileBothDirectoryInformation>();
+    TestCaseBodyConvertFileInformationStruct<SFileNamesInformation>();
+    TestCaseBodyConvertFileInformationStruct<SFileIdBothDirectoryInformation>();
+    TestCaseBodyConvertFileInformationStruct<SFileIdFullDirectoryInformation>();
+  }
+
+  // Verifies that conversion is refused for file information classes that cannot be synthesized
+  // from the source file information structure.
+  TEST_CASE(FileInformationStructLayout_ConvertFileInformationStruct_Unsupported)
+  {
+    auto sourceStructBuffer = InitializeFileInformationStructBuffer();
+    auto testStructBuffer = InitializeFileInformationStructBuffer();
+
+    const FileInformationStructLayout sourceStructLayout =
+        FileInformationStructLayout::LayoutForFileInformationClass(
+            SFileIdBothDirectoryInformation::kFileInformationClass)
+            .value();
+    const FileInformationStructLayout testStructLayout =
+        FileInformationStructLayout::LayoutForFileInformationClass(
+            SFileIdExtdDirectoryInformation::kFileInformationClass)
+            .value();
+
+    TEST_ASSERT(
+        0 ==
+        testStructLayout.ConvertFileInformationStruct(
+            sourceStructLayout, sourceStructBuffer.Data(), testStructBuffer.Data()));
+  }
+
+  // Verifies that a compile-time file information structure layout describes the same layout as
+  // the runtime layout for the same file information class, and that both produce identical
+  // results when reading and writing the same file information structure.
+  template <typename FileInformationStructType> static void
+      TestCaseBodyStaticLayoutMatchesRuntimeLayout(void)
+  {
+    using TStaticLayout = StaticFileInformationStructLayout<FileInformationStructType>;
+    constexpr std::wstring_view testValue = L"AbCdEfG hIjKlMnOp";
+
+    const FileInformationStructLayout runtimeLayout =
+        FileInformationStructLayout::LayoutForFileInformationClass(
+            FileInformationStructType::kFileInformationClass)
+            .value();
+    TEST_ASSERT(TStaticLayout::Layout() == runtimeLayout);
+    TEST_ASSERT(TStaticLayout::FileInformationClass() == runtimeLayout.FileInformationClass());
+    TEST_ASSERT(TStaticLayout::BaseStructureSize() == runtimeLayout.BaseStructureSize());
+
+    auto testStructBuffer = InitializeFileInformationStructBuffer();
+    void* const testStruct = testStructBuffer.Data();
+
+    TStaticLayout::WriteFileName(testStruct, testValue, testStructBuffer.Size());
+    TEST_ASSERT(TStaticLayout::ReadFileName(testStruct) == testValue);
+    TEST_ASSERT(runtimeLayout.ReadFileName(testStruct) == testValue);
+    TEST_ASSERT(
+        TStaticLayout::FileNamePointer(testStruct) == runtimeLayout.FileNamePointer(testStruct));
+    TEST_ASSERT(
+        TStaticLayout::ReadFileNameLength(testStruct) ==
+        runtimeLayout.ReadFileNameLength(testStruct));
+    TEST_ASSERT(TStaticLayout::SizeOfStruct(testStruct) == runtimeLayout.SizeOfStruct(testStruct));
+    TEST_ASSERT(
+        TStaticLayout::ReadNextEntryOffset(testStruct) == runtimeLayout.SizeOfStruct(testStruct));
+
+    TStaticLayout::ClearNextEntryOffset(testStruct);
+    TEST_ASSERT(0 == runtimeLayout.ReadNextEntryOffset(testStruct));
+
+    TStaticLayout::UpdateNextEntryOffset(testStruct);
+    TEST_ASSERT(
+        TStaticLayout::ReadNextEntryOffset(testStruct) == runtimeLayout.SizeOfStruct(testStruct));
+
+    constexpr unsigned int kShortFileNameLengthBytes = 4;
+    TStaticLayout::WriteFileNameLength(testStruct, kShortFileNameLengthBytes);
+    TEST_ASSERT(kShortFileNameLengthBytes == runtimeLayout.ReadFileNameLength(testStruct));
+    TEST_ASSERT(
+        TStaticLayout::HypotheticalSizeForFileNameLength(kShortFileNameLengthBytes) ==
+        runtimeLayout.HypotheticalSizeForFileNameLength(kShortFileNameLengthBytes));
+    TEST_ASSERT(
+        TStaticLayout::ReadNextEntryOffset(testStruct) == runtimeLayout.SizeOfStruct(testStruct));
+  }
+
+  TEST_CASE(StaticFileInformationStructLayout_MatchesRuntimeLayout)
+  {
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileFullDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileBothDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileNamesInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileIdBothDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileIdFullDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileIdGlobalTxDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileIdExtdDirectoryInformation>();
+    TestCaseBodyStaticLayoutMatchesRuntimeLayout<SFileIdExtdBothDirectoryInformation>();
+  }
+
+  // Verifies that invoking a function with a compile-time layout supplies the compile-time layout
+  // for the correct file information class.
+  template <typename FileInformationStructType> static void
+      TestCaseBodyInvokeWithStaticLayout(void)
+  {
+    const FileInformationStructLayout runtimeLayout =
+        FileInformationStructLayout::LayoutForFileInformationClass(
+            FileInformationStructType::kFileInformationClass)
+            .value();
+
+    const bool isExpectedStaticLayout = runtimeLayout.InvokeWithStaticLayout(
+        [](const auto& layout) -> bool
+        {
+          return std::is_same_v<
+              StaticFileInformationStructLayout<FileInformationStructType>,
+              std::remove_cvref_t<decltype(layout)>>;
+        });
+    TEST_ASSERT(true == isExpectedStaticLayout);
+  }
+
+  TEST_CASE(FileInformationStructLayout_InvokeWithStaticLayout)
+  {
+    TestCaseBodyInvokeWithStaticLayout<SFileDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileFullDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileBothDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileNamesInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileIdBothDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileIdFullDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileIdGlobalTxDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileIdExtdDirectoryInformation>();
+    TestCaseBodyInvokeWithStaticLayout<SFileIdExtdBothDirectoryInformation>();
+  }
+
+  // Verifies that invoking a function with a compile-time layout falls back to supplying the
+  // runtime layout itself if there is no compile-time layout for its file information class.
+  TEST_CASE(FileInformationStructLayout_InvokeWithStaticLayout_RuntimeFallback)
+  {
+    const FileInformationStructLayout runtimeLayout(
+        static_cast<FILE_INFORMATION_CLASS>(0), 16, 0, 4, 8);
+
+    const bool isRuntimeLayout = runtimeLayout.InvokeWithStaticLayout(
+        [&runtimeLayout](const auto& layout) -> bool
+        {
+          if constexpr (
+              std::is_same_v<FileInformationStructLayout, std::remove_cvref_t<decltype(layout)>>)
+            return (&runtimeLayout == &layout);
+          else
+            return false;
+        });
+    TEST_ASSERT(true == isRuntimeLayout);
+  }
 } // namespace PathwinderTest
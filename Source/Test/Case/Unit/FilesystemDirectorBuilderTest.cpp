@@ -290,6 +290,29 @@ namespace PathwinderTest
     TEST_ASSERT(false == maybeConfigRule2.Value()->FileNameMatchesAnyPattern(L"asdf.txt"));
   }
 
+  // Verifies that filesystem rules can be configured to require sorted directory enumeration output
+  // and that this setting defaults to disabled if it is not present.
+  TEST_CASE(FilesystemDirectorBuilder_AddRuleFromConfigurationSection_Success_SortDirectoryEnumerationOutput)
+  {
+    Infra::Configuration::Section configSection1 = {
+        {L"OriginDirectory", L"C:\\OriginDir1"},
+        {L"TargetDirectory", L"C:\\TargetDir1"},
+        {L"SortDirectoryEnumerationOutput", true}};
+
+    Infra::Configuration::Section configSection2 = {
+        {L"OriginDirectory", L"C:\\OriginDir2"}, {L"TargetDirectory", L"C:\\TargetDir2"}};
+
+    FilesystemDirectorBuilder directorBuilder;
+
+    auto maybeConfigRule1 = directorBuilder.AddRuleFromConfigurationSection(L"1", configSection1);
+    TEST_ASSERT(maybeConfigRule1.HasValue());
+    TEST_ASSERT(true == maybeConfigRule1.Value()->ShouldSortDirectoryEnumerationOutput());
+
+    auto maybeConfigRule2 = directorBuilder.AddRuleFromConfigurationSection(L"2", configSection2);
+    TEST_ASSERT(maybeConfigRule2.HasValue());
+    TEST_ASSERT(false == maybeConfigRule2.Value()->ShouldSortDirectoryEnumerationOutput());
+  }
+
   // Verifies that filesystem rules cannot be created from configuration sections that are missing
   // either an origin or a target directory.
   TEST_CASE(FilesystemDirectorBuilder_AddRuleFromConfigurationSection_Failure_MissingDirectory)
@@ -213,14 +213,17 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"C:\\Origin1\\file1.txt",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin2\\Subdir2\\file2.txt",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target2\\Subdir2\\file2.txt", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target2\\Subdir2\\file2.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
-             EAssociateNameWithHandle::Unredirected)}};
+             EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -248,13 +251,16 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"C:\\Origin\\file1.txt",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\TargetForTxt\\file1.txt", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\TargetForTxt\\file1.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin\\file2.bin",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\TargetForBin\\file2.bin", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\TargetForBin\\file2.bin", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(1)},
         {L"C:\\Origin\\file3.exe",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\TargetForExe\\file3.exe", EAssociateNameWithHandle::Unredirected)}};
+             L"C:\\TargetForExe\\file3.exe", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(2)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -287,14 +293,17 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"C:\\Origin\\SubDir.txt\\file1",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\TargetForTxt\\SubDir.txt\\file1", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\TargetForTxt\\SubDir.txt\\file1", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin\\SubDir.bin\\file2",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\TargetForBin\\SubDir.bin\\file2", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\TargetForBin\\SubDir.bin\\file2", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(1)},
         {L"C:\\Origin\\SubDir.exe\\AnotherSubDir\\file3",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\TargetForExe\\SubDir.exe\\AnotherSubDir\\file3",
-             EAssociateNameWithHandle::Unredirected)}};
+             EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(2)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -323,14 +332,17 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"C:\\Origin1\\file1.txt",
          FileOperationInstruction::OverlayRedirectTo(
-             L"C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin2\\Subdir2\\file2.txt",
          FileOperationInstruction::OverlayRedirectTo(
-             L"C:\\Target2\\Subdir2\\file2.txt", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target2\\Subdir2\\file2.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
          FileOperationInstruction::OverlayRedirectTo(
              L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
-             EAssociateNameWithHandle::Unredirected)}};
+             EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -366,17 +378,20 @@ namespace PathwinderTest
              EAssociateNameWithHandle::Unredirected,
              ECreateDispositionPreference::PreferOpenExistingFile,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")},
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin2\\Subdir2\\file2.txt",
          FileOperationInstruction::OverlayRedirectTo(
              L"C:\\Target2\\Subdir2\\file2.txt",
              EAssociateNameWithHandle::Unredirected,
-             ECreateDispositionPreference::PreferOpenExistingFile)},
+             ECreateDispositionPreference::PreferOpenExistingFile)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
          FileOperationInstruction::OverlayRedirectTo(
              L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
              EAssociateNameWithHandle::Unredirected,
-             ECreateDispositionPreference::PreferOpenExistingFile)}};
+             ECreateDispositionPreference::PreferOpenExistingFile)
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -416,31 +431,37 @@ namespace PathwinderTest
              L"C:\\Target1",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")},
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin1\\",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target1\\",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")},
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin2\\Subdir2",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target2\\Subdir2",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target2\\Subdir2")},
+             L"C:\\Target2\\Subdir2")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin3\\Subdir3\\Subdir3B\\Subdir3C",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C")},
+             L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin1\\file1.txt",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected, {}, L"")},
+             L"C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected, {}, L"")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin2\\Subdir2\\file2.bin",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target2\\Subdir2\\file2.bin", EAssociateNameWithHandle::Unredirected, {}, L"")}};
+             L"C:\\Target2\\Subdir2\\file2.bin", EAssociateNameWithHandle::Unredirected, {}, L"")
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -473,13 +494,15 @@ namespace PathwinderTest
              L"C:\\Target1\\AnyTypeOfFile",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")},
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin1\\NewDirectoryToCreate\\",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target1\\NewDirectoryToCreate\\",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")}};
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -513,13 +536,15 @@ namespace PathwinderTest
              L"C:\\Target1\\AnyTypeOfFile",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")},
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin1\\NewDirectoryToCreate\\",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target1\\NewDirectoryToCreate\\",
              EAssociateNameWithHandle::Unredirected,
              {static_cast<int>(EExtraPreOperation::EnsurePathHierarchyExists)},
-             L"C:\\Target1")}};
+             L"C:\\Target1")
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -549,14 +574,17 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"C:\\Origin1\\Subdir1\\",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target1\\Subdir1\\", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target1\\Subdir1\\", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin2\\Subdir2\\Subdir2B\\",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target2\\Subdir2\\Subdir2B\\", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target2\\Subdir2\\Subdir2B\\", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin3\\Subdir3\\Subdir3B\\Subdir3C\\",
          FileOperationInstruction::SimpleRedirectTo(
              L"C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C\\",
-             EAssociateNameWithHandle::Unredirected)}};
+             EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -587,14 +615,17 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"\\??\\C:\\Origin1\\file1.txt",
          FileOperationInstruction::SimpleRedirectTo(
-             L"\\??\\C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected)},
+             L"\\??\\C:\\Target1\\file1.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"\\\\?\\C:\\Origin2\\Subdir2\\file2.txt",
          FileOperationInstruction::SimpleRedirectTo(
-             L"\\\\?\\C:\\Target2\\Subdir2\\file2.txt", EAssociateNameWithHandle::Unredirected)},
+             L"\\\\?\\C:\\Target2\\Subdir2\\file2.txt", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"\\\\.\\C:\\Origin3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
          FileOperationInstruction::SimpleRedirectTo(
              L"\\\\.\\C:\\Target3\\Subdir3\\Subdir3B\\Subdir3C\\file3.txt",
-             EAssociateNameWithHandle::Unredirected)}};
+             EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)}};
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
     {
@@ -632,6 +663,65 @@ namespace PathwinderTest
     }
   }
 
+  // Creates a filesystem director with a few filesystem rules and queries it with paths inside
+  // several directories, once without and once with a resume point for the containing directory,
+  // as would happen for files opened relative to a root directory handle. Verifies that the resume
+  // point is resolved on first use and that the instructions are the same either way, including
+  // for directories that are outside of all rules, ancestors of rules, or have a trailing
+  // backslash.
+  TEST_CASE(FilesystemDirector_GetInstructionForFileOperation_ResumeFromRootDirectory)
+  {
+    MockFilesystemOperations mockFilesystem;
+
+    const FilesystemDirector director(MakeFilesystemDirector({
+        {L"1", FilesystemRule(L"1", L"C:\\Origin1", L"C:\\Target1")},
+        {L"2", FilesystemRule(L"2", L"C:\\Origin2\\Subdir2", L"C:\\Target2")},
+    }));
+
+    const std::pair<std::wstring_view, std::wstring_view> kTestDirectoriesAndFiles[] = {
+        {L"C:\\Origin1", L"file1.txt"},
+        {L"C:\\Origin1", L"Subdir1\\file1.txt"},
+        {L"C:\\Origin1\\", L"file1.txt"},
+        {L"C:\\Origin2", L"Subdir2"},
+        {L"C:\\Origin2", L"Subdir2\\file2.txt"},
+        {L"C:\\Origin2", L"OtherSubdir\\file2.txt"},
+        {L"C:\\", L"Origin1\\file1.txt"},
+        {L"C:\\", L"Origin2"},
+        {L"\\??\\C:\\Origin1", L"file1.txt"},
+        {L"D:\\NonRedirectedDirectory", L"Subdir\\file.log"}};
+
+    for (const auto& testRecord : kTestDirectoriesAndFiles)
+    {
+      const std::wstring_view testDirectory = testRecord.first;
+
+      std::wstring testInput(testDirectory);
+      if (L'\\' != testInput.back()) testInput.push_back(L'\\');
+      testInput.append(testRecord.second);
+
+      SPathLookupResumePoint resumePoint = {
+          .directoryPathLength = static_cast<unsigned int>(testDirectory.length()),
+          .isResolved = false};
+
+      const auto expectedOutput = director.GetInstructionForFileOperation(
+          testInput, FileAccessMode::ReadOnly(), CreateDisposition::OpenExistingFile());
+
+      const auto actualOutputFirst = director.GetInstructionForFileOperation(
+          testInput,
+          FileAccessMode::ReadOnly(),
+          CreateDisposition::OpenExistingFile(),
+          &resumePoint);
+      TEST_ASSERT(true == resumePoint.isResolved);
+      TEST_ASSERT(actualOutputFirst == expectedOutput);
+
+      const auto actualOutputResumed = director.GetInstructionForFileOperation(
+          testInput,
+          FileAccessMode::ReadOnly(),
+          CreateDisposition::OpenExistingFile(),
+          &resumePoint);
+      TEST_ASSERT(actualOutputResumed == expectedOutput);
+    }
+  }
+
   // Creates a filesystem director a single filesystem rule and queries it with inputs that should
   // not be redirected due to no match. In this case the input query string is not
   // null-terminated, but the buffer itself contains a null-terminated string that ordinarily
@@ -693,10 +783,12 @@ namespace PathwinderTest
     const std::pair<std::wstring_view, FileOperationInstruction> kTestInputsAndExpectedOutputs[] = {
         {L"C:\\Origin1",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target1", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target1", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
         {L"C:\\Origin1\\",
          FileOperationInstruction::SimpleRedirectTo(
-             L"C:\\Target1\\", EAssociateNameWithHandle::Unredirected)},
+             L"C:\\Target1\\", EAssociateNameWithHandle::Unredirected)
+             .WithRedirectingRuleIndex(0)},
     };
 
     for (const auto& testRecord : kTestInputsAndExpectedOutputs)
@@ -930,6 +1022,47 @@ namespace PathwinderTest
     TEST_ASSERT(actualDirectoryEnumerationInstruction == expectedDirectoryEnumerationInstruction);
   }
 
+  // Creates a filesystem director with two filesystem rules having the same origin directory, such
+  // that the target directory of the first is an ancestor of the target directory of the second.
+  // Opens a subdirectory that is redirected by the second rule and then requests a directory
+  // enumeration instruction for it using the redirecting rule position index from the file
+  // operation instruction. Verifies that the second rule, which uses overlay mode, is used for
+  // the directory enumeration even though the redirected path is also within the scope of the
+  // target directory of the first rule.
+  TEST_CASE(FilesystemDirector_GetInstructionForDirectoryEnumeration_RedirectingRuleIndexFromOpen)
+  {
+    MockFilesystemOperations mockFilesystem;
+
+    const FilesystemDirector director(MakeFilesystemDirector({
+        {L"1", FilesystemRule(L"1", L"C:\\Origin", L"C:\\Target", {L"*.txt"})},
+        {L"2",
+         FilesystemRule(
+             L"2", L"C:\\Origin", L"C:\\Target\\Nested", {L"*.bin"}, ERedirectMode::Overlay)},
+    }));
+
+    constexpr std::wstring_view associatedPath = L"C:\\Origin\\Subdir.bin";
+    constexpr std::wstring_view realOpenedPath = L"C:\\Target\\Nested\\Subdir.bin";
+
+    const FileOperationInstruction fileOperationInstruction =
+        director.GetInstructionForFileOperation(
+            associatedPath, FileAccessMode::ReadOnly(), CreateDisposition::OpenExistingFile());
+    TEST_ASSERT(true == fileOperationInstruction.HasRedirectedFilename());
+    TEST_ASSERT(fileOperationInstruction.GetRedirectedFilename() == realOpenedPath);
+    TEST_ASSERT(1 == fileOperationInstruction.GetRedirectingRuleIndex());
+
+    const DirectoryEnumerationInstruction expectedDirectoryEnumerationInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                 EDirectoryPathSource::RealOpenedPath),
+             DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                 EDirectoryPathSource::AssociatedPath)});
+    const DirectoryEnumerationInstruction actualDirectoryEnumerationInstruction =
+        director.GetInstructionForDirectoryEnumeration(
+            associatedPath, realOpenedPath, fileOperationInstruction.GetRedirectingRuleIndex());
+
+    TEST_ASSERT(actualDirectoryEnumerationInstruction == expectedDirectoryEnumerationInstruction);
+  }
+
   // Creates a filesystem director with a single filesystem rule without file patterns.
   // Requests a directory enumeration instruction such that the rule is configured for overlay
   // mode and verifies that it correctly merges the target and origin directory contents.
@@ -13,10 +13,14 @@
 #include "FilesystemExecutor.h"
 
 #include <array>
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <set>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include <Infra/Core/ArrayList.h>
 #include <Infra/Core/Strings.h>
@@ -28,6 +32,7 @@
 #include "FilesystemDirector.h"
 #include "FilesystemInstruction.h"
 #include "FilesystemRule.h"
+#include "Globals.h"
 #include "MockDirectoryOperationQueue.h"
 #include "MockFilesystemOperations.h"
 #include "OpenHandleStore.h"
@@ -48,16 +53,25 @@ namespace PathwinderTest
   {
     IDirectoryOperationQueue* queue;
     FileInformationStructLayout fileInformationStructLayout;
-    std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
-        enumeratedFilenames;
+    std::wstring queryFilePattern;
+    std::wstring lastEnumeratedFilename;
+    unsigned int numEnumeratedFilenames;
+    std::optional<
+        std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>>
+        unsortedEnumeratedFilenames;
     bool isFirstInvocation;
+    bool isDrained;
 
     inline SDirectoryEnumerationStateSnapshot(
         const OpenHandleStore::SInProgressDirectoryEnumeration& inProgressDirectoryEnumeration)
         : queue(inProgressDirectoryEnumeration.queue.get()),
           fileInformationStructLayout(inProgressDirectoryEnumeration.fileInformationStructLayout),
-          enumeratedFilenames(inProgressDirectoryEnumeration.enumeratedFilenames),
-          isFirstInvocation(inProgressDirectoryEnumeration.isFirstInvocation)
+          queryFilePattern(inProgressDirectoryEnumeration.queryFilePattern),
+          lastEnumeratedFilename(inProgressDirectoryEnumeration.lastEnumeratedFilename),
+          numEnumeratedFilenames(inProgressDirectoryEnumeration.numEnumeratedFilenames),
+          unsortedEnumeratedFilenames(inProgressDirectoryEnumeration.unsortedEnumeratedFilenames),
+          isFirstInvocation(inProgressDirectoryEnumeration.isFirstInvocation),
+          isDrained(inProgressDirectoryEnumeration.isDrained)
     {}
 
     bool operator==(const SDirectoryEnumerationStateSnapshot& other) const = default;
@@ -69,6 +83,27 @@ namespace PathwinderTest
     }
   };
 
+  /// Saves the global performance settings when created and restores them when destroyed, so that
+  /// test cases can modify them without affecting other test cases.
+  class ScopedPerformanceSettings
+  {
+  public:
+    inline ScopedPerformanceSettings(void)
+        : savedPerformanceSettings(Globals::PerformanceSettings())
+    {}
+
+    ScopedPerformanceSettings(const ScopedPerformanceSettings& other) = delete;
+
+    inline ~ScopedPerformanceSettings(void)
+    {
+      Globals::PerformanceSettings() = savedPerformanceSettings;
+    }
+
+  private:
+    /// Performance settings that were in effect when this object was created.
+    const Globals::SPerformanceSettings savedPerformanceSettings;
+  };
+
   /// Determines if a directory operation queue object is of the specified type.
   /// @tparam DirectoryOperationQueueType Type of directory operation queue to check for a match
   /// with the parameter object.
@@ -723,6 +758,475 @@ namespace PathwinderTest
     }
   }
 
+  // Verifies that, once all files are enumerated, the directory enumeration state is drained by
+  // releasing its queue, that a drained directory enumeration continues to indicate no more files
+  // without being passed through to the system, and that restarting it rebuilds the queue so that
+  // all files are enumerated all over again.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DrainedStateRebuiltOnRestart)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath)});
+    auto instructionSourceFunc = [&testInstruction](
+                                     std::wstring_view,
+                                     std::wstring_view,
+                                     RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+        -> DirectoryEnumerationInstruction
+    {
+      return testInstruction;
+    };
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\File1.txt");
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\File2.txt");
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\File3.txt");
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+
+    auto prepareAndAdvance = [&](ULONG queryFlags) -> NTSTATUS
+    {
+      const std::optional<NTSTATUS> prepareResult = FilesystemExecutor::DirectoryEnumerationPrepare(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          nullptr,
+          instructionSourceFunc);
+      TEST_ASSERT(prepareResult == NtStatus::kSuccess);
+
+      IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+      const NTSTATUS advanceResult = FilesystemExecutor::DirectoryEnumerationAdvance(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          nullptr,
+          nullptr,
+          nullptr,
+          &ioStatusBlock,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          queryFlags,
+          nullptr);
+      TEST_ASSERT(ioStatusBlock.Status == advanceResult);
+
+      if (NtStatus::kSuccess == advanceResult)
+      {
+        const std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+            expectedFilenames = {L"File1.txt", L"File2.txt", L"File3.txt"};
+        std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+            actualFilenames;
+
+        unsigned int bytePosition = 0;
+        while (true)
+        {
+          const void* const fileInformationStruct = &enumerationOutputBytes[bytePosition];
+          actualFilenames.emplace(fileNameStructLayout.ReadFileName(fileInformationStruct));
+
+          const unsigned int nextEntryOffset =
+              fileNameStructLayout.ReadNextEntryOffset(fileInformationStruct);
+          if (0 == nextEntryOffset) break;
+          bytePosition += nextEntryOffset;
+        }
+
+        TEST_ASSERT(actualFilenames == expectedFilenames);
+      }
+      else
+      {
+        TEST_ASSERT(0 == ioStatusBlock.Information);
+      }
+
+      return advanceResult;
+    };
+
+    for (int i = 0; i < 2; ++i)
+    {
+      TEST_ASSERT(NtStatus::kSuccess == prepareAndAdvance((0 == i) ? 0 : SL_RESTART_SCAN));
+
+      const SDirectoryEnumerationStateSnapshot drainedDirectoryEnumerationState =
+          SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+      TEST_ASSERT(true == drainedDirectoryEnumerationState.isDrained);
+      TEST_ASSERT(nullptr == drainedDirectoryEnumerationState.queue);
+      TEST_ASSERT(true == drainedDirectoryEnumerationState.lastEnumeratedFilename.empty());
+      TEST_ASSERT(
+          false == drainedDirectoryEnumerationState.unsortedEnumeratedFilenames.has_value());
+
+      for (int j = 0; j < 3; ++j)
+        TEST_ASSERT(NtStatus::kNoMoreFiles == prepareAndAdvance(0));
+
+      TEST_ASSERT(
+          nullptr ==
+          SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore)
+              .queue);
+    }
+  }
+
+  // Verifies that restarting a drained directory enumeration without supplying a query file pattern
+  // rebuilds the queue using the query file pattern the application supplied originally, such that
+  // the same files are enumerated all over again.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DrainedStateRebuiltWithQueryFilePattern)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+    constexpr std::wstring_view kTestFilePattern = L"*.txt";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath)});
+    auto instructionSourceFunc = [&testInstruction](
+                                     std::wstring_view,
+                                     std::wstring_view,
+                                     RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+        -> DirectoryEnumerationInstruction
+    {
+      return testInstruction;
+    };
+
+    const std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+        expectedFilenames = {L"File1.txt", L"File2.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\File1.txt");
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\File2.txt");
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\Other.log");
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+    UNICODE_STRING queryFilePatternUnicodeString =
+        Strings::NtConvertStringViewToUnicodeString(kTestFilePattern);
+
+    auto prepareAndEnumerateAll = [&](ULONG queryFlags, UNICODE_STRING* queryFilePattern)
+        -> std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+    {
+      std::set<std::wstring, Infra::Strings::CaseInsensitiveLessThanComparator<wchar_t>>
+          actualFilenames;
+
+      const std::optional<NTSTATUS> prepareResult = FilesystemExecutor::DirectoryEnumerationPrepare(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          queryFilePattern,
+          instructionSourceFunc);
+      TEST_ASSERT(prepareResult == NtStatus::kSuccess);
+
+      while (true)
+      {
+        IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+        const NTSTATUS advanceResult = FilesystemExecutor::DirectoryEnumerationAdvance(
+            TestCaseName().data(),
+            kFunctionRequestIdentifier,
+            openHandleStore,
+            directoryHandle,
+            nullptr,
+            nullptr,
+            nullptr,
+            &ioStatusBlock,
+            enumerationOutputBytes.Data(),
+            enumerationOutputBytes.CapacityBytes(),
+            kFileNamesInformationClass,
+            queryFlags | SL_RETURN_SINGLE_ENTRY,
+            queryFilePattern);
+        if (NtStatus::kNoMoreFiles == advanceResult) break;
+
+        TEST_ASSERT(NtStatus::kSuccess == advanceResult);
+        actualFilenames.emplace(fileNameStructLayout.ReadFileName(enumerationOutputBytes.Data()));
+        queryFlags = 0;
+        queryFilePattern = nullptr;
+      }
+
+      return actualFilenames;
+    };
+
+    TEST_ASSERT(prepareAndEnumerateAll(0, &queryFilePatternUnicodeString) == expectedFilenames);
+    TEST_ASSERT(
+        true ==
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore)
+            .isDrained);
+
+    TEST_ASSERT(prepareAndEnumerateAll(SL_RESTART_SCAN, nullptr) == expectedFilenames);
+    TEST_ASSERT(
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore)
+            .queryFilePattern == kTestFilePattern);
+  }
+
+  // Verifies that a drained directory enumeration whose queue cannot be created again on restart
+  // remains drained, such that it continues to indicate no more files rather than an internal
+  // error and can be restarted successfully once the queue can be created again.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DrainedStateRebuildFailure)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath)});
+    bool instructionSourceCanCreateQueue = true;
+    auto instructionSourceFunc = [&testInstruction, &instructionSourceCanCreateQueue](
+                                     std::wstring_view,
+                                     std::wstring_view,
+                                     RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+        -> DirectoryEnumerationInstruction
+    {
+      if (true == instructionSourceCanCreateQueue) return testInstruction;
+      return DirectoryEnumerationInstruction::PassThroughUnmodifiedQuery();
+    };
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"X:\\Test\\Directory\\File1.txt");
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+
+    auto prepareAndAdvance = [&](ULONG queryFlags) -> NTSTATUS
+    {
+      const std::optional<NTSTATUS> prepareResult = FilesystemExecutor::DirectoryEnumerationPrepare(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          nullptr,
+          instructionSourceFunc);
+      TEST_ASSERT(prepareResult == NtStatus::kSuccess);
+
+      IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+      return FilesystemExecutor::DirectoryEnumerationAdvance(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          nullptr,
+          nullptr,
+          nullptr,
+          &ioStatusBlock,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          queryFlags,
+          nullptr);
+    };
+
+    TEST_ASSERT(NtStatus::kSuccess == prepareAndAdvance(0));
+    TEST_ASSERT(
+        true ==
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore)
+            .isDrained);
+
+    instructionSourceCanCreateQueue = false;
+    TEST_ASSERT(NtStatus::kInternalError == prepareAndAdvance(SL_RESTART_SCAN));
+
+    const SDirectoryEnumerationStateSnapshot failedDirectoryEnumerationState =
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+    TEST_ASSERT(true == failedDirectoryEnumerationState.isDrained);
+    TEST_ASSERT(nullptr == failedDirectoryEnumerationState.queue);
+    TEST_ASSERT(NtStatus::kNoMoreFiles == prepareAndAdvance(0));
+
+    instructionSourceCanCreateQueue = true;
+    TEST_ASSERT(NtStatus::kSuccess == prepareAndAdvance(SL_RESTART_SCAN));
+  }
+
+  // Verifies that enumerating the real opened path of a directory handle by way of a duplicate of
+  // the application's handle produces all of the files exactly once, even though the duplicate
+  // shares its enumeration cursor with the application's handle. This covers enough files to
+  // require reading ahead in the background, as well as draining the directory enumeration state
+  // and rebuilding it on restart, which duplicates the application's handle again. Afterwards the
+  // application's own handle is expected to observe the cursor left behind by the duplicates.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DuplicatedHandleSharesCursor)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+    constexpr unsigned int kNumFiles = 3000;
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    ScopedPerformanceSettings scopedPerformanceSettings;
+    Globals::PerformanceSettings().directoryEnumerationReadAhead = true;
+
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::RealOpenedPath)});
+    auto instructionSourceFunc = [&testInstruction](
+                                     std::wstring_view,
+                                     std::wstring_view,
+                                     RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+        -> DirectoryEnumerationInstruction
+    {
+      return testInstruction;
+    };
+
+    MockFilesystemOperations mockFilesystem;
+    for (unsigned int i = 0; i < kNumFiles; ++i)
+    {
+      Infra::TemporaryString fileAbsolutePath;
+      fileAbsolutePath << kTestDirectory << L'\\'
+                       << Infra::Strings::Format(L"File%05u.txt", i).AsStringView();
+      mockFilesystem.AddFile(fileAbsolutePath.AsStringView());
+    }
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+
+    // The output buffer is kept small so that each directory enumeration queue buffer is consumed
+    // over multiple calls, which gives reading ahead time to take place.
+    std::array<uint8_t, 2048> enumerationOutputBytes{};
+
+    for (int i = 0; i < 2; ++i)
+    {
+      std::vector<std::wstring> actualFilenames;
+      ULONG queryFlags = ((0 == i) ? 0 : SL_RESTART_SCAN);
+      bool duplicatedHandleVerified = false;
+
+      while (true)
+      {
+        const std::optional<NTSTATUS> prepareResult =
+            FilesystemExecutor::DirectoryEnumerationPrepare(
+                TestCaseName().data(),
+                kFunctionRequestIdentifier,
+                openHandleStore,
+                directoryHandle,
+                enumerationOutputBytes.data(),
+                static_cast<ULONG>(enumerationOutputBytes.size()),
+                kFileNamesInformationClass,
+                nullptr,
+                instructionSourceFunc);
+        TEST_ASSERT(prepareResult == NtStatus::kSuccess);
+
+        IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+        const NTSTATUS advanceResult = FilesystemExecutor::DirectoryEnumerationAdvance(
+            TestCaseName().data(),
+            kFunctionRequestIdentifier,
+            openHandleStore,
+            directoryHandle,
+            nullptr,
+            nullptr,
+            nullptr,
+            &ioStatusBlock,
+            enumerationOutputBytes.data(),
+            static_cast<ULONG>(enumerationOutputBytes.size()),
+            kFileNamesInformationClass,
+            queryFlags,
+            nullptr);
+        TEST_ASSERT(ioStatusBlock.Status == advanceResult);
+        queryFlags = 0;
+
+        if (NtStatus::kNoMoreFiles == advanceResult) break;
+        TEST_ASSERT(NtStatus::kSuccess == advanceResult);
+
+        if (false == duplicatedHandleVerified)
+        {
+          const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+              SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+          TEST_ASSERT(
+              DirectoryOperationQueueTypeIs<EnumerationQueue>(*directoryEnumerationState.queue));
+
+          const EnumerationQueue* const enumerationQueue =
+              static_cast<const EnumerationQueue*>(directoryEnumerationState.queue);
+          TEST_ASSERT(true == enumerationQueue->IsReadAheadEnabled());
+          TEST_ASSERT(
+              mockFilesystem.GetDuplicationSourceFromHandle(
+                  enumerationQueue->GetDirectoryHandle()) == directoryHandle);
+
+          duplicatedHandleVerified = true;
+        }
+
+        unsigned int bytePosition = 0;
+        while (true)
+        {
+          const void* const fileInformationStruct = &enumerationOutputBytes[bytePosition];
+          actualFilenames.emplace_back(fileNameStructLayout.ReadFileName(fileInformationStruct));
+
+          const unsigned int nextEntryOffset =
+              fileNameStructLayout.ReadNextEntryOffset(fileInformationStruct);
+          if (0 == nextEntryOffset) break;
+          bytePosition += nextEntryOffset;
+        }
+      }
+
+      TEST_ASSERT(true == duplicatedHandleVerified);
+      TEST_ASSERT(kNumFiles == actualFilenames.size());
+      for (unsigned int j = 0; j < kNumFiles; ++j)
+        TEST_ASSERT(
+            actualFilenames[j] == Infra::Strings::Format(L"File%05u.txt", j).AsStringView());
+
+      const SDirectoryEnumerationStateSnapshot drainedDirectoryEnumerationState =
+          SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+      TEST_ASSERT(true == drainedDirectoryEnumerationState.isDrained);
+      TEST_ASSERT(nullptr == drainedDirectoryEnumerationState.queue);
+    }
+
+    // The duplicates left the shared cursor at the end of the directory, so the application's own
+    // handle only produces more files once it restarts the scan.
+    Infra::TemporaryVector<uint8_t> applicationOutputBytes;
+    TEST_ASSERT(
+        NtStatus::kNoMoreFiles ==
+        mockFilesystem.PartialEnumerateDirectoryContents(
+            directoryHandle,
+            kFileNamesInformationClass,
+            applicationOutputBytes.Data(),
+            applicationOutputBytes.CapacityBytes(),
+            0,
+            std::wstring_view()));
+    TEST_ASSERT(
+        NtStatus::kSuccess ==
+        mockFilesystem.PartialEnumerateDirectoryContents(
+            directoryHandle,
+            kFileNamesInformationClass,
+            applicationOutputBytes.Data(),
+            applicationOutputBytes.CapacityBytes(),
+            SL_RESTART_SCAN,
+            std::wstring_view()));
+    TEST_ASSERT(
+        fileNameStructLayout.ReadFileName(applicationOutputBytes.Data()) == L"File00000.txt");
+  }
+
   // Verifies that, after all files are enumerated, restarting the enumeration results in them being
   // properly enumerated all over again.
   TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_RestartEnumeration)
@@ -967,20 +1471,22 @@ namespace PathwinderTest
     TEST_ASSERT(actualBytesWritten == expectedBytesWritten);
   }
 
-  // Verifies single-stepped directory enumeration advancement whereby one file information
-  // structure is copied to the output buffer each invocation. Checks that the file information
-  // structures are copied correctly and that all of them are copied.
-  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_SingleEntry)
+  // Verifies that files enumerated from multiple sorted queues containing the same filenames are
+  // deduplicated such that each filename is enumerated exactly once, and that doing so never
+  // requires falling back to retaining the complete set of filenames enumerated so far.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DeduplicateWithBoundedMemory)
   {
     constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+    constexpr unsigned int kNumFilesPerQueue = 1000;
 
     constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
         SFileNamesInformation::kFileInformationClass;
     const FileInformationStructLayout fileNameStructLayout =
         *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
 
-    const MockDirectoryOperationQueue::TFileNamesToEnumerate expectedEnumeratedFilenames = {
-        L"file1.txt", L"00file2.txt", L"FILE3.log", L"app1.exe", L"binfile.bin"};
+    MockDirectoryOperationQueue::TFileNamesToEnumerate expectedEnumeratedFilenames;
+    for (unsigned int i = 0; i < kNumFilesPerQueue; ++i)
+      expectedEnumeratedFilenames.emplace(L"file" + std::to_wstring(i) + L".txt");
 
     MockFilesystemOperations mockFilesystem;
     mockFilesystem.AddDirectory(kTestDirectory);
@@ -992,15 +1498,316 @@ namespace PathwinderTest
         directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
     openHandleStore.AssociateDirectoryEnumerationState(
         directoryHandle,
-        std::make_unique<MockDirectoryOperationQueue>(
-            fileNameStructLayout,
-            MockDirectoryOperationQueue::TFileNamesToEnumerate(expectedEnumeratedFilenames)),
-        fileNameStructLayout);
-
-    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
-    MockDirectoryOperationQueue::TFileNamesToEnumerate actualEnumeratedFilenames;
-
-    for (size_t i = 0; i < expectedEnumeratedFilenames.size(); ++i)
+        std::make_unique<MergedFileInformationQueue>(MergedFileInformationQueue::Create<3>({
+            std::make_unique<MockDirectoryOperationQueue>(
+                fileNameStructLayout,
+                MockDirectoryOperationQueue::TFileNamesToEnumerate(expectedEnumeratedFilenames)),
+            std::make_unique<MockDirectoryOperationQueue>(
+                fileNameStructLayout,
+                MockDirectoryOperationQueue::TFileNamesToEnumerate(expectedEnumeratedFilenames)),
+            std::make_unique<MockDirectoryOperationQueue>(
+                fileNameStructLayout,
+                MockDirectoryOperationQueue::TFileNamesToEnumerate(expectedEnumeratedFilenames)),
+        })),
+        fileNameStructLayout);
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+    MockDirectoryOperationQueue::TFileNamesToEnumerate actualEnumeratedFilenames;
+    unsigned int numFilesEnumerated = 0;
+
+    while (true)
+    {
+      IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+      const NTSTATUS actualReturnCode = FilesystemExecutor::DirectoryEnumerationAdvance(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          nullptr,
+          nullptr,
+          nullptr,
+          &ioStatusBlock,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          SL_RETURN_SINGLE_ENTRY,
+          nullptr);
+      if (NtStatus::kNoMoreFiles == actualReturnCode) break;
+
+      TEST_ASSERT(actualReturnCode == NtStatus::kSuccess);
+      TEST_ASSERT(
+          true ==
+          actualEnumeratedFilenames
+              .emplace(fileNameStructLayout.ReadFileName(enumerationOutputBytes.Data()))
+              .second);
+      numFilesEnumerated += 1;
+
+      TEST_ASSERT(false ==
+                  SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore)
+                      .unsortedEnumeratedFilenames.has_value());
+    }
+
+    TEST_ASSERT(actualEnumeratedFilenames == expectedEnumeratedFilenames);
+    TEST_ASSERT(numFilesEnumerated == kNumFilesPerQueue);
+  }
+
+  // Verifies that files enumerated are deduplicated even if one of the queues produces filenames
+  // out of sorted order. In this situation duplicates are not necessarily adjacent, so the
+  // complete set of enumerated filenames is expected to be used for deduplication.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DeduplicateUnsortedQueue)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    const MockDirectoryOperationQueue::TFileNamesToEnumerate expectedEnumeratedFilenames = {
+        L"a.txt", L"b.txt", L"c.txt", L"d.txt", L"e.txt"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kTestDirectory);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+    openHandleStore.AssociateDirectoryEnumerationState(
+        directoryHandle,
+        std::make_unique<MergedFileInformationQueue>(MergedFileInformationQueue::Create<2>({
+            std::make_unique<MockDirectoryOperationQueue>(
+                fileNameStructLayout,
+                MockDirectoryOperationQueue::TFileNamesToEnumerate(
+                    {L"a.txt", L"b.txt", L"c.txt", L"d.txt"})),
+            std::make_unique<MockDirectoryOperationQueue>(
+                fileNameStructLayout,
+                MockDirectoryOperationQueue::TUnsortedFileNamesToEnumerate(
+                    {L"D.TXT", L"A.TXT", L"e.txt", L"b.txt"})),
+        })),
+        fileNameStructLayout);
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+    MockDirectoryOperationQueue::TFileNamesToEnumerate actualEnumeratedFilenames;
+    unsigned int numFilesEnumerated = 0;
+
+    while (true)
+    {
+      IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+      const NTSTATUS actualReturnCode = FilesystemExecutor::DirectoryEnumerationAdvance(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          nullptr,
+          nullptr,
+          nullptr,
+          &ioStatusBlock,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          SL_RETURN_SINGLE_ENTRY,
+          nullptr);
+      if (NtStatus::kNoMoreFiles == actualReturnCode) break;
+
+      TEST_ASSERT(actualReturnCode == NtStatus::kSuccess);
+      actualEnumeratedFilenames.emplace(
+          fileNameStructLayout.ReadFileName(enumerationOutputBytes.Data()));
+      numFilesEnumerated += 1;
+    }
+
+    TEST_ASSERT(actualEnumeratedFilenames == expectedEnumeratedFilenames);
+    TEST_ASSERT(numFilesEnumerated == expectedEnumeratedFilenames.size());
+    TEST_ASSERT(true ==
+                SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore)
+                    .unsortedEnumeratedFilenames.has_value());
+  }
+
+  // Verifies that files enumerated are deduplicated without any problems if one of the queues
+  // produces filenames out of sorted order and the directory contents shrink before the queues are
+  // replayed to rebuild the deduplication state. The replay runs out of filenames before reaching
+  // the position of the original pass, so enumeration is expected to end without any filename
+  // being enumerated more than once.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_DeduplicateShrinkDuringReplay)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    const MockDirectoryOperationQueue::TFileNamesToEnumerate expectedEnumeratedFilenames = {
+        L"a.txt", L"b.txt", L"c.txt", L"d.txt"};
+
+    auto sortedQueue = std::make_unique<MockDirectoryOperationQueue>(
+        fileNameStructLayout,
+        MockDirectoryOperationQueue::TFileNamesToEnumerate(
+            {L"a.txt", L"b.txt", L"c.txt", L"d.txt"}));
+    sortedQueue->SetFileNamesToEnumerateAfterRestart({L"a.txt"});
+
+    auto unsortedQueue = std::make_unique<MockDirectoryOperationQueue>(
+        fileNameStructLayout,
+        MockDirectoryOperationQueue::TUnsortedFileNamesToEnumerate(
+            {L"D.TXT", L"A.TXT", L"e.txt", L"b.txt"}));
+    unsortedQueue->SetFileNamesToEnumerateAfterRestart({L"A.TXT"});
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kTestDirectory);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+    openHandleStore.AssociateDirectoryEnumerationState(
+        directoryHandle,
+        std::make_unique<MergedFileInformationQueue>(MergedFileInformationQueue::Create<2>(
+            {std::move(sortedQueue), std::move(unsortedQueue)})),
+        fileNameStructLayout);
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+    MockDirectoryOperationQueue::TFileNamesToEnumerate actualEnumeratedFilenames;
+    NTSTATUS actualReturnCode = NtStatus::kSuccess;
+
+    while (true)
+    {
+      IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+      actualReturnCode = FilesystemExecutor::DirectoryEnumerationAdvance(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          nullptr,
+          nullptr,
+          nullptr,
+          &ioStatusBlock,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          SL_RETURN_SINGLE_ENTRY,
+          nullptr);
+      if (NtStatus::kSuccess != actualReturnCode) break;
+
+      TEST_ASSERT(
+          true ==
+          actualEnumeratedFilenames
+              .emplace(fileNameStructLayout.ReadFileName(enumerationOutputBytes.Data()))
+              .second);
+    }
+
+    TEST_ASSERT(actualReturnCode == NtStatus::kNoMoreFiles);
+    TEST_ASSERT(actualEnumeratedFilenames == expectedEnumeratedFilenames);
+  }
+
+  // Verifies that the query file pattern supplied by the application when the directory
+  // enumeration was first requested is used again when the queue is replayed to rebuild the
+  // deduplication state after being observed to produce filenames out of sorted order.
+  TEST_CASE(
+      FilesystemExecutor_DirectoryEnumerationAdvance_DeduplicateUnsortedQueueReplayFilePattern)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+    constexpr std::wstring_view kTestFilePattern = L"*.txt";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    const MockDirectoryOperationQueue::TFileNamesToEnumerate expectedEnumeratedFilenames = {
+        L"a.txt", L"b.txt", L"c.txt"};
+
+    auto unsortedQueue = std::make_unique<MockDirectoryOperationQueue>(
+        fileNameStructLayout,
+        MockDirectoryOperationQueue::TUnsortedFileNamesToEnumerate(
+            {L"b.txt", L"a.txt", L"c.txt"}));
+    const MockDirectoryOperationQueue* const directoryOperationQueue = unsortedQueue.get();
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kTestDirectory);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+    openHandleStore.AssociateDirectoryEnumerationState(
+        directoryHandle,
+        std::move(unsortedQueue),
+        fileNameStructLayout,
+        OpenHandleStore::TDirectoryEnumerationInstructionSource(),
+        kTestFilePattern);
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+    MockDirectoryOperationQueue::TFileNamesToEnumerate actualEnumeratedFilenames;
+    NTSTATUS actualReturnCode = NtStatus::kSuccess;
+
+    while (true)
+    {
+      IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
+      actualReturnCode = FilesystemExecutor::DirectoryEnumerationAdvance(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          nullptr,
+          nullptr,
+          nullptr,
+          &ioStatusBlock,
+          enumerationOutputBytes.Data(),
+          enumerationOutputBytes.CapacityBytes(),
+          kFileNamesInformationClass,
+          SL_RETURN_SINGLE_ENTRY,
+          nullptr);
+      if (NtStatus::kSuccess != actualReturnCode) break;
+
+      TEST_ASSERT(
+          true ==
+          actualEnumeratedFilenames
+              .emplace(fileNameStructLayout.ReadFileName(enumerationOutputBytes.Data()))
+              .second);
+    }
+
+    TEST_ASSERT(actualReturnCode == NtStatus::kNoMoreFiles);
+    TEST_ASSERT(actualEnumeratedFilenames == expectedEnumeratedFilenames);
+    TEST_ASSERT(directoryOperationQueue->GetLastRestartedQueryFilePattern() == kTestFilePattern);
+  }
+
+  // Verifies single-stepped directory enumeration advancement whereby one file information
+  // structure is copied to the output buffer each invocation. Checks that the file information
+  // structures are copied correctly and that all of them are copied.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationAdvance_SingleEntry)
+  {
+    constexpr std::wstring_view kTestDirectory = L"X:\\Test\\Directory";
+
+    constexpr FILE_INFORMATION_CLASS kFileNamesInformationClass =
+        SFileNamesInformation::kFileInformationClass;
+    const FileInformationStructLayout fileNameStructLayout =
+        *FileInformationStructLayout::LayoutForFileInformationClass(kFileNamesInformationClass);
+
+    const MockDirectoryOperationQueue::TFileNamesToEnumerate expectedEnumeratedFilenames = {
+        L"file1.txt", L"00file2.txt", L"FILE3.log", L"app1.exe", L"binfile.bin"};
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kTestDirectory);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kTestDirectory);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kTestDirectory), std::wstring(kTestDirectory));
+    openHandleStore.AssociateDirectoryEnumerationState(
+        directoryHandle,
+        std::make_unique<MockDirectoryOperationQueue>(
+            fileNameStructLayout,
+            MockDirectoryOperationQueue::TFileNamesToEnumerate(expectedEnumeratedFilenames)),
+        fileNameStructLayout);
+
+    Infra::TemporaryVector<uint8_t> enumerationOutputBytes;
+    MockDirectoryOperationQueue::TFileNamesToEnumerate actualEnumeratedFilenames;
+
+    for (size_t i = 0; i < expectedEnumeratedFilenames.size(); ++i)
     {
       IO_STATUS_BLOCK ioStatusBlock = InitializeIoStatusBlock();
 
@@ -1187,12 +1994,14 @@ namespace PathwinderTest
     }
   }
 
-  // Verifies that the correct paths for the provided directory handle are provided to the
-  // instruction source function when preparing to start a directory enumeration operation.
+  // Verifies that the correct paths and redirecting rule position index for the provided directory
+  // handle are provided to the instruction source function when preparing to start a directory
+  // enumeration operation.
   TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_InstructionSourcePathSelection)
   {
     constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
     constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+    constexpr RelatedFilesystemRuleContainer::TFilesystemRulesIndex kRedirectingRuleIndex = 3;
 
     std::array<uint8_t, 256> unusedBuffer{};
 
@@ -1204,7 +2013,10 @@ namespace PathwinderTest
 
     OpenHandleStore openHandleStore;
     openHandleStore.InsertHandle(
-        directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
+        directoryHandle,
+        std::wstring(kAssociatedPath),
+        std::wstring(kRealOpenedPath),
+        kRedirectingRuleIndex);
 
     bool instructionSourceFuncInvoked = false;
 
@@ -1219,10 +2031,13 @@ namespace PathwinderTest
         nullptr,
         [&instructionSourceFuncInvoked](
             std::wstring_view associatedPath,
-            std::wstring_view realOpenedPath) -> DirectoryEnumerationInstruction
+            std::wstring_view realOpenedPath,
+            RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)
+            -> DirectoryEnumerationInstruction
         {
           TEST_ASSERT(associatedPath == kAssociatedPath);
           TEST_ASSERT(realOpenedPath == kRealOpenedPath);
+          TEST_ASSERT(redirectingRuleIndex == kRedirectingRuleIndex);
 
           instructionSourceFuncInvoked = true;
           return DirectoryEnumerationInstruction::PassThroughUnmodifiedQuery();
@@ -1275,7 +2090,11 @@ namespace PathwinderTest
               static_cast<ULONG>(unusedBuffer.size()),
               SFileNamesInformation::kFileInformationClass,
               nullptr,
-              [](std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+              [](
+                  std::wstring_view,
+                  std::wstring_view,
+                  RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                  -> DirectoryEnumerationInstruction
               {
                 TEST_FAILED_BECAUSE(L"Unexpected invocation of instruction source function.");
               });
@@ -1333,7 +2152,11 @@ namespace PathwinderTest
               static_cast<ULONG>(unusedBuffer.size()),
               SFileNamesInformation::kFileInformationClass,
               nullptr,
-              [](std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+              [](
+                  std::wstring_view,
+                  std::wstring_view,
+                  RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                  -> DirectoryEnumerationInstruction
               {
                 TEST_FAILED_BECAUSE(L"Unexpected invocation of instruction source function.");
               });
@@ -1379,7 +2202,11 @@ namespace PathwinderTest
             static_cast<ULONG>(tooSmallBuffer.size()),
             SFileNamesInformation::kFileInformationClass,
             nullptr,
-            [](std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+            [](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               TEST_FAILED_BECAUSE(L"Unexpected invocation of instruction source function.");
             });
@@ -1420,7 +2247,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             nullptr,
             [&instructionSourceFuncInvoked](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               instructionSourceFuncInvoked = true;
               return DirectoryEnumerationInstruction::PassThroughUnmodifiedQuery();
@@ -1461,7 +2291,11 @@ namespace PathwinderTest
             static_cast<ULONG>(unusedBuffer.size()),
             SFileBasicInformation::kFileInformationClass,
             nullptr,
-            [](std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+            [](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               TEST_FAILED_BECAUSE(L"Unexpected invocation of instruction source function.");
             });
@@ -1497,7 +2331,11 @@ namespace PathwinderTest
             static_cast<ULONG>(unusedBuffer.size()),
             SFileNamesInformation::kFileInformationClass,
             nullptr,
-            [](std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+            [](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               TEST_FAILED_BECAUSE(L"Unexpected invocation of instruction source function.");
             });
@@ -1548,7 +2386,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             nullptr,
             [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               return testInstruction;
             });
@@ -1633,7 +2474,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             nullptr,
             [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               return testInstruction;
             });
@@ -1719,7 +2563,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             &filePatternUnicodeString,
             [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               return testInstruction;
             });
@@ -1798,7 +2645,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             nullptr,
             [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               return testInstruction;
             });
@@ -1807,91 +2657,549 @@ namespace PathwinderTest
     TEST_ASSERT(
         openHandleStore.GetDataForHandle(directoryHandle)->directoryEnumeration.has_value());
 
-    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
-        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+
+    // Created queues are examined in detail at this point. The specific checks used here are based
+    // on the expected result, which is documented along with the directory enumeration instruction
+    // used in this test case.
+    VerifyIsNameInsertionQueueAndMatchesSpec(
+        directoryEnumerationState.queue,
+        {singleNameInsertionInstructions[0]},
+        SFileNamesInformation::kFileInformationClass);
+  }
+
+  // Verifies that the correct type of directory enumeration queue is created when the instruction
+  // specifies to enumerate a specific set of directories as the entire output of the enumeration.
+  // This test models the situation in which application specified a file pattern, meaning that it
+  // is expected to be associated with the open directory handle and used to filter enumeration
+  // output.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_NameInsertionWithQueryFilePattern)
+  {
+    constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
+    constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+
+    std::array<uint8_t, 256> unusedBuffer{};
+
+    // Expected result is a single name insertion queue.
+    const FilesystemRule filesystemRules[] = {
+        FilesystemRule(L"", kAssociatedPath, kRealOpenedPath)};
+    const DirectoryEnumerationInstruction::SingleDirectoryNameInsertion
+        singleNameInsertionInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryNameInsertion(filesystemRules[0])};
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::UseOnlyRuleOriginDirectoryNames(
+            {singleNameInsertionInstructions[0]});
+
+    constexpr std::wstring_view kQueryFilePattern = L"*.txt";
+    UNICODE_STRING filePatternUnicodeString =
+        Strings::NtConvertStringViewToUnicodeString(kQueryFilePattern);
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kAssociatedPath);
+    mockFilesystem.AddDirectory(kRealOpenedPath);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kRealOpenedPath);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
+
+    const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
+    const std::optional<NTSTATUS> actualReturnValue =
+        FilesystemExecutor::DirectoryEnumerationPrepare(
+            TestCaseName().data(),
+            kFunctionRequestIdentifier,
+            openHandleStore,
+            directoryHandle,
+            unusedBuffer.data(),
+            static_cast<ULONG>(unusedBuffer.size()),
+            SFileNamesInformation::kFileInformationClass,
+            &filePatternUnicodeString,
+            [&testInstruction](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
+            {
+              return testInstruction;
+            });
+
+    TEST_ASSERT(actualReturnValue == expectedReturnValue);
+    TEST_ASSERT(
+        openHandleStore.GetDataForHandle(directoryHandle)->directoryEnumeration.has_value());
+
+    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+
+    // Created queues are examined in detail at this point. The specific checks used here are based
+    // on the expected result, which is documented along with the directory enumeration instruction
+    // used in this test case.
+    VerifyIsNameInsertionQueueAndMatchesSpec(
+        directoryEnumerationState.queue,
+        {singleNameInsertionInstructions[0]},
+        SFileNamesInformation::kFileInformationClass,
+        kQueryFilePattern);
+  }
+
+  // Verifies that the correct type of directory enumeration queues are created when the instruction
+  // specifies both directory enumeration and name insertion.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_CombinedNameInsertionAndEnumeration)
+  {
+    constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
+    constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+    constexpr std::wstring_view kOriginDirectory = L"E:\\OriginPath1";
+    constexpr std::wstring_view kTargetDirectory = L"E:\\TargetPath2";
+
+    std::array<uint8_t, 256> unusedBuffer{};
+
+    // Expected result is a single name insertion queue.
+    const FilesystemRule filesystemRules[] = {
+        FilesystemRule(L"", kOriginDirectory, kTargetDirectory)};
+    const DirectoryEnumerationInstruction::SingleDirectoryEnumeration
+        singleEnumerationInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath),
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::RealOpenedPath)};
+    const DirectoryEnumerationInstruction::SingleDirectoryNameInsertion
+        singleNameInsertionInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryNameInsertion(filesystemRules[0])};
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectoriesAndInsertRuleOriginDirectoryNames(
+            {singleEnumerationInstructions[0], singleEnumerationInstructions[1]},
+            {singleNameInsertionInstructions[0]});
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kAssociatedPath);
+    mockFilesystem.AddDirectory(kRealOpenedPath);
+    mockFilesystem.AddDirectory(kOriginDirectory);
+    mockFilesystem.AddDirectory(kTargetDirectory);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kRealOpenedPath);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
+
+    const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
+    const std::optional<NTSTATUS> actualReturnValue =
+        FilesystemExecutor::DirectoryEnumerationPrepare(
+            TestCaseName().data(),
+            kFunctionRequestIdentifier,
+            openHandleStore,
+            directoryHandle,
+            unusedBuffer.data(),
+            static_cast<ULONG>(unusedBuffer.size()),
+            SFileNamesInformation::kFileInformationClass,
+            nullptr,
+            [&testInstruction](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
+            {
+              return testInstruction;
+            });
+
+    TEST_ASSERT(actualReturnValue == expectedReturnValue);
+    TEST_ASSERT(
+        openHandleStore.GetDataForHandle(directoryHandle)->directoryEnumeration.has_value());
+
+    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+
+    // Created queues are examined in detail at this point. The specific checks used here are based
+    // on the expected result, which is documented along with the directory enumeration instruction
+    // used in this test case.
+    TEST_ASSERT(DirectoryOperationQueueTypeIs<MergedFileInformationQueue>(
+        *directoryEnumerationState.queue));
+
+    MergedFileInformationQueue* topLevelMergeQueue =
+        static_cast<MergedFileInformationQueue*>(directoryEnumerationState.queue);
+
+    TEST_ASSERT(3 == topLevelMergeQueue->GetUnderlyingQueueCount());
+    VerifyIsEnumerationQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(0),
+        mockFilesystem,
+        singleEnumerationInstructions[0],
+        kAssociatedPath,
+        SFileNamesInformation::kFileInformationClass);
+    VerifyIsEnumerationQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(1),
+        mockFilesystem,
+        singleEnumerationInstructions[1],
+        kRealOpenedPath,
+        SFileNamesInformation::kFileInformationClass);
+    VerifyIsNameInsertionQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(2),
+        {singleNameInsertionInstructions[0]},
+        SFileNamesInformation::kFileInformationClass);
+  }
+
+  // Verifies that enumerating the real opened path of a directory handle reuses the application's
+  // own handle, by way of duplication, rather than opening the same directory again. Other
+  // directory path sources still require that their directories be opened.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_RealOpenedPathReusesApplicationHandle)
+  {
+    constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
+    constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+
+    std::array<uint8_t, 256> unusedBuffer{};
+
+    const DirectoryEnumerationInstruction::SingleDirectoryEnumeration
+        singleEnumerationInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath),
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::RealOpenedPath)};
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {singleEnumerationInstructions[0], singleEnumerationInstructions[1]});
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kAssociatedPath);
+    mockFilesystem.AddDirectory(kRealOpenedPath);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(kRealOpenedPath);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
+
+    const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
+    const std::optional<NTSTATUS> actualReturnValue =
+        FilesystemExecutor::DirectoryEnumerationPrepare(
+            TestCaseName().data(),
+            kFunctionRequestIdentifier,
+            openHandleStore,
+            directoryHandle,
+            unusedBuffer.data(),
+            static_cast<ULONG>(unusedBuffer.size()),
+            SFileNamesInformation::kFileInformationClass,
+            nullptr,
+            [&testInstruction](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
+            {
+              return testInstruction;
+            });
+
+    TEST_ASSERT(actualReturnValue == expectedReturnValue);
+
+    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+
+    TEST_ASSERT(DirectoryOperationQueueTypeIs<MergedFileInformationQueue>(
+        *directoryEnumerationState.queue));
+
+    MergedFileInformationQueue* topLevelMergeQueue =
+        static_cast<MergedFileInformationQueue*>(directoryEnumerationState.queue);
+
+    TEST_ASSERT(2 == topLevelMergeQueue->GetUnderlyingQueueCount());
+    VerifyIsEnumerationQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(0),
+        mockFilesystem,
+        singleEnumerationInstructions[0],
+        kAssociatedPath,
+        SFileNamesInformation::kFileInformationClass);
+    VerifyIsEnumerationQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(1),
+        mockFilesystem,
+        singleEnumerationInstructions[1],
+        kRealOpenedPath,
+        SFileNamesInformation::kFileInformationClass);
+
+    const HANDLE associatedPathEnumerationHandle =
+        static_cast<const EnumerationQueue*>(topLevelMergeQueue->GetUnderlyingQueue(0))
+            ->GetDirectoryHandle();
+    const HANDLE realOpenedPathEnumerationHandle =
+        static_cast<const EnumerationQueue*>(topLevelMergeQueue->GetUnderlyingQueue(1))
+            ->GetDirectoryHandle();
+
+    TEST_ASSERT(
+        mockFilesystem.GetDuplicationSourceFromHandle(associatedPathEnumerationHandle) == nullptr);
+    TEST_ASSERT(
+        mockFilesystem.GetDuplicationSourceFromHandle(realOpenedPathEnumerationHandle) ==
+        directoryHandle);
+  }
+
+  // Verifies that enumerating the real opened path of a directory handle falls back to opening the
+  // directory again if the application's handle is not suitable for synchronous enumeration.
+  TEST_CASE(
+      FilesystemExecutor_DirectoryEnumerationPrepare_RealOpenedPathAsynchronousHandleOpensDirectory)
+  {
+    constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
+    constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+
+    std::array<uint8_t, 256> unusedBuffer{};
+
+    const DirectoryEnumerationInstruction::SingleDirectoryEnumeration
+        singleEnumerationInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath),
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::RealOpenedPath)};
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {singleEnumerationInstructions[0], singleEnumerationInstructions[1]});
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kAssociatedPath);
+    mockFilesystem.AddDirectory(kRealOpenedPath);
+
+    const HANDLE directoryHandle = mockFilesystem.Open(
+        kRealOpenedPath, MockFilesystemOperations::EOpenHandleMode::Asynchronous);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
+
+    const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
+    const std::optional<NTSTATUS> actualReturnValue =
+        FilesystemExecutor::DirectoryEnumerationPrepare(
+            TestCaseName().data(),
+            kFunctionRequestIdentifier,
+            openHandleStore,
+            directoryHandle,
+            unusedBuffer.data(),
+            static_cast<ULONG>(unusedBuffer.size()),
+            SFileNamesInformation::kFileInformationClass,
+            nullptr,
+            [&testInstruction](
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
+            {
+              return testInstruction;
+            });
+
+    TEST_ASSERT(actualReturnValue == expectedReturnValue);
+
+    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+
+    TEST_ASSERT(DirectoryOperationQueueTypeIs<MergedFileInformationQueue>(
+        *directoryEnumerationState.queue));
+
+    MergedFileInformationQueue* topLevelMergeQueue =
+        static_cast<MergedFileInformationQueue*>(directoryEnumerationState.queue);
+
+    TEST_ASSERT(2 == topLevelMergeQueue->GetUnderlyingQueueCount());
+    VerifyIsEnumerationQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(0),
+        mockFilesystem,
+        singleEnumerationInstructions[0],
+        kAssociatedPath,
+        SFileNamesInformation::kFileInformationClass);
+    VerifyIsEnumerationQueueAndMatchesSpec(
+        topLevelMergeQueue->GetUnderlyingQueue(1),
+        mockFilesystem,
+        singleEnumerationInstructions[1],
+        kRealOpenedPath,
+        SFileNamesInformation::kFileInformationClass);
+
+    const HANDLE associatedPathEnumerationHandle =
+        static_cast<const EnumerationQueue*>(topLevelMergeQueue->GetUnderlyingQueue(0))
+            ->GetDirectoryHandle();
+    const HANDLE realOpenedPathEnumerationHandle =
+        static_cast<const EnumerationQueue*>(topLevelMergeQueue->GetUnderlyingQueue(1))
+            ->GetDirectoryHandle();
+
+    TEST_ASSERT(
+        mockFilesystem.GetDuplicationSourceFromHandle(associatedPathEnumerationHandle) == nullptr);
+    TEST_ASSERT(
+        mockFilesystem.GetDuplicationSourceFromHandle(realOpenedPathEnumerationHandle) ==
+        nullptr);
+  }
+
+  // Verifies that, when directory listing caching is enabled, a directory enumeration is served
+  // from the cache after the same directory is enumerated once, and that successfully creating a
+  // new file in that directory invalidates the cached listing.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_ListingCacheInvalidatedByNewFile)
+  {
+    constexpr std::wstring_view kDirectoryPath = L"C:\\ListingCacheInvalidatedByNewFile";
+    constexpr std::wstring_view kNewFilePath =
+        L"C:\\ListingCacheInvalidatedByNewFile\\NewFile.txt";
+
+    ScopedPerformanceSettings scopedPerformanceSettings;
+    Globals::PerformanceSettings().directoryEnumerationListingCacheTimeToLiveMilliseconds = 60000;
+
+    std::array<uint8_t, 256> unusedBuffer{};
+
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath)});
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\ListingCacheInvalidatedByNewFile\\ExistingFile.txt");
+
+    OpenHandleStore openHandleStore;
+
+    auto prepareAndDrainEnumerationQueue = [&]() -> bool
+    {
+      const HANDLE directoryHandle = mockFilesystem.Open(kDirectoryPath);
+      openHandleStore.InsertHandle(
+          directoryHandle, std::wstring(kDirectoryPath), std::wstring(kDirectoryPath));
+
+      const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
+      const std::optional<NTSTATUS> actualReturnValue =
+          FilesystemExecutor::DirectoryEnumerationPrepare(
+              TestCaseName().data(),
+              kFunctionRequestIdentifier,
+              openHandleStore,
+              directoryHandle,
+              unusedBuffer.data(),
+              static_cast<ULONG>(unusedBuffer.size()),
+              SFileNamesInformation::kFileInformationClass,
+              nullptr,
+              [&testInstruction](
+                  std::wstring_view,
+                  std::wstring_view,
+                  RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                  -> DirectoryEnumerationInstruction
+              {
+                return testInstruction;
+              });
+      TEST_ASSERT(actualReturnValue == expectedReturnValue);
+
+      const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+          SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+      TEST_ASSERT(
+          DirectoryOperationQueueTypeIs<EnumerationQueue>(*directoryEnumerationState.queue));
+
+      EnumerationQueue* enumerationQueue =
+          static_cast<EnumerationQueue*>(directoryEnumerationState.queue);
+      const bool isServingCachedListing = enumerationQueue->IsServingCachedListing();
+      while (NT_SUCCESS(enumerationQueue->EnumerationStatus())) enumerationQueue->PopFront();
+
+      return isServingCachedListing;
+    };
+
+    TEST_ASSERT(false == prepareAndDrainEnumerationQueue());
+    TEST_ASSERT(true == prepareAndDrainEnumerationQueue());
+
+    UNICODE_STRING unicodeStringNewFilePath =
+        Strings::NtConvertStringViewToUnicodeString(kNewFilePath);
+    OBJECT_ATTRIBUTES objectAttributesNewFilePath =
+        CreateObjectAttributes(unicodeStringNewFilePath);
+    HANDLE newFileHandle = NULL;
 
-    // Created queues are examined in detail at this point. The specific checks used here are based
-    // on the expected result, which is documented along with the directory enumeration instruction
-    // used in this test case.
-    VerifyIsNameInsertionQueueAndMatchesSpec(
-        directoryEnumerationState.queue,
-        {singleNameInsertionInstructions[0]},
-        SFileNamesInformation::kFileInformationClass);
+    const NTSTATUS newFileHandleResult = FilesystemExecutor::NewFileHandle(
+        TestCaseName().data(),
+        kFunctionRequestIdentifier,
+        openHandleStore,
+        &newFileHandle,
+        GENERIC_WRITE,
+        &objectAttributesNewFilePath,
+        0,
+        FILE_CREATE,
+        0,
+        [](std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+            -> FileOperationInstruction
+        {
+          return FileOperationInstruction::NoRedirectionOrInterception();
+        },
+        [&mockFilesystem, kNewFilePath](PHANDLE handle, POBJECT_ATTRIBUTES, ULONG) -> NTSTATUS
+        {
+          mockFilesystem.AddFile(kNewFilePath);
+          *handle = mockFilesystem.Open(kNewFilePath);
+          return NtStatus::kSuccess;
+        });
+    TEST_ASSERT(NtStatus::kSuccess == newFileHandleResult);
+
+    TEST_ASSERT(false == prepareAndDrainEnumerationQueue());
+    TEST_ASSERT(true == prepareAndDrainEnumerationQueue());
   }
 
-  // Verifies that the correct type of directory enumeration queue is created when the instruction
-  // specifies to enumerate a specific set of directories as the entire output of the enumeration.
-  // This test models the situation in which application specified a file pattern, meaning that it
-  // is expected to be associated with the open directory handle and used to filter enumeration
-  // output.
-  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_NameInsertionWithQueryFilePattern)
+  // Opens a directory handle and prefetches the directory listings that enumerating it would need,
+  // then prepares a directory enumeration on that handle. The enumeration should be served the
+  // prefetched listing rather than reading the directory contents itself. Prefetching should have
+  // no effect if the handle was not opened as a directory.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrefetch_EnumerationServedFromPrefetchedListing)
   {
-    constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
-    constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+    constexpr std::wstring_view kDirectoryPath = L"C:\\DirectoryEnumerationPrefetch";
+    constexpr std::wstring_view kNotPrefetchedDirectoryPath =
+        L"C:\\DirectoryEnumerationPrefetchNotDirectory";
+
+    ScopedPerformanceSettings scopedPerformanceSettings;
+    Globals::PerformanceSettings().directoryEnumerationListingCacheTimeToLiveMilliseconds = 60000;
+    Globals::PerformanceSettings().directoryEnumerationPrefetch = true;
 
     std::array<uint8_t, 256> unusedBuffer{};
 
-    // Expected result is a single name insertion queue.
-    const FilesystemRule filesystemRules[] = {
-        FilesystemRule(L"", kAssociatedPath, kRealOpenedPath)};
-    const DirectoryEnumerationInstruction::SingleDirectoryNameInsertion
-        singleNameInsertionInstructions[] = {
-            DirectoryEnumerationInstruction::SingleDirectoryNameInsertion(filesystemRules[0])};
     const DirectoryEnumerationInstruction testInstruction =
-        DirectoryEnumerationInstruction::UseOnlyRuleOriginDirectoryNames(
-            {singleNameInsertionInstructions[0]});
-
-    constexpr std::wstring_view kQueryFilePattern = L"*.txt";
-    UNICODE_STRING filePatternUnicodeString =
-        Strings::NtConvertStringViewToUnicodeString(kQueryFilePattern);
+        DirectoryEnumerationInstruction::EnumerateDirectories(
+            {DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath)});
+    auto instructionSourceFunc = [&testInstruction](
+                                     std::wstring_view,
+                                     std::wstring_view,
+                                     RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+        -> DirectoryEnumerationInstruction
+    {
+      return testInstruction;
+    };
 
     MockFilesystemOperations mockFilesystem;
-    mockFilesystem.AddDirectory(kAssociatedPath);
-    mockFilesystem.AddDirectory(kRealOpenedPath);
-
-    const HANDLE directoryHandle = mockFilesystem.Open(kRealOpenedPath);
+    mockFilesystem.AddFile(L"C:\\DirectoryEnumerationPrefetch\\File1.txt");
+    mockFilesystem.AddFile(L"C:\\DirectoryEnumerationPrefetch\\File2.txt");
+    mockFilesystem.AddFile(L"C:\\DirectoryEnumerationPrefetchNotDirectory\\File1.txt");
+    mockFilesystem.SetConfigSystemCallLatency(20);
 
     OpenHandleStore openHandleStore;
-    openHandleStore.InsertHandle(
-        directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
 
-    const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
-    const std::optional<NTSTATUS> actualReturnValue =
-        FilesystemExecutor::DirectoryEnumerationPrepare(
-            TestCaseName().data(),
-            kFunctionRequestIdentifier,
-            openHandleStore,
-            directoryHandle,
-            unusedBuffer.data(),
-            static_cast<ULONG>(unusedBuffer.size()),
-            SFileNamesInformation::kFileInformationClass,
-            &filePatternUnicodeString,
-            [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
-            {
-              return testInstruction;
-            });
+    auto openPrefetchAndPrepare = [&](std::wstring_view directoryPath, ULONG createOptions) -> bool
+    {
+      const HANDLE directoryHandle = mockFilesystem.Open(directoryPath);
+      openHandleStore.InsertHandle(
+          directoryHandle, std::wstring(directoryPath), std::wstring(directoryPath));
 
-    TEST_ASSERT(actualReturnValue == expectedReturnValue);
-    TEST_ASSERT(
-        openHandleStore.GetDataForHandle(directoryHandle)->directoryEnumeration.has_value());
+      FilesystemExecutor::DirectoryEnumerationPrefetch(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          directoryHandle,
+          createOptions,
+          instructionSourceFunc);
 
-    const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
-        SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+      const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
+      const std::optional<NTSTATUS> actualReturnValue =
+          FilesystemExecutor::DirectoryEnumerationPrepare(
+              TestCaseName().data(),
+              kFunctionRequestIdentifier,
+              openHandleStore,
+              directoryHandle,
+              unusedBuffer.data(),
+              static_cast<ULONG>(unusedBuffer.size()),
+              SFileNamesInformation::kFileInformationClass,
+              nullptr,
+              instructionSourceFunc);
+      TEST_ASSERT(actualReturnValue == expectedReturnValue);
 
-    // Created queues are examined in detail at this point. The specific checks used here are based
-    // on the expected result, which is documented along with the directory enumeration instruction
-    // used in this test case.
-    VerifyIsNameInsertionQueueAndMatchesSpec(
-        directoryEnumerationState.queue,
-        {singleNameInsertionInstructions[0]},
-        SFileNamesInformation::kFileInformationClass,
-        kQueryFilePattern);
+      const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
+          SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
+      TEST_ASSERT(
+          DirectoryOperationQueueTypeIs<EnumerationQueue>(*directoryEnumerationState.queue));
+
+      return static_cast<EnumerationQueue*>(directoryEnumerationState.queue)
+          ->IsServingCachedListing();
+    };
+
+    TEST_ASSERT(true == openPrefetchAndPrepare(kDirectoryPath, FILE_DIRECTORY_FILE));
+    TEST_ASSERT(false == openPrefetchAndPrepare(kNotPrefetchedDirectoryPath, 0));
   }
 
   // Verifies that the correct type of directory enumeration queues are created when the instruction
-  // specifies both directory enumeration and name insertion.
-  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_CombinedNameInsertionAndEnumeration)
+  // specifies both directory enumeration and name insertion and the queues are created
+  // concurrently. Expected result is the same as for sequential creation, including the order of
+  // the underlying queues.
+  TEST_CASE(
+      FilesystemExecutor_DirectoryEnumerationPrepare_CombinedNameInsertionAndEnumerationWithConcurrentInitialFill)
   {
     constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
     constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
@@ -1900,7 +3208,6 @@ namespace PathwinderTest
 
     std::array<uint8_t, 256> unusedBuffer{};
 
-    // Expected result is a single name insertion queue.
     const FilesystemRule filesystemRules[] = {
         FilesystemRule(L"", kOriginDirectory, kTargetDirectory)};
     const DirectoryEnumerationInstruction::SingleDirectoryEnumeration
@@ -1929,6 +3236,9 @@ namespace PathwinderTest
     openHandleStore.InsertHandle(
         directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
 
+    ScopedPerformanceSettings scopedPerformanceSettings;
+    Globals::PerformanceSettings().directoryEnumerationConcurrentInitialFill = true;
+
     const std::optional<NTSTATUS> expectedReturnValue = NtStatus::kSuccess;
     const std::optional<NTSTATUS> actualReturnValue =
         FilesystemExecutor::DirectoryEnumerationPrepare(
@@ -1941,7 +3251,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             nullptr,
             [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               return testInstruction;
             });
@@ -1953,9 +3266,6 @@ namespace PathwinderTest
     const SDirectoryEnumerationStateSnapshot directoryEnumerationState =
         SDirectoryEnumerationStateSnapshot::GetForHandle(directoryHandle, openHandleStore);
 
-    // Created queues are examined in detail at this point. The specific checks used here are based
-    // on the expected result, which is documented along with the directory enumeration instruction
-    // used in this test case.
     TEST_ASSERT(DirectoryOperationQueueTypeIs<MergedFileInformationQueue>(
         *directoryEnumerationState.queue));
 
@@ -1981,6 +3291,108 @@ namespace PathwinderTest
         SFileNamesInformation::kFileInformationClass);
   }
 
+  // Prepares a directory enumeration that requires several directories to be enumerated, each of
+  // which is slow to open and to query, and verifies that creating the queues concurrently results
+  // in their system calls actually being in progress at the same time. Concurrency is checked by
+  // holding back the first system call of each queue until all of them have been made, which can
+  // only complete if the queues are being created concurrently. Elapsed times are reported but not
+  // checked, because they depend on the load on the machine running the test.
+  TEST_CASE(FilesystemExecutor_DirectoryEnumerationPrepare_ConcurrentInitialFill_Benchmark)
+  {
+    constexpr std::wstring_view kAssociatedPath = L"C:\\AssociatedPathDirectory";
+    constexpr std::wstring_view kRealOpenedPath = L"D:\\RealOpenedPath\\Directory";
+    constexpr std::wstring_view kOriginDirectory = L"E:\\OriginPath1";
+    constexpr std::wstring_view kTargetDirectory = L"E:\\TargetPath2";
+    constexpr unsigned int kSystemCallLatencyMilliseconds = 40;
+
+    std::array<uint8_t, 256> unusedBuffer{};
+
+    const FilesystemRule filesystemRules[] = {
+        FilesystemRule(L"", kOriginDirectory, kTargetDirectory)};
+    const DirectoryEnumerationInstruction::SingleDirectoryEnumeration
+        singleEnumerationInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::AssociatedPath),
+            DirectoryEnumerationInstruction::SingleDirectoryEnumeration::IncludeAllFilenames(
+                EDirectoryPathSource::RealOpenedPath)};
+    const DirectoryEnumerationInstruction::SingleDirectoryNameInsertion
+        singleNameInsertionInstructions[] = {
+            DirectoryEnumerationInstruction::SingleDirectoryNameInsertion(filesystemRules[0])};
+    const DirectoryEnumerationInstruction testInstruction =
+        DirectoryEnumerationInstruction::EnumerateDirectoriesAndInsertRuleOriginDirectoryNames(
+            {singleEnumerationInstructions[0], singleEnumerationInstructions[1]},
+            {singleNameInsertionInstructions[0]});
+    const unsigned int numQueuesToCreate = static_cast<unsigned int>(
+        std::size(singleEnumerationInstructions) + std::size(singleNameInsertionInstructions));
+
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddDirectory(kAssociatedPath);
+    mockFilesystem.AddDirectory(kRealOpenedPath);
+    mockFilesystem.AddDirectory(kOriginDirectory);
+    mockFilesystem.AddDirectory(kTargetDirectory);
+    mockFilesystem.SetConfigSystemCallLatency(kSystemCallLatencyMilliseconds);
+
+    ScopedPerformanceSettings scopedPerformanceSettings;
+    Globals::PerformanceSettings().directoryEnumerationReadAhead = false;
+    Globals::PerformanceSettings().directoryEnumerationListingCacheTimeToLiveMilliseconds = 0;
+
+    auto timeDirectoryEnumerationPrepare =
+        [&](bool enableConcurrentInitialFill) -> std::chrono::steady_clock::duration
+    {
+      Globals::PerformanceSettings().directoryEnumerationConcurrentInitialFill =
+          enableConcurrentInitialFill;
+
+      const HANDLE directoryHandle = mockFilesystem.Open(kRealOpenedPath);
+
+      OpenHandleStore openHandleStore;
+      openHandleStore.InsertHandle(
+          directoryHandle, std::wstring(kAssociatedPath), std::wstring(kRealOpenedPath));
+
+      const auto startTime = std::chrono::steady_clock::now();
+
+      const std::optional<NTSTATUS> actualReturnValue =
+          FilesystemExecutor::DirectoryEnumerationPrepare(
+              TestCaseName().data(),
+              kFunctionRequestIdentifier,
+              openHandleStore,
+              directoryHandle,
+              unusedBuffer.data(),
+              static_cast<ULONG>(unusedBuffer.size()),
+              SFileNamesInformation::kFileInformationClass,
+              nullptr,
+              [&testInstruction](
+                  std::wstring_view,
+                  std::wstring_view,
+                  RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                  -> DirectoryEnumerationInstruction
+              {
+                return testInstruction;
+              });
+
+      const auto duration = (std::chrono::steady_clock::now() - startTime);
+
+      TEST_ASSERT(actualReturnValue == NtStatus::kSuccess);
+      TEST_ASSERT(
+          openHandleStore.GetDataForHandle(directoryHandle)->directoryEnumeration.has_value());
+
+      return duration;
+    };
+
+    const auto durationSequential = timeDirectoryEnumerationPrepare(false);
+    TEST_ASSERT(1 == mockFilesystem.GetMaxConcurrentSystemCalls());
+
+    mockFilesystem.SetConfigSystemCallRendezvous(numQueuesToCreate);
+    const auto durationConcurrent = timeDirectoryEnumerationPrepare(true);
+    TEST_ASSERT(mockFilesystem.GetMaxConcurrentSystemCalls() >= numQueuesToCreate);
+
+    TEST_PRINT_MESSAGE(
+        L"Directory enumeration preparation took %lld ms sequentially and %lld ms concurrently.",
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(durationSequential).count()),
+        static_cast<long long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(durationConcurrent).count()));
+  }
+
   // Verifies that the correct type of directory enumeration queues are created when the instruction
   // specifies both directory enumeration and name insertion. This test models the situation in
   // which application specified a file pattern, meaning that it is expected to be associated with
@@ -2040,7 +3452,10 @@ namespace PathwinderTest
             SFileNamesInformation::kFileInformationClass,
             &filePatternUnicodeString,
             [&testInstruction](
-                std::wstring_view, std::wstring_view) -> DirectoryEnumerationInstruction
+                std::wstring_view,
+                std::wstring_view,
+                RelatedFilesystemRuleContainer::TFilesystemRulesIndex)
+                -> DirectoryEnumerationInstruction
             {
               return testInstruction;
             });
@@ -2130,7 +3545,8 @@ namespace PathwinderTest
             0,
             0,
             [&fileOperationInstructionToTry](
-                std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+                std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+                -> FileOperationInstruction
             {
               return fileOperationInstructionToTry;
             },
@@ -2197,7 +3613,8 @@ namespace PathwinderTest
             0,
             0,
             [&fileOperationInstructionToTry](
-                std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+                std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+                -> FileOperationInstruction
             {
               return fileOperationInstructionToTry;
             },
@@ -2248,7 +3665,8 @@ namespace PathwinderTest
           [expectedCreateDisposition](
               std::wstring_view,
               FileAccessMode,
-              CreateDisposition actualCreateDisposition) -> FileOperationInstruction
+              CreateDisposition actualCreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             TEST_ASSERT(actualCreateDisposition == expectedCreateDisposition);
             return FileOperationInstruction::NoRedirectionOrInterception();
@@ -2303,7 +3721,8 @@ namespace PathwinderTest
           [expectedFileAccessMode](
               std::wstring_view,
               FileAccessMode actualFileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             TEST_ASSERT(actualFileAccessMode == expectedFileAccessMode);
             return FileOperationInstruction::NoRedirectionOrInterception();
@@ -2376,7 +3795,8 @@ namespace PathwinderTest
           [kUnredirectedPath](
               std::wstring_view actualRequestedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             std::wstring_view expectedRequestedPath = kUnredirectedPath;
             TEST_ASSERT(actualRequestedPath == expectedRequestedPath);
@@ -2389,6 +3809,69 @@ namespace PathwinderTest
     }
   }
 
+  // Verifies that a resume point for the root directory is supplied to the instruction source when
+  // a new file handle is being created relative to a cached root directory handle. The first time
+  // the resume point is unresolved, and once the instruction source resolves it the resume point
+  // is stored with the root directory handle and supplied already-resolved from then on.
+  TEST_CASE(FilesystemExecutor_NewFileHandle_InstructionSourceRootDirectoryResumePoint)
+  {
+    constexpr std::wstring_view kDirectoryName = L"C:\\TestDirectory";
+    constexpr std::wstring_view kFileNames[] = {L"TestFile1.txt", L"TestFile2.txt"};
+
+    const HANDLE kRootDirectoryHandleValueTestInput = reinterpret_cast<HANDLE>(2049);
+
+    OpenHandleStore openHandleStore;
+    openHandleStore.InsertHandle(
+        kRootDirectoryHandleValueTestInput,
+        std::wstring(kDirectoryName),
+        std::wstring(kDirectoryName));
+
+    bool expectedIsResolved = false;
+
+    for (const auto& fileName : kFileNames)
+    {
+      UNICODE_STRING unicodeStringFileName = Strings::NtConvertStringViewToUnicodeString(fileName);
+      OBJECT_ATTRIBUTES objectAttributes =
+          CreateObjectAttributes(unicodeStringFileName, kRootDirectoryHandleValueTestInput);
+
+      FilesystemExecutor::NewFileHandle(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          nullptr,
+          0,
+          &objectAttributes,
+          0,
+          0,
+          0,
+          [kDirectoryName, expectedIsResolved](
+              std::wstring_view,
+              FileAccessMode,
+              CreateDisposition,
+              SPathLookupResumePoint* rootDirectoryResumePoint) -> FileOperationInstruction
+          {
+            TEST_ASSERT(nullptr != rootDirectoryResumePoint);
+            TEST_ASSERT(rootDirectoryResumePoint->directoryPathLength == kDirectoryName.length());
+            TEST_ASSERT(rootDirectoryResumePoint->isResolved == expectedIsResolved);
+
+            rootDirectoryResumePoint->isResolved = true;
+            return FileOperationInstruction::NoRedirectionOrInterception();
+          },
+          [](PHANDLE, POBJECT_ATTRIBUTES, ULONG) -> NTSTATUS
+          {
+            return NtStatus::kSuccess;
+          });
+
+      const SPathLookupResumePoint* const storedResumePoint =
+          openHandleStore.GetDataForHandle(kRootDirectoryHandleValueTestInput)
+              ->pathLookupResumePoint;
+      TEST_ASSERT(nullptr != storedResumePoint);
+      TEST_ASSERT(true == storedResumePoint->isResolved);
+
+      expectedIsResolved = true;
+    }
+  }
+
   // Verifies that any file attempt preference is honored if it is contained in a file operation
   // instruction when a new file handle is being created. The instructions used in this test case
   // all contain an unredirected and a redirected path, and they supply various enumerators
@@ -2451,7 +3934,8 @@ namespace PathwinderTest
           [&testInputFileOperationInstruction](
               std::wstring_view actualUnredirectedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             return testInputFileOperationInstruction;
           },
@@ -2487,11 +3971,13 @@ namespace PathwinderTest
   // Verifies that the correct name is associated with a newly-created file handle, based on
   // whatever name association is specified in the file operation instruction. Various orderings of
   // files to try are also needed here because sometimes the associated name depends on the order in
-  // which files are tried.
+  // which files are tried. Whenever a name is associated, the redirecting rule position index from
+  // the file operation instruction is expected to be stored along with it.
   TEST_CASE(FilesystemExecutor_NewFileHandle_AssociateNameWithHandle)
   {
     constexpr std::wstring_view kUnredirectedPath = L"C:\\TestDirectory\\TestFile.txt";
     constexpr std::wstring_view kRedirectedPath = L"C:\\RedirectedDirectory\\TestFile.txt";
+    constexpr RelatedFilesystemRuleContainer::TFilesystemRulesIndex kRedirectingRuleIndex = 1;
 
     UNICODE_STRING unicodeStringUnredirectedPath =
         Strings::NtConvertStringViewToUnicodeString(kUnredirectedPath);
@@ -2625,13 +4111,15 @@ namespace PathwinderTest
 
     for (const auto& nameAssociationTestRecord : nameAssociationTestRecords)
     {
-      const FileOperationInstruction fileOperationInstructionTestInput(
-          kRedirectedPath,
-          nameAssociationTestRecord.tryFilesTestInput,
-          ECreateDispositionPreference::NoPreference,
-          nameAssociationTestRecord.associateNameWithHandleTestInput,
-          {},
-          L"");
+      const FileOperationInstruction fileOperationInstructionTestInput =
+          FileOperationInstruction(
+              kRedirectedPath,
+              nameAssociationTestRecord.tryFilesTestInput,
+              ECreateDispositionPreference::NoPreference,
+              nameAssociationTestRecord.associateNameWithHandleTestInput,
+              {},
+              L"")
+              .WithRedirectingRuleIndex(kRedirectingRuleIndex);
 
       OpenHandleStore openHandleStore;
 
@@ -2647,7 +4135,8 @@ namespace PathwinderTest
           0,
           0,
           [&fileOperationInstructionTestInput](
-              std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+              std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+              -> FileOperationInstruction
           {
             return fileOperationInstructionTestInput;
           },
@@ -2688,10 +4177,85 @@ namespace PathwinderTest
 
         TEST_ASSERT(actualAssociatedPath == expectedAssociatedPath);
         TEST_ASSERT(actualRealOpenedPath == expectedRealOpenedPath);
+        TEST_ASSERT(maybeHandleData->redirectingRuleIndex == kRedirectingRuleIndex);
       }
     }
   }
 
+  // Verifies that handles intercepted without redirection and associated with their unredirected
+  // names are stored only if they could be directories. Handles explicitly opened as non-directory
+  // files are not stored, whereas handles opened as directories or with no preference are stored.
+  // Handles that are redirected are stored regardless.
+  TEST_CASE(FilesystemExecutor_NewFileHandle_AssociateNameWithHandle_NonDirectoryFile)
+  {
+    constexpr std::wstring_view kUnredirectedPath = L"C:\\TestDirectory\\TestFile.txt";
+    constexpr std::wstring_view kRedirectedPath = L"C:\\RedirectedDirectory\\TestFile.txt";
+    const HANDLE kHandleValue = reinterpret_cast<HANDLE>(1084);
+
+    UNICODE_STRING unicodeStringUnredirectedPath =
+        Strings::NtConvertStringViewToUnicodeString(kUnredirectedPath);
+    OBJECT_ATTRIBUTES objectAttributesUnredirectedPath =
+        CreateObjectAttributes(unicodeStringUnredirectedPath);
+
+    const struct
+    {
+      FileOperationInstruction instructionTestInput;
+      ULONG createOptionsTestInput;
+      bool expectedHandleIsStored;
+    } nonDirectoryFileTestRecords[] = {
+        {.instructionTestInput = FileOperationInstruction::InterceptWithoutRedirection(
+             EAssociateNameWithHandle::Unredirected),
+         .createOptionsTestInput = FILE_NON_DIRECTORY_FILE,
+         .expectedHandleIsStored = false},
+        {.instructionTestInput = FileOperationInstruction::InterceptWithoutRedirection(
+             EAssociateNameWithHandle::Unredirected),
+         .createOptionsTestInput = FILE_DIRECTORY_FILE,
+         .expectedHandleIsStored = true},
+        {.instructionTestInput = FileOperationInstruction::InterceptWithoutRedirection(
+             EAssociateNameWithHandle::Unredirected),
+         .createOptionsTestInput = 0,
+         .expectedHandleIsStored = true},
+        {.instructionTestInput = FileOperationInstruction::SimpleRedirectTo(
+             kRedirectedPath, EAssociateNameWithHandle::Unredirected),
+         .createOptionsTestInput = FILE_NON_DIRECTORY_FILE,
+         .expectedHandleIsStored = true},
+    };
+
+    for (const auto& nonDirectoryFileTestRecord : nonDirectoryFileTestRecords)
+    {
+      OpenHandleStore openHandleStore;
+
+      HANDLE handleValue = NULL;
+      NTSTATUS newFileHandleResult = FilesystemExecutor::NewFileHandle(
+          TestCaseName().data(),
+          kFunctionRequestIdentifier,
+          openHandleStore,
+          &handleValue,
+          0,
+          &objectAttributesUnredirectedPath,
+          0,
+          FILE_OPEN,
+          nonDirectoryFileTestRecord.createOptionsTestInput,
+          [&nonDirectoryFileTestRecord](
+              std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+              -> FileOperationInstruction
+          {
+            return nonDirectoryFileTestRecord.instructionTestInput;
+          },
+          [kHandleValue](PHANDLE handle, POBJECT_ATTRIBUTES, ULONG) -> NTSTATUS
+          {
+            *handle = kHandleValue;
+            return NtStatus::kSuccess;
+          });
+
+      TEST_ASSERT(NtStatus::kSuccess == newFileHandleResult);
+      TEST_ASSERT(kHandleValue == handleValue);
+      TEST_ASSERT(
+          nonDirectoryFileTestRecord.expectedHandleIsStored ==
+          openHandleStore.GetDataForHandle(kHandleValue).has_value());
+    }
+  }
+
   // Verifies that create disposition preferences contained in filesystem instructions are
   // honored when creating a new file handle. The test case itself sends in a variety of different
   // create dispositions from the application and encodes several different create disposition
@@ -2835,7 +4399,8 @@ namespace PathwinderTest
           [&testInputFileOperationInstruction](
               std::wstring_view actualUnredirectedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             return testInputFileOperationInstruction;
           },
@@ -3155,7 +4720,8 @@ namespace PathwinderTest
           [&testInputFileOperationInstruction](
               std::wstring_view actualUnredirectedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             return testInputFileOperationInstruction;
           },
@@ -3289,7 +4855,8 @@ namespace PathwinderTest
           0,
           0,
           [kUnredirectedPath, &fileOperationInstructionToTry, &instructionSourceWasInvoked](
-              std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+              std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+              -> FileOperationInstruction
           {
             instructionSourceWasInvoked = true;
             return fileOperationInstructionToTry;
@@ -3346,7 +4913,8 @@ namespace PathwinderTest
         [kUnredirectedPath](
             std::wstring_view actualUnredirectedPath,
             FileAccessMode,
-            CreateDisposition) -> FileOperationInstruction
+            CreateDisposition,
+            SPathLookupResumePoint*) -> FileOperationInstruction
         {
           TEST_FAILED_BECAUSE(
               "Instruction source should not be invoked if the root directory handle is present but uncached.");
@@ -3411,7 +4979,8 @@ namespace PathwinderTest
             inputFileRenameInformation.GetFileInformationStruct(),
             inputFileRenameInformation.GetFileInformationStructSizeBytes(),
             [&fileOperationInstructionToTry](
-                std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+                std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+                -> FileOperationInstruction
             {
               return fileOperationInstructionToTry;
             },
@@ -3483,7 +5052,8 @@ namespace PathwinderTest
           [kUnredirectedPath](
               std::wstring_view actualRequestedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             std::wstring_view expectedRequestedPath = kUnredirectedPath;
             TEST_ASSERT(actualRequestedPath == expectedRequestedPath);
@@ -3526,8 +5096,11 @@ namespace PathwinderTest
         kFileBeingRenamedHandleTestInput,
         fileRenameInformationUnredirectedPath.GetFileInformationStruct(),
         fileRenameInformationUnredirectedPath.GetFileInformationStructSizeBytes(),
-        [kRenamedPath](std::wstring_view actualRequestedPath, FileAccessMode, CreateDisposition)
-            -> FileOperationInstruction
+        [kRenamedPath](
+            std::wstring_view actualRequestedPath,
+            FileAccessMode,
+            CreateDisposition,
+            SPathLookupResumePoint*) -> FileOperationInstruction
         {
           std::wstring_view expectedRequestedPath = kRenamedPath;
           TEST_ASSERT(actualRequestedPath == expectedRequestedPath);
@@ -3568,8 +5141,11 @@ namespace PathwinderTest
         initialPathHandle,
         fileRenameInformationUnredirectedPath.GetFileInformationStruct(),
         fileRenameInformationUnredirectedPath.GetFileInformationStructSizeBytes(),
-        [kRenamedPath](std::wstring_view actualRequestedPath, FileAccessMode, CreateDisposition)
-            -> FileOperationInstruction
+        [kRenamedPath](
+            std::wstring_view actualRequestedPath,
+            FileAccessMode,
+            CreateDisposition,
+            SPathLookupResumePoint*) -> FileOperationInstruction
         {
           std::wstring_view expectedRequestedPath = kRenamedPath;
           TEST_ASSERT(actualRequestedPath == expectedRequestedPath);
@@ -3638,7 +5214,8 @@ namespace PathwinderTest
           [&testInputFileOperationInstruction](
               std::wstring_view actualUnredirectedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             return testInputFileOperationInstruction;
           },
@@ -3840,7 +5417,8 @@ namespace PathwinderTest
           fileRenameInformationUnredirectedPath.GetFileInformationStruct(),
           fileRenameInformationUnredirectedPath.GetFileInformationStructSizeBytes(),
           [&fileOperationInstructionTestInput](
-              std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+              std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+              -> FileOperationInstruction
           {
             return fileOperationInstructionTestInput;
           },
@@ -3956,7 +5534,8 @@ namespace PathwinderTest
           fileRenameInformationUnredirectedPath.GetFileInformationStruct(),
           fileRenameInformationUnredirectedPath.GetFileInformationStructSizeBytes(),
           [kUnredirectedPath, &fileOperationInstructionToTry, &instructionSourceWasInvoked](
-              std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+              std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+              -> FileOperationInstruction
           {
             instructionSourceWasInvoked = true;
             return fileOperationInstructionToTry;
@@ -3999,7 +5578,8 @@ namespace PathwinderTest
         existingFileHandle,
         fileRenameInformationUnredirectedPath.GetFileInformationStruct(),
         fileRenameInformationUnredirectedPath.GetFileInformationStructSizeBytes(),
-        [](std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+        [](std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+            -> FileOperationInstruction
         {
           return FileOperationInstruction::NoRedirectionOrInterception();
         },
@@ -4059,7 +5639,8 @@ namespace PathwinderTest
             &objectAttributesUnredirectedPath,
             GENERIC_READ,
             [&fileOperationInstructionToTry](
-                std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+                std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+                -> FileOperationInstruction
             {
               return fileOperationInstructionToTry;
             },
@@ -4130,7 +5711,8 @@ namespace PathwinderTest
           [kUnredirectedPath](
               std::wstring_view actualRequestedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             std::wstring_view expectedRequestedPath = kUnredirectedPath;
             TEST_ASSERT(actualRequestedPath == expectedRequestedPath);
@@ -4201,7 +5783,8 @@ namespace PathwinderTest
           [&testInputFileOperationInstruction](
               std::wstring_view actualUnredirectedPath,
               FileAccessMode,
-              CreateDisposition) -> FileOperationInstruction
+              CreateDisposition,
+              SPathLookupResumePoint*) -> FileOperationInstruction
           {
             return testInputFileOperationInstruction;
           },
@@ -4287,7 +5870,8 @@ namespace PathwinderTest
           &objectAttributesUnredirectedPath,
           GENERIC_READ,
           [kUnredirectedPath, &fileOperationInstructionToTry, &instructionSourceWasInvoked](
-              std::wstring_view, FileAccessMode, CreateDisposition) -> FileOperationInstruction
+              std::wstring_view, FileAccessMode, CreateDisposition, SPathLookupResumePoint*)
+              -> FileOperationInstruction
           {
             instructionSourceWasInvoked = true;
             return fileOperationInstructionToTry;
@@ -4340,7 +5924,8 @@ namespace PathwinderTest
         [kUnredirectedPath](
             std::wstring_view actualUnredirectedPath,
             FileAccessMode,
-            CreateDisposition) -> FileOperationInstruction
+            CreateDisposition,
+            SPathLookupResumePoint*) -> FileOperationInstruction
         {
           TEST_FAILED_BECAUSE(
               "Instruction source should not be invoked if the root directory handle is present but uncached.");
@@ -11,9 +11,16 @@
 
 #include "OpenHandleStore.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <set>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include <Infra/Test/TestCase.h>
 
@@ -376,4 +383,387 @@ namespace PathwinderTest
       TEST_ASSERT(assertion.GetFailureMessage().contains(L"handle that is not in storage"));
     }
   }
+
+  // Verifies that identical paths are held only once regardless of how many handles refer to them,
+  // including the common case of a handle whose associated path and real opened path are the same,
+  // and that paths are freed once no handles refer to them anymore.
+  TEST_CASE(OpenHandleStore_PathInterning_IdenticalPathsShared)
+  {
+    const HANDLE kFirstHandle = reinterpret_cast<HANDLE>(0x1000);
+    const HANDLE kSecondHandle = reinterpret_cast<HANDLE>(0x1004);
+    constexpr std::wstring_view kPath = L"C:\\Directory\\File.txt";
+    constexpr std::wstring_view kRedirectedPath = L"D:\\Redirected\\File.txt";
+
+    OpenHandleStore handleStore;
+
+    handleStore.InsertHandle(kFirstHandle, std::wstring(kPath), std::wstring(kPath));
+    TEST_ASSERT(1 == handleStore.NumDistinctPaths());
+
+    handleStore.InsertHandle(kSecondHandle, std::wstring(kPath), std::wstring(kRedirectedPath));
+    TEST_ASSERT(2 == handleStore.NumDistinctPaths());
+
+    constexpr OpenHandleStore::SHandleDataView expectedHandleData = {
+        .associatedPath = kPath, .realOpenedPath = kRedirectedPath};
+    TEST_ASSERT(*handleStore.GetDataForHandle(kSecondHandle) == expectedHandleData);
+
+    TEST_ASSERT(true == handleStore.RemoveHandle(kSecondHandle, nullptr));
+    TEST_ASSERT(1 == handleStore.NumDistinctPaths());
+
+    TEST_ASSERT(true == handleStore.RemoveHandle(kFirstHandle, nullptr));
+    TEST_ASSERT(0 == handleStore.NumDistinctPaths());
+  }
+
+  // Verifies that data stored for a handle not used for directory enumeration takes up only a few
+  // words, because paths are interned and both directory enumeration state and path lookup resume
+  // points are stored out-of-line.
+  TEST_CASE(OpenHandleStore_PathInterning_CompactHandleData)
+  {
+    TEST_ASSERT(sizeof(OpenHandleStore::SHandleData) <= (5 * sizeof(void*)));
+  }
+
+  // Verifies that the position index of the filesystem rule that redirected a handle is stored
+  // along with the handle and replaced when the handle is updated.
+  TEST_CASE(OpenHandleStore_RedirectingRuleIndex_InsertAndUpdate)
+  {
+    const HANDLE kHandle = reinterpret_cast<HANDLE>(0x12345678);
+
+    OpenHandleStore handleStore;
+
+    handleStore.InsertHandle(
+        kHandle, std::wstring(L"C:\\Origin"), std::wstring(L"C:\\Target"), 2);
+    TEST_ASSERT(2 == handleStore.GetDataForHandle(kHandle)->redirectingRuleIndex);
+
+    handleStore.InsertOrUpdateHandle(
+        kHandle, std::wstring(L"C:\\Origin2"), std::wstring(L"C:\\Target2"), 5);
+    TEST_ASSERT(5 == handleStore.GetDataForHandle(kHandle)->redirectingRuleIndex);
+
+    handleStore.InsertOrUpdateHandle(
+        kHandle, std::wstring(L"C:\\Origin3"), std::wstring(L"C:\\Origin3"));
+    TEST_ASSERT(
+        FileOperationInstruction::kUnknownRedirectingRuleIndex ==
+        handleStore.GetDataForHandle(kHandle)->redirectingRuleIndex);
+  }
+
+  // Verifies that a path lookup resume point can be associated with a handle, that it is visible
+  // in the handle's data, and that a second association for the same handle is ignored.
+  TEST_CASE(OpenHandleStore_SetPathLookupResumePoint_Nominal)
+  {
+    const HANDLE kHandle = reinterpret_cast<HANDLE>(0x12345678);
+    const SPathLookupResumePoint kResumePoint = {
+        .directoryPathLength = 10,
+        .isResolved = true,
+        .walkPosition = {.node = nullptr, .longestMatchingPrefixNode = nullptr, .isOnPath = false}};
+    const SPathLookupResumePoint kResumePointDuplicate = {
+        .directoryPathLength = 20,
+        .isResolved = true,
+        .walkPosition = {.node = nullptr, .longestMatchingPrefixNode = nullptr, .isOnPath = true}};
+
+    OpenHandleStore handleStore;
+
+    handleStore.InsertHandle(kHandle, std::wstring(L"C:\\Directory"), std::wstring(L"C:\\Real"));
+    TEST_ASSERT(nullptr == handleStore.GetDataForHandle(kHandle)->pathLookupResumePoint);
+
+    handleStore.SetPathLookupResumePoint(kHandle, kResumePoint);
+    const SPathLookupResumePoint* actualResumePoint =
+        handleStore.GetDataForHandle(kHandle)->pathLookupResumePoint;
+    TEST_ASSERT(nullptr != actualResumePoint);
+    TEST_ASSERT(kResumePoint.directoryPathLength == actualResumePoint->directoryPathLength);
+    TEST_ASSERT(kResumePoint.walkPosition.isOnPath == actualResumePoint->walkPosition.isOnPath);
+
+    handleStore.SetPathLookupResumePoint(kHandle, kResumePointDuplicate);
+    actualResumePoint = handleStore.GetDataForHandle(kHandle)->pathLookupResumePoint;
+    TEST_ASSERT(nullptr != actualResumePoint);
+    TEST_ASSERT(kResumePoint.directoryPathLength == actualResumePoint->directoryPathLength);
+    TEST_ASSERT(kResumePoint.walkPosition.isOnPath == actualResumePoint->walkPosition.isOnPath);
+  }
+
+  // Verifies that associating a path lookup resume point with a handle that is not in the store has
+  // no effect and that updating a handle's path discards any existing resume point.
+  TEST_CASE(OpenHandleStore_SetPathLookupResumePoint_NonExistentHandleAndUpdate)
+  {
+    const HANDLE kHandle = reinterpret_cast<HANDLE>(0x12345678);
+    const SPathLookupResumePoint kResumePoint = {
+        .directoryPathLength = 10,
+        .isResolved = true,
+        .walkPosition = {.node = nullptr, .longestMatchingPrefixNode = nullptr, .isOnPath = false}};
+
+    OpenHandleStore handleStore;
+
+    handleStore.SetPathLookupResumePoint(kHandle, kResumePoint);
+    TEST_ASSERT(true == handleStore.Empty());
+
+    handleStore.InsertHandle(kHandle, std::wstring(L"C:\\Directory"), std::wstring(L"C:\\Real"));
+    handleStore.SetPathLookupResumePoint(kHandle, kResumePoint);
+    TEST_ASSERT(nullptr != handleStore.GetDataForHandle(kHandle)->pathLookupResumePoint);
+
+    handleStore.InsertOrUpdateHandle(
+        kHandle, std::wstring(L"C:\\OtherDirectory"), std::wstring(L"C:\\OtherReal"));
+    TEST_ASSERT(nullptr == handleStore.GetDataForHandle(kHandle)->pathLookupResumePoint);
+  }
+
+  // Verifies that handles with adjacent values are spread across all of the segments of the open
+  // handle store, and that queries about the whole store take every segment into account.
+  TEST_CASE(OpenHandleStore_Segments_AdjacentHandlesSpreadAcrossSegments)
+  {
+    constexpr unsigned int kNumHandles = OpenHandleStore::kNumSegments * 4;
+
+    OpenHandleStore handleStore;
+
+    std::set<unsigned int> actualSegmentIndices;
+    for (unsigned int i = 1; i <= kNumHandles; ++i)
+    {
+      const HANDLE handle = reinterpret_cast<HANDLE>(static_cast<size_t>(i) * 4);
+      actualSegmentIndices.insert(OpenHandleStore::SegmentIndexForHandle(handle));
+      handleStore.InsertHandle(handle, std::wstring(L"associated"), std::wstring(L"real"));
+    }
+
+    TEST_ASSERT(OpenHandleStore::kNumSegments == actualSegmentIndices.size());
+    TEST_ASSERT(kNumHandles == handleStore.Size());
+    TEST_ASSERT(false == handleStore.Empty());
+
+    for (unsigned int i = 1; i <= kNumHandles; ++i)
+    {
+      const HANDLE handle = reinterpret_cast<HANDLE>(static_cast<size_t>(i) * 4);
+      TEST_ASSERT(true == handleStore.GetDataForHandle(handle).has_value());
+      TEST_ASSERT(true == handleStore.RemoveHandle(handle, nullptr));
+    }
+
+    TEST_ASSERT(0 == handleStore.Size());
+    TEST_ASSERT(true == handleStore.Empty());
+  }
+
+  // Verifies that the membership filter reports handles as possibly stored while they are in the
+  // open handle store and definitely not stored otherwise, including when multiple stored handles
+  // share the same filter counter.
+  TEST_CASE(OpenHandleStore_MightContainHandle_Nominal)
+  {
+    const HANDLE kHandle = reinterpret_cast<HANDLE>(0x1234);
+    const HANDLE kHandleSharingFilterCounter = reinterpret_cast<HANDLE>(
+        0x1234 + (static_cast<size_t>(OpenHandleStore::kNumFilterSlots) * 4));
+    const HANDLE kUnrelatedHandle = reinterpret_cast<HANDLE>(0x1238);
+
+    OpenHandleStore handleStore;
+    TEST_ASSERT(false == handleStore.MightContainHandle(kHandle));
+
+    handleStore.InsertHandle(kHandle, std::wstring(L"associated"), std::wstring(L"real"));
+    handleStore.InsertOrUpdateHandle(
+        kHandleSharingFilterCounter, std::wstring(L"associated"), std::wstring(L"real"));
+    handleStore.InsertOrUpdateHandle(
+        kHandleSharingFilterCounter, std::wstring(L"associated2"), std::wstring(L"real2"));
+    TEST_ASSERT(true == handleStore.MightContainHandle(kHandle));
+    TEST_ASSERT(true == handleStore.MightContainHandle(kHandleSharingFilterCounter));
+    TEST_ASSERT(false == handleStore.MightContainHandle(kUnrelatedHandle));
+
+    TEST_ASSERT(true == handleStore.RemoveHandle(kHandle, nullptr));
+    TEST_ASSERT(false == handleStore.RemoveHandle(kHandle, nullptr));
+    TEST_ASSERT(true == handleStore.MightContainHandle(kHandleSharingFilterCounter));
+
+    TEST_ASSERT(true == handleStore.RemoveHandle(kHandleSharingFilterCounter, nullptr));
+    TEST_ASSERT(false == handleStore.MightContainHandle(kHandle));
+    TEST_ASSERT(false == handleStore.MightContainHandle(kHandleSharingFilterCounter));
+  }
+
+  // Verifies that closing a stored handle removes it from the membership filter.
+  TEST_CASE(OpenHandleStore_MightContainHandle_RemoveAndCloseHandle)
+  {
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\\TestFile.txt");
+
+    const HANDLE handle = mockFilesystem.Open(L"C:\\TestFile.txt");
+
+    OpenHandleStore handleStore;
+    handleStore.InsertHandle(handle, std::wstring(L"associated"), std::wstring(L"real"));
+    TEST_ASSERT(true == handleStore.MightContainHandle(handle));
+
+    TEST_ASSERT(NtStatus::kSuccess == handleStore.RemoveAndCloseHandle(handle, nullptr));
+    TEST_ASSERT(false == handleStore.MightContainHandle(handle));
+  }
+
+  // Verifies that repeatedly retrieving data for the same handle produces up-to-date data after
+  // every kind of modification, even though the most recently retrieved data is cached.
+  TEST_CASE(OpenHandleStore_GetDataForHandle_CachedDataInvalidatedByModification)
+  {
+    const HANDLE kHandle = reinterpret_cast<HANDLE>(0x12345678);
+    const SPathLookupResumePoint kResumePoint = {
+        .directoryPathLength = 10,
+        .isResolved = true,
+        .walkPosition = {.node = nullptr, .longestMatchingPrefixNode = nullptr, .isOnPath = true}};
+
+    OpenHandleStore handleStore;
+
+    handleStore.InsertHandle(kHandle, std::wstring(L"associated"), std::wstring(L"real"));
+    TEST_ASSERT(L"associated" == handleStore.GetDataForHandle(kHandle)->associatedPath);
+    TEST_ASSERT(L"associated" == handleStore.GetDataForHandle(kHandle)->associatedPath);
+
+    handleStore.InsertOrUpdateHandle(kHandle, std::wstring(L"associated2"), std::wstring(L"real2"));
+    TEST_ASSERT(L"associated2" == handleStore.GetDataForHandle(kHandle)->associatedPath);
+    TEST_ASSERT(L"real2" == handleStore.GetDataForHandle(kHandle)->realOpenedPath);
+
+    handleStore.SetPathLookupResumePoint(kHandle, kResumePoint);
+    TEST_ASSERT(nullptr != handleStore.GetDataForHandle(kHandle)->pathLookupResumePoint);
+
+    handleStore.AssociateDirectoryEnumerationState(
+        kHandle,
+        std::make_unique<MockDirectoryOperationQueue>(),
+        FileInformationStructLayout(static_cast<FILE_INFORMATION_CLASS>(100), 200, 300, 400, 500));
+    TEST_ASSERT(true == handleStore.GetDataForHandle(kHandle)->directoryEnumeration.has_value());
+
+    TEST_ASSERT(true == handleStore.RemoveHandle(kHandle, nullptr));
+    TEST_ASSERT(false == handleStore.GetDataForHandle(kHandle).has_value());
+
+    handleStore.InsertHandle(kHandle, std::wstring(L"associated3"), std::wstring(L"real3"));
+    const OpenHandleStore::SHandleDataView actualHandleData =
+        *handleStore.GetDataForHandle(kHandle);
+    TEST_ASSERT(L"associated3" == actualHandleData.associatedPath);
+    TEST_ASSERT(nullptr == actualHandleData.pathLookupResumePoint);
+    TEST_ASSERT(false == actualHandleData.directoryEnumeration.has_value());
+  }
+
+  // Verifies that cached handle data is not shared between different open handle store instances
+  // that contain the same handle value.
+  TEST_CASE(OpenHandleStore_GetDataForHandle_CachedDataSpecificToStore)
+  {
+    const HANDLE kHandle = reinterpret_cast<HANDLE>(0x12345678);
+
+    OpenHandleStore handleStore1;
+    OpenHandleStore handleStore2;
+
+    handleStore1.InsertHandle(kHandle, std::wstring(L"associated1"), std::wstring(L"real1"));
+    handleStore2.InsertHandle(kHandle, std::wstring(L"associated2"), std::wstring(L"real2"));
+
+    for (int i = 0; i < 2; ++i)
+    {
+      TEST_ASSERT(L"associated1" == handleStore1.GetDataForHandle(kHandle)->associatedPath);
+      TEST_ASSERT(L"associated2" == handleStore2.GetDataForHandle(kHandle)->associatedPath);
+    }
+
+    TEST_ASSERT(true == handleStore2.RemoveHandle(kHandle, nullptr));
+    TEST_ASSERT(true == handleStore1.GetDataForHandle(kHandle).has_value());
+    TEST_ASSERT(false == handleStore2.GetDataForHandle(kHandle).has_value());
+  }
+
+  // Verifies that handle data cached on one thread is not used once another thread closes the
+  // handle and the same handle value is reused for a different path.
+  TEST_CASE(OpenHandleStore_GetDataForHandle_CachedDataInvalidatedByOtherThread)
+  {
+    MockFilesystemOperations mockFilesystem;
+    mockFilesystem.AddFile(L"C:\TestFile.txt");
+
+    const HANDLE handle = mockFilesystem.Open(L"C:\TestFile.txt");
+
+    OpenHandleStore handleStore;
+    handleStore.InsertHandle(handle, std::wstring(L"associated"), std::wstring(L"real"));
+    TEST_ASSERT(L"associated" == handleStore.GetDataForHandle(handle)->associatedPath);
+
+    std::thread(
+        [&handleStore, handle]() -> void
+        {
+          handleStore.GetDataForHandle(handle);
+          handleStore.RemoveAndCloseHandle(handle, nullptr);
+          handleStore.InsertHandle(handle, std::wstring(L"reused"), std::wstring(L"reused_real"));
+        })
+        .join();
+
+    TEST_ASSERT(L"reused" == handleStore.GetDataForHandle(handle)->associatedPath);
+    TEST_ASSERT(true == handleStore.RemoveHandle(handle, nullptr));
+    TEST_ASSERT(false == handleStore.GetDataForHandle(handle).has_value());
+  }
+
+  /// Runs a workload in which multiple threads concurrently insert, update, query, and remove their
+  /// own handles in the same open handle store, which mirrors applications that perform filesystem
+  /// operations on multiple threads.
+  /// @param [in, out] handleStore Open handle store on which to run the workload.
+  /// @param [in] numThreads Number of threads to run concurrently.
+  /// @param [in] numOperationsPerThread Number of handles each thread inserts, updates, queries,
+  /// and removes.
+  /// @return Number of operations that failed.
+  static unsigned int RunConcurrentIndependentHandlesWorkload(
+      OpenHandleStore& handleStore, unsigned int numThreads, unsigned int numOperationsPerThread)
+  {
+    std::atomic<unsigned int> numFailedOperations = 0;
+    std::atomic<bool> startSignal = false;
+
+    std::vector<std::thread> workerThreads;
+    for (unsigned int threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+    {
+      workerThreads.emplace_back(
+          [&handleStore, &numFailedOperations, &startSignal, numOperationsPerThread, threadIndex]()
+              -> void
+          {
+            while (false == startSignal.load()) std::this_thread::yield();
+
+            for (unsigned int i = 0; i < numOperationsPerThread; ++i)
+            {
+              const HANDLE handle = reinterpret_cast<HANDLE>(
+                  ((static_cast<size_t>(threadIndex) * numOperationsPerThread) + i + 1) * 4);
+
+              handleStore.InsertHandle(handle, std::wstring(L"a"), std::wstring(L"r"));
+              handleStore.InsertOrUpdateHandle(handle, std::wstring(L"a2"), std::wstring(L"r2"));
+
+              const auto maybeHandleData = handleStore.GetDataForHandle(handle);
+              if ((false == maybeHandleData.has_value()) ||
+                  (L"a2" != maybeHandleData->associatedPath))
+                numFailedOperations += 1;
+
+              if (false == handleStore.RemoveHandle(handle, nullptr)) numFailedOperations += 1;
+            }
+          });
+    }
+
+    startSignal = true;
+
+    for (auto& workerThread : workerThreads)
+      workerThread.join();
+
+    return numFailedOperations;
+  }
+
+  // Verifies that the open handle store remains consistent with between 1 and 32 threads
+  // concurrently inserting, updating, querying, and removing their own handles. All operations must
+  // succeed regardless of the number of threads, and the store must be empty once they finish.
+  TEST_CASE(OpenHandleStore_Concurrency_IndependentHandlesManyThreads)
+  {
+    constexpr std::array<unsigned int, 6> kThreadCounts = {1, 2, 4, 8, 16, 32};
+    constexpr unsigned int kNumOperationsPerThread = 20000;
+
+    for (const unsigned int numThreads : kThreadCounts)
+    {
+      OpenHandleStore handleStore;
+      TEST_ASSERT(
+          0 ==
+          RunConcurrentIndependentHandlesWorkload(
+              handleStore, numThreads, kNumOperationsPerThread));
+      TEST_ASSERT(true == handleStore.Empty());
+    }
+  }
+
+  // Measures the throughput of the open handle store with between 1 and 32 threads concurrently
+  // inserting, updating, querying, and removing their own handles. Because unrelated handles are
+  // stored in different segments, overall throughput should not drop as threads are added, up to
+  // the number of available processors. This is a benchmark, so throughput is reported but not
+  // checked, because it depends on the load on the machine running the test.
+  TEST_CASE(OpenHandleStore_Concurrency_ScalingBenchmark)
+  {
+    constexpr std::array<unsigned int, 6> kThreadCounts = {1, 2, 4, 8, 16, 32};
+    constexpr unsigned int kNumOperationsPerThread = 20000;
+
+    for (const unsigned int numThreads : kThreadCounts)
+    {
+      OpenHandleStore handleStore;
+
+      const auto startTime = std::chrono::steady_clock::now();
+      const unsigned int numFailedOperations =
+          RunConcurrentIndependentHandlesWorkload(handleStore, numThreads, kNumOperationsPerThread);
+      const std::chrono::duration<double> elapsedTime =
+          std::chrono::steady_clock::now() - startTime;
+
+      TEST_ASSERT(0 == numFailedOperations);
+
+      TEST_PRINT_MESSAGE(
+          L"%2u threads: %.0f operations per second.",
+          numThreads,
+          (static_cast<double>(numThreads) * static_cast<double>(kNumOperationsPerThread)) /
+              std::max(elapsedTime.count(), 1e-9));
+    }
+  }
 } // namespace PathwinderTest
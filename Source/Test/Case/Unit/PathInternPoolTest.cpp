@@ -0,0 +1,137 @@
+/***************************************************************************************************
+ * Pathwinder
+ *   Path redirection for files, directories, and registry entries.
+ ***************************************************************************************************
+ * Authored by Samuel Grossman
+ * Copyright (c) 2022-2025
+ ***********************************************************************************************//**
+ * @file PathInternPoolTest.cpp
+ *   Unit tests for the pool that stores a single reference-counted copy of each distinct path.
+ **************************************************************************************************/
+
+#include "PathInternPool.h"
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <Infra/Test/TestCase.h>
+
+namespace PathwinderTest
+{
+  using namespace ::Pathwinder;
+
+  // Verifies that interning the same path multiple times results in a single copy being held by
+  // the pool and that all of the references refer to that same copy.
+  TEST_CASE(PathInternPool_Intern_IdenticalPathsShared)
+  {
+    constexpr std::wstring_view kPath = L"C:\\Directory\\Subdirectory\\File.txt";
+
+    PathInternPool pathInternPool;
+
+    const PathInternPool::InternedPath firstPath = pathInternPool.Intern(std::wstring(kPath));
+    const PathInternPool::InternedPath secondPath = pathInternPool.Intern(std::wstring(kPath));
+
+    TEST_ASSERT(firstPath.AsStringView() == kPath);
+    TEST_ASSERT(secondPath.AsStringView() == kPath);
+    TEST_ASSERT(firstPath.AsCString() == secondPath.AsCString());
+    TEST_ASSERT(1 == pathInternPool.Size());
+  }
+
+  // Verifies that paths differing only by case are held separately, because the exact path
+  // representation is significant.
+  TEST_CASE(PathInternPool_Intern_DifferentCaseHeldSeparately)
+  {
+    PathInternPool pathInternPool;
+
+    const PathInternPool::InternedPath lowerCasePath =
+        pathInternPool.Intern(std::wstring(L"C:\\directory"));
+    const PathInternPool::InternedPath upperCasePath =
+        pathInternPool.Intern(std::wstring(L"C:\\DIRECTORY"));
+
+    TEST_ASSERT(lowerCasePath.AsStringView() == L"C:\\directory");
+    TEST_ASSERT(upperCasePath.AsStringView() == L"C:\\DIRECTORY");
+    TEST_ASSERT(false == (lowerCasePath == upperCasePath));
+    TEST_ASSERT(2 == pathInternPool.Size());
+  }
+
+  // Verifies that empty paths are represented without being added to the pool.
+  TEST_CASE(PathInternPool_Intern_EmptyPath)
+  {
+    PathInternPool pathInternPool;
+
+    const PathInternPool::InternedPath emptyPath = pathInternPool.Intern(std::wstring());
+
+    TEST_ASSERT(true == emptyPath.AsStringView().empty());
+    TEST_ASSERT(std::wstring_view(L"") == emptyPath.AsCString());
+    TEST_ASSERT(emptyPath == PathInternPool::InternedPath());
+    TEST_ASSERT(0 == pathInternPool.Size());
+  }
+
+  // Verifies that a path is freed once its last reference is destroyed, including references that
+  // were moved from one object to another along the way.
+  TEST_CASE(PathInternPool_Release_FreedWithLastReference)
+  {
+    constexpr std::wstring_view kPath = L"C:\\Directory";
+
+    PathInternPool pathInternPool;
+
+    std::optional<PathInternPool::InternedPath> firstPath =
+        pathInternPool.Intern(std::wstring(kPath));
+    std::optional<PathInternPool::InternedPath> secondPath =
+        pathInternPool.Intern(std::wstring(kPath));
+    TEST_ASSERT(1 == pathInternPool.Size());
+
+    PathInternPool::InternedPath movedPath = std::move(*firstPath);
+    firstPath.reset();
+    TEST_ASSERT(1 == pathInternPool.Size());
+    TEST_ASSERT(movedPath.AsStringView() == kPath);
+
+    secondPath.reset();
+    TEST_ASSERT(1 == pathInternPool.Size());
+
+    movedPath = PathInternPool::InternedPath();
+    TEST_ASSERT(0 == pathInternPool.Size());
+  }
+
+  // Verifies that many threads concurrently obtaining and destroying references to the same path,
+  // such that its last reference is repeatedly destroyed and the path added back to the pool,
+  // always see the correct path and leave nothing behind in the pool once they are done.
+  TEST_CASE(PathInternPool_Release_ConcurrentIdenticalPaths)
+  {
+    constexpr std::wstring_view kPath = L"C:\\Directory\\Subdirectory\\File.txt";
+    constexpr unsigned int kNumThreads = 8;
+    constexpr unsigned int kNumIterationsPerThread = 10000;
+
+    PathInternPool pathInternPool;
+    std::atomic<unsigned int> numIncorrectPaths = 0;
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < kNumThreads; ++i)
+    {
+      threads.emplace_back(
+          [&pathInternPool, &numIncorrectPaths, kPath]() -> void
+          {
+            for (unsigned int j = 0; j < kNumIterationsPerThread; ++j)
+            {
+              PathInternPool::InternedPath firstPath = pathInternPool.Intern(std::wstring(kPath));
+              PathInternPool::InternedPath secondPath = pathInternPool.Intern(std::wstring(kPath));
+
+              if ((firstPath.AsStringView() != kPath) ||
+                  (firstPath.AsCString() != secondPath.AsCString()))
+                numIncorrectPaths += 1;
+            }
+          });
+    }
+
+    for (auto& thread : threads)
+      thread.join();
+
+    TEST_ASSERT(0 == numIncorrectPaths);
+    TEST_ASSERT(0 == pathInternPool.Size());
+  }
+} // namespace PathwinderTest
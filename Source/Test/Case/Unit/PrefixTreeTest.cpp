@@ -12,6 +12,8 @@
 
 #include "PrefixTree.h"
 
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <unordered_map>
 
@@ -379,6 +381,64 @@ namespace PathwinderTest
     TEST_ASSERT(nullptr == longestMatchingPrefixNode);
   }
 
+  // Walks part of the way down the tree and then resumes the walk with the rest of several longer
+  // strings. Verifies that the resumed walk reaches the same position as a full walk would have.
+  TEST_CASE(PrefixTree_WalkFrom_ResumedMatchesFullWalk)
+  {
+    TTestPrefixTree index(L"\\");
+
+    TEST_ASSERT(true == index.Insert(L"Root\\Level1", 11).second);
+    TEST_ASSERT(true == index.Insert(L"Root\\Level1\\Level2\\Level3", 13).second);
+
+    const auto partialWalkPosition = index.Walk(L"Root\\Level1");
+    TEST_ASSERT(true == partialWalkPosition.isOnPath);
+    TEST_ASSERT(index.Find(L"Root\\Level1") == partialWalkPosition.longestMatchingPrefixNode);
+
+    constexpr std::wstring_view kRemainingStrings[] = {
+        L"",
+        L"\\Level2",
+        L"\\Level2\\Level3",
+        L"\\Level2\\Level3\\Level4\\Level5",
+        L"\\OtherLevel2\\Level3",
+        L"\\\\Level2\\\\Level3\\"};
+
+    for (const auto& remainingString : kRemainingStrings)
+    {
+      const std::wstring fullString = std::wstring(L"Root\\Level1") + std::wstring(remainingString);
+
+      const auto expectedWalkPosition = index.Walk(fullString);
+      const auto actualWalkPosition = index.WalkFrom(partialWalkPosition, remainingString);
+
+      TEST_ASSERT(actualWalkPosition.node == expectedWalkPosition.node);
+      TEST_ASSERT(
+          actualWalkPosition.longestMatchingPrefixNode ==
+          expectedWalkPosition.longestMatchingPrefixNode);
+      TEST_ASSERT(actualWalkPosition.isOnPath == expectedWalkPosition.isOnPath);
+      TEST_ASSERT(
+          actualWalkPosition.longestMatchingPrefixNode == index.LongestMatchingPrefix(fullString));
+    }
+  }
+
+  // Walks down the tree along a string that leaves the tree partway through and then attempts to
+  // resume the walk. Verifies that the walk is reported as having left the tree and that resuming
+  // it does not reach any deeper nodes.
+  TEST_CASE(PrefixTree_WalkFrom_LeftTree)
+  {
+    TTestPrefixTree index(L"\\");
+
+    TEST_ASSERT(true == index.Insert(L"Root\\Level1\\Level2", 12).second);
+
+    const auto partialWalkPosition = index.Walk(L"Root\\Other");
+    TEST_ASSERT(false == partialWalkPosition.isOnPath);
+    TEST_ASSERT(nullptr == partialWalkPosition.longestMatchingPrefixNode);
+    TEST_ASSERT(index.TraverseTo(L"Root") == partialWalkPosition.node);
+
+    const auto resumedWalkPosition = index.WalkFrom(partialWalkPosition, L"\\Level1\\Level2");
+    TEST_ASSERT(false == resumedWalkPosition.isOnPath);
+    TEST_ASSERT(nullptr == resumedWalkPosition.longestMatchingPrefixNode);
+    TEST_ASSERT(partialWalkPosition.node == resumedWalkPosition.node);
+  }
+
   // Creates a small hierarchy of prefixes, including a common base node for a few sub-nodes.
   // Verifies that the base node is correctly identified as the ancestor when the sub-nodes are
   // queried for their ancestors.
@@ -11,7 +11,13 @@
 
 #include "ThreadPool.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
 
 #include <Infra/Test/TestCase.h>
 
@@ -139,4 +145,176 @@ namespace PathwinderTest
     secondThreadPool.WaitForOutstandingWork();
     TEST_ASSERT(actualNumCallbacksInvoked == expectedNumCallbacksInvoked);
   }
+
+  // Verifies that multiple work items can be submitted to a thread pool backed by the portable
+  // work-stealing implementation and that they all execute and complete successfully.
+  TEST_CASE(ThreadPool_WorkStealing_MultipleWork)
+  {
+    constexpr int expectedNumCallbacksInvoked = 10000;
+    std::atomic<int> actualNumCallbacksInvoked = 0;
+
+    std::optional<ThreadPool> threadPool = ThreadPool::Create(4);
+    TEST_ASSERT(threadPool.has_value());
+
+    for (int i = 0; i < expectedNumCallbacksInvoked; ++i)
+    {
+      TEST_ASSERT(
+          true ==
+          threadPool->SubmitWork(
+              [](PTP_CALLBACK_INSTANCE, PVOID param) -> void
+              {
+                *(reinterpret_cast<std::atomic<int>*>(param)) += 1;
+              },
+              &actualNumCallbacksInvoked));
+    }
+
+    threadPool->WaitForOutstandingWork();
+    TEST_ASSERT(actualNumCallbacksInvoked == expectedNumCallbacksInvoked);
+  }
+
+  // Verifies that work items submitted to a thread pool backed by the portable work-stealing
+  // implementation all execute and complete successfully, even when the thread pool object is
+  // move-assigned in the middle of the work.
+  TEST_CASE(ThreadPool_WorkStealing_AssignDuringMultipleWork)
+  {
+    constexpr int expectedNumCallbacksInvoked = 100;
+    std::atomic<int> actualNumCallbacksInvoked = 0;
+
+    std::optional<ThreadPool> threadPool = ThreadPool::Create(2);
+    TEST_ASSERT(threadPool.has_value());
+
+    for (int i = 0; i < expectedNumCallbacksInvoked; ++i)
+    {
+      TEST_ASSERT(
+          true ==
+          threadPool->SubmitWork(
+              [](PTP_CALLBACK_INSTANCE, PVOID param) -> void
+              {
+                Sleep(1);
+                *(reinterpret_cast<std::atomic<int>*>(param)) += 1;
+              },
+              &actualNumCallbacksInvoked));
+    }
+
+    ThreadPool secondThreadPool(std::move(*threadPool));
+    threadPool = std::nullopt;
+
+    secondThreadPool.WaitForOutstandingWork();
+    TEST_ASSERT(actualNumCallbacksInvoked == expectedNumCallbacksInvoked);
+  }
+
+  // Verifies that both the Windows thread pool and the portable work-stealing thread pool execute
+  // every one of a large number of short, independent work items exactly once on a workload that
+  // resembles asynchronous directory enumeration, in which a single thread submits all of them.
+  // Each work item has its own counter, so any work item that is lost or executed more than once
+  // causes a failure.
+  TEST_CASE(ThreadPool_AsyncDirectoryEnumeration_EachWorkItemExecutedOnce)
+  {
+    constexpr unsigned int kNumWorkItems = 20000;
+
+    for (const unsigned int numWorkerThreads : {0u, 4u})
+    {
+      std::vector<std::atomic<unsigned int>> numTimesExecuted(kNumWorkItems);
+
+      std::optional<ThreadPool> threadPool = ThreadPool::Create(numWorkerThreads);
+      TEST_ASSERT(threadPool.has_value());
+
+      for (auto& numTimesWorkItemExecuted : numTimesExecuted)
+      {
+        TEST_ASSERT(
+            true ==
+            threadPool->SubmitWork(
+                [](PTP_CALLBACK_INSTANCE, PVOID param) -> void
+                {
+                  *(reinterpret_cast<std::atomic<unsigned int>*>(param)) += 1;
+                },
+                &numTimesWorkItemExecuted));
+      }
+
+      threadPool->WaitForOutstandingWork();
+      TEST_ASSERT(
+          true ==
+          std::all_of(
+              numTimesExecuted.cbegin(),
+              numTimesExecuted.cend(),
+              [](const std::atomic<unsigned int>& numTimesWorkItemExecuted) -> bool
+              {
+                return (1 == numTimesWorkItemExecuted);
+              }));
+    }
+  }
+
+  // Compares the Windows thread pool with the portable work-stealing thread pool on a workload that
+  // resembles asynchronous directory enumeration, in which a single thread submits a large number
+  // of short, independent work items. Measures both the average latency of submitting a work item
+  // and the overall throughput. Submitting to the work-stealing thread pool only appends to an
+  // in-memory queue, so it is expected to be no slower than submitting to the Windows thread pool.
+  // This is a benchmark, so the measurements are reported but not checked, because they depend on
+  // the load on the machine running the test.
+  TEST_CASE(ThreadPool_AsyncDirectoryEnumeration_Benchmark)
+  {
+    constexpr unsigned int kNumWorkItems = 20000;
+
+    struct SBenchmarkResult
+    {
+      std::chrono::duration<double> submissionLatency;
+      double workItemsPerSecond;
+    };
+
+    auto runBenchmark = [](unsigned int numWorkerThreads) -> SBenchmarkResult
+    {
+      std::atomic<uint64_t> checksum = 0;
+
+      std::optional<ThreadPool> threadPool = ThreadPool::Create(numWorkerThreads);
+      TEST_ASSERT(threadPool.has_value());
+
+      std::chrono::steady_clock::duration totalSubmissionTime{};
+      const auto startTime = std::chrono::steady_clock::now();
+
+      for (unsigned int i = 0; i < kNumWorkItems; ++i)
+      {
+        const auto submissionStartTime = std::chrono::steady_clock::now();
+        const bool submitted = threadPool->SubmitWork(
+            [](PTP_CALLBACK_INSTANCE, PVOID param) -> void
+            {
+              uint64_t value = 0;
+              for (uint64_t j = 0; j < 2000; ++j)
+                value = (value * 31) + j;
+
+              reinterpret_cast<std::atomic<uint64_t>*>(param)->fetch_add(
+                  value, std::memory_order_relaxed);
+            },
+            &checksum);
+        totalSubmissionTime += (std::chrono::steady_clock::now() - submissionStartTime);
+
+        TEST_ASSERT(true == submitted);
+      }
+
+      threadPool->WaitForOutstandingWork();
+
+      const std::chrono::duration<double> elapsedTime =
+          std::chrono::steady_clock::now() - startTime;
+
+      TEST_ASSERT(0 != checksum);
+
+      return {
+          .submissionLatency =
+              std::chrono::duration<double>(totalSubmissionTime) / kNumWorkItems,
+          .workItemsPerSecond =
+              static_cast<double>(kNumWorkItems) / std::max(elapsedTime.count(), 1e-9)};
+    };
+
+    const SBenchmarkResult windowsThreadPoolResult = runBenchmark(0);
+    const SBenchmarkResult workStealingThreadPoolResult =
+        runBenchmark(std::max(1u, std::thread::hardware_concurrency()));
+
+    TEST_PRINT_MESSAGE(
+        L"Windows thread pool: %.3f us per submission, %.0f work items per second.",
+        windowsThreadPoolResult.submissionLatency.count() * 1e6,
+        windowsThreadPoolResult.workItemsPerSecond);
+    TEST_PRINT_MESSAGE(
+        L"Work-stealing thread pool: %.3f us per submission, %.0f work items per second.",
+        workStealingThreadPoolResult.submissionLatency.count() * 1e6,
+        workStealingThreadPoolResult.workItemsPerSecond);
+  }
 } // namespace PathwinderTest
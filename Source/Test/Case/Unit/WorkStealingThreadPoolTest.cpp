@@ -0,0 +1,370 @@
+/***************************************************************************************************
+ * Pathwinder
+ *   Path redirection for files, directories, and registry entries.
+ ***************************************************************************************************
+ * Authored by Samuel Grossman
+ * Copyright (c) 2022-2025
+ ***********************************************************************************************//**
+ * @file WorkStealingThreadPoolTest.cpp
+ *   Unit tests for the portable work-stealing thread pool.
+ **************************************************************************************************/
+
+#include "WorkStealingThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <Infra/Test/TestCase.h>
+
+namespace PathwinderTest
+{
+  using namespace ::Pathwinder;
+
+  /// Type alias for a work-stealing thread pool whose callbacks have the same shape as those of
+  /// the Windows thread pool but do not depend on any Windows types.
+  using TTestThreadPool = WorkStealingThreadPool<void (*)(void*, void*)>;
+
+  // Nominally verifies that submitting a single work item to a thread pool results in the work item
+  // executing and completing successfully.
+  TEST_CASE(WorkStealingThreadPool_SingleWork)
+  {
+    bool callbackInvoked = false;
+
+    TTestThreadPool threadPool(2);
+    TEST_ASSERT(2 == threadPool.NumWorkerThreads());
+
+    TEST_ASSERT(
+        true ==
+        threadPool.SubmitWork(
+            [](void*, void* param) -> void
+            {
+              *(reinterpret_cast<bool*>(param)) = true;
+            },
+            &callbackInvoked));
+
+    threadPool.WaitForOutstandingWork();
+    TEST_ASSERT(true == callbackInvoked);
+  }
+
+  // Verifies that multiple work items can be submitted to the thread pool and that they all execute
+  // and complete successfully.
+  TEST_CASE(WorkStealingThreadPool_MultipleWork)
+  {
+    constexpr int expectedNumCallbacksInvoked = 10000;
+    std::atomic<int> actualNumCallbacksInvoked = 0;
+
+    TTestThreadPool threadPool(4);
+
+    for (int i = 0; i < expectedNumCallbacksInvoked; ++i)
+    {
+      TEST_ASSERT(
+          true ==
+          threadPool.SubmitWork(
+              [](void*, void* param) -> void
+              {
+                *(reinterpret_cast<std::atomic<int>*>(param)) += 1;
+              },
+              &actualNumCallbacksInvoked));
+    }
+
+    threadPool.WaitForOutstandingWork();
+    TEST_ASSERT(actualNumCallbacksInvoked == expectedNumCallbacksInvoked);
+  }
+
+  // Verifies that worker threads are started only once work is submitted and that no more than the
+  // requested number of them are started when none of them ever blocks.
+  TEST_CASE(WorkStealingThreadPool_WorkersStartedOnDemand)
+  {
+    constexpr unsigned int kNumWorkers = 4;
+    std::atomic<int> numCallbacksInvoked = 0;
+
+    TTestThreadPool threadPool(kNumWorkers);
+    TEST_ASSERT(0 == threadPool.NumStartedWorkerThreads());
+
+    for (int i = 0; i < 1000; ++i)
+    {
+      TEST_ASSERT(
+          true ==
+          threadPool.SubmitWork(
+              [](void*, void* param) -> void
+              {
+                *(reinterpret_cast<std::atomic<int>*>(param)) += 1;
+              },
+              &numCallbacksInvoked));
+    }
+
+    threadPool.WaitForOutstandingWork();
+    TEST_ASSERT(1000 == numCallbacksInvoked);
+    TEST_ASSERT(threadPool.NumStartedWorkerThreads() >= 1);
+    TEST_ASSERT(threadPool.NumStartedWorkerThreads() <= kNumWorkers);
+  }
+
+  // Verifies that a work item which blocks waiting for another work item it submitted does not
+  // deadlock a thread pool with only one worker, provided that it marks the wait as blocking. The
+  // submitted work item goes into the blocked worker's own queue, so it can only execute if another
+  // worker is started to take the blocked worker's place. The wait gives up after a generous amount
+  // of time so that a failure does not hang the test.
+  TEST_CASE(WorkStealingThreadPool_BlockingWaitStartsReplacementWorker)
+  {
+    struct SBlockingTestContext
+    {
+      TTestThreadPool* threadPool = nullptr;
+      std::atomic<bool> childWorkItemCompleted = false;
+    };
+
+    TTestThreadPool threadPool(1);
+    SBlockingTestContext blockingTestContext;
+    blockingTestContext.threadPool = &threadPool;
+
+    TEST_ASSERT(
+        true ==
+        threadPool.SubmitWork(
+            [](void*, void* param) -> void
+            {
+              SBlockingTestContext* const blockingTestContext =
+                  reinterpret_cast<SBlockingTestContext*>(param);
+
+              const bool submitted = blockingTestContext->threadPool->SubmitWork(
+                  [](void*, void* param) -> void
+                  {
+                    reinterpret_cast<SBlockingTestContext*>(param)->childWorkItemCompleted = true;
+                  },
+                  blockingTestContext);
+              if (false == submitted) return;
+
+              TTestThreadPool::BeginBlockingWait();
+
+              const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+              while ((false == blockingTestContext->childWorkItemCompleted) &&
+                     (std::chrono::steady_clock::now() < deadline))
+                std::this_thread::yield();
+
+              TTestThreadPool::EndBlockingWait();
+            },
+            &blockingTestContext));
+
+    threadPool.WaitForOutstandingWork();
+    TEST_ASSERT(true == blockingTestContext.childWorkItemCompleted);
+    TEST_ASSERT(2 == threadPool.NumStartedWorkerThreads());
+  }
+
+  // Verifies that work items submitted by a worker thread are placed into that worker's own queue
+  // and stolen by the other workers. The submitting work item does not complete until all of the
+  // work items it submitted have completed, so its worker is busy the whole time and every one of
+  // them must be stolen in order to execute at all.
+  TEST_CASE(WorkStealingThreadPool_WorkSubmittedByWorkerStolen)
+  {
+    constexpr int kNumChildWorkItems = 64;
+
+    struct SStealTestContext
+    {
+      TTestThreadPool* threadPool = nullptr;
+      std::thread::id submittingThread;
+      std::atomic<int> numChildWorkItemsSubmitted = 0;
+      std::atomic<int> numChildWorkItemsCompleted = 0;
+      std::mutex executingThreadsMutex;
+      std::set<std::thread::id> executingThreads;
+    };
+
+    TTestThreadPool threadPool(4);
+    SStealTestContext stealTestContext;
+    stealTestContext.threadPool = &threadPool;
+
+    TEST_ASSERT(
+        true ==
+        threadPool.SubmitWork(
+            [](void*, void* param) -> void
+            {
+              SStealTestContext* const stealTestContext =
+                  reinterpret_cast<SStealTestContext*>(param);
+              stealTestContext->submittingThread = std::this_thread::get_id();
+
+              for (int i = 0; i < kNumChildWorkItems; ++i)
+              {
+                const bool submitted = stealTestContext->threadPool->SubmitWork(
+                    [](void*, void* param) -> void
+                    {
+                      SStealTestContext* const stealTestContext =
+                          reinterpret_cast<SStealTestContext*>(param);
+
+                      do
+                      {
+                        std::scoped_lock lock(stealTestContext->executingThreadsMutex);
+                        stealTestContext->executingThreads.insert(std::this_thread::get_id());
+                      }
+                      while (false);
+
+                      stealTestContext->numChildWorkItemsCompleted += 1;
+                    },
+                    stealTestContext);
+
+                if (true == submitted) stealTestContext->numChildWorkItemsSubmitted += 1;
+              }
+
+              while (stealTestContext->numChildWorkItemsCompleted <
+                     stealTestContext->numChildWorkItemsSubmitted)
+                std::this_thread::yield();
+            },
+            &stealTestContext));
+
+    threadPool.WaitForOutstandingWork();
+    TEST_ASSERT(kNumChildWorkItems == stealTestContext.numChildWorkItemsSubmitted);
+    TEST_ASSERT(kNumChildWorkItems == stealTestContext.numChildWorkItemsCompleted);
+    TEST_ASSERT(false == stealTestContext.executingThreads.empty());
+    TEST_ASSERT(
+        false == stealTestContext.executingThreads.contains(stealTestContext.submittingThread));
+  }
+
+  // Verifies that work items submitted after all of the workers have stopped spinning and parked
+  // still wake a worker up and execute.
+  TEST_CASE(WorkStealingThreadPool_WakeAfterPark)
+  {
+    std::atomic<int> numCallbacksInvoked = 0;
+
+    TTestThreadPool threadPool(2);
+
+    for (int i = 1; i <= 3; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+      TEST_ASSERT(
+          true ==
+          threadPool.SubmitWork(
+              [](void*, void* param) -> void
+              {
+                *(reinterpret_cast<std::atomic<int>*>(param)) += 1;
+              },
+              &numCallbacksInvoked));
+
+      threadPool.WaitForOutstandingWork();
+      TEST_ASSERT(i == numCallbacksInvoked);
+    }
+  }
+
+  // Verifies that thread pool deletion results in all outstanding work items being executed
+  // before the worker threads stop, so that nothing waiting for a work item to complete is left
+  // waiting forever.
+  TEST_CASE(WorkStealingThreadPool_DestroyCompletesOutstandingWork)
+  {
+    constexpr int kNumWorkItemsSubmitted = 1000;
+    std::atomic<int> numWorkItemsCompleted = 0;
+
+    do
+    {
+      TTestThreadPool threadPool(2);
+
+      for (int i = 0; i < kNumWorkItemsSubmitted; ++i)
+      {
+        TEST_ASSERT(
+            true ==
+            threadPool.SubmitWork(
+                [](void*, void* param) -> void
+                {
+                  std::this_thread::sleep_for(std::chrono::microseconds(100));
+                  *(reinterpret_cast<std::atomic<int>*>(param)) += 1;
+                },
+                &numWorkItemsCompleted));
+      }
+    }
+    while (false);
+
+    TEST_ASSERT(kNumWorkItemsSubmitted == numWorkItemsCompleted);
+  }
+
+  // Verifies that, with between 1 and 8 workers, every one of a large number of small, independent
+  // work items submitted by a single thread executes exactly once, which mirrors many asynchronous
+  // directory enumeration requests arriving at once. Each work item has its own counter, so any
+  // work item that is lost or executed more than once causes a failure.
+  TEST_CASE(WorkStealingThreadPool_EachWorkItemExecutedOnce)
+  {
+    constexpr std::array<unsigned int, 4> kWorkerCounts = {1, 2, 4, 8};
+    constexpr unsigned int kNumWorkItems = 20000;
+
+    for (const unsigned int numWorkers : kWorkerCounts)
+    {
+      std::vector<std::atomic<unsigned int>> numTimesExecuted(kNumWorkItems);
+
+      TTestThreadPool threadPool(numWorkers);
+
+      for (auto& numTimesWorkItemExecuted : numTimesExecuted)
+      {
+        TEST_ASSERT(
+            true ==
+            threadPool.SubmitWork(
+                [](void*, void* param) -> void
+                {
+                  *(reinterpret_cast<std::atomic<unsigned int>*>(param)) += 1;
+                },
+                &numTimesWorkItemExecuted));
+      }
+
+      threadPool.WaitForOutstandingWork();
+      TEST_ASSERT(
+          true ==
+          std::all_of(
+              numTimesExecuted.cbegin(),
+              numTimesExecuted.cend(),
+              [](const std::atomic<unsigned int>& numTimesWorkItemExecuted) -> bool
+              {
+                return (1 == numTimesWorkItemExecuted);
+              }));
+    }
+  }
+
+  // Measures the throughput of the thread pool with between 1 and 8 workers executing a large
+  // number of small, independent work items submitted by a single thread, which mirrors many
+  // asynchronous directory enumeration requests arriving at once. Throughput should not drop as
+  // workers are added, up to the number of available processors. This is a benchmark, so
+  // throughput is reported but not checked, because it depends on the load on the machine running
+  // the test.
+  TEST_CASE(WorkStealingThreadPool_ThroughputBenchmark)
+  {
+    constexpr std::array<unsigned int, 4> kWorkerCounts = {1, 2, 4, 8};
+    constexpr unsigned int kNumWorkItems = 20000;
+
+    for (const unsigned int numWorkers : kWorkerCounts)
+    {
+      std::atomic<uint64_t> checksum = 0;
+
+      TTestThreadPool threadPool(numWorkers);
+
+      const auto startTime = std::chrono::steady_clock::now();
+
+      for (unsigned int i = 0; i < kNumWorkItems; ++i)
+      {
+        TEST_ASSERT(
+            true ==
+            threadPool.SubmitWork(
+                [](void*, void* param) -> void
+                {
+                  uint64_t value = 0;
+                  for (uint64_t j = 0; j < 2000; ++j)
+                    value = (value * 31) + j;
+
+                  reinterpret_cast<std::atomic<uint64_t>*>(param)->fetch_add(
+                      value, std::memory_order_relaxed);
+                },
+                &checksum));
+      }
+
+      threadPool.WaitForOutstandingWork();
+
+      const std::chrono::duration<double> elapsedTime =
+          std::chrono::steady_clock::now() - startTime;
+
+      TEST_ASSERT(0 != checksum);
+
+      TEST_PRINT_MESSAGE(
+          L"%u workers: %.0f work items per second.",
+          numWorkers,
+          static_cast<double>(kNumWorkItems) / std::max(elapsedTime.count(), 1e-9));
+    }
+  }
+} // namespace PathwinderTest
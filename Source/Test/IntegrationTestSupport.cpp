@@ -62,10 +62,11 @@ namespace PathwinderTest
         [&context](
             std::wstring_view absolutePath,
             FileAccessMode fileAccessMode,
-            CreateDisposition createDisposition) -> FileOperationInstruction
+            CreateDisposition createDisposition,
+            SPathLookupResumePoint* rootDirectoryResumePoint) -> FileOperationInstruction
         {
           return context->filesystemDirector.GetInstructionForFileOperation(
-              absolutePath, fileAccessMode, createDisposition);
+              absolutePath, fileAccessMode, createDisposition, rootDirectoryResumePoint);
         },
         [&context, isDirectory](
             PHANDLE fileHandle,
@@ -126,11 +127,14 @@ namespace PathwinderTest
         nextFileInformation.CapacityBytes(),
         SFileNamesInformation::kFileInformationClass,
         nullptr,
-        [&context](std::wstring_view associatedPath, std::wstring_view realOpenedPath)
+        [&context](
+            std::wstring_view associatedPath,
+            std::wstring_view realOpenedPath,
+            RelatedFilesystemRuleContainer::TFilesystemRulesIndex redirectingRuleIndex)
             -> DirectoryEnumerationInstruction
         {
           return context->filesystemDirector.GetInstructionForDirectoryEnumeration(
-              associatedPath, realOpenedPath);
+              associatedPath, realOpenedPath, redirectingRuleIndex);
         });
 
     TEST_ASSERT_WITH_FAILURE_MESSAGE(
@@ -341,7 +345,10 @@ namespace PathwinderTest
   }
 
   HANDLE OpenUsingFilesystemExecutor(
-      TIntegrationTestContext& context, std::wstring_view pathToOpen, HANDLE rootDirectory)
+      TIntegrationTestContext& context,
+      std::wstring_view pathToOpen,
+      HANDLE rootDirectory,
+      ULONG additionalCreateOptions)
   {
     HANDLE newlyOpenedFileHandle = nullptr;
 
@@ -361,14 +368,15 @@ namespace PathwinderTest
         &pathToOpenObjectAttributes,
         0,
         FILE_OPEN,
-        FILE_SYNCHRONOUS_IO_NONALERT,
+        (FILE_SYNCHRONOUS_IO_NONALERT | additionalCreateOptions),
         [&context](
             std::wstring_view absolutePath,
             FileAccessMode fileAccessMode,
-            CreateDisposition createDisposition) -> FileOperationInstruction
+            CreateDisposition createDisposition,
+            SPathLookupResumePoint* rootDirectoryResumePoint) -> FileOperationInstruction
         {
           return context->filesystemDirector.GetInstructionForFileOperation(
-              absolutePath, fileAccessMode, createDisposition);
+              absolutePath, fileAccessMode, createDisposition, rootDirectoryResumePoint);
         },
         [&context](PHANDLE fileHandle, POBJECT_ATTRIBUTES objectAttributes, ULONG createDisposition)
             -> NTSTATUS
@@ -420,10 +428,11 @@ namespace PathwinderTest
         [&context](
             std::wstring_view absolutePath,
             FileAccessMode fileAccessMode,
-            CreateDisposition createDisposition) -> FileOperationInstruction
+            CreateDisposition createDisposition,
+            SPathLookupResumePoint* rootDirectoryResumePoint) -> FileOperationInstruction
         {
           return context->filesystemDirector.GetInstructionForFileOperation(
-              absolutePath, fileAccessMode, createDisposition);
+              absolutePath, fileAccessMode, createDisposition, rootDirectoryResumePoint);
         },
         [&context](POBJECT_ATTRIBUTES objectAttributes) -> NTSTATUS
         {
@@ -16,6 +16,7 @@
 #include <set>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <Infra/Test/TestCase.h>
 
@@ -28,15 +29,26 @@ namespace PathwinderTest
       : fileInformationStructLayout(),
         fileNamesToEnumerate(),
         nextFileNameToEnumerate(),
+        fileNamesToEnumerateAfterRestart(),
         enumerationStatusOverride(enumerationStatus)
   {}
 
   MockDirectoryOperationQueue::MockDirectoryOperationQueue(
       Pathwinder::FileInformationStructLayout fileInformationStructLayout,
       TFileNamesToEnumerate&& fileNamesToEnumerate)
+      : MockDirectoryOperationQueue(
+            fileInformationStructLayout,
+            TUnsortedFileNamesToEnumerate(
+                fileNamesToEnumerate.cbegin(), fileNamesToEnumerate.cend()))
+  {}
+
+  MockDirectoryOperationQueue::MockDirectoryOperationQueue(
+      Pathwinder::FileInformationStructLayout fileInformationStructLayout,
+      TUnsortedFileNamesToEnumerate&& fileNamesToEnumerate)
       : fileInformationStructLayout(fileInformationStructLayout),
         fileNamesToEnumerate(std::move(fileNamesToEnumerate)),
         nextFileNameToEnumerate(),
+        fileNamesToEnumerateAfterRestart(),
         enumerationStatusOverride()
   {
     if (Pathwinder::FileInformationStructLayout() == this->fileInformationStructLayout)
@@ -89,10 +101,27 @@ namespace PathwinderTest
     if (false == fileNamesToEnumerate.empty()) ++nextFileNameToEnumerate;
   }
 
+  void MockDirectoryOperationQueue::SetFileNamesToEnumerateAfterRestart(
+      TUnsortedFileNamesToEnumerate&& fileNamesToEnumerate)
+  {
+    if (true == fileNamesToEnumerate.empty())
+      TEST_FAILED_BECAUSE(
+          L"%s: Test implementation error due to replacement of filenames to enumerate with an empty set.",
+          __FUNCTIONW__);
+
+    fileNamesToEnumerateAfterRestart = std::move(fileNamesToEnumerate);
+  }
+
   void MockDirectoryOperationQueue::Restart(std::wstring_view queryFilePattern)
   {
     lastRestartedQueryFilePattern = queryFilePattern;
 
+    if (true == fileNamesToEnumerateAfterRestart.has_value())
+    {
+      fileNamesToEnumerate = std::move(*fileNamesToEnumerateAfterRestart);
+      fileNamesToEnumerateAfterRestart.reset();
+    }
+
     if (false == fileNamesToEnumerate.empty())
       nextFileNameToEnumerate = fileNamesToEnumerate.cbegin();
   }
@@ -11,11 +11,16 @@
 
 #include "MockFilesystemOperations.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <cwctype>
+#include <iterator>
 #include <limits>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 
 #include <Infra/Core/ValueOrError.h>
@@ -43,19 +48,129 @@ namespace PathwinderTest
     return filePatternString;
   }
 
+  /// Determines if the specified directory enumeration has no more items to enumerate.
+  /// @param [in] enumerationState Directory enumeration state to check.
+  /// @return `true` if the enumeration is complete, `false` otherwise.
+  static bool IsDirectoryEnumerationComplete(
+      const MockFilesystemOperations::SDirectoryEnumerationState& enumerationState)
+  {
+    if (true == enumerationState.reverseOrder)
+      return (enumerationState.beginIterator == enumerationState.nextItemIterator);
+
+    return (enumerationState.endIterator == enumerationState.nextItemIterator);
+  }
+
+  /// Retrieves the filename of the next item to be enumerated in the specified directory
+  /// enumeration, which must not already be complete.
+  /// @param [in] enumerationState Directory enumeration state to query.
+  /// @return Filename of the next item to be enumerated.
+  static std::wstring_view DirectoryEnumerationNextFileName(
+      const MockFilesystemOperations::SDirectoryEnumerationState& enumerationState)
+  {
+    if (true == enumerationState.reverseOrder)
+      return std::prev(enumerationState.nextItemIterator)->first;
+
+    return enumerationState.nextItemIterator->first;
+  }
+
+  /// Advances the specified directory enumeration to its next item.
+  /// @param [in, out] enumerationState Directory enumeration state to advance.
+  static void DirectoryEnumerationAdvance(
+      MockFilesystemOperations::SDirectoryEnumerationState& enumerationState)
+  {
+    if (true == enumerationState.reverseOrder)
+      --enumerationState.nextItemIterator;
+    else
+      ++enumerationState.nextItemIterator;
+  }
+
+  /// Resets the specified directory enumeration so that it starts again from the beginning.
+  /// @param [in, out] enumerationState Directory enumeration state to reset.
+  static void DirectoryEnumerationReset(
+      MockFilesystemOperations::SDirectoryEnumerationState& enumerationState)
+  {
+    if (true == enumerationState.reverseOrder)
+      enumerationState.nextItemIterator = enumerationState.endIterator;
+    else
+      enumerationState.nextItemIterator = enumerationState.beginIterator;
+  }
+
   MockFilesystemOperations::MockFilesystemOperations(void)
       : configAllowCloseInvalidHandle(),
         configAllowOpenNonExistentFile(),
+        configEnumerateInReverseOrder(),
+        configSystemCallLatencyMilliseconds(),
+        configSystemCallRendezvousCount(),
+        systemCallRendezvousMutex(),
+        systemCallRendezvousCondition(),
+        numSystemCallsInProgress(0),
+        maxConcurrentSystemCalls(0),
+        creatingThreadId(std::this_thread::get_id()),
+        numDirectoriesOpenedForEnumeration(0),
+        numSingleFileDirectoryInformationQueries(0),
+        numDirectoryEnumerationCalls(0),
+        numDirectoryEnumerationCallsFromOtherThreads(0),
+        mockStateMutex(),
         filesystemContents(),
         openFilesystemHandles(),
         inProgressDirectoryEnumerations(),
         nextHandleValue(1000)
   {}
 
+  void MockFilesystemOperations::SimulateSystemCallLatencyInternal(void)
+  {
+    // Held-back system calls are released after this much time even if the rendezvous is not
+    // complete, so that a test case expecting concurrent system calls fails rather than hangs.
+    constexpr std::chrono::seconds kSystemCallRendezvousTimeout(10);
+
+    const unsigned int numConcurrentSystemCalls = numSystemCallsInProgress.fetch_add(1) + 1;
+    unsigned int previousMaxConcurrentSystemCalls = maxConcurrentSystemCalls;
+    while ((numConcurrentSystemCalls > previousMaxConcurrentSystemCalls) &&
+           (false ==
+            maxConcurrentSystemCalls.compare_exchange_weak(
+                previousMaxConcurrentSystemCalls, numConcurrentSystemCalls)));
+
+    do
+    {
+      std::unique_lock lock(systemCallRendezvousMutex);
+      if (0 == configSystemCallRendezvousCount) break;
+
+      configSystemCallRendezvousCount -= 1;
+      if (0 == configSystemCallRendezvousCount)
+        systemCallRendezvousCondition.notify_all();
+      else if (
+          false ==
+          systemCallRendezvousCondition.wait_for(
+              lock,
+              kSystemCallRendezvousTimeout,
+              [this]() -> bool
+              {
+                return (0 == configSystemCallRendezvousCount);
+              }))
+      {
+        // The rendezvous is abandoned so that no other system calls are held back by it.
+        configSystemCallRendezvousCount = 0;
+        systemCallRendezvousCondition.notify_all();
+      }
+    } while (false);
+
+    if (0 != configSystemCallLatencyMilliseconds) Sleep(configSystemCallLatencyMilliseconds);
+
+    numSystemCallsInProgress -= 1;
+  }
+
+  void MockFilesystemOperations::SetConfigSystemCallRendezvous(
+      unsigned int newConfigSystemCallRendezvousCount)
+  {
+    std::scoped_lock lock(systemCallRendezvousMutex);
+    configSystemCallRendezvousCount = newConfigSystemCallRendezvousCount;
+  }
+
   std::optional<std::wstring_view> MockFilesystemOperations::GetFilePatternForDirectoryEnumeration(
       HANDLE handle) const
   {
-    const auto directoryEnumerationIter = inProgressDirectoryEnumerations.find(handle);
+    const auto directoryEnumerationIter =
+        inProgressDirectoryEnumerations.find(DirectoryEnumerationStateKeyInternal(handle));
     if (inProgressDirectoryEnumerations.cend() == directoryEnumerationIter) return std::nullopt;
     return directoryEnumerationIter->second.filePattern;
   }
@@ -67,8 +182,18 @@ namespace PathwinderTest
     return directoryHandleIter->second.absolutePath;
   }
 
+  std::optional<HANDLE> MockFilesystemOperations::GetDuplicationSourceFromHandle(
+      HANDLE handle) const
+  {
+    const auto directoryHandleIter = openFilesystemHandles.find(handle);
+    if (openFilesystemHandles.cend() == directoryHandleIter) return std::nullopt;
+    return directoryHandleIter->second.duplicatedFromHandle;
+  }
+
   HANDLE MockFilesystemOperations::Open(std::wstring_view absolutePath, EOpenHandleMode ioMode)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     HANDLE openResult = OpenFilesystemEntityInternal(absolutePath, ioMode);
 
     if ((nullptr == openResult) && (false == configAllowOpenNonExistentFile))
@@ -87,6 +212,8 @@ namespace PathwinderTest
       unsigned int sizeInBytes,
       bool recursivelyCreateDirectories)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     std::wstring_view currentPathView = absolutePath;
 
     size_t lastBackslashIndex = currentPathView.find_last_of(L'\\');
@@ -154,7 +281,11 @@ namespace PathwinderTest
         openFilesystemHandles
             .emplace(
                 handleValue,
-                SOpenHandleData{.absolutePath = std::wstring(absolutePath), .ioMode = ioMode})
+                SOpenHandleData{
+                    .absolutePath = std::wstring(absolutePath),
+                    .ioMode = ioMode,
+                    .duplicatedFromHandle = nullptr,
+                    .fileObjectHandle = handleValue})
             .second;
 
     if (false == insertWasSuccessful)
@@ -165,6 +296,13 @@ namespace PathwinderTest
     return handleValue;
   }
 
+  HANDLE MockFilesystemOperations::DirectoryEnumerationStateKeyInternal(HANDLE handle) const
+  {
+    const auto directoryHandleIter = openFilesystemHandles.find(handle);
+    if (openFilesystemHandles.cend() == directoryHandleIter) return handle;
+    return directoryHandleIter->second.fileObjectHandle;
+  }
+
   bool MockFilesystemOperations::RemoveFilesystemEntityInternal(std::wstring_view absolutePath)
   {
     const size_t lastBackslashIndex = absolutePath.find_last_of(L'\\');
@@ -183,6 +321,8 @@ namespace PathwinderTest
 
   NTSTATUS MockFilesystemOperations::CloseHandle(HANDLE handle)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     const auto directoryHandleIter = openFilesystemHandles.find(handle);
     if (openFilesystemHandles.cend() == directoryHandleIter)
     {
@@ -208,13 +348,36 @@ namespace PathwinderTest
 
   NTSTATUS MockFilesystemOperations::Delete(std::wstring_view absolutePath)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     const std::wstring_view absolutePathTrimmed =
         Infra::Strings::RemoveTrailing(absolutePath, L'\\');
     return RemoveFilesystemEntityInternal(absolutePathTrimmed);
   }
 
+  Infra::ValueOrError<HANDLE, NTSTATUS>
+      MockFilesystemOperations::DuplicateDirectoryHandleForEnumeration(HANDLE directoryHandle)
+  {
+    std::scoped_lock lock(mockStateMutex);
+
+    const auto directoryHandleIter = openFilesystemHandles.find(directoryHandle);
+    if (openFilesystemHandles.cend() == directoryHandleIter) return NtStatus::kInvalidHandle;
+    if (EOpenHandleMode::SynchronousIoNonAlert != directoryHandleIter->second.ioMode)
+      return NtStatus::kInvalidParameter;
+
+    SOpenHandleData duplicatedHandleData = directoryHandleIter->second;
+    duplicatedHandleData.duplicatedFromHandle = directoryHandle;
+
+    const HANDLE handleValue = reinterpret_cast<HANDLE>(nextHandleValue++);
+    openFilesystemHandles.emplace(handleValue, std::move(duplicatedHandleData));
+
+    return handleValue;
+  }
+
   bool MockFilesystemOperations::Exists(std::wstring_view absolutePath)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     size_t lastBackslashIndex = absolutePath.find_last_of(L'\\');
     if (std::wstring_view::npos == lastBackslashIndex) return false;
 
@@ -229,12 +392,19 @@ namespace PathwinderTest
 
   bool MockFilesystemOperations::IsDirectory(std::wstring_view absolutePath)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     return filesystemContents.contains(absolutePath);
   }
 
   Infra::ValueOrError<HANDLE, NTSTATUS> MockFilesystemOperations::OpenDirectoryForEnumeration(
       std::wstring_view absoluteDirectoryPath)
   {
+    numDirectoriesOpenedForEnumeration += 1;
+
+    SimulateSystemCallLatencyInternal();
+    std::scoped_lock lock(mockStateMutex);
+
     HANDLE openResult =
         OpenFilesystemEntityInternal(absoluteDirectoryPath, EOpenHandleMode::SynchronousIoNonAlert);
     if (nullptr == openResult) return NtStatus::kObjectNameNotFound;
@@ -249,6 +419,13 @@ namespace PathwinderTest
       ULONG queryFlags,
       std::wstring_view filePattern)
   {
+    numDirectoryEnumerationCalls += 1;
+    if (std::this_thread::get_id() != creatingThreadId)
+      numDirectoryEnumerationCallsFromOtherThreads += 1;
+
+    SimulateSystemCallLatencyInternal();
+    std::scoped_lock lock(mockStateMutex);
+
     const auto maybeFileInformationStructLayout =
         FileInformationStructLayout::LayoutForFileInformationClass(fileInformationClass);
     if (false == maybeFileInformationStructLayout.has_value())
@@ -258,7 +435,13 @@ namespace PathwinderTest
           static_cast<size_t>(fileInformationClass));
     const auto& fileInformationStructLayout = *maybeFileInformationStructLayout;
 
-    auto directoryEnumerationStateIter = inProgressDirectoryEnumerations.find(directoryHandle);
+    // Duplicated handles share the enumeration state of the handle from which they were
+    // duplicated, so enumerating using either one advances the same cursor.
+    const HANDLE directoryEnumerationStateKey =
+        DirectoryEnumerationStateKeyInternal(directoryHandle);
+
+    auto directoryEnumerationStateIter =
+        inProgressDirectoryEnumerations.find(directoryEnumerationStateKey);
     if (inProgressDirectoryEnumerations.cend() == directoryEnumerationStateIter)
     {
       const auto directoryHandleIter = openFilesystemHandles.find(directoryHandle);
@@ -279,12 +462,15 @@ namespace PathwinderTest
       const auto& directoryContents = directoryContentsIter->second;
 
       auto createDirectoryEnumerationStateResult = inProgressDirectoryEnumerations.emplace(
-          directoryHandle,
+          directoryEnumerationStateKey,
           SDirectoryEnumerationState{
               .filePattern = MakeFilePatternString(filePattern),
-              .nextItemIterator = directoryContents.cbegin(),
+              .nextItemIterator =
+                  ((true == configEnumerateInReverseOrder) ? directoryContents.cend()
+                                                           : directoryContents.cbegin()),
               .beginIterator = directoryContents.cbegin(),
-              .endIterator = directoryContents.cend()});
+              .endIterator = directoryContents.cend(),
+              .reverseOrder = configEnumerateInReverseOrder});
       if (false == createDirectoryEnumerationStateResult.second)
         TEST_FAILED_BECAUSE(
             "%s: Internal implementation error due to failure to create a new directory enumeration state object.",
@@ -296,8 +482,7 @@ namespace PathwinderTest
     if (queryFlags & SL_RESTART_SCAN)
     {
       directoryEnumerationStateIter->second.filePattern = MakeFilePatternString(filePattern);
-      directoryEnumerationStateIter->second.nextItemIterator =
-          directoryEnumerationStateIter->second.beginIterator;
+      DirectoryEnumerationReset(directoryEnumerationStateIter->second);
     }
 
     const unsigned int maxElementsToWrite =
@@ -306,17 +491,17 @@ namespace PathwinderTest
     unsigned int bufferBytePosition = 0;
     void* lastElementWritten = nullptr;
 
-    // Taking references to these iterators ensures they can be updated automatically each
+    // Taking a reference to the enumeration state ensures it can be updated automatically each
     // iteration of the loop that does the enumeration itself.
-    auto& nextItemIterator = directoryEnumerationStateIter->second.nextItemIterator;
-    const auto& endIterator = directoryEnumerationStateIter->second.endIterator;
+    auto& enumerationState = directoryEnumerationStateIter->second;
 
-    std::wstring_view enumerationFilePattern = directoryEnumerationStateIter->second.filePattern;
+    std::wstring_view enumerationFilePattern = enumerationState.filePattern;
 
-    for (; (nextItemIterator != endIterator) && (numElementsWritten < maxElementsToWrite);
-         ++nextItemIterator)
+    for (; (false == IsDirectoryEnumerationComplete(enumerationState)) &&
+         (numElementsWritten < maxElementsToWrite);
+         DirectoryEnumerationAdvance(enumerationState))
     {
-      std::wstring_view currentFileName = nextItemIterator->first;
+      std::wstring_view currentFileName = DirectoryEnumerationNextFileName(enumerationState);
       if (false == Strings::FileNameMatchesPattern(currentFileName, enumerationFilePattern))
         continue;
 
@@ -360,6 +545,8 @@ namespace PathwinderTest
   Infra::ValueOrError<Infra::TemporaryString, NTSTATUS>
       MockFilesystemOperations::QueryAbsolutePathByHandle(HANDLE fileHandle)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     auto maybeAbsolutePath = GetPathFromHandle(fileHandle);
 
     if (false == maybeAbsolutePath.has_value())
@@ -374,6 +561,8 @@ namespace PathwinderTest
   Infra::ValueOrError<ULONG, NTSTATUS> MockFilesystemOperations::QueryFileHandleMode(
       HANDLE fileHandle)
   {
+    std::scoped_lock lock(mockStateMutex);
+
     const auto directoryHandleIter = openFilesystemHandles.find(fileHandle);
     if (openFilesystemHandles.cend() == directoryHandleIter) return NtStatus::kObjectNameNotFound;
 
@@ -400,6 +589,11 @@ namespace PathwinderTest
       void* enumerationBuffer,
       unsigned int enumerationBufferCapacityBytes)
   {
+    numSingleFileDirectoryInformationQueries += 1;
+
+    SimulateSystemCallLatencyInternal();
+    std::scoped_lock lock(mockStateMutex);
+
     const auto maybeFileInformationStructLayout =
         FileInformationStructLayout::LayoutForFileInformationClass(fileInformationClass);
     if (false == maybeFileInformationStructLayout.has_value())
@@ -453,6 +647,13 @@ namespace Pathwinder
       MOCK_FREE_FUNCTION_BODY(MockFilesystemOperations, Delete, absolutePath);
     }
 
+    Infra::ValueOrError<HANDLE, NTSTATUS> DuplicateDirectoryHandleForEnumeration(
+        HANDLE directoryHandle)
+    {
+      MOCK_FREE_FUNCTION_BODY(
+          MockFilesystemOperations, DuplicateDirectoryHandleForEnumeration, directoryHandle);
+    }
+
     bool Exists(std::wstring_view absolutePath)
     {
       MOCK_FREE_FUNCTION_BODY(MockFilesystemOperations, Exists, absolutePath);
@@ -12,11 +12,13 @@
 
 #include "ThreadPool.h"
 
+#include <memory>
 #include <utility>
 
 #include <Infra/Core/Mutex.h>
 
 #include "ApiWindows.h"
+#include "WorkStealingThreadPool.h"
 
 namespace Pathwinder
 {
@@ -24,30 +26,42 @@ namespace Pathwinder
       : workItemMutex(),
         threadPool(threadPool),
         threadPoolCleanupGroup(threadPoolCleanupGroup),
-        threadPoolEnvironment()
+        threadPoolEnvironment(),
+        workStealingThreadPool()
   {
     InitializeThreadpoolEnvironment(&threadPoolEnvironment);
     SetThreadpoolCallbackPool(&threadPoolEnvironment, threadPool);
     SetThreadpoolCallbackCleanupGroup(&threadPoolEnvironment, threadPoolCleanupGroup, nullptr);
   }
 
+  ThreadPool::ThreadPool(std::unique_ptr<TWorkStealingThreadPool>&& workStealingThreadPool)
+      : workItemMutex(),
+        threadPool(nullptr),
+        threadPoolCleanupGroup(nullptr),
+        threadPoolEnvironment(),
+        workStealingThreadPool(std::move(workStealingThreadPool))
+  {}
+
   ThreadPool::ThreadPool(ThreadPool&& other) noexcept
       : workItemMutex(),
         threadPool(nullptr),
         threadPoolCleanupGroup(nullptr),
-        threadPoolEnvironment()
+        threadPoolEnvironment(),
+        workStealingThreadPool()
   {
     std::unique_lock lock(other.workItemMutex);
 
     std::swap(threadPool, other.threadPool);
     std::swap(threadPoolCleanupGroup, other.threadPoolCleanupGroup);
     std::swap(threadPoolEnvironment, other.threadPoolEnvironment);
+    std::swap(workStealingThreadPool, other.workStealingThreadPool);
   }
 
   ThreadPool::~ThreadPool(void)
   {
     std::unique_lock lock(workItemMutex);
 
+    workStealingThreadPool.reset();
     DestroyThreadpoolEnvironment(&threadPoolEnvironment);
 
     if (nullptr != threadPoolCleanupGroup)
@@ -62,8 +76,11 @@ namespace Pathwinder
     }
   }
 
-  std::optional<ThreadPool> ThreadPool::Create(void)
+  std::optional<ThreadPool> ThreadPool::Create(unsigned int numWorkerThreads)
   {
+    if (numWorkerThreads > 0)
+      return ThreadPool(std::make_unique<TWorkStealingThreadPool>(numWorkerThreads));
+
     PTP_POOL newThreadPool = CreateThreadpool(nullptr);
 
     if (nullptr != newThreadPool)
@@ -84,6 +101,9 @@ namespace Pathwinder
     std::shared_lock lock(workItemMutex, std::try_to_lock);
     if (false == lock.owns_lock()) return false;
 
+    if (nullptr != workStealingThreadPool)
+      return workStealingThreadPool->SubmitWork(functionToInvoke, contextParam);
+
     return (
         TRUE ==
         TrySubmitThreadpoolCallback(functionToInvoke, contextParam, &threadPoolEnvironment));
@@ -94,6 +114,12 @@ namespace Pathwinder
     std::shared_lock lock(workItemMutex, std::try_to_lock);
     if (false == lock.owns_lock()) return;
 
+    if (nullptr != workStealingThreadPool)
+    {
+      workStealingThreadPool->WaitForOutstandingWork();
+      return;
+    }
+
     CloseThreadpoolCleanupGroupMembers(threadPoolCleanupGroup, FALSE, nullptr);
   }
 } // namespace Pathwinder